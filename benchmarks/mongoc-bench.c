@@ -0,0 +1,1294 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * mongoc-bench -- microbenchmarks for the driver's hot paths.
+ *
+ * usage: mongoc-bench [--json FILE] [--iterations N] [BENCHMARK ...]
+ *
+ * Network benchmarks talk to the in-process mock server from the test
+ * suite, so the numbers include the mock server's own overhead. They are
+ * meant for comparing one build of the driver against another on the same
+ * machine, not as absolute figures for a real deployment.
+ *
+ * Each benchmark reports operations per second, items (documents or
+ * bytes) per second, and per-operation latency percentiles. Pass --json
+ * to also write the results as a JSON document.
+ */
+
+
+#include <mongoc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mongoc-array-private.h"
+#include "mongoc-rpc-private.h"
+#include "mongoc-thread-private.h"
+
+#include "mock_server/mock-server.h"
+#include "mongoc-tests.h"
+
+
+#define BENCH_SMALL_DOCS_PER_BATCH 1000
+#define BENCH_FIND_BATCH_SIZE      1000
+#define BENCH_GETMORE_BATCH_SIZE   100
+#define BENCH_GETMORES_PER_CURSOR  10
+#define BENCH_POOL_THREADS         8
+#define BENCH_POOL_SIZE            4
+#define BENCH_RPC_DOCS             100
+#define BENCH_MATCHER_DOCS         1000
+#define BENCH_MATCHER_SET_QUERIES  1000
+
+
+typedef struct
+{
+   const char *name;
+   const char *item_name;
+   int64_t     n_samples;
+   int64_t    *samples;     /* per-operation latency in microseconds */
+   int32_t     n_recorded;
+   int64_t     n_items;
+   int64_t     started;
+   int64_t     elapsed;
+} bench_t;
+
+
+typedef struct
+{
+   const char *name;
+   int64_t     default_iterations;
+   void      (*func) (bench_t *bench, int64_t iterations);
+} bench_desc_t;
+
+
+/*
+ * mock-server.c reads its verbosity from the environment through the test
+ * framework; the benchmark has no test framework, so provide the hook.
+ */
+bool
+test_framework_getenv_bool (const char *name)
+{
+   char *value;
+   bool ret;
+
+#ifdef _MSC_VER
+   size_t len;
+
+   if (_dupenv_s (&value, &len, name) != 0) {
+      return false;
+   }
+#else
+   value = getenv (name);
+   value = value ? bson_strdup (value) : NULL;
+#endif
+
+   ret = value && strcmp (value, "") != 0 && strcmp (value, "0") != 0;
+   bson_free (value);
+
+   return ret;
+}
+
+
+static void
+bench_init (bench_t    *bench,
+            const char *name,
+            const char *item_name,
+            int64_t     n_samples)
+{
+   memset (bench, 0, sizeof *bench);
+   bench->name = name;
+   bench->item_name = item_name;
+   bench->n_samples = n_samples;
+   bench->samples = (int64_t *)bson_malloc0 (
+      (size_t)BSON_MAX (n_samples, 1) * sizeof (int64_t));
+}
+
+
+static void
+bench_begin (bench_t *bench)
+{
+   bench->started = bson_get_monotonic_time ();
+}
+
+
+static void
+bench_finish (bench_t *bench)
+{
+   bench->elapsed = bson_get_monotonic_time () - bench->started;
+}
+
+
+/* thread-safe: pool benchmark threads record concurrently */
+static void
+bench_record (bench_t *bench,
+              int64_t  started,
+              int64_t  n_items)
+{
+   int64_t now = bson_get_monotonic_time ();
+   int32_t i;
+
+   i = bson_atomic_int_add (&bench->n_recorded, 1) - 1;
+   if (i < bench->n_samples) {
+      bench->samples[i] = now - started;
+   }
+
+   bson_atomic_int64_add (&bench->n_items, n_items);
+}
+
+
+static int
+cmp_int64 (const void *a,
+           const void *b)
+{
+   int64_t x = *(const int64_t *)a;
+   int64_t y = *(const int64_t *)b;
+
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+static int64_t
+percentile (const int64_t *sorted,
+            int64_t        n,
+            double         p)
+{
+   int64_t i;
+
+   if (!n) {
+      return 0;
+   }
+
+   i = (int64_t)(p * (double)(n - 1) + 0.5);
+
+   return sorted[BSON_MIN (i, n - 1)];
+}
+
+
+/*
+ * Sort the samples, print a line to stdout and append the result to
+ * "results" as a subdocument.
+ */
+static void
+bench_report (bench_t *bench,
+              bson_t  *results)
+{
+   bson_t doc;
+   char key[16];
+   const char *keyptr;
+   int64_t n;
+   int64_t i;
+   int64_t sum = 0;
+   double secs;
+   double ops_per_sec;
+   double items_per_sec;
+
+   n = BSON_MIN ((int64_t)bench->n_recorded, bench->n_samples);
+   qsort (bench->samples, (size_t)n, sizeof (int64_t), cmp_int64);
+
+   for (i = 0; i < n; i++) {
+      sum += bench->samples[i];
+   }
+
+   secs = (double)BSON_MAX (bench->elapsed, 1) / 1e6;
+   ops_per_sec = (double)n / secs;
+   items_per_sec = (double)bench->n_items / secs;
+
+   printf ("%-20s %10" PRId64 " ops %12.0f ops/s %14.0f %s/s"
+           "   p50 %6" PRId64 "us  p99 %6" PRId64 "us\n",
+           bench->name, n, ops_per_sec, items_per_sec, bench->item_name,
+           percentile (bench->samples, n, 0.50),
+           percentile (bench->samples, n, 0.99));
+
+   if (!results) {
+      return;
+   }
+
+   bson_uint32_to_string (bson_count_keys (results), &keyptr, key,
+                          sizeof key);
+   bson_append_document_begin (results, keyptr, -1, &doc);
+   BSON_APPEND_UTF8 (&doc, "name", bench->name);
+   BSON_APPEND_INT64 (&doc, "operations", n);
+   BSON_APPEND_INT64 (&doc, "items", bench->n_items);
+   BSON_APPEND_UTF8 (&doc, "item_name", bench->item_name);
+   BSON_APPEND_INT64 (&doc, "elapsed_usec", bench->elapsed);
+   BSON_APPEND_DOUBLE (&doc, "ops_per_sec", ops_per_sec);
+   BSON_APPEND_DOUBLE (&doc, "items_per_sec", items_per_sec);
+   BSON_APPEND_INT64 (&doc, "latency_min_usec", n ? bench->samples[0] : 0);
+   BSON_APPEND_DOUBLE (&doc, "latency_mean_usec",
+                       n ? (double)sum / (double)n : 0.0);
+   BSON_APPEND_INT64 (&doc, "latency_p50_usec",
+                      percentile (bench->samples, n, 0.50));
+   BSON_APPEND_INT64 (&doc, "latency_p90_usec",
+                      percentile (bench->samples, n, 0.90));
+   BSON_APPEND_INT64 (&doc, "latency_p99_usec",
+                      percentile (bench->samples, n, 0.99));
+   BSON_APPEND_INT64 (&doc, "latency_max_usec",
+                      n ? bench->samples[n - 1] : 0);
+   bson_append_document_end (results, &doc);
+}
+
+
+static void
+bench_destroy (bench_t *bench)
+{
+   bson_free (bench->samples);
+}
+
+
+static void
+make_small_doc (bson_t  *doc,
+                int64_t  i)
+{
+   bson_init (doc);
+   BSON_APPEND_INT64 (doc, "_id", i);
+   BSON_APPEND_UTF8 (doc, "name", "benchmark");
+   BSON_APPEND_INT32 (doc, "a", (int32_t)(i % 10));
+   BSON_APPEND_DOUBLE (doc, "x", (double)i * 1.5);
+}
+
+
+static bson_t *
+make_small_docs (int n)
+{
+   bson_t *docs;
+   int i;
+
+   docs = (bson_t *)bson_malloc ((size_t)n * sizeof (bson_t));
+   for (i = 0; i < n; i++) {
+      make_small_doc (&docs[i], i);
+   }
+
+   return docs;
+}
+
+
+static void
+destroy_docs (bson_t *docs,
+              int     n)
+{
+   int i;
+
+   for (i = 0; i < n; i++) {
+      bson_destroy (&docs[i]);
+   }
+
+   bson_free (docs);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * Mock server autoresponders.
+ *
+ *       Replies are built once up front so the benchmarks spend as little
+ *       time as possible in the mock server rather than the driver.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+typedef struct
+{
+   bson_t         *batch;
+   int             batch_len;
+   int64_t         first_cursor_id;
+   mongoc_mutex_t  mutex;
+   int             getmores_left;
+} responder_t;
+
+
+static bool
+auto_write_command (request_t *request,
+                    void      *data)
+{
+   const bson_t *cmd;
+   bson_iter_t iter;
+   bson_t reply = BSON_INITIALIZER;
+   int32_t n = 0;
+
+   if (!request->is_command ||
+       (strcmp (request->command_name, "insert") != 0 &&
+        strcmp (request->command_name, "update") != 0 &&
+        strcmp (request->command_name, "delete") != 0)) {
+      return false;
+   }
+
+   cmd = request_get_doc (request, 0);
+   if (bson_iter_init_find (&iter, cmd, "documents") &&
+       BSON_ITER_HOLDS_ARRAY (&iter)) {
+      bson_t arr;
+      const uint8_t *buf;
+      uint32_t len;
+
+      bson_iter_array (&iter, &len, &buf);
+      if (bson_init_static (&arr, buf, len)) {
+         n = (int32_t)bson_count_keys (&arr);
+      }
+   }
+
+   BSON_APPEND_INT32 (&reply, "ok", 1);
+   BSON_APPEND_INT32 (&reply, "n", n);
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, &reply, 1, 0);
+   bson_destroy (&reply);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static bool
+auto_ping (request_t *request,
+           void      *data)
+{
+   bson_t reply = BSON_INITIALIZER;
+
+   if (!request->is_command || strcmp (request->command_name, "ping") != 0) {
+      return false;
+   }
+
+   BSON_APPEND_INT32 (&reply, "ok", 1);
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, &reply, 1, 0);
+   bson_destroy (&reply);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static bool
+auto_query (request_t *request,
+            void      *data)
+{
+   responder_t *responder = (responder_t *)data;
+
+   if (request->is_command || request->opcode != MONGOC_OPCODE_QUERY) {
+      return false;
+   }
+
+   if (responder->first_cursor_id) {
+      mongoc_mutex_lock (&responder->mutex);
+      responder->getmores_left = BENCH_GETMORES_PER_CURSOR;
+      mongoc_mutex_unlock (&responder->mutex);
+   }
+
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, responder->batch,
+                            responder->batch_len,
+                            responder->first_cursor_id);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static bool
+auto_getmore (request_t *request,
+              void      *data)
+{
+   responder_t *responder = (responder_t *)data;
+   int64_t cursor_id;
+
+   if (request->opcode != MONGOC_OPCODE_GET_MORE) {
+      return false;
+   }
+
+   mongoc_mutex_lock (&responder->mutex);
+   cursor_id = --responder->getmores_left > 0 ?
+               responder->first_cursor_id : 0;
+   mongoc_mutex_unlock (&responder->mutex);
+
+   mock_server_reply_multi (request, MONGOC_REPLY_NONE, responder->batch,
+                            responder->batch_len, cursor_id);
+   request_destroy (request);
+
+   return true;
+}
+
+
+static mock_server_t *
+bench_server_new (responder_t *responder)
+{
+   mock_server_t *server;
+
+   /* wire version 3: write commands, OP_QUERY finds and OP_GET_MORE */
+   server = mock_server_with_autoismaster (3);
+   mock_server_autoresponds (server, auto_write_command, NULL, NULL);
+   mock_server_autoresponds (server, auto_ping, NULL, NULL);
+   if (responder) {
+      mock_server_autoresponds (server, auto_query, responder, NULL);
+      mock_server_autoresponds (server, auto_getmore, responder, NULL);
+   }
+   mock_server_run (server);
+
+   return server;
+}
+
+
+static void
+responder_init (responder_t *responder,
+                int          batch_len,
+                int64_t      first_cursor_id)
+{
+   memset (responder, 0, sizeof *responder);
+   responder->batch = make_small_docs (batch_len);
+   responder->batch_len = batch_len;
+   responder->first_cursor_id = first_cursor_id;
+   mongoc_mutex_init (&responder->mutex);
+}
+
+
+static void
+responder_destroy (responder_t *responder)
+{
+   destroy_docs (responder->batch, responder->batch_len);
+   mongoc_mutex_destroy (&responder->mutex);
+}
+
+
+static void
+check_error (bool                ok,
+             const char         *what,
+             const bson_error_t *error)
+{
+   if (!ok) {
+      fprintf (stderr, "%s failed: %s\n", what, error->message);
+      abort ();
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * Benchmarks.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+bench_insert_one (bench_t *bench,
+                  int64_t  iterations)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   bson_error_t error;
+   bson_t doc;
+   int64_t started;
+   int64_t i;
+   bool r;
+
+   server = bench_server_new (NULL);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   make_small_doc (&doc, 0);
+
+   bench_init (bench, "insert_one", "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      r = mongoc_collection_insert (collection, MONGOC_INSERT_NONE, &doc,
+                                    NULL, &error);
+      check_error (r, "insert", &error);
+      bench_record (bench, started, 1);
+   }
+
+   bench_finish (bench);
+
+   bson_destroy (&doc);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+bench_bulk_insert (bench_t *bench,
+                   int64_t  iterations)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   bson_error_t error;
+   bson_t *docs;
+   int64_t started;
+   int64_t i;
+   int j;
+   bool r;
+
+   server = bench_server_new (NULL);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   docs = make_small_docs (BENCH_SMALL_DOCS_PER_BATCH);
+
+   bench_init (bench, "bulk_insert", "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      bulk = mongoc_collection_create_bulk_operation (collection, true, NULL);
+      for (j = 0; j < BENCH_SMALL_DOCS_PER_BATCH; j++) {
+         mongoc_bulk_operation_insert (bulk, &docs[j]);
+      }
+      r = mongoc_bulk_operation_execute (bulk, NULL, &error);
+      check_error (r, "bulk insert", &error);
+      mongoc_bulk_operation_destroy (bulk);
+      bench_record (bench, started, BENCH_SMALL_DOCS_PER_BATCH);
+   }
+
+   bench_finish (bench);
+
+   destroy_docs (docs, BENCH_SMALL_DOCS_PER_BATCH);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* drain a cursor, returning the number of documents read */
+static int64_t
+drain (mongoc_cursor_t *cursor)
+{
+   const bson_t *doc;
+   bson_error_t error;
+   int64_t n = 0;
+
+   while (mongoc_cursor_next (cursor, &doc)) {
+      n++;
+   }
+
+   if (mongoc_cursor_error (cursor, &error)) {
+      check_error (false, "cursor", &error);
+   }
+
+   return n;
+}
+
+
+static void
+bench_find_cursor (bench_t    *bench,
+                   const char *name,
+                   int64_t     iterations,
+                   int         batch_len,
+                   int64_t     cursor_id)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   responder_t responder;
+   bson_t query = BSON_INITIALIZER;
+   int64_t started;
+   int64_t i;
+
+   responder_init (&responder, batch_len, cursor_id);
+   server = bench_server_new (&responder);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+
+   bench_init (bench, name, "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0,
+                                       0, &query, NULL, NULL);
+      bench_record (bench, started, drain (cursor));
+      mongoc_cursor_destroy (cursor);
+   }
+
+   bench_finish (bench);
+
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+   responder_destroy (&responder);
+}
+
+
+static void
+bench_find (bench_t *bench,
+            int64_t  iterations)
+{
+   /* one large batch and no cursor: measures reply parsing */
+   bench_find_cursor (bench, "find", iterations, BENCH_FIND_BATCH_SIZE, 0);
+}
+
+
+static void
+bench_getmore (bench_t *bench,
+               int64_t  iterations)
+{
+   /* every cursor iterates BENCH_GETMORES_PER_CURSOR getMores */
+   bench_find_cursor (bench, "getmore", iterations,
+                      BENCH_GETMORE_BATCH_SIZE, 1234);
+}
+
+
+static void
+bench_command (bench_t *bench,
+               int64_t  iterations)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+   bson_t cmd = BSON_INITIALIZER;
+   bson_t reply;
+   int64_t started;
+   int64_t i;
+   bool r;
+
+   server = bench_server_new (NULL);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   BSON_APPEND_INT32 (&cmd, "ping", 1);
+
+   bench_init (bench, "command", "commands", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      r = mongoc_client_command_simple (client, "admin", &cmd, NULL, &reply,
+                                        &error);
+      check_error (r, "ping", &error);
+      bson_destroy (&reply);
+      bench_record (bench, started, 1);
+   }
+
+   bench_finish (bench);
+
+   bson_destroy (&cmd);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+typedef struct
+{
+   bench_t              *bench;
+   mongoc_client_pool_t *pool;
+   int64_t               iterations;
+} pool_thread_t;
+
+
+static void *
+pool_worker (void *data)
+{
+   pool_thread_t *ctx = (pool_thread_t *)data;
+   mongoc_client_t *client;
+   int64_t started;
+   int64_t i;
+
+   for (i = 0; i < ctx->iterations; i++) {
+      started = bson_get_monotonic_time ();
+      client = mongoc_client_pool_pop (ctx->pool);
+      mongoc_client_pool_push (ctx->pool, client);
+      bench_record (ctx->bench, started, 1);
+   }
+
+   return NULL;
+}
+
+
+static void
+bench_pool (bench_t *bench,
+            int64_t  iterations)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_thread_t threads[BENCH_POOL_THREADS];
+   pool_thread_t ctx;
+   int i;
+
+   server = bench_server_new (NULL);
+   pool = mongoc_client_pool_new (mock_server_get_uri (server));
+   mongoc_client_pool_max_size (pool, BENCH_POOL_SIZE);
+
+   ctx.pool = pool;
+   ctx.iterations = BSON_MAX (iterations / BENCH_POOL_THREADS, 1);
+   ctx.bench = bench;
+
+   bench_init (bench, "pool_checkout", "checkouts",
+               ctx.iterations * BENCH_POOL_THREADS);
+   bench_begin (bench);
+
+   for (i = 0; i < BENCH_POOL_THREADS; i++) {
+      mongoc_thread_create (&threads[i], pool_worker, &ctx);
+   }
+
+   for (i = 0; i < BENCH_POOL_THREADS; i++) {
+      mongoc_thread_join (threads[i]);
+   }
+
+   bench_finish (bench);
+
+   mongoc_client_pool_destroy (pool);
+   mock_server_destroy (server);
+}
+
+
+static void
+bench_rpc (bench_t *bench,
+           int64_t  iterations)
+{
+   mongoc_rpc_t rpc;
+   mongoc_rpc_t scattered;
+   mongoc_array_t iovs;
+   mongoc_iovec_t *iov;
+   mongoc_iovec_t doc_iovs[BENCH_RPC_DOCS];
+   bson_t *docs;
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bool eof;
+   uint8_t *buf = NULL;
+   size_t buflen = 0;
+   size_t off;
+   int64_t started;
+   int64_t i;
+   size_t j;
+
+   docs = make_small_docs (BENCH_RPC_DOCS);
+   for (j = 0; j < BENCH_RPC_DOCS; j++) {
+      doc_iovs[j].iov_base = (void *)bson_get_data (&docs[j]);
+      doc_iovs[j].iov_len = docs[j].len;
+   }
+
+   _mongoc_array_init (&iovs, sizeof (mongoc_iovec_t));
+
+   bench_init (bench, "rpc_gather_scatter", "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+
+      memset (&rpc, 0, sizeof rpc);
+      rpc.insert.msg_len = 0;
+      rpc.insert.request_id = (int32_t)i;
+      rpc.insert.response_to = 0;
+      rpc.insert.opcode = MONGOC_OPCODE_INSERT;
+      rpc.insert.flags = MONGOC_INSERT_NONE;
+      rpc.insert.collection = "db.collection";
+      rpc.insert.documents = doc_iovs;
+      rpc.insert.n_documents = BENCH_RPC_DOCS;
+
+      iovs.len = 0;
+      _mongoc_rpc_gather (&rpc, &iovs);
+      _mongoc_rpc_swab_to_le (&rpc);
+
+      if (buflen < (size_t)BSON_UINT32_FROM_LE (rpc.header.msg_len)) {
+         buflen = (size_t)BSON_UINT32_FROM_LE (rpc.header.msg_len);
+         buf = (uint8_t *)bson_realloc (buf, buflen);
+      }
+
+      iov = (mongoc_iovec_t *)iovs.data;
+      for (j = 0, off = 0; j < iovs.len; j++) {
+         memcpy (buf + off, iov[j].iov_base, iov[j].iov_len);
+         off += iov[j].iov_len;
+      }
+
+      if (!_mongoc_rpc_scatter (&scattered, buf, off)) {
+         fprintf (stderr, "failed to scatter rpc\n");
+         abort ();
+      }
+      _mongoc_rpc_swab_from_le (&scattered);
+
+      reader = bson_reader_new_from_data (
+         (const uint8_t *)scattered.insert.documents[0].iov_base,
+         scattered.insert.documents[0].iov_len);
+      j = 0;
+      while ((doc = bson_reader_read (reader, &eof))) {
+         j++;
+      }
+      bson_reader_destroy (reader);
+
+      bench_record (bench, started, (int64_t)j);
+   }
+
+   bench_finish (bench);
+
+   bson_free (buf);
+   _mongoc_array_destroy (&iovs);
+   destroy_docs (docs, BENCH_RPC_DOCS);
+}
+
+
+/*
+ * The number of @docs whose @field is in [@lo, @hi), counted without the
+ * matcher so the matcher benchmarks can check their results.
+ */
+static int64_t
+count_docs_in_range (const bson_t *docs,
+                     int           n,
+                     const char   *field,
+                     double        lo,
+                     double        hi)
+{
+   bson_iter_t iter;
+   int64_t count = 0;
+   double v;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      if (!bson_iter_init_find (&iter, &docs[i], field)) {
+         continue;
+      }
+
+      if (BSON_ITER_HOLDS_DOUBLE (&iter)) {
+         v = bson_iter_double (&iter);
+      } else {
+         v = (double)bson_iter_as_int64 (&iter);
+      }
+
+      if (v >= lo && v < hi) {
+         count++;
+      }
+   }
+
+   return count;
+}
+
+
+BEGIN_IGNORE_DEPRECATIONS;
+
+/*
+ * Time @query against BENCH_MATCHER_DOCS small documents, one call to
+ * mongoc_matcher_match per document or, if @many, one call to
+ * mongoc_matcher_match_many per pass. Each pass must match the documents
+ * whose @field is in [@lo, @hi).
+ */
+static void
+run_matcher (bench_t    *bench,
+             int64_t     iterations,
+             const char *name,
+             bool        many,
+             bson_t     *query,
+             const char *field,
+             double      lo,
+             double      hi)
+{
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   bson_t *docs;
+   const bson_t **batch;
+   uint8_t selection[(BENCH_MATCHER_DOCS + 7) / 8];
+   int64_t started;
+   int64_t i;
+   int64_t matched = 0;
+   int64_t expected;
+   int j;
+
+   matcher = mongoc_matcher_new (query, &error);
+   check_error (matcher != NULL, name, &error);
+   docs = make_small_docs (BENCH_MATCHER_DOCS);
+   expected = count_docs_in_range (docs, BENCH_MATCHER_DOCS, field, lo, hi);
+
+   batch = (const bson_t **)bson_malloc (BENCH_MATCHER_DOCS * sizeof *batch);
+   for (j = 0; j < BENCH_MATCHER_DOCS; j++) {
+      batch[j] = &docs[j];
+   }
+
+   bench_init (bench, name, "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      if (many) {
+         matched += (int64_t)mongoc_matcher_match_many (
+            matcher, batch, BENCH_MATCHER_DOCS, selection);
+      } else {
+         for (j = 0; j < BENCH_MATCHER_DOCS; j++) {
+            matched += mongoc_matcher_match (matcher, batch[j]);
+         }
+      }
+      bench_record (bench, started, BENCH_MATCHER_DOCS);
+   }
+
+   bench_finish (bench);
+
+   if (matched != iterations * expected) {
+      fprintf (stderr, "%s: matched %" PRId64 ", expected %" PRId64 "\n",
+               name, matched, iterations * expected);
+      abort ();
+   }
+
+   bson_free (batch);
+   destroy_docs (docs, BENCH_MATCHER_DOCS);
+   mongoc_matcher_destroy (matcher);
+}
+
+
+static void
+bench_matcher (bench_t *bench,
+               int64_t  iterations)
+{
+   bson_t *query;
+
+   /* every document's name is "benchmark" */
+   query = BCON_NEW ("a", "{", "$gte", BCON_INT32 (3), "$lt", BCON_INT32 (8),
+                     "}", "name", BCON_UTF8 ("benchmark"));
+   run_matcher (bench, iterations, "matcher", false, query, "a", 3, 8);
+   bson_destroy (query);
+}
+
+
+static void
+bench_matcher_many (bench_t *bench,
+                    int64_t  iterations)
+{
+   bson_t *query;
+
+   query = BCON_NEW ("a", "{", "$gte", BCON_INT32 (3), "$lt", BCON_INT32 (8),
+                     "}", "name", BCON_UTF8 ("benchmark"));
+   run_matcher (bench, iterations, "matcher_many", true, query, "a", 3, 8);
+   bson_destroy (query);
+}
+
+
+/* a range on one numeric field, the case match_many is meant to speed up */
+static void
+bench_matcher_range (bench_t *bench,
+                     int64_t  iterations)
+{
+   bson_t *query;
+
+   query = BCON_NEW ("x", "{", "$gte", BCON_DOUBLE (300.0),
+                     "$lt", BCON_DOUBLE (1200.0), "}");
+   run_matcher (bench, iterations, "matcher_range", false, query, "x",
+                300.0, 1200.0);
+   bson_destroy (query);
+}
+
+
+static void
+bench_matcher_many_range (bench_t *bench,
+                          int64_t  iterations)
+{
+   bson_t *query;
+
+   query = BCON_NEW ("x", "{", "$gte", BCON_DOUBLE (300.0),
+                     "$lt", BCON_DOUBLE (1200.0), "}");
+   run_matcher (bench, iterations, "matcher_many_range", true, query, "x",
+                300.0, 1200.0);
+   bson_destroy (query);
+}
+
+
+/* ten predicates over every field, to time resolving many paths at once */
+static void
+bench_matcher_wide (bench_t *bench,
+                    int64_t  iterations)
+{
+   bson_t *query;
+
+   query = BCON_NEW ("$and", "[",
+                     "{", "_id", "{", "$gte", BCON_INT64 (0), "}", "}",
+                     "{", "_id", "{", "$lt", BCON_INT64 (1000), "}", "}",
+                     "{", "name", BCON_UTF8 ("benchmark"), "}",
+                     "{", "name", "{", "$ne", BCON_UTF8 ("other"), "}", "}",
+                     "{", "a", "{", "$gte", BCON_INT32 (0), "}", "}",
+                     "{", "a", "{", "$lt", BCON_INT32 (10), "}", "}",
+                     "{", "a", "{", "$ne", BCON_INT32 (11), "}", "}",
+                     "{", "x", "{", "$gte", BCON_DOUBLE (0.0), "}", "}",
+                     "{", "x", "{", "$lt", BCON_DOUBLE (1200.0), "}", "}",
+                     "{", "missing", "{", "$exists", BCON_BOOL (false), "}",
+                     "}",
+                     "]");
+   run_matcher (bench, iterations, "matcher_wide", false, query, "x",
+                0.0, 1200.0);
+   bson_destroy (query);
+}
+
+
+/* query @j of the matcher set cases: equality, range or multi-field */
+static void
+make_set_query (bson_t *query,
+                int     j)
+{
+   bson_init (query);
+   if (j % 3 == 0) {
+      BSON_APPEND_INT64 (query, "_id", j);
+   } else if (j % 3 == 1) {
+      BCON_APPEND (query, "x", "{", "$gte", BCON_DOUBLE (j),
+                   "$lt", BCON_DOUBLE (j + 15), "}");
+   } else {
+      BCON_APPEND (query, "a", BCON_INT32 (j % 10),
+                   "_id", "{", "$gt", BCON_INT64 (j), "}");
+   }
+}
+
+
+/*
+ * Match BENCH_MATCHER_DOCS documents against @n_queries queries, with one
+ * mongoc_matcher_set_t if @use_set, else by calling mongoc_matcher_match
+ * for every query, which is what the set replaces. Both must find the
+ * same number of matches.
+ */
+static void
+run_matcher_set (bench_t    *bench,
+                 int64_t     iterations,
+                 const char *name,
+                 int         n_queries,
+                 bool        use_set)
+{
+   mongoc_matcher_set_t *set;
+   mongoc_matcher_t **matchers;
+   bson_error_t error;
+   bson_t query;
+   bson_t *docs;
+   uint32_t ids[16];
+   int64_t started;
+   int64_t i;
+   int64_t matched = 0;
+   int64_t expected = 0;
+   int j;
+   int k;
+
+   set = mongoc_matcher_set_new ();
+   matchers = (mongoc_matcher_t **)bson_malloc (
+      (size_t)n_queries * sizeof *matchers);
+
+   for (j = 0; j < n_queries; j++) {
+      make_set_query (&query, j);
+      check_error (mongoc_matcher_set_add (set, (uint32_t)j, &query, &error),
+                   name, &error);
+      matchers[j] = mongoc_matcher_new (&query, &error);
+      check_error (matchers[j] != NULL, name, &error);
+      bson_destroy (&query);
+   }
+
+   docs = make_small_docs (BENCH_MATCHER_DOCS);
+
+   for (j = 0; j < BENCH_MATCHER_DOCS; j++) {
+      for (k = 0; k < n_queries; k++) {
+         expected += mongoc_matcher_match (matchers[k], &docs[j]);
+      }
+   }
+
+   bench_init (bench, name, "docs", iterations);
+   bench_begin (bench);
+
+   for (i = 0; i < iterations; i++) {
+      started = bson_get_monotonic_time ();
+      for (j = 0; j < BENCH_MATCHER_DOCS; j++) {
+         if (use_set) {
+            matched += mongoc_matcher_set_match (set, &docs[j], ids, 16);
+         } else {
+            for (k = 0; k < n_queries; k++) {
+               matched += mongoc_matcher_match (matchers[k], &docs[j]);
+            }
+         }
+      }
+      bench_record (bench, started, BENCH_MATCHER_DOCS);
+   }
+
+   bench_finish (bench);
+
+   if (!expected || matched != iterations * expected) {
+      fprintf (stderr, "%s: matched %" PRId64 ", expected %" PRId64 "\n",
+               name, matched, iterations * expected);
+      abort ();
+   }
+
+   for (j = 0; j < n_queries; j++) {
+      mongoc_matcher_destroy (matchers[j]);
+   }
+
+   bson_free (matchers);
+   destroy_docs (docs, BENCH_MATCHER_DOCS);
+   mongoc_matcher_set_destroy (set);
+}
+
+
+static void
+bench_matcher_set (bench_t *bench,
+                   int64_t  iterations)
+{
+   run_matcher_set (bench, iterations, "matcher_set",
+                    BENCH_MATCHER_SET_QUERIES, true);
+}
+
+
+static void
+bench_matcher_set_loop (bench_t *bench,
+                        int64_t  iterations)
+{
+   run_matcher_set (bench, iterations, "matcher_set_loop",
+                    BENCH_MATCHER_SET_QUERIES, false);
+}
+
+
+static void
+bench_matcher_set_large (bench_t *bench,
+                         int64_t  iterations)
+{
+   run_matcher_set (bench, iterations, "matcher_set_large",
+                    5 * BENCH_MATCHER_SET_QUERIES, true);
+}
+
+
+static void
+bench_matcher_set_large_loop (bench_t *bench,
+                              int64_t  iterations)
+{
+   run_matcher_set (bench, iterations, "matcher_set_large_loop",
+                    5 * BENCH_MATCHER_SET_QUERIES, false);
+}
+
+END_IGNORE_DEPRECATIONS;
+
+
+static const bench_desc_t gBenchmarks[] = {
+   { "insert_one", 10000, bench_insert_one },
+   { "bulk_insert", 100, bench_bulk_insert },
+   { "find", 500, bench_find },
+   { "getmore", 500, bench_getmore },
+   { "command", 10000, bench_command },
+   { "pool_checkout", 200000, bench_pool },
+   { "rpc_gather_scatter", 100000, bench_rpc },
+   { "matcher", 1000, bench_matcher },
+   { "matcher_many", 1000, bench_matcher_many },
+   { "matcher_range", 1000, bench_matcher_range },
+   { "matcher_many_range", 1000, bench_matcher_many_range },
+   { "matcher_wide", 1000, bench_matcher_wide },
+   { "matcher_set", 100, bench_matcher_set },
+   { "matcher_set_loop", 10, bench_matcher_set_loop },
+   { "matcher_set_large", 20, bench_matcher_set_large },
+   { "matcher_set_large_loop", 2, bench_matcher_set_large_loop },
+   { NULL }
+};
+
+
+static bool
+selected (const char *name,
+          int         argc,
+          char      **argv,
+          int         first)
+{
+   int i;
+
+   if (first >= argc) {
+      return true;
+   }
+
+   for (i = first; i < argc; i++) {
+      if (strcmp (argv[i], name) == 0) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+static void
+usage (FILE *stream)
+{
+   const bench_desc_t *desc;
+
+   fprintf (stream,
+            "usage: mongoc-bench [--json FILE] [--iterations N] "
+            "[BENCHMARK ...]\n\nbenchmarks:\n");
+
+   for (desc = gBenchmarks; desc->name; desc++) {
+      fprintf (stream, "  %-20s (default %" PRId64 " iterations)\n",
+               desc->name, desc->default_iterations);
+   }
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+   const bench_desc_t *desc;
+   const char *json_path = NULL;
+   int64_t iterations = 0;
+   bench_t bench;
+   bson_t doc = BSON_INITIALIZER;
+   bson_t results;
+   char *json;
+   FILE *f;
+   int first;
+   int i;
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "--json") == 0 && i + 1 < argc) {
+         json_path = argv[++i];
+      } else if (strcmp (argv[i], "--iterations") == 0 && i + 1 < argc) {
+         iterations = bson_ascii_strtoll (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "--help") == 0 ||
+                 strcmp (argv[i], "-h") == 0) {
+         usage (stdout);
+         return EXIT_SUCCESS;
+      } else if (argv[i][0] == '-') {
+         usage (stderr);
+         return EXIT_FAILURE;
+      } else {
+         break;
+      }
+   }
+
+   for (first = i; i < argc; i++) {
+      for (desc = gBenchmarks; desc->name; desc++) {
+         if (strcmp (desc->name, argv[i]) == 0) {
+            break;
+         }
+      }
+
+      if (!desc->name) {
+         fprintf (stderr, "unknown benchmark: %s\n", argv[i]);
+         usage (stderr);
+         return EXIT_FAILURE;
+      }
+   }
+
+   mongoc_init ();
+
+   BSON_APPEND_UTF8 (&doc, "driver", MONGOC_VERSION_S);
+   bson_append_array_begin (&doc, "results", -1, &results);
+
+   for (desc = gBenchmarks; desc->name; desc++) {
+      if (!selected (desc->name, argc, argv, first)) {
+         continue;
+      }
+
+      desc->func (&bench, iterations > 0 ? iterations :
+                  desc->default_iterations);
+      bench_report (&bench, &results);
+      bench_destroy (&bench);
+   }
+
+   bson_append_array_end (&doc, &results);
+
+   if (json_path) {
+      json = bson_as_json (&doc, NULL);
+      f = fopen (json_path, "w");
+      if (!f) {
+         fprintf (stderr, "cannot open %s\n", json_path);
+         return EXIT_FAILURE;
+      }
+      fprintf (f, "%s\n", json);
+      fclose (f);
+      bson_free (json);
+   }
+
+   bson_destroy (&doc);
+   mongoc_cleanup ();
+
+   return EXIT_SUCCESS;
+}
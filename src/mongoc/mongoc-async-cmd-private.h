@@ -42,13 +42,18 @@ typedef enum
    MONGOC_ASYNC_CMD_CANCELED_STATE,
 } mongoc_async_cmd_state_t;
 
-typedef struct _mongoc_async_cmd
+struct _mongoc_async_cmd
 {
    mongoc_stream_t *stream;
 
    mongoc_async_t          *async;
    mongoc_async_cmd_state_t state;
    int                      events;
+   int                      revents;
+   int                      registered_events;
+   int                      fd;
+   size_t                   timer_idx;
+   size_t                   ready_idx;
    mongoc_async_cmd_setup_t setup;
    void                    *setup_ctx;
    mongoc_async_cmd_cb_t    cb;
@@ -69,7 +74,7 @@ typedef struct _mongoc_async_cmd
 
    struct _mongoc_async_cmd *next;
    struct _mongoc_async_cmd *prev;
-} mongoc_async_cmd_t;
+};
 
 mongoc_async_cmd_t *
 mongoc_async_cmd_new (mongoc_async_t           *async,
@@ -88,6 +93,12 @@ mongoc_async_cmd_destroy (mongoc_async_cmd_t *acmd);
 bool
 mongoc_async_cmd_run (mongoc_async_cmd_t *acmd);
 
+void
+mongoc_async_cmd_complete (mongoc_async_cmd_t        *acmd,
+                           mongoc_async_cmd_result_t  result,
+                           const bson_t              *reply,
+                           int64_t                    rtt);
+
 #ifdef MONGOC_ENABLE_SSL
 int
 mongoc_async_cmd_tls_setup (mongoc_stream_t *stream,
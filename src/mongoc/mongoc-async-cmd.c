@@ -46,6 +46,9 @@ _mongoc_async_cmd_phase_recv_len (mongoc_async_cmd_t *cmd);
 mongoc_async_cmd_result_t
 _mongoc_async_cmd_phase_recv_rpc (mongoc_async_cmd_t *cmd);
 
+static void
+_mongoc_async_cmd_free (mongoc_async_cmd_t *acmd);
+
 static const _mongoc_async_cmd_phase_t gMongocCMDPhases[] = {
    _mongoc_async_cmd_phase_setup,
    _mongoc_async_cmd_phase_send,
@@ -113,16 +116,41 @@ mongoc_async_cmd_run (mongoc_async_cmd_t *acmd)
    rtt = bson_get_monotonic_time () - acmd->start_time;
 
    if (result == MONGOC_ASYNC_CMD_SUCCESS) {
-      acmd->cb (result, &acmd->reply, rtt, acmd->data, &acmd->error);
+      mongoc_async_cmd_complete (acmd, result, &acmd->reply, rtt);
    } else {
       /* we're in ERROR, TIMEOUT, or CANCELED */
-      acmd->cb (result, NULL, rtt, acmd->data, &acmd->error);
+      mongoc_async_cmd_complete (acmd, result, NULL, rtt);
    }
 
-   mongoc_async_cmd_destroy (acmd);
    return false;
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_async_cmd_complete --
+ *
+ *       Invoke @acmd's callback with @result and destroy @acmd.
+ *
+ *       The command is unregistered from its executor before the
+ *       callback runs, so the callback may close the stream or start a
+ *       new command on it.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_async_cmd_complete (mongoc_async_cmd_t        *acmd,
+                           mongoc_async_cmd_result_t  result,
+                           const bson_t              *reply,
+                           int64_t                    rtt)
+{
+   _mongoc_async_remove_cmd (acmd->async, acmd);
+   acmd->cb (result, reply, rtt, acmd->data, &acmd->error);
+   _mongoc_async_cmd_free (acmd);
+}
+
 void
 _mongoc_async_cmd_init_send (mongoc_async_cmd_t *acmd,
                              const char         *dbname)
@@ -170,8 +198,6 @@ mongoc_async_cmd_new (mongoc_async_t           *async,
                       int32_t                   timeout_msec)
 {
    mongoc_async_cmd_t *acmd;
-   mongoc_async_cmd_t *tmp;
-   bool found = false;
 
    BSON_ASSERT (cmd);
    BSON_ASSERT (dbname);
@@ -194,22 +220,7 @@ mongoc_async_cmd_new (mongoc_async_t           *async,
 
    _mongoc_async_cmd_state_start (acmd);
 
-   /* slot the cmd into the right place in the expiration list */
-   {
-      async->ncmds++;
-      DL_FOREACH (async->cmds, tmp)
-      {
-         if (tmp->expire_at >= acmd->expire_at) {
-            DL_PREPEND_ELEM (async->cmds, tmp, acmd);
-            found = true;
-            break;
-         }
-      }
-
-      if (! found) {
-         DL_APPEND (async->cmds, acmd);
-      }
-   }
+   _mongoc_async_add_cmd (async, acmd);
 
    return acmd;
 }
@@ -220,9 +231,14 @@ mongoc_async_cmd_destroy (mongoc_async_cmd_t *acmd)
 {
    BSON_ASSERT (acmd);
 
-   DL_DELETE (acmd->async->cmds, acmd);
-   acmd->async->ncmds--;
+   _mongoc_async_remove_cmd (acmd->async, acmd);
+   _mongoc_async_cmd_free (acmd);
+}
 
+
+static void
+_mongoc_async_cmd_free (mongoc_async_cmd_t *acmd)
+{
    bson_destroy (&acmd->cmd);
 
    if (acmd->reply_needs_cleanup) {
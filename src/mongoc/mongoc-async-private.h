@@ -22,61 +22,77 @@
 #endif
 
 #include <bson.h>
+
+#include "mongoc-async.h"
+#include "mongoc-array-private.h"
 #include "mongoc-stream.h"
 
+#ifdef __linux__
+# define MONGOC_ASYNC_USE_EPOLL 1
+# include <sys/epoll.h>
+#endif
+
 BSON_BEGIN_DECLS
 
-struct _mongoc_async_cmd;
+/* called from mongoc_async_destroy, after every command is freed */
+typedef void (*mongoc_async_teardown_t) (void *ctx);
 
-typedef struct _mongoc_async
+typedef struct
 {
-   struct _mongoc_async_cmd *cmds;
-   size_t                    ncmds;
-   uint32_t                  request_id;
-} mongoc_async_t;
+   mongoc_async_teardown_t teardown;
+   void                   *ctx;
+} mongoc_async_hook_t;
 
-typedef enum
+struct _mongoc_async
 {
-   MONGOC_ASYNC_CMD_IN_PROGRESS,
-   MONGOC_ASYNC_CMD_SUCCESS,
-   MONGOC_ASYNC_CMD_ERROR,
-   MONGOC_ASYNC_CMD_TIMEOUT,
-} mongoc_async_cmd_result_t;
+   struct _mongoc_async_cmd  *cmds;
+   size_t                     ncmds;
+   uint32_t                   request_id;
+
+   /* min-heap of commands ordered by expire_at */
+   mongoc_array_t             timers;
+
+   /* commands reported ready by the last wait */
+   struct _mongoc_async_cmd **ready;
+   size_t                     ready_size;
+
+   /* poll() fallback, rebuilt only when registrations change */
+   mongoc_stream_poll_t      *poller;
+   struct _mongoc_async_cmd **polled;
+   size_t                     poll_size;
+   bool                       poll_dirty;
+
+   /* mongoc_async_hook_t, for owners of state bound to this executor */
+   mongoc_array_t             hooks;
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   int                        epfd;
+   struct epoll_event        *epoll_events;
+   size_t                     epoll_size;
+#endif
+};
 
-typedef void (*mongoc_async_cmd_cb_t)(mongoc_async_cmd_result_t result,
-                                      const bson_t             *bson,
-                                      int64_t                   rtt_msec,
-                                      void                     *data,
-                                      bson_error_t             *error);
+void
+_mongoc_async_add_cmd (mongoc_async_t     *async,
+                       mongoc_async_cmd_t *acmd);
 
-typedef int
-(*mongoc_async_cmd_setup_t)(mongoc_stream_t *stream,
-                            int             *events,
-                            void            *ctx,
-                            int32_t         timeout_msec,
-                            bson_error_t    *error);
+void
+_mongoc_async_update_cmd (mongoc_async_t     *async,
+                          mongoc_async_cmd_t *acmd);
 
+void
+_mongoc_async_remove_cmd (mongoc_async_t     *async,
+                          mongoc_async_cmd_t *acmd);
 
-mongoc_async_t *
-mongoc_async_new ();
+void
+_mongoc_async_add_hook (mongoc_async_t          *async,
+                        mongoc_async_teardown_t  teardown,
+                        void                    *ctx);
 
 void
-mongoc_async_destroy (mongoc_async_t *async);
-
-bool
-mongoc_async_run (mongoc_async_t *async,
-                  int32_t         timeout_msec);
-
-struct _mongoc_async_cmd *
-mongoc_async_cmd (mongoc_async_t          *async,
-                  mongoc_stream_t         *stream,
-                  mongoc_async_cmd_setup_t setup,
-                  void                    *setup_ctx,
-                  const char              *dbname,
-                  const bson_t            *cmd,
-                  mongoc_async_cmd_cb_t    cb,
-                  void                    *cb_data,
-                  int32_t                  timeout_msec);
+_mongoc_async_remove_hook (mongoc_async_t          *async,
+                           mongoc_async_teardown_t  teardown,
+                           void                    *ctx);
 
 BSON_END_DECLS
 
@@ -17,13 +17,26 @@
 
 #include <bson.h>
 
+#ifdef MONGOC_ASYNC_USE_EPOLL
+# include <unistd.h>
+#endif
+
 #include "mongoc-async-private.h"
 #include "mongoc-async-cmd-private.h"
+#include "mongoc-log.h"
+#include "mongoc-socket-private.h"
+#include "mongoc-stream-private.h"
+#include "mongoc-stream-socket.h"
 #include "utlist.h"
 
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "async"
 
+
+#define TIMER_AT(_a, _i) \
+   (_mongoc_array_index (&(_a)->timers, mongoc_async_cmd_t *, (_i)))
+
+
 mongoc_async_cmd_t *
 mongoc_async_cmd (mongoc_async_t           *async,
                   mongoc_stream_t          *stream,
@@ -40,10 +53,21 @@ mongoc_async_cmd (mongoc_async_t           *async,
 }
 
 mongoc_async_t *
-mongoc_async_new ()
+mongoc_async_new (void)
 {
    mongoc_async_t *async = (mongoc_async_t *)bson_malloc0 (sizeof (*async));
 
+   _mongoc_array_init (&async->timers, sizeof (mongoc_async_cmd_t *));
+   _mongoc_array_init (&async->hooks, sizeof (mongoc_async_hook_t));
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   async->epfd = epoll_create1 (EPOLL_CLOEXEC);
+
+   if (async->epfd == -1) {
+      MONGOC_DEBUG ("epoll_create1 failed, falling back to poll(): %d", errno);
+   }
+#endif
+
    return async;
 }
 
@@ -51,27 +75,487 @@ void
 mongoc_async_destroy (mongoc_async_t *async)
 {
    mongoc_async_cmd_t *acmd, *tmp;
+   mongoc_async_hook_t *hook;
+   size_t i;
 
    DL_FOREACH_SAFE (async->cmds, acmd, tmp)
    {
       mongoc_async_cmd_destroy (acmd);
    }
 
+   /* the commands are gone, let their owners release what they lent us */
+   for (i = 0; i < async->hooks.len; i++) {
+      hook = &_mongoc_array_index (&async->hooks, mongoc_async_hook_t, i);
+      hook->teardown (hook->ctx);
+   }
+
+   _mongoc_array_destroy (&async->hooks);
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   if (async->epfd != -1) {
+      close (async->epfd);
+   }
+
+   bson_free (async->epoll_events);
+#endif
+
+   _mongoc_array_destroy (&async->timers);
+   bson_free (async->ready);
+   bson_free (async->poller);
+   bson_free (async->polled);
    bson_free (async);
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_add_hook --
+ * _mongoc_async_remove_hook --
+ *
+ *       Register @teardown to be called with @ctx when @async is
+ *       destroyed, so state bound to @async doesn't outlive it. A hook
+ *       must not add or remove hooks while it runs.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_async_add_hook (mongoc_async_t          *async,
+                        mongoc_async_teardown_t  teardown,
+                        void                    *ctx)
+{
+   mongoc_async_hook_t hook;
+
+   hook.teardown = teardown;
+   hook.ctx = ctx;
+
+   _mongoc_array_append_val (&async->hooks, hook);
+}
+
+void
+_mongoc_async_remove_hook (mongoc_async_t          *async,
+                           mongoc_async_teardown_t  teardown,
+                           void                    *ctx)
+{
+   mongoc_async_hook_t *hook;
+   size_t i;
+
+   for (i = 0; i < async->hooks.len; i++) {
+      hook = &_mongoc_array_index (&async->hooks, mongoc_async_hook_t, i);
+
+      if (hook->teardown == teardown && hook->ctx == ctx) {
+         *hook = _mongoc_array_index (&async->hooks, mongoc_async_hook_t,
+                                      async->hooks.len - 1);
+         async->hooks.len--;
+         return;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_timer_swap --
+ * _mongoc_async_timer_up --
+ * _mongoc_async_timer_down --
+ *
+ *       Maintain the binary min-heap of commands keyed on expire_at.
+ *       Each command remembers its slot in timer_idx so it can be
+ *       removed in O(log n) when it completes before expiring.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_async_timer_swap (mongoc_async_t *async,
+                          size_t          a,
+                          size_t          b)
+{
+   mongoc_async_cmd_t *tmp;
+
+   tmp = TIMER_AT (async, a);
+   TIMER_AT (async, a) = TIMER_AT (async, b);
+   TIMER_AT (async, b) = tmp;
+
+   TIMER_AT (async, a)->timer_idx = a;
+   TIMER_AT (async, b)->timer_idx = b;
+}
+
+static void
+_mongoc_async_timer_up (mongoc_async_t *async,
+                        size_t          idx)
+{
+   size_t parent;
+
+   while (idx > 0) {
+      parent = (idx - 1) / 2;
+
+      if (TIMER_AT (async, parent)->expire_at <=
+          TIMER_AT (async, idx)->expire_at) {
+         break;
+      }
+
+      _mongoc_async_timer_swap (async, parent, idx);
+      idx = parent;
+   }
+}
+
+static void
+_mongoc_async_timer_down (mongoc_async_t *async,
+                          size_t          idx)
+{
+   size_t len = async->timers.len;
+   size_t child;
+
+   for (;;) {
+      child = idx * 2 + 1;
+
+      if (child >= len) {
+         break;
+      }
+
+      if (child + 1 < len &&
+          TIMER_AT (async, child + 1)->expire_at <
+          TIMER_AT (async, child)->expire_at) {
+         child++;
+      }
+
+      if (TIMER_AT (async, idx)->expire_at <=
+          TIMER_AT (async, child)->expire_at) {
+         break;
+      }
+
+      _mongoc_async_timer_swap (async, idx, child);
+      idx = child;
+   }
+}
+
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+static uint32_t
+_mongoc_async_epoll_events (int events)
+{
+   uint32_t r = 0;
+
+   if (events & POLLIN) {
+      r |= EPOLLIN;
+   }
+
+   if (events & POLLOUT) {
+      r |= EPOLLOUT;
+   }
+
+   return r;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_use_poll --
+ *
+ *       Abandon epoll for this executor, e.g. because a command was
+ *       registered on a stream that is not backed by a socket. All
+ *       later waits go through mongoc_stream_poll().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_async_use_poll (mongoc_async_t *async)
+{
+   mongoc_async_cmd_t *acmd;
+
+   if (async->epfd == -1) {
+      return;
+   }
+
+   close (async->epfd);
+   async->epfd = -1;
+   async->poll_dirty = true;
+
+   DL_FOREACH (async->cmds, acmd)
+   {
+      acmd->fd = -1;
+   }
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_add_cmd --
+ *
+ *       Take ownership of @acmd: link it into the command list, push
+ *       it onto the timer heap and register its socket with epoll.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_async_add_cmd (mongoc_async_t     *async,
+                       mongoc_async_cmd_t *acmd)
+{
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   mongoc_stream_t *root;
+   struct epoll_event ev = { 0 };
+#endif
+
+   DL_APPEND (async->cmds, acmd);
+   async->ncmds++;
+
+   acmd->timer_idx = async->timers.len;
+   _mongoc_array_append_val (&async->timers, acmd);
+   _mongoc_async_timer_up (async, acmd->timer_idx);
+
+   acmd->fd = -1;
+   acmd->registered_events = acmd->events;
+   async->poll_dirty = true;
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   if (async->epfd == -1) {
+      return;
+   }
+
+   root = mongoc_stream_get_root_stream (acmd->stream);
+
+   if (root->type != MONGOC_STREAM_SOCKET) {
+      _mongoc_async_use_poll (async);
+      return;
+   }
+
+   acmd->fd = mongoc_stream_socket_get_socket (
+      (mongoc_stream_socket_t *)root)->sd;
+
+   ev.events = _mongoc_async_epoll_events (acmd->events);
+   ev.data.ptr = acmd;
+
+   if (epoll_ctl (async->epfd, EPOLL_CTL_ADD, acmd->fd, &ev) != 0) {
+      /* e.g. two commands sharing one socket */
+      MONGOC_DEBUG ("epoll_ctl failed, falling back to poll(): %d", errno);
+      _mongoc_async_use_poll (async);
+   }
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_update_cmd --
+ *
+ *       Refresh @acmd's registration after a phase changed the events
+ *       it is waiting for. No-op if they did not change.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_async_update_cmd (mongoc_async_t     *async,
+                          mongoc_async_cmd_t *acmd)
+{
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   struct epoll_event ev = { 0 };
+#endif
+
+   if (acmd->events == acmd->registered_events) {
+      return;
+   }
+
+   acmd->registered_events = acmd->events;
+   async->poll_dirty = true;
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   if (acmd->fd != -1) {
+      ev.events = _mongoc_async_epoll_events (acmd->events);
+      ev.data.ptr = acmd;
+
+      if (epoll_ctl (async->epfd, EPOLL_CTL_MOD, acmd->fd, &ev) != 0) {
+         MONGOC_DEBUG ("epoll_ctl failed, falling back to poll(): %d", errno);
+         _mongoc_async_use_poll (async);
+      }
+   }
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_remove_cmd --
+ *
+ *       Undo _mongoc_async_add_cmd(). Called from
+ *       mongoc_async_cmd_destroy() before the stream is closed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_async_remove_cmd (mongoc_async_t     *async,
+                          mongoc_async_cmd_t *acmd)
+{
+   size_t idx = acmd->timer_idx;
+   size_t last = async->timers.len - 1;
+
+   BSON_ASSERT (TIMER_AT (async, idx) == acmd);
+
+   if (idx != last) {
+      _mongoc_async_timer_swap (async, idx, last);
+   }
+
+   async->timers.len--;
+
+   if (idx != last) {
+      _mongoc_async_timer_down (async, idx);
+      _mongoc_async_timer_up (async, idx);
+   }
+
+   /* don't dispatch to a destroyed command later in this wake-up */
+   if (acmd->ready_idx) {
+      async->ready[acmd->ready_idx - 1] = NULL;
+   }
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   if (acmd->fd != -1) {
+      /* errors are harmless: closing the fd already unregistered it */
+      epoll_ctl (async->epfd, EPOLL_CTL_DEL, acmd->fd, NULL);
+   }
+#endif
+
+   DL_DELETE (async->cmds, acmd);
+   async->ncmds--;
+   async->poll_dirty = true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_async_wait --
+ *
+ *       Wait up to @timeout_msec for registered commands to become
+ *       ready.
+ *
+ * Returns:
+ *       The number of entries stored in async->ready, 0 on timeout,
+ *       or -1 on failure.
+ *
+ * Side effects:
+ *       Sets revents on each ready command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static ssize_t
+_mongoc_async_wait (mongoc_async_t *async,
+                    int32_t         timeout_msec)
+{
+   mongoc_async_cmd_t *acmd;
+   ssize_t nactive;
+   size_t nready = 0;
+   size_t i;
+
+   if (async->ready_size < async->ncmds) {
+      async->ready = (mongoc_async_cmd_t **)bson_realloc (
+         async->ready, sizeof (*async->ready) * async->ncmds);
+      async->ready_size = async->ncmds;
+   }
+
+#ifdef MONGOC_ASYNC_USE_EPOLL
+   if (async->epfd != -1) {
+      if (async->epoll_size < async->ncmds) {
+         async->epoll_events = (struct epoll_event *)bson_realloc (
+            async->epoll_events, sizeof (struct epoll_event) * async->ncmds);
+         async->epoll_size = async->ncmds;
+      }
+
+      nactive = epoll_wait (async->epfd, async->epoll_events,
+                            (int)async->ncmds, timeout_msec);
+
+      for (i = 0; nactive > 0 && i < (size_t)nactive; i++) {
+         acmd = (mongoc_async_cmd_t *)async->epoll_events[i].data.ptr;
+         acmd->revents = 0;
+
+         if (async->epoll_events[i].events & EPOLLIN) {
+            acmd->revents |= POLLIN;
+         }
+
+         if (async->epoll_events[i].events & EPOLLOUT) {
+            acmd->revents |= POLLOUT;
+         }
+
+         if (async->epoll_events[i].events & EPOLLERR) {
+            acmd->revents |= POLLERR;
+         }
+
+         if (async->epoll_events[i].events & EPOLLHUP) {
+            acmd->revents |= POLLHUP;
+         }
+
+         async->ready[nready++] = acmd;
+         acmd->ready_idx = nready;
+      }
+
+      return nactive < 0 ? -1 : (ssize_t)nready;
+   }
+#endif
+
+   if (async->poll_dirty) {
+      if (async->poll_size < async->ncmds) {
+         async->poller = (mongoc_stream_poll_t *)bson_realloc (
+            async->poller, sizeof (*async->poller) * async->ncmds);
+         async->polled = (mongoc_async_cmd_t **)bson_realloc (
+            async->polled, sizeof (*async->polled) * async->ncmds);
+         async->poll_size = async->ncmds;
+      }
+
+      i = 0;
+      DL_FOREACH (async->cmds, acmd)
+      {
+         async->poller[i].stream = acmd->stream;
+         async->poller[i].events = acmd->events;
+         async->polled[i] = acmd;
+         i++;
+      }
+
+      async->poll_dirty = false;
+   }
+
+   for (i = 0; i < async->ncmds; i++) {
+      async->poller[i].revents = 0;
+   }
+
+   nactive = mongoc_stream_poll (async->poller, async->ncmds, timeout_msec);
+
+   if (nactive <= 0) {
+      return nactive;
+   }
+
+   for (i = 0; i < async->ncmds; i++) {
+      if (async->poller[i].revents) {
+         async->polled[i]->revents = async->poller[i].revents;
+         async->ready[nready++] = async->polled[i];
+         async->polled[i]->ready_idx = nready;
+      }
+   }
+
+   return (ssize_t)nready;
+}
+
+
 bool
 mongoc_async_run (mongoc_async_t *async,
                   int32_t         timeout_msec)
 {
-   mongoc_async_cmd_t *acmd, *tmp;
-   mongoc_stream_poll_t *poller = NULL;
-   int i;
-   ssize_t nactive = 0;
+   mongoc_async_cmd_t *acmd;
+   ssize_t nready;
+   ssize_t i;
    int64_t now;
    int64_t expire_at = 0;
-
-   size_t poll_size = 0;
+   int64_t next;
 
    for (;;) {
       now = bson_get_monotonic_time ();
@@ -83,79 +567,61 @@ mongoc_async_run (mongoc_async_t *async,
             expire_at = -1;
          }
       } else if (timeout_msec >= 0) {
-         timeout_msec = (expire_at - now) / 1000;
+         timeout_msec = (int32_t) ((expire_at - now) / 1000);
       }
 
       if (now > expire_at) {
          break;
       }
 
-      DL_FOREACH_SAFE (async->cmds, acmd, tmp)
-      {
-         /* async commands are sorted by expire_at */
-         if (now > acmd->expire_at) {
-            acmd->cb (MONGOC_ASYNC_CMD_TIMEOUT, NULL, (now - acmd->start_time), acmd->data,
-                      &acmd->error);
-            mongoc_async_cmd_destroy (acmd);
-         } else {
+      /* fire timeouts, soonest first */
+      while (async->timers.len) {
+         acmd = TIMER_AT (async, 0);
+
+         if (now <= acmd->expire_at) {
             break;
          }
+
+         mongoc_async_cmd_complete (acmd, MONGOC_ASYNC_CMD_TIMEOUT, NULL,
+                                    now - acmd->start_time);
       }
 
       if (!async->ncmds) {
          break;
       }
 
-      if (poll_size < async->ncmds) {
-         poller = (mongoc_stream_poll_t *)bson_realloc (poller, sizeof (*poller) * async->ncmds);
-         poll_size = async->ncmds;
-      }
-
-      i = 0;
-      DL_FOREACH (async->cmds, acmd)
-      {
-         poller[i].stream = acmd->stream;
-         poller[i].events = acmd->events;
-         poller[i].revents = 0;
-         i++;
-      }
+      next = (TIMER_AT (async, 0)->expire_at - now) / 1000;
 
       if (timeout_msec >= 0) {
-         timeout_msec = BSON_MIN (timeout_msec, (async->cmds->expire_at - now) / 1000);
+         timeout_msec = (int32_t) BSON_MIN (timeout_msec, next);
       } else {
-         timeout_msec = (async->cmds->expire_at - now) / 1000;
+         timeout_msec = (int32_t) next;
       }
 
-      nactive = mongoc_stream_poll (poller, async->ncmds, timeout_msec);
+      nready = _mongoc_async_wait (async, timeout_msec);
 
-      if (nactive) {
-         i = 0;
+      for (i = 0; i < nready; i++) {
+         acmd = async->ready[i];
 
-         DL_FOREACH_SAFE (async->cmds, acmd, tmp)
-         {
-            if (poller[i].revents & (POLLERR | POLLHUP)) {
-               acmd->state = MONGOC_ASYNC_CMD_ERROR_STATE;
-            }
+         if (!acmd) {
+            /* destroyed by an earlier callback in this wake-up */
+            continue;
+         }
 
-            if (acmd->state == MONGOC_ASYNC_CMD_ERROR_STATE
-                || (poller[i].revents & poller[i].events)) {
+         acmd->ready_idx = 0;
 
-               mongoc_async_cmd_run (acmd);
-               nactive--;
+         if (acmd->revents & (POLLERR | POLLHUP)) {
+            acmd->state = MONGOC_ASYNC_CMD_ERROR_STATE;
+         }
 
-               if (!nactive) {
-                  break;
-               }
+         if (acmd->state == MONGOC_ASYNC_CMD_ERROR_STATE
+             || (acmd->revents & acmd->events)) {
+            if (mongoc_async_cmd_run (acmd)) {
+               _mongoc_async_update_cmd (async, acmd);
             }
-
-            i++;
          }
       }
    }
 
-   if (poll_size) {
-      bson_free (poller);
-   }
-
    return async->ncmds;
 }
@@ -71,6 +71,11 @@ _mongoc_buffer_fill (mongoc_buffer_t *buffer,
                      int32_t          timeout_msec,
                      bson_error_t    *error);
 
+bool
+_mongoc_buffer_append (mongoc_buffer_t *buffer,
+                       const uint8_t   *data,
+                       size_t           data_size);
+
 void
 _mongoc_buffer_destroy (mongoc_buffer_t *buffer);
 
@@ -66,7 +66,7 @@ _mongoc_buffer_init (mongoc_buffer_t   *buffer,
    }
 
    if (!buf) {
-      buf = (uint8_t *)realloc_func (NULL, buflen, NULL);
+      buf = (uint8_t *)realloc_func (NULL, buflen, realloc_data);
    }
 
    memset (buffer, 0, sizeof *buffer);
@@ -163,7 +163,8 @@ _mongoc_buffer_append_from_stream (mongoc_buffer_t *buffer,
       buffer->off = 0;
       if (!SPACE_FOR (buffer, size)) {
          buffer->datalen = bson_next_power_of_two (size + buffer->len + buffer->off);
-         buffer->data = (uint8_t *)buffer->realloc_func (buffer->data, buffer->datalen, NULL);
+         buffer->data = (uint8_t *)buffer->realloc_func (buffer->data, buffer->datalen,
+                                                         buffer->realloc_data);
       }
    }
 
@@ -187,6 +188,56 @@ _mongoc_buffer_append_from_stream (mongoc_buffer_t *buffer,
 }
 
 
+/**
+ * _mongoc_buffer_append:
+ * @buffer: A mongoc_buffer_t.
+ * @data: The data to append to @buffer.
+ * @data_size: The number of bytes in @data.
+ *
+ * Appends bytes that were already read from a stream to @buffer, growing it
+ * if necessary. This is used to replay a message that was read earlier.
+ *
+ * Returns: true if successful; otherwise false.
+ */
+bool
+_mongoc_buffer_append (mongoc_buffer_t *buffer,
+                       const uint8_t   *data,
+                       size_t           data_size)
+{
+   uint8_t *buf;
+
+   ENTRY;
+
+   BSON_ASSERT (buffer);
+   BSON_ASSERT (data_size);
+
+   BSON_ASSERT (buffer->datalen);
+   BSON_ASSERT ((buffer->datalen + data_size) < INT_MAX);
+
+   if (!SPACE_FOR (buffer, data_size)) {
+      if (buffer->len) {
+         memmove(&buffer->data[0], &buffer->data[buffer->off], buffer->len);
+      }
+      buffer->off = 0;
+      if (!SPACE_FOR (buffer, data_size)) {
+         buffer->datalen = bson_next_power_of_two (data_size + buffer->len + buffer->off);
+         buffer->data = (uint8_t *)buffer->realloc_func (buffer->data, buffer->datalen,
+                                                         buffer->realloc_data);
+      }
+   }
+
+   buf = &buffer->data[buffer->off + buffer->len];
+
+   BSON_ASSERT ((buffer->off + buffer->len + data_size) <= buffer->datalen);
+
+   memcpy (buf, data, data_size);
+
+   buffer->len += data_size;
+
+   RETURN (true);
+}
+
+
 /**
  * _mongoc_buffer_fill:
  * @buffer: A mongoc_buffer_t.
@@ -306,7 +357,8 @@ _mongoc_buffer_try_append_from_stream (mongoc_buffer_t *buffer,
       buffer->off = 0;
       if (!SPACE_FOR (buffer, size)) {
          buffer->datalen = bson_next_power_of_two (size + buffer->len + buffer->off);
-         buffer->data = (uint8_t *)buffer->realloc_func (buffer->data, buffer->datalen, NULL);
+         buffer->data = (uint8_t *)buffer->realloc_func (buffer->data, buffer->datalen,
+                                                         buffer->realloc_data);
       }
    }
 
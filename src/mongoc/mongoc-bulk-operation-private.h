@@ -39,6 +39,13 @@ struct _mongoc_bulk_operation_t
    mongoc_array_t                 commands;
    mongoc_write_result_t          result;
    bool                           executed;
+   bool                           streaming;
+   uint32_t                       max_in_flight;
+   /* set from the first write sent until execute() completes */
+   bool                           flushed;
+   uint32_t                       offset;
+   mongoc_server_stream_t        *server_stream;
+   mongoc_write_pipeline_t        pipeline;
 };
 
 
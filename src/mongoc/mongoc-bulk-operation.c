@@ -32,8 +32,6 @@
  *
  * Some interesting optimizations might be:
  *
- *   - If unordered mode, send operations as we get them instead of waiting
- *     for execute() to be called. This could save us memcpy()'s too.
  *   - If there is no acknowledgement desired, keep a count of how many
  *     replies we need and ask the socket layer to skip that many bytes
  *     when reading.
@@ -51,8 +49,10 @@ mongoc_bulk_operation_new (bool ordered)
    bulk->flags.bypass_document_validation = MONGOC_BYPASS_DOCUMENT_VALIDATION_DEFAULT;
    bulk->flags.ordered = ordered;
    bulk->hint = 0;
+   bulk->max_in_flight = MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT;
 
    _mongoc_array_init (&bulk->commands, sizeof (mongoc_write_command_t));
+   _mongoc_write_result_init (&bulk->result);
 
    return bulk;
 }
@@ -89,6 +89,16 @@ mongoc_bulk_operation_destroy (mongoc_bulk_operation_t *bulk) /* IN */
    int i;
 
    if (bulk) {
+      if (bulk->server_stream) {
+         /* a streaming bulk destroyed before execute(), await its writes */
+         if (!bulk->flags.ordered) {
+            _mongoc_write_pipeline_drain (&bulk->pipeline, &bulk->result);
+            _mongoc_write_pipeline_destroy (&bulk->pipeline);
+         }
+
+         mongoc_server_stream_cleanup (bulk->server_stream);
+      }
+
       for (i = 0; i < bulk->commands.len; i++) {
          command = &_mongoc_array_index (&bulk->commands,
                                          mongoc_write_command_t, i);
@@ -99,13 +109,183 @@ mongoc_bulk_operation_destroy (mongoc_bulk_operation_t *bulk) /* IN */
       bson_free (bulk->collection);
       mongoc_write_concern_destroy (bulk->write_concern);
       _mongoc_array_destroy (&bulk->commands);
+      _mongoc_write_result_destroy (&bulk->result);
+
+      bson_free (bulk);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_operation_begin --
+ *
+ *       Select the server to send writes to. Unordered writes are
+ *       pipelined on its stream.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_bulk_operation_begin (mongoc_bulk_operation_t *bulk,
+                              bson_error_t            *error)
+{
+   mongoc_cluster_t *cluster;
+
+   ENTRY;
+
+   cluster = &bulk->client->cluster;
+
+   if (bulk->hint) {
+      bulk->server_stream = mongoc_cluster_stream_for_server (
+         cluster, bulk->hint, true /* reconnect_ok */, error);
+   } else {
+      bulk->server_stream = mongoc_cluster_stream_for_writes (cluster, error);
+   }
+
+   if (!bulk->server_stream) {
+      RETURN (false);
+   }
+
+   bulk->offset = 0;
+
+   if (!bulk->flags.ordered) {
+      /* batches are independent, send them without awaiting each reply */
+      _mongoc_write_pipeline_init (&bulk->pipeline, bulk->client,
+                                   bulk->server_stream, bulk->max_in_flight);
+   }
+
+   RETURN (true);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_operation_run --
+ *
+ *       Execute the first @n_commands commands. Once an ordered bulk
+ *       has failed, the rest are skipped. If @consume is true, the
+ *       commands are then removed from the bulk.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_bulk_operation_run (mongoc_bulk_operation_t *bulk,
+                            uint32_t                 n_commands,
+                            bool                     consume)
+{
+   mongoc_write_command_t *command;
+   uint32_t i;
+
+   ENTRY;
+
+   for (i = 0; i < n_commands; i++) {
+      command = &_mongoc_array_index (&bulk->commands,
+                                      mongoc_write_command_t, i);
+
+      if (!bulk->server_stream ||
+          (bulk->result.failed && bulk->flags.ordered)) {
+         /* discard */
+      } else if (bulk->flags.ordered) {
+         _mongoc_write_command_execute (command, bulk->client,
+                                        bulk->server_stream,
+                                        bulk->database, bulk->collection,
+                                        bulk->write_concern, bulk->offset,
+                                        &bulk->result);
+         bulk->hint = command->hint;
+      } else {
+         _mongoc_write_command_execute_pipelined (command, &bulk->pipeline,
+                                                  bulk->database,
+                                                  bulk->collection,
+                                                  bulk->write_concern,
+                                                  bulk->offset,
+                                                  &bulk->result);
+         bulk->hint = command->hint;
+      }
+
+      bulk->offset += command->n_documents;
+
+      if (consume) {
+         _mongoc_write_command_destroy (command);
+      }
+   }
+
+   if (consume) {
+      memmove (bulk->commands.data,
+               (uint8_t *)bulk->commands.data +
+                  n_commands * bulk->commands.element_size,
+               (bulk->commands.len - n_commands) *
+                  bulk->commands.element_size);
+      bulk->commands.len -= n_commands;
+   }
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_bulk_operation_stream --
+ *
+ *       Called after each operation is added. If the bulk is streaming,
+ *       send every command that can no longer grow: all but the last,
+ *       and the last too once it holds a full batch. Writes to the
+ *       server are sent from here until execute(), so only the batch
+ *       being filled is held in memory.
+ *
+ *       If the first write can't select a server, the error is reported
+ *       by execute() and further operations are discarded.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_bulk_operation_stream (mongoc_bulk_operation_t *bulk)
+{
+   mongoc_write_command_t *last;
+   uint32_t n_commands;
+
+   ENTRY;
+
+   if (!bulk->streaming ||
+       !bulk->client || !bulk->database || !bulk->collection) {
+      EXIT;
+   }
+
+   if (!bulk->flushed) {
+      bulk->flushed = true;
 
       if (bulk->executed) {
          _mongoc_write_result_destroy (&bulk->result);
+         _mongoc_write_result_init (&bulk->result);
       }
 
-      bson_free (bulk);
+      if (!_mongoc_bulk_operation_begin (bulk, &bulk->result.error)) {
+         bulk->result.failed = true;
+      }
+   }
+
+   last = &_mongoc_array_index (&bulk->commands, mongoc_write_command_t,
+                                bulk->commands.len - 1);
+   n_commands = (uint32_t) bulk->commands.len - 1;
+
+   if (!bulk->server_stream ||
+       last->n_documents >= mongoc_server_stream_max_write_batch_size (
+          bulk->server_stream) ||
+       last->documents->len >= mongoc_server_stream_max_bson_obj_size (
+          bulk->server_stream)) {
+      n_commands++;
    }
+
+   if (n_commands) {
+      _mongoc_bulk_operation_run (bulk, n_commands, true);
+   }
+
+   EXIT;
 }
 
 
@@ -128,6 +308,7 @@ mongoc_bulk_operation_remove (mongoc_bulk_operation_t *bulk,     /* IN */
       if ((last->type == MONGOC_WRITE_COMMAND_DELETE) &&
           last->u.delete_.multi) {
          _mongoc_write_command_delete_append (last, selector);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -135,6 +316,7 @@ mongoc_bulk_operation_remove (mongoc_bulk_operation_t *bulk,     /* IN */
    _mongoc_write_command_init_delete (&command, selector, true, bulk->flags);
 
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
 
    EXIT;
 }
@@ -159,6 +341,7 @@ mongoc_bulk_operation_remove_one (mongoc_bulk_operation_t *bulk,     /* IN */
       if ((last->type == MONGOC_WRITE_COMMAND_DELETE) &&
           !last->u.delete_.multi) {
          _mongoc_write_command_delete_append (last, selector);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -166,6 +349,7 @@ mongoc_bulk_operation_remove_one (mongoc_bulk_operation_t *bulk,     /* IN */
    _mongoc_write_command_init_delete (&command, selector, false, bulk->flags);
 
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
 
    EXIT;
 }
@@ -214,6 +398,7 @@ mongoc_bulk_operation_insert (mongoc_bulk_operation_t *bulk,
 
       if (last->type == MONGOC_WRITE_COMMAND_INSERT) {
          _mongoc_write_command_insert_append (last, document);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -223,6 +408,7 @@ mongoc_bulk_operation_insert (mongoc_bulk_operation_t *bulk,
       !_mongoc_write_concern_needs_gle (bulk->write_concern));
 
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
 
    EXIT;
 }
@@ -258,6 +444,7 @@ mongoc_bulk_operation_replace_one (mongoc_bulk_operation_t *bulk,
                                    bulk->commands.len - 1);
       if (last->type == MONGOC_WRITE_COMMAND_UPDATE) {
          _mongoc_write_command_update_append (last, selector, document, upsert, false);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -265,6 +452,7 @@ mongoc_bulk_operation_replace_one (mongoc_bulk_operation_t *bulk,
    _mongoc_write_command_init_update (&command, selector, document, upsert,
                                       false, bulk->flags);
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
 
    EXIT;
 }
@@ -303,6 +491,7 @@ mongoc_bulk_operation_update (mongoc_bulk_operation_t *bulk,
                                    bulk->commands.len - 1);
       if (last->type == MONGOC_WRITE_COMMAND_UPDATE) {
          _mongoc_write_command_update_append (last, selector, document, upsert, multi);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -310,6 +499,7 @@ mongoc_bulk_operation_update (mongoc_bulk_operation_t *bulk,
    _mongoc_write_command_init_update (&command, selector, document, upsert,
                                       multi, bulk->flags);
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
    EXIT;
 }
 
@@ -346,6 +536,7 @@ mongoc_bulk_operation_update_one (mongoc_bulk_operation_t *bulk,
                                    bulk->commands.len - 1);
       if (last->type == MONGOC_WRITE_COMMAND_UPDATE) {
          _mongoc_write_command_update_append (last, selector, document, upsert, false);
+         _mongoc_bulk_operation_stream (bulk);
          EXIT;
       }
    }
@@ -353,6 +544,7 @@ mongoc_bulk_operation_update_one (mongoc_bulk_operation_t *bulk,
    _mongoc_write_command_init_update (&command, selector, document, upsert,
                                       false, bulk->flags);
    _mongoc_array_append_val (&bulk->commands, command);
+   _mongoc_bulk_operation_stream (bulk);
    EXIT;
 }
 
@@ -362,25 +554,19 @@ mongoc_bulk_operation_execute (mongoc_bulk_operation_t *bulk,  /* IN */
                                bson_t                  *reply, /* OUT */
                                bson_error_t            *error) /* OUT */
 {
-   mongoc_cluster_t *cluster;
-   mongoc_write_command_t *command;
-   mongoc_server_stream_t *server_stream;
    bool ret;
-   uint32_t offset = 0;
-   int i;
 
    ENTRY;
 
    BSON_ASSERT (bulk);
 
-   cluster = &bulk->client->cluster;
-
-   if (bulk->executed) {
-      _mongoc_write_result_destroy (&bulk->result);
+   if (!bulk->flushed) {
+      if (bulk->executed) {
+         _mongoc_write_result_destroy (&bulk->result);
+         _mongoc_write_result_init (&bulk->result);
+      }
    }
 
-   _mongoc_write_result_init (&bulk->result);
-
    bulk->executed = true;
 
    if (!bulk->client) {
@@ -410,7 +596,7 @@ mongoc_bulk_operation_execute (mongoc_bulk_operation_t *bulk,  /* IN */
       bson_init (reply);
    }
 
-   if (!bulk->commands.len) {
+   if (!bulk->commands.len && !bulk->flushed) {
       bson_set_error (error,
                       MONGOC_ERROR_COMMAND,
                       MONGOC_ERROR_COMMAND_INVALID_ARG,
@@ -418,44 +604,32 @@ mongoc_bulk_operation_execute (mongoc_bulk_operation_t *bulk,  /* IN */
       RETURN (false);
    }
 
-   if (bulk->hint) {
-      server_stream = mongoc_cluster_stream_for_server (cluster,
-                                                        bulk->hint,
-                                                        true /* reconnect_ok */,
-                                                        error);
-   } else {
-      server_stream = mongoc_cluster_stream_for_writes (cluster, error);
-   }
-
-   if (!server_stream) {
+   if (!bulk->flushed && !_mongoc_bulk_operation_begin (bulk, error)) {
       RETURN (false);
    }
 
-   for (i = 0; i < bulk->commands.len; i++) {
-      command = &_mongoc_array_index (&bulk->commands,
-                                      mongoc_write_command_t, i);
-
-      _mongoc_write_command_execute (command, bulk->client, server_stream,
-                                     bulk->database, bulk->collection,
-                                     bulk->write_concern, offset,
-                                     &bulk->result);
+   /* a streaming bulk has sent all but its last batch already */
+   _mongoc_bulk_operation_run (bulk, (uint32_t) bulk->commands.len,
+                               bulk->streaming);
 
-      bulk->hint = command->hint;
-
-      if (bulk->result.failed && bulk->flags.ordered) {
-         GOTO (cleanup);
+   if (bulk->server_stream) {
+      if (!bulk->flags.ordered) {
+         _mongoc_write_pipeline_drain (&bulk->pipeline, &bulk->result);
+         _mongoc_write_pipeline_destroy (&bulk->pipeline);
       }
 
-      offset += command->n_documents;
+      mongoc_server_stream_cleanup (bulk->server_stream);
+      bulk->server_stream = NULL;
    }
 
-cleanup:
+   bulk->flushed = false;
+
    ret = _mongoc_write_result_complete (&bulk->result, reply, error);
-   mongoc_server_stream_cleanup (server_stream);
 
    RETURN (ret ? bulk->hint : 0);
 }
 
+
 void
 mongoc_bulk_operation_set_write_concern (mongoc_bulk_operation_t      *bulk,
                                          const mongoc_write_concern_t *write_concern)
@@ -542,3 +716,62 @@ mongoc_bulk_operation_set_bypass_document_validation (mongoc_bulk_operation_t *b
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_operation_set_streaming --
+ *
+ *       If @streaming is true, each batch of writes is sent as soon as it
+ *       is full, instead of when mongoc_bulk_operation_execute() is
+ *       called, so the bulk never holds more than one batch. Calls
+ *       after operations are added are ignored with a warning.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_bulk_operation_set_streaming (mongoc_bulk_operation_t *bulk,
+                                     bool                     streaming)
+{
+   BSON_ASSERT (bulk);
+
+   if (bulk->commands.len || bulk->flushed) {
+      MONGOC_WARNING ("%s(): must be called before adding operations.",
+                      BSON_FUNC);
+      return;
+   }
+
+   bulk->streaming = streaming;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_bulk_operation_set_max_in_flight --
+ *
+ *       Set how many batches of an unordered bulk are sent before the
+ *       reply to the first is awaited. Adding an operation to a
+ *       streaming bulk blocks while this many batches are in flight.
+ *       Calls after operations are added are ignored with a warning.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_bulk_operation_set_max_in_flight (mongoc_bulk_operation_t *bulk,
+                                         uint32_t                 max_in_flight)
+{
+   BSON_ASSERT (bulk);
+   BSON_ASSERT (max_in_flight > 0);
+
+   if (bulk->commands.len || bulk->flushed) {
+      MONGOC_WARNING ("%s(): must be called before adding operations.",
+                      BSON_FUNC);
+      return;
+   }
+
+   bulk->max_in_flight = max_in_flight;
+}
+
+
@@ -62,6 +62,10 @@ void mongoc_bulk_operation_update_one  (mongoc_bulk_operation_t       *bulk,
                                         bool                           upsert);
 void mongoc_bulk_operation_set_bypass_document_validation (mongoc_bulk_operation_t   *bulk,
                                                            bool                       bypass);
+void mongoc_bulk_operation_set_streaming                  (mongoc_bulk_operation_t   *bulk,
+                                                           bool                       streaming);
+void mongoc_bulk_operation_set_max_in_flight              (mongoc_bulk_operation_t   *bulk,
+                                                           uint32_t                   max_in_flight);
 
 
 /*
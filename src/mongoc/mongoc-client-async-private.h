@@ -0,0 +1,84 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_CLIENT_ASYNC_PRIVATE_H
+#define MONGOC_CLIENT_ASYNC_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-array-private.h"
+#include "mongoc-async.h"
+#include "mongoc-client.h"
+#include "mongoc-set-private.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* per-server connection limit when the URI has no maxPoolSize */
+#define MONGOC_CLIENT_ASYNC_MAX_CONNS 100
+
+
+typedef struct _mongoc_client_async_op_t mongoc_client_async_op_t;
+
+
+/* Connections to one server that are reserved for async operations. */
+typedef struct _mongoc_client_async_server_t
+{
+   uint32_t                  server_id;
+   mongoc_array_t            idle;     /* mongoc_stream_t * */
+   size_t                    nconns;   /* idle and in use */
+   mongoc_client_async_op_t *queue;    /* waiting for a connection */
+} mongoc_client_async_server_t;
+
+
+typedef struct _mongoc_client_async_t
+{
+   mongoc_client_t          *client;
+   mongoc_set_t             *servers;
+   mongoc_client_async_op_t *ops;      /* in flight */
+   mongoc_async_t           *async;    /* set while any op is outstanding */
+   size_t                    nops;
+   uint32_t                  max_conns;
+} mongoc_client_async_t;
+
+
+mongoc_client_async_t *
+_mongoc_client_async_new (mongoc_client_t *client);
+
+void
+_mongoc_client_async_destroy (mongoc_client_async_t *ca);
+
+bool
+_mongoc_client_async_command (mongoc_client_t       *client,
+                              mongoc_async_t        *async,
+                              uint32_t               server_id,
+                              const char            *db_name,
+                              const bson_t          *command,
+                              mongoc_async_cmd_cb_t  cb,
+                              void                  *cb_data,
+                              int32_t                timeout_msec,
+                              bson_error_t          *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_CLIENT_ASYNC_PRIVATE_H */
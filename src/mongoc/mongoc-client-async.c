@@ -0,0 +1,531 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mongoc-async-private.h"
+#include "mongoc-client-async-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-cluster-private.h"
+#include "mongoc-error.h"
+#include "mongoc-rpc-private.h"
+#include "mongoc-stream-private.h"
+#include "mongoc-trace.h"
+#include "utlist.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "client"
+
+
+struct _mongoc_client_async_op_t
+{
+   mongoc_client_async_t            *ca;
+   mongoc_client_async_server_t     *server;
+   mongoc_stream_t                  *stream;
+   char                             *db_name;
+   bson_t                            command;
+   mongoc_async_cmd_cb_t             cb;
+   void                             *cb_data;
+   int64_t                           expire_at;
+   struct _mongoc_client_async_op_t *next;
+   struct _mongoc_client_async_op_t *prev;
+};
+
+
+static void
+_mongoc_client_async_dispatch (mongoc_client_async_t        *ca,
+                               mongoc_client_async_server_t *server);
+
+static void
+_mongoc_client_async_teardown (void *ctx);
+
+
+static void
+_mongoc_client_async_op_destroy (mongoc_client_async_op_t *op)
+{
+   mongoc_client_async_t *ca = op->ca;
+
+   if (op->stream) {
+      mongoc_stream_destroy (op->stream);
+   }
+
+   bson_destroy (&op->command);
+   bson_free (op->db_name);
+   bson_free (op);
+
+   /* unbind so the client can be driven by another executor */
+   if (--ca->nops == 0 && ca->async) {
+      _mongoc_async_remove_hook (ca->async, _mongoc_client_async_teardown, ca);
+      ca->async = NULL;
+   }
+}
+
+
+static bool
+_mongoc_client_async_server_cancel (void *item,
+                                    void *ctx)
+{
+   mongoc_client_async_server_t *server;
+   mongoc_client_async_op_t *op, *tmp;
+
+   server = (mongoc_client_async_server_t *)item;
+
+   DL_FOREACH_SAFE (server->queue, op, tmp) {
+      DL_DELETE (server->queue, op);
+      _mongoc_client_async_op_destroy (op);
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_teardown --
+ *
+ *       Hook run when the mongoc_async_t the client is bound to is
+ *       destroyed. Its commands are already freed, so every outstanding
+ *       operation is dropped without invoking its callback, and the
+ *       client is unbound so another executor can drive it.
+ *
+ * Side effects:
+ *       Connections with a command in flight are closed, since a late
+ *       reply could still arrive on them. Idle connections are kept.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_client_async_teardown (void *ctx)
+{
+   mongoc_client_async_t *ca = (mongoc_client_async_t *)ctx;
+   mongoc_client_async_op_t *op, *tmp;
+
+   /* the executor is releasing its hooks, don't remove ours */
+   ca->async = NULL;
+
+   DL_FOREACH_SAFE (ca->ops, op, tmp) {
+      DL_DELETE (ca->ops, op);
+      mongoc_stream_failed (op->stream);
+      op->stream = NULL;
+      op->server->nconns--;
+      _mongoc_client_async_op_destroy (op);
+   }
+
+   mongoc_set_for_each (ca->servers, _mongoc_client_async_server_cancel, NULL);
+
+   BSON_ASSERT (ca->nops == 0);
+}
+
+
+static void
+_mongoc_client_async_server_dtor (void *item,
+                                  void *ctx)
+{
+   mongoc_client_async_server_t *server;
+   mongoc_client_async_op_t *op, *tmp;
+   size_t i;
+
+   server = (mongoc_client_async_server_t *)item;
+
+   for (i = 0; i < server->idle.len; i++) {
+      mongoc_stream_destroy (
+         _mongoc_array_index (&server->idle, mongoc_stream_t *, i));
+   }
+
+   DL_FOREACH_SAFE (server->queue, op, tmp) {
+      DL_DELETE (server->queue, op);
+      _mongoc_client_async_op_destroy (op);
+   }
+
+   _mongoc_array_destroy (&server->idle);
+   bson_free (server);
+}
+
+
+mongoc_client_async_t *
+_mongoc_client_async_new (mongoc_client_t *client)
+{
+   mongoc_client_async_t *ca;
+   const bson_t *options;
+   bson_iter_t iter;
+
+   ca = (mongoc_client_async_t *)bson_malloc0 (sizeof *ca);
+   ca->client = client;
+   ca->servers = mongoc_set_new (8, _mongoc_client_async_server_dtor, NULL);
+   ca->max_conns = MONGOC_CLIENT_ASYNC_MAX_CONNS;
+
+   options = mongoc_uri_get_options (client->uri);
+
+   if (bson_iter_init_find_case (&iter, options, "maxpoolsize") &&
+       BSON_ITER_HOLDS_INT32 (&iter)) {
+      ca->max_conns = BSON_MAX (1, bson_iter_int32 (&iter));
+   }
+
+   return ca;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_destroy --
+ *
+ *       Close every async connection and free outstanding operations
+ *       without invoking their callbacks. The mongoc_async_t they ran
+ *       on must already be destroyed, or have no commands left.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_client_async_destroy (mongoc_client_async_t *ca)
+{
+   mongoc_client_async_op_t *op, *tmp;
+
+   if (!ca) {
+      return;
+   }
+
+   if (ca->async) {
+      _mongoc_async_remove_hook (ca->async, _mongoc_client_async_teardown, ca);
+      ca->async = NULL;
+   }
+
+   DL_FOREACH_SAFE (ca->ops, op, tmp) {
+      DL_DELETE (ca->ops, op);
+      _mongoc_client_async_op_destroy (op);
+   }
+
+   mongoc_set_destroy (ca->servers);
+   bson_free (ca);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_reply_error --
+ *
+ *       Check a command reply for "ok" 0, or for the write errors and
+ *       write concern error a write command reports with "ok" 1.
+ *
+ * Returns:
+ *       true and sets @error if @reply reports a failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_client_async_reply_error (const bson_t *reply,
+                                  bson_error_t *error)
+{
+   bson_iter_t iter;
+   bson_iter_t child;
+   uint32_t domain;
+   int32_t code = 0;
+   const char *errmsg = "Unknown error";
+
+   if (bson_iter_init_find (&iter, reply, "ok") &&
+       !bson_iter_as_bool (&iter)) {
+      _mongoc_populate_error (reply, true, error);
+      return true;
+   }
+
+   if (bson_iter_init_find (&iter, reply, "writeErrors") &&
+       BSON_ITER_HOLDS_ARRAY (&iter) &&
+       bson_iter_recurse (&iter, &child) &&
+       bson_iter_next (&child) &&
+       BSON_ITER_HOLDS_DOCUMENT (&child)) {
+      domain = MONGOC_ERROR_COMMAND;
+      bson_iter_recurse (&child, &iter);
+   } else if (bson_iter_init_find (&iter, reply, "writeConcernError") &&
+              BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      domain = MONGOC_ERROR_WRITE_CONCERN;
+      bson_iter_recurse (&iter, &child);
+      memcpy (&iter, &child, sizeof iter);
+   } else {
+      return false;
+   }
+
+   while (bson_iter_next (&iter)) {
+      if (BSON_ITER_IS_KEY (&iter, "code") && BSON_ITER_HOLDS_INT32 (&iter)) {
+         code = bson_iter_int32 (&iter);
+      } else if (BSON_ITER_IS_KEY (&iter, "errmsg") &&
+                 BSON_ITER_HOLDS_UTF8 (&iter)) {
+         errmsg = bson_iter_utf8 (&iter, NULL);
+      }
+   }
+
+   bson_set_error (error, domain, (uint32_t) code, "%s", errmsg);
+
+   return true;
+}
+
+
+static void
+_mongoc_client_async_op_done (mongoc_async_cmd_result_t  result,
+                              const bson_t              *reply,
+                              int64_t                    rtt_msec,
+                              void                      *data,
+                              bson_error_t              *error)
+{
+   mongoc_client_async_op_t *op = (mongoc_client_async_op_t *)data;
+   mongoc_client_async_t *ca = op->ca;
+   mongoc_client_async_server_t *server = op->server;
+   mongoc_async_cmd_cb_t cb = op->cb;
+   void *cb_data = op->cb_data;
+   bson_error_t cmd_error;
+
+   DL_DELETE (ca->ops, op);
+
+   if (result == MONGOC_ASYNC_CMD_SUCCESS) {
+      _mongoc_array_append_val (&server->idle, op->stream);
+      op->stream = NULL;
+
+      if (_mongoc_client_async_reply_error (reply, &cmd_error)) {
+         result = MONGOC_ASYNC_CMD_ERROR;
+         error = &cmd_error;
+      }
+   } else {
+      /* a late reply may still arrive, the connection can't be reused */
+      mongoc_stream_failed (op->stream);
+      op->stream = NULL;
+      server->nconns--;
+   }
+
+   /* finish our bookkeeping first, @cb may destroy the client */
+   _mongoc_client_async_op_destroy (op);
+   _mongoc_client_async_dispatch (ca, server);
+
+   cb (result, reply, rtt_msec, cb_data, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_op_start --
+ *
+ *       Send @op on an idle connection to its server, opening a new
+ *       connection if the server is below its limit. Otherwise @op is
+ *       queued until a connection is released.
+ *
+ * Returns:
+ *       false if a new connection could not be opened, and @error is
+ *       set. The caller still owns @op.
+ *
+ * Side effects:
+ *       Connecting and authenticating a new connection blocks.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_client_async_op_start (mongoc_client_async_op_t *op,
+                               bson_error_t             *error)
+{
+   mongoc_client_async_t *ca = op->ca;
+   mongoc_client_async_server_t *server = op->server;
+   mongoc_stream_t *io_stream;
+   int64_t timeout_msec;
+
+   ENTRY;
+
+   if (server->idle.len) {
+      op->stream = _mongoc_array_index (&server->idle, mongoc_stream_t *,
+                                        server->idle.len - 1);
+      server->idle.len--;
+   } else if (server->nconns < ca->max_conns) {
+      op->stream = mongoc_cluster_connect_server (&ca->client->cluster,
+                                                  server->server_id, error);
+      if (!op->stream) {
+         RETURN (false);
+      }
+
+      server->nconns++;
+   } else {
+      DL_APPEND (server->queue, op);
+      RETURN (true);
+   }
+
+   /* the buffered layer reads ahead, which would hide readiness from the
+    * executor. it is empty between operations, so bypass it. */
+   io_stream = op->stream;
+   if (io_stream->type == MONGOC_STREAM_BUFFERED) {
+      io_stream = mongoc_stream_get_base_stream (io_stream);
+   }
+
+   timeout_msec = (op->expire_at - bson_get_monotonic_time ()) / 1000;
+
+   DL_APPEND (ca->ops, op);
+   mongoc_async_cmd (ca->async, io_stream, NULL, NULL, op->db_name,
+                     &op->command, _mongoc_client_async_op_done, op,
+                     (int32_t) BSON_MAX (timeout_msec, 0));
+
+   RETURN (true);
+}
+
+
+static void
+_mongoc_client_async_op_fail (mongoc_client_async_op_t  *op,
+                              mongoc_async_cmd_result_t  result,
+                              bson_error_t              *error)
+{
+   mongoc_async_cmd_cb_t cb = op->cb;
+   void *cb_data = op->cb_data;
+
+   _mongoc_client_async_op_destroy (op);
+   cb (result, NULL, 0, cb_data, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_dispatch --
+ *
+ *       Start queued operations for @server while it has capacity.
+ *       Operations whose deadline passed while queued fail with
+ *       MONGOC_ASYNC_CMD_TIMEOUT.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_client_async_dispatch (mongoc_client_async_t        *ca,
+                               mongoc_client_async_server_t *server)
+{
+   mongoc_client_async_op_t *op;
+   bson_error_t error;
+
+   while (server->queue &&
+          (server->idle.len || server->nconns < ca->max_conns)) {
+      op = server->queue;
+      DL_DELETE (server->queue, op);
+
+      if (bson_get_monotonic_time () >= op->expire_at) {
+         bson_set_error (&error,
+                         MONGOC_ERROR_STREAM,
+                         MONGOC_ERROR_STREAM_SOCKET,
+                         "Timed out waiting for a connection.");
+         _mongoc_client_async_op_fail (op, MONGOC_ASYNC_CMD_TIMEOUT, &error);
+      } else if (!_mongoc_client_async_op_start (op, &error)) {
+         _mongoc_client_async_op_fail (op, MONGOC_ASYNC_CMD_ERROR, &error);
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_async_command --
+ *
+ *       Run @command on @server_id without waiting for the reply. The
+ *       command is sent on a connection reserved for async operations,
+ *       never on the cluster's own stream, so it can't interleave with
+ *       blocking operations on @client. @cb is invoked from
+ *       mongoc_async_run() once the reply arrives; a reply with "ok" 0
+ *       or a write error is reported as MONGOC_ASYNC_CMD_ERROR.
+ *
+ *       All operations outstanding on a client must use the same
+ *       mongoc_async_t. Destroying it cancels them, and the client may
+ *       then be used with another.
+ *
+ * Returns:
+ *       true if the command was sent or queued, otherwise false and
+ *       @error is set. @cb is only invoked if true is returned.
+ *
+ * Side effects:
+ *       May block to open and authenticate a new connection.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_client_async_command (mongoc_client_t       *client,
+                              mongoc_async_t        *async,
+                              uint32_t               server_id,
+                              const char            *db_name,
+                              const bson_t          *command,
+                              mongoc_async_cmd_cb_t  cb,
+                              void                  *cb_data,
+                              int32_t                timeout_msec,
+                              bson_error_t          *error)
+{
+   mongoc_client_async_t *ca;
+   mongoc_client_async_server_t *server;
+   mongoc_client_async_op_t *op;
+
+   ENTRY;
+
+   BSON_ASSERT (client);
+   BSON_ASSERT (async);
+   BSON_ASSERT (db_name);
+   BSON_ASSERT (command);
+   BSON_ASSERT (cb);
+
+   if (!client->async) {
+      client->async = _mongoc_client_async_new (client);
+   }
+
+   ca = client->async;
+
+   if (ca->async && ca->async != async) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "Client has operations outstanding on another "
+                      "mongoc_async_t.");
+      RETURN (false);
+   }
+
+   if (!(server = (mongoc_client_async_server_t *)mongoc_set_get (
+            ca->servers, server_id))) {
+      server = (mongoc_client_async_server_t *)bson_malloc0 (sizeof *server);
+      server->server_id = server_id;
+      _mongoc_array_init (&server->idle, sizeof (mongoc_stream_t *));
+      mongoc_set_add (ca->servers, server_id, server);
+   }
+
+   if (timeout_msec < 0) {
+      timeout_msec = (int32_t) client->cluster.sockettimeoutms;
+   }
+
+   op = (mongoc_client_async_op_t *)bson_malloc0 (sizeof *op);
+   op->ca = ca;
+   op->server = server;
+   op->db_name = bson_strdup (db_name);
+   bson_copy_to (command, &op->command);
+   op->cb = cb;
+   op->cb_data = cb_data;
+   op->expire_at = bson_get_monotonic_time () + (int64_t) timeout_msec * 1000;
+
+   if (!ca->async) {
+      _mongoc_async_add_hook (async, _mongoc_client_async_teardown, ca);
+      ca->async = async;
+   }
+
+   ca->nops++;
+
+   if (!_mongoc_client_async_op_start (op, error)) {
+      _mongoc_client_async_op_destroy (op);
+      RETURN (false);
+   }
+
+   RETURN (true);
+}
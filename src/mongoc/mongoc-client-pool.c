@@ -15,6 +15,7 @@
  */
 
 
+#include "mongoc-array-private.h"
 #include "mongoc-counters-private.h"
 #include "mongoc-client-pool-private.h"
 #include "mongoc-client-pool.h"
@@ -25,16 +26,51 @@
 #include "mongoc-trace.h"
 
 
+#ifndef MONGOC_CLIENT_POOL_MAX_SHARDS
+# define MONGOC_CLIENT_POOL_MAX_SHARDS 16
+#endif
+
+
+/* how often warm-up checks for discovered servers before it connects */
+#define MONGOC_CLIENT_POOL_WARM_UP_RETRY_MS 500
+
+
+/*
+ * Idle clients are kept in several small free lists, each with its own
+ * mutex, so that threads checking clients in and out rarely touch the
+ * same lock. pool->mutex and pool->cond are only used to create and
+ * destroy clients and to block when the pool is exhausted. n_idle is
+ * updated under the shard's mutex, and read atomically to skip empty
+ * shards without locking them.
+ */
+typedef struct
+{
+   mongoc_mutex_t     mutex;
+   mongoc_queue_t     queue;
+   volatile int32_t   n_idle;
+} mongoc_client_pool_shard_t;
+
+
 struct _mongoc_client_pool_t
 {
    mongoc_mutex_t     mutex;
    mongoc_cond_t      cond;
-   mongoc_queue_t     queue;
+   mongoc_client_pool_shard_t *shards;
+   uint32_t           n_shards;
+   volatile int32_t   next_shard;
+   volatile int32_t   n_waiters;
    mongoc_topology_t *topology;
    mongoc_uri_t      *uri;
    uint32_t           min_pool_size;
    uint32_t           max_pool_size;
-   uint32_t           size;
+   volatile int32_t   size;
+   mongoc_thread_t    warm_up_thread;
+   mongoc_cond_t      warm_up_cond;
+   bool               warm_up_started;
+   bool               warm_up_shutdown;
+   bool               apm_callbacks_set;
+   mongoc_apm_callbacks_t apm_callbacks;
+   void              *apm_context;
 #ifdef MONGOC_ENABLE_SSL
    bool               ssl_opts_set;
    mongoc_ssl_opt_t   ssl_opts;
@@ -42,6 +78,314 @@ struct _mongoc_client_pool_t
 };
 
 
+static BSON_INLINE uint32_t
+_mongoc_client_pool_shard_hint (mongoc_client_pool_t *pool)
+{
+#if defined(ENABLE_RDTSCP) || defined(HAVE_SCHED_GETCPU)
+   return (uint32_t) _mongoc_sched_getcpu () % pool->n_shards;
+#else
+   return (uint32_t) bson_atomic_int_add (&pool->next_shard, 1) %
+          pool->n_shards;
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_pool_take_idle --
+ *
+ *       Take an idle client from the free lists, starting with the
+ *       shard for the calling thread's CPU.
+ *
+ * Returns:
+ *       An idle client, or NULL if there are none.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_client_t *
+_mongoc_client_pool_take_idle (mongoc_client_pool_t *pool)
+{
+   mongoc_client_pool_shard_t *shard;
+   mongoc_client_t *client;
+   uint32_t hint;
+   uint32_t i;
+
+   hint = _mongoc_client_pool_shard_hint (pool);
+
+   for (i = 0; i < pool->n_shards; i++) {
+      shard = &pool->shards[(hint + i) % pool->n_shards];
+
+      /* don't bother locking an empty shard */
+      if (!bson_atomic_int_add (&shard->n_idle, 0)) {
+         continue;
+      }
+
+      mongoc_mutex_lock (&shard->mutex);
+      client = (mongoc_client_t *)_mongoc_queue_pop_head (&shard->queue);
+      if (client) {
+         bson_atomic_int_add (&shard->n_idle, -1);
+      }
+      mongoc_mutex_unlock (&shard->mutex);
+
+      if (client) {
+         return client;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_pool_put_idle --
+ *
+ *       Add @client to the free list for the calling thread's CPU and
+ *       wake a thread blocked in mongoc_client_pool_pop, if any.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_client_pool_put_idle (mongoc_client_pool_t *pool,
+                              mongoc_client_t      *client)
+{
+   mongoc_client_pool_shard_t *shard;
+
+   shard = &pool->shards[_mongoc_client_pool_shard_hint (pool)];
+
+   mongoc_mutex_lock (&shard->mutex);
+   _mongoc_queue_push_tail (&shard->queue, client);
+   bson_atomic_int_add (&shard->n_idle, 1);
+   mongoc_mutex_unlock (&shard->mutex);
+
+   /* a waiter increments n_waiters before its last look at the shards */
+   bson_memory_barrier ();
+
+   if (pool->n_waiters) {
+      mongoc_mutex_lock (&pool->mutex);
+      mongoc_cond_signal (&pool->cond);
+      mongoc_mutex_unlock (&pool->mutex);
+   }
+}
+
+
+/* call with pool->mutex held */
+static mongoc_client_t *
+_mongoc_client_pool_create_client (mongoc_client_pool_t *pool)
+{
+   mongoc_client_t *client;
+
+   if ((uint32_t) pool->size >= pool->max_pool_size) {
+      return NULL;
+   }
+
+   client = _mongoc_client_new_from_uri (pool->uri, pool->topology);
+   if (pool->apm_callbacks_set) {
+      mongoc_client_set_apm_callbacks (client, &pool->apm_callbacks,
+                                       pool->apm_context);
+   }
+#ifdef MONGOC_ENABLE_SSL
+   if (pool->ssl_opts_set) {
+      mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
+   }
+#endif
+   bson_atomic_int_add (&pool->size, 1);
+
+   return client;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_pool_connect --
+ *
+ *       Open and authenticate @client's connections to each server in
+ *       @server_ids, so that its first operations don't have to. Each
+ *       connection, handshake included, is bounded by connectTimeoutMS
+ *       rather than socketTimeoutMS, and pool destruction is checked
+ *       before each one, so mongoc_client_pool_destroy() waits for at
+ *       most one connection attempt.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_client_pool_connect (mongoc_client_pool_t *pool,
+                             mongoc_client_t      *client,
+                             const mongoc_array_t *server_ids)
+{
+   mongoc_server_stream_t *server_stream;
+   bson_error_t error;
+   uint32_t sockettimeoutms;
+   bool shutdown;
+   uint32_t id;
+   size_t i;
+
+   sockettimeoutms = client->cluster.sockettimeoutms;
+   client->cluster.sockettimeoutms =
+      (uint32_t) pool->topology->connect_timeout_msec;
+
+   for (i = 0; i < server_ids->len; i++) {
+      mongoc_mutex_lock (&pool->mutex);
+      shutdown = pool->warm_up_shutdown;
+      mongoc_mutex_unlock (&pool->mutex);
+
+      if (shutdown) {
+         break;
+      }
+
+      id = _mongoc_array_index (server_ids, uint32_t, i);
+      server_stream = mongoc_cluster_stream_for_server (&client->cluster, id,
+                                                        true, &error);
+      if (server_stream) {
+         mongoc_server_stream_cleanup (server_stream);
+      } else {
+         MONGOC_WARNING ("Pool warm-up could not connect: %s", error.message);
+      }
+   }
+
+   client->cluster.sockettimeoutms = sockettimeoutms;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_client_pool_warm_up --
+ *
+ *       The warm-up thread: whenever the pool has fewer than
+ *       min_pool_size clients, create clients connected to the servers
+ *       discovered so far and add them to the free lists. Waits, rather
+ *       than connecting, until a server has been discovered.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void *
+_mongoc_client_pool_warm_up (void *data)
+{
+   mongoc_client_pool_t *pool = (mongoc_client_pool_t *)data;
+   mongoc_client_t *client;
+   mongoc_array_t server_ids;
+   int64_t wait_msec;
+
+   _mongoc_array_init (&server_ids, sizeof (uint32_t));
+
+   mongoc_mutex_lock (&pool->mutex);
+
+   while (!pool->warm_up_shutdown) {
+      wait_msec = pool->topology->heartbeat_msec;
+
+      if ((uint32_t) pool->size < pool->min_pool_size) {
+         _mongoc_array_clear (&server_ids);
+         mongoc_topology_get_data_server_ids (pool->topology, &server_ids);
+
+         if (!server_ids.len) {
+            wait_msec = MONGOC_CLIENT_POOL_WARM_UP_RETRY_MS;
+         } else if ((client = _mongoc_client_pool_create_client (pool))) {
+            mongoc_mutex_unlock (&pool->mutex);
+            _mongoc_client_pool_connect (pool, client, &server_ids);
+            _mongoc_client_pool_put_idle (pool, client);
+            mongoc_mutex_lock (&pool->mutex);
+            continue;
+         }
+      }
+
+      mongoc_cond_timedwait (&pool->warm_up_cond, &pool->mutex, wait_msec);
+   }
+
+   mongoc_mutex_unlock (&pool->mutex);
+
+   _mongoc_array_destroy (&server_ids);
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_client_pool_warm_up --
+ *
+ *       Start a thread that creates min_pool_size clients in the
+ *       background, opens and authenticates their connections to the
+ *       discovered servers, and tops the pool up again if min_pool_size
+ *       is raised. Call it once @pool is configured: clients created
+ *       before mongoc_client_pool_set_ssl_opts() or
+ *       mongoc_client_pool_set_apm_callbacks() don't get those options.
+ *
+ *       Does nothing if it was already called.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_client_pool_warm_up (mongoc_client_pool_t *pool)
+{
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+
+   if (!pool->warm_up_started) {
+      pool->warm_up_started = true;
+      mongoc_thread_create (&pool->warm_up_thread,
+                            _mongoc_client_pool_warm_up, pool);
+   }
+
+   mongoc_mutex_unlock (&pool->mutex);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_client_pool_set_apm_callbacks --
+ *
+ *       Set the command monitoring callbacks for clients created by
+ *       @pool from now on. Call it before popping the first client:
+ *       clients that already exist are not changed. The callbacks are
+ *       called from whichever thread is using the client.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_client_pool_set_apm_callbacks (mongoc_client_pool_t         *pool,
+                                      const mongoc_apm_callbacks_t *callbacks,
+                                      void                         *context)
+{
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+
+   if (pool->size) {
+      MONGOC_WARNING ("Setting apm callbacks after clients were created, "
+                      "they will only apply to new clients.");
+   }
+
+   memset (&pool->apm_callbacks, 0, sizeof pool->apm_callbacks);
+   pool->apm_callbacks_set = false;
+
+   if (callbacks) {
+      memcpy (&pool->apm_callbacks, callbacks, sizeof pool->apm_callbacks);
+      pool->apm_callbacks_set = true;
+   }
+
+   pool->apm_context = context;
+
+   mongoc_mutex_unlock (&pool->mutex);
+}
+
+
 #ifdef MONGOC_ENABLE_SSL
 void
 mongoc_client_pool_set_ssl_opts (mongoc_client_pool_t   *pool,
@@ -64,6 +408,42 @@ mongoc_client_pool_set_ssl_opts (mongoc_client_pool_t   *pool,
 
    mongoc_mutex_unlock (&pool->mutex);
 }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_client_pool_reload_ssl_certs --
+ *
+ *       Read the PEM, CA and CRL files named by the pool's SSL options
+ *       again, e.g. after a certificate was rotated on disk. Connections
+ *       opened from now on use the new certificates; open connections
+ *       are not affected.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set. The
+ *       previous certificates stay in use if loading fails.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_client_pool_reload_ssl_certs (mongoc_client_pool_t *pool,
+                                     bson_error_t         *error)
+{
+   bool ret;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+
+   mongoc_mutex_lock (&pool->mutex);
+   ret = mongoc_topology_scanner_reload_ssl_ctx (pool->topology->scanner,
+                                                 error);
+   mongoc_mutex_unlock (&pool->mutex);
+
+   RETURN (ret);
+}
 #endif
 
 
@@ -74,6 +454,7 @@ mongoc_client_pool_new (const mongoc_uri_t *uri)
    mongoc_client_pool_t *pool;
    const bson_t *b;
    bson_iter_t iter;
+   uint32_t i;
 
    ENTRY;
 
@@ -89,7 +470,18 @@ mongoc_client_pool_new (const mongoc_uri_t *uri)
 
    pool = (mongoc_client_pool_t *)bson_malloc0(sizeof *pool);
    mongoc_mutex_init(&pool->mutex);
-   _mongoc_queue_init(&pool->queue);
+   mongoc_cond_init(&pool->cond);
+   mongoc_cond_init(&pool->warm_up_cond);
+
+   pool->n_shards = BSON_MIN (BSON_MAX (1, _mongoc_get_cpu_count ()),
+                              MONGOC_CLIENT_POOL_MAX_SHARDS);
+   pool->shards = (mongoc_client_pool_shard_t *)bson_malloc0 (
+      pool->n_shards * sizeof *pool->shards);
+   for (i = 0; i < pool->n_shards; i++) {
+      mongoc_mutex_init (&pool->shards[i].mutex);
+      _mongoc_queue_init (&pool->shards[i].queue);
+   }
+
    pool->uri = mongoc_uri_copy(uri);
    pool->min_pool_size = 0;
    pool->max_pool_size = 100;
@@ -122,20 +514,37 @@ void
 mongoc_client_pool_destroy (mongoc_client_pool_t *pool)
 {
    mongoc_client_t *client;
+   uint32_t i;
 
    ENTRY;
 
    BSON_ASSERT (pool);
 
-   while ((client = (mongoc_client_t *)_mongoc_queue_pop_head(&pool->queue))) {
-      mongoc_client_destroy(client);
+   mongoc_mutex_lock (&pool->mutex);
+   pool->warm_up_shutdown = true;
+   mongoc_cond_signal (&pool->warm_up_cond);
+   mongoc_mutex_unlock (&pool->mutex);
+
+   if (pool->warm_up_started) {
+      mongoc_thread_join (pool->warm_up_thread);
+   }
+
+   for (i = 0; i < pool->n_shards; i++) {
+      while ((client = (mongoc_client_t *)_mongoc_queue_pop_head (
+                 &pool->shards[i].queue))) {
+         mongoc_client_destroy (client);
+      }
+      mongoc_mutex_destroy (&pool->shards[i].mutex);
    }
 
+   bson_free (pool->shards);
+
    mongoc_topology_destroy (pool->topology);
 
    mongoc_uri_destroy(pool->uri);
    mongoc_mutex_destroy(&pool->mutex);
    mongoc_cond_destroy(&pool->cond);
+   mongoc_cond_destroy(&pool->warm_up_cond);
    bson_free(pool);
 
    mongoc_counter_client_pools_active_dec();
@@ -149,31 +558,37 @@ mongoc_client_t *
 mongoc_client_pool_pop (mongoc_client_pool_t *pool)
 {
    mongoc_client_t *client;
+   int64_t started;
 
    ENTRY;
 
    BSON_ASSERT (pool);
 
+   started = bson_get_monotonic_time ();
+
+   if ((client = _mongoc_client_pool_take_idle (pool))) {
+      mongoc_histogram_client_pool_pop_record (
+         bson_get_monotonic_time () - started);
+      RETURN (client);
+   }
+
    mongoc_mutex_lock(&pool->mutex);
+   bson_atomic_int_add (&pool->n_waiters, 1);
 
 again:
-   if (!(client = (mongoc_client_t *)_mongoc_queue_pop_head(&pool->queue))) {
-      if (pool->size < pool->max_pool_size) {
-         client = _mongoc_client_new_from_uri(pool->uri, pool->topology);
-#ifdef MONGOC_ENABLE_SSL
-         if (pool->ssl_opts_set) {
-            mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
-         }
-#endif
-         pool->size++;
-      } else {
+   if (!(client = _mongoc_client_pool_take_idle (pool))) {
+      if (!(client = _mongoc_client_pool_create_client (pool))) {
          mongoc_cond_wait(&pool->cond, &pool->mutex);
          GOTO(again);
       }
    }
 
+   bson_atomic_int_add (&pool->n_waiters, -1);
    mongoc_mutex_unlock(&pool->mutex);
 
+   mongoc_histogram_client_pool_pop_record (
+      bson_get_monotonic_time () - started);
+
    RETURN(client);
 }
 
@@ -187,20 +602,14 @@ mongoc_client_pool_try_pop (mongoc_client_pool_t *pool)
 
    BSON_ASSERT (pool);
 
-   mongoc_mutex_lock(&pool->mutex);
-
-   if (!(client = (mongoc_client_t *)_mongoc_queue_pop_head(&pool->queue))) {
-      if (pool->size < pool->max_pool_size) {
-         client = _mongoc_client_new_from_uri(pool->uri, pool->topology);
-#ifdef MONGOC_ENABLE_SSL
-         if (pool->ssl_opts_set) {
-            mongoc_client_set_ssl_opts (client, &pool->ssl_opts);
-         }
-#endif
-         pool->size++;
-      }
+   if ((client = _mongoc_client_pool_take_idle (pool))) {
+      RETURN (client);
    }
 
+   mongoc_mutex_lock(&pool->mutex);
+   if (!(client = _mongoc_client_pool_take_idle (pool))) {
+      client = _mongoc_client_pool_create_client (pool);
+   }
    mongoc_mutex_unlock(&pool->mutex);
 
    RETURN(client);
@@ -211,27 +620,27 @@ void
 mongoc_client_pool_push (mongoc_client_pool_t *pool,
                          mongoc_client_t      *client)
 {
+   mongoc_client_t *old_client = NULL;
+
    ENTRY;
 
    BSON_ASSERT (pool);
    BSON_ASSERT (client);
 
-   mongoc_mutex_lock(&pool->mutex);
-   if (pool->size > pool->min_pool_size) {
-      mongoc_client_t *old_client;
-      old_client = (mongoc_client_t *)_mongoc_queue_pop_head (&pool->queue);
-      if (old_client) {
-          mongoc_client_destroy (old_client);
-          pool->size--;
-      }
+   /* check and shrink the size together, so that two threads can't both
+    * trim the pool below min_pool_size */
+   mongoc_mutex_lock (&pool->mutex);
+   if ((uint32_t) pool->size > pool->min_pool_size &&
+       (old_client = _mongoc_client_pool_take_idle (pool))) {
+      bson_atomic_int_add (&pool->size, -1);
    }
-   mongoc_mutex_unlock(&pool->mutex);
+   mongoc_mutex_unlock (&pool->mutex);
 
-   mongoc_mutex_lock (&pool->mutex);
-   _mongoc_queue_push_tail (&pool->queue, client);
+   if (old_client) {
+      mongoc_client_destroy (old_client);
+   }
 
-   mongoc_cond_signal(&pool->cond);
-   mongoc_mutex_unlock(&pool->mutex);
+   _mongoc_client_pool_put_idle (pool, client);
 
    EXIT;
 }
@@ -271,6 +680,8 @@ mongoc_client_pool_min_size(mongoc_client_pool_t *pool,
 
    mongoc_mutex_lock (&pool->mutex);
    pool->min_pool_size = min_pool_size;
+   /* top up now, if warming up */
+   mongoc_cond_signal (&pool->warm_up_cond);
    mongoc_mutex_unlock (&pool->mutex);
 
    EXIT;
@@ -47,9 +47,15 @@ void                  mongoc_client_pool_max_size(mongoc_client_pool_t *pool,
                                                   uint32_t              max_pool_size);
 void                  mongoc_client_pool_min_size(mongoc_client_pool_t *pool,
                                                   uint32_t              min_pool_size);
+void                  mongoc_client_pool_warm_up (mongoc_client_pool_t *pool);
+void                  mongoc_client_pool_set_apm_callbacks (mongoc_client_pool_t         *pool,
+                                                            const mongoc_apm_callbacks_t *callbacks,
+                                                            void                         *context);
 #ifdef MONGOC_ENABLE_SSL
 void                  mongoc_client_pool_set_ssl_opts (mongoc_client_pool_t   *pool,
                                                        const mongoc_ssl_opt_t *opts);
+bool                  mongoc_client_pool_reload_ssl_certs (mongoc_client_pool_t *pool,
+                                                           bson_error_t         *error);
 #endif
 
 
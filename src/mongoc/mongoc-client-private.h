@@ -23,8 +23,10 @@
 
 #include <bson.h>
 
+#include "mongoc-apm-private.h"
 #include "mongoc-buffer-private.h"
 #include "mongoc-client.h"
+#include "mongoc-client-async-private.h"
 #include "mongoc-cluster-private.h"
 #include "mongoc-config.h"
 #include "mongoc-host-list.h"
@@ -59,6 +61,8 @@ BSON_BEGIN_DECLS
 #define WIRE_VERSION_FAM_WRITE_CONCERN 4
 /* first version to support readConcern */
 #define WIRE_VERSION_READ_CONCERN 4
+/* first version with the $sample aggregation stage and $type aliases */
+#define WIRE_VERSION_SAMPLE 4
 
 
 struct _mongoc_client_t
@@ -83,6 +87,13 @@ struct _mongoc_client_t
    mongoc_read_prefs_t       *read_prefs;
    mongoc_read_concern_t     *read_concern;
    mongoc_write_concern_t    *write_concern;
+
+   mongoc_client_async_t     *async;
+
+   /* apm_enabled is the only thing checked on the fast path */
+   bool                       apm_enabled;
+   mongoc_apm_callbacks_t     apm_callbacks;
+   void                      *apm_context;
 };
 
 
@@ -106,6 +117,7 @@ _mongoc_client_recv (mongoc_client_t        *client,
                      mongoc_rpc_t           *rpc,
                      mongoc_buffer_t        *buffer,
                      mongoc_server_stream_t *server_stream,
+                     int32_t                 request_id,
                      bson_error_t           *error);
 
 bool
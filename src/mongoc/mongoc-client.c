@@ -22,6 +22,7 @@
 #endif
 
 #include "mongoc-cursor-array-private.h"
+#include "mongoc-client-async-private.h"
 #include "mongoc-client-private.h"
 #include "mongoc-collection-private.h"
 #include "mongoc-config.h"
@@ -326,8 +327,8 @@ mongoc_client_default_stream_initiator (const mongoc_uri_t       *uri,
 
       if (client->use_ssl ||
           (mechanism && (0 == strcmp (mechanism, "MONGODB-X509")))) {
-         base_stream = mongoc_stream_tls_new (base_stream, &client->ssl_opts,
-                                              true);
+         base_stream = mongoc_topology_scanner_tls_stream_new (
+            client->topology->scanner, base_stream, &client->ssl_opts, host);
 
          if (!base_stream) {
             bson_set_error (error,
@@ -397,7 +398,8 @@ _mongoc_client_create_stream (mongoc_client_t          *client,
  *
  * _mongoc_client_recv --
  *
- *       Receives a RPC from a remote MongoDB cluster node.
+ *       Receives the reply to @request_id from a remote MongoDB cluster
+ *       node. Other requests may be outstanding on the same stream.
  *
  * Returns:
  *       true if successful; otherwise false and @error is set.
@@ -413,6 +415,7 @@ _mongoc_client_recv (mongoc_client_t        *client,
                      mongoc_rpc_t           *rpc,
                      mongoc_buffer_t        *buffer,
                      mongoc_server_stream_t *server_stream,
+                     int32_t                 request_id,
                      bson_error_t           *error)
 {
    BSON_ASSERT (client);
@@ -420,8 +423,8 @@ _mongoc_client_recv (mongoc_client_t        *client,
    BSON_ASSERT (buffer);
    BSON_ASSERT (server_stream);
 
-   if (!mongoc_cluster_try_recv (&client->cluster, rpc, buffer,
-                                 server_stream, error)) {
+   if (!mongoc_cluster_try_recv_reply (&client->cluster, rpc, buffer,
+                                       server_stream, request_id, error)) {
       mongoc_topology_invalidate_server (client->topology,
                                          server_stream->sd->id);
       return false;
@@ -540,8 +543,12 @@ _mongoc_client_recv_gle (mongoc_client_t        *client,
 
    _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
 
-   if (!mongoc_cluster_try_recv (&client->cluster, &rpc, &buffer,
-                                 server_stream, error)) {
+   /* the getlasterror is the last request mongoc_cluster_sendv_to_server
+    * numbered */
+   if (!mongoc_cluster_try_recv_reply (&client->cluster, &rpc, &buffer,
+                                       server_stream,
+                                       (int32_t) client->cluster.request_id,
+                                       error)) {
 
       mongoc_topology_invalidate_server (client->topology,
                                          server_stream->sd->id);
@@ -796,6 +803,7 @@ mongoc_client_destroy (mongoc_client_t *client)
       mongoc_write_concern_destroy (client->write_concern);
       mongoc_read_concern_destroy (client->read_concern);
       mongoc_read_prefs_destroy (client->read_prefs);
+      _mongoc_client_async_destroy (client->async);
       mongoc_cluster_destroy (&client->cluster);
       mongoc_uri_destroy (client->uri);
       bson_free (client);
@@ -1243,10 +1251,9 @@ mongoc_client_command_simple (mongoc_client_t           *client,
    apply_read_preferences (read_prefs, server_stream, command,
                            MONGOC_QUERY_NONE, &result);
 
-   ret = mongoc_cluster_run_command (cluster, server_stream->stream,
-                                     result.flags, db_name,
-                                     result.query_with_read_prefs,
-                                     reply, error);
+   ret = mongoc_cluster_run_command_server_stream (
+      cluster, server_stream, result.flags, db_name,
+      result.query_with_read_prefs, reply, error);
 
 done:
    mongoc_server_stream_cleanup (server_stream);
@@ -1332,9 +1339,9 @@ _mongoc_client_killcursors_command (mongoc_cluster_t       *cluster,
    /* Find, getMore And killCursors Commands Spec: "The result from the
     * killCursors command MAY be safely ignored."
     */
-   mongoc_cluster_run_command (cluster, server_stream->stream,
-                               MONGOC_QUERY_SLAVE_OK, db, &command,
-                               NULL, NULL);
+   mongoc_cluster_run_command_server_stream (cluster, server_stream,
+                                             MONGOC_QUERY_SLAVE_OK, db,
+                                             &command, NULL, NULL);
 
    bson_destroy (&command);
 }
@@ -1500,6 +1507,41 @@ mongoc_client_get_server_status (mongoc_client_t     *client,     /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_client_set_apm_callbacks --
+ *
+ *       Set the command monitoring callbacks for @client, replacing any
+ *       set before. @callbacks is copied, and may be NULL to stop
+ *       monitoring. @context is passed to the callbacks with each event.
+ *
+ *       Commands sent to authenticate and to check servers are not
+ *       monitored.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_client_set_apm_callbacks (mongoc_client_t              *client,
+                                 const mongoc_apm_callbacks_t *callbacks,
+                                 void                         *context)
+{
+   BSON_ASSERT (client);
+
+   if (callbacks) {
+      memcpy (&client->apm_callbacks, callbacks, sizeof *callbacks);
+   } else {
+      memset (&client->apm_callbacks, 0, sizeof client->apm_callbacks);
+   }
+
+   client->apm_context = context;
+   client->apm_enabled = (client->apm_callbacks.started ||
+                          client->apm_callbacks.succeeded ||
+                          client->apm_callbacks.failed);
+}
+
+
 void
 mongoc_client_set_stream_initiator (mongoc_client_t           *client,
                                     mongoc_stream_initiator_t  initiator,
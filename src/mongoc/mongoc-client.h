@@ -23,6 +23,7 @@
 
 #include <bson.h>
 
+#include "mongoc-apm.h"
 #include "mongoc-collection.h"
 #include "mongoc-config.h"
 #include "mongoc-cursor.h"
@@ -147,6 +148,9 @@ void                           mongoc_client_set_read_concern     (mongoc_client
 const mongoc_read_prefs_t     *mongoc_client_get_read_prefs       (const mongoc_client_t        *client);
 void                           mongoc_client_set_read_prefs       (mongoc_client_t              *client,
                                                                    const mongoc_read_prefs_t    *read_prefs);
+void                           mongoc_client_set_apm_callbacks    (mongoc_client_t              *client,
+                                                                   const mongoc_apm_callbacks_t *callbacks,
+                                                                   void                         *context);
 #ifdef MONGOC_ENABLE_SSL
 void                           mongoc_client_set_ssl_opts         (mongoc_client_t              *client,
                                                                    const mongoc_ssl_opt_t       *opts);
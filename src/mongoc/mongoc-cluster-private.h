@@ -27,6 +27,7 @@
 #include "mongoc-buffer-private.h"
 #include "mongoc-config.h"
 #include "mongoc-client.h"
+#include "mongoc-counters-private.h"
 #include "mongoc-list-private.h"
 #include "mongoc-opcode.h"
 #include "mongoc-read-prefs.h"
@@ -45,6 +46,7 @@ BSON_BEGIN_DECLS
 typedef struct _mongoc_cluster_node_t
 {
    mongoc_stream_t *stream;
+   uint32_t         generation;  /* distinguishes reconnects to the node */
 
    int32_t          max_wire_version;
    int32_t          min_wire_version;
@@ -55,11 +57,43 @@ typedef struct _mongoc_cluster_node_t
    int64_t          timestamp;
 } mongoc_cluster_node_t;
 
+/* At most this many replies are kept per stream; see
+ * _mongoc_cluster_stash_reply. */
+#define MONGOC_CLUSTER_MAX_STASHED_REPLIES 64
+
+/* A reply read off a stream while waiting for a different request's reply.
+ * It is kept until the caller that sent the request asks for it. If
+ * @data is NULL the caller gave up waiting, and the reply is discarded
+ * when it arrives. */
+typedef struct _mongoc_cluster_reply_t
+{
+   mongoc_stream_t *stream;
+   int32_t          response_to;
+   uint8_t         *data;
+   size_t           len;
+} mongoc_cluster_reply_t;
+
+/* When a request was sent, and the histogram its round trip is recorded in
+ * once the reply arrives. If command monitoring is enabled, also what the
+ * command succeeded or failed events need. */
+typedef struct _mongoc_cluster_timing_t
+{
+   int32_t             request_id;
+   int64_t             started;
+   mongoc_histogram_t *histogram;
+   uint32_t            server_id;
+   bool                monitored;
+   bool                is_command;
+   char                command_name[32];
+} mongoc_cluster_timing_t;
+
 typedef struct _mongoc_cluster_t
 {
    uint32_t         request_id;
+   uint32_t         generation;
    uint32_t         sockettimeoutms;
    uint32_t         socketcheckintervalms;
+   int32_t          zlib_compression_level;
    mongoc_uri_t    *uri;
    unsigned         requires_auth : 1;
 
@@ -67,6 +101,9 @@ typedef struct _mongoc_cluster_t
 
    mongoc_set_t    *nodes;
    mongoc_array_t   iov;
+   mongoc_array_t   compressed;
+   mongoc_array_t   replies;
+   mongoc_array_t   timings;  /* of mongoc_cluster_timing_t */
 } mongoc_cluster_t;
 
 void
@@ -110,6 +147,14 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                          mongoc_server_stream_t *server_stream,
                          bson_error_t           *error);
 
+bool
+mongoc_cluster_try_recv_reply (mongoc_cluster_t       *cluster,
+                               mongoc_rpc_t           *rpc,
+                               mongoc_buffer_t        *buffer,
+                               mongoc_server_stream_t *server_stream,
+                               int32_t                 request_id,
+                               bson_error_t           *error);
+
 mongoc_server_stream_t *
 mongoc_cluster_stream_for_reads (mongoc_cluster_t *cluster,
                                  const mongoc_read_prefs_t *read_prefs,
@@ -119,6 +164,11 @@ mongoc_server_stream_t *
 mongoc_cluster_stream_for_writes (mongoc_cluster_t *cluster,
                                   bson_error_t *error);
 
+mongoc_stream_t *
+mongoc_cluster_connect_server (mongoc_cluster_t *cluster,
+                               uint32_t          server_id,
+                               bson_error_t     *error);
+
 mongoc_server_stream_t *
 mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
                                   uint32_t server_id,
@@ -126,13 +176,15 @@ mongoc_cluster_stream_for_server (mongoc_cluster_t *cluster,
                                   bson_error_t *error);
 
 bool
-mongoc_cluster_run_command_rpc (mongoc_cluster_t *cluster,
-                                mongoc_stream_t  *stream,
-                                const char       *command_name,
-                                mongoc_rpc_t     *rpc,
-                                mongoc_rpc_t     *reply_rpc,
-                                mongoc_buffer_t  *buffer,
-                                bson_error_t     *error);
+mongoc_cluster_run_command_rpc (mongoc_cluster_t       *cluster,
+                                mongoc_stream_t        *stream,
+                                mongoc_server_stream_t *server_stream,
+                                int32_t                 compressor_id,
+                                const char             *command_name,
+                                mongoc_rpc_t           *rpc,
+                                mongoc_rpc_t           *reply_rpc,
+                                mongoc_buffer_t        *buffer,
+                                bson_error_t           *error);
 
 bool
 mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
@@ -143,6 +195,15 @@ mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
                             bson_t              *reply,
                             bson_error_t        *error);
 
+bool
+mongoc_cluster_run_command_server_stream (mongoc_cluster_t       *cluster,
+                                          mongoc_server_stream_t *server_stream,
+                                          mongoc_query_flags_t    flags,
+                                          const char             *db_name,
+                                          const bson_t           *command,
+                                          bson_t                 *reply,
+                                          bson_error_t           *error);
+
 
 BSON_END_DECLS
 
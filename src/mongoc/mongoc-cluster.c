@@ -26,6 +26,7 @@
 #include "mongoc-cluster-private.h"
 #include "mongoc-client-private.h"
 #include "mongoc-counters-private.h"
+#include "mongoc-compression-private.h"
 #include "mongoc-config.h"
 #include "mongoc-error.h"
 #include "mongoc-host-list-private.h"
@@ -100,6 +101,952 @@ _bson_error_message_printf (bson_error_t *error,
    }
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_rpc_doc --
+ *
+ *       Static-init @doc from the BSON at @data, which is in an rpc that
+ *       may not be swabbed to host byte order yet.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_rpc_doc (const uint8_t *data,
+                         bson_t        *doc)
+{
+   int32_t len;
+
+   memcpy (&len, data, 4);
+   len = BSON_UINT32_FROM_LE (len);
+
+   return bson_init_static (doc, data, (size_t) len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_rpc_command --
+ *
+ *       If @rpc, in host byte order, is a command, static-init @command
+ *       from it, without the "$query" wrapper added for read preferences.
+ *
+ * Returns:
+ *       true if @rpc is a command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_rpc_command (const mongoc_rpc_t *rpc,
+                             bson_t             *command)
+{
+   const uint8_t *data;
+   uint32_t len;
+   bson_iter_t iter;
+
+   if (rpc->header.opcode != MONGOC_OPCODE_QUERY ||
+       !strstr (rpc->query.collection, ".$cmd") ||
+       !_mongoc_cluster_rpc_doc (rpc->query.query, command)) {
+      return false;
+   }
+
+   if (bson_iter_init_find (&iter, command, "$query") &&
+       BSON_ITER_HOLDS_DOCUMENT (&iter)) {
+      bson_iter_document (&iter, &len, &data);
+      bson_init_static (command, data, len);
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_rpc_command_name --
+ *
+ *       The command name used to monitor @rpc, which must still be in
+ *       host byte order. Legacy opcodes are named after the commands
+ *       that replace them.
+ *
+ * Returns:
+ *       A command name, or NULL if @rpc expects no reply.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static const char *
+_mongoc_cluster_rpc_command_name (const mongoc_rpc_t *rpc)
+{
+   const char *name;
+   bson_t command;
+
+   switch (rpc->header.opcode) {
+   case MONGOC_OPCODE_QUERY:
+      if (!_mongoc_cluster_rpc_command (rpc, &command)) {
+         return "find";
+      }
+
+      name = _mongoc_get_command_name (&command);
+      return name ? name : "";
+   case MONGOC_OPCODE_GET_MORE:
+      return "getMore";
+   case MONGOC_OPCODE_INSERT:
+      return "insert";
+   case MONGOC_OPCODE_UPDATE:
+      return "update";
+   case MONGOC_OPCODE_DELETE:
+      return "delete";
+   default:
+      return NULL;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_command_histogram --
+ *
+ *       Choose the latency histogram for the round trip of the command
+ *       @name. "find", "getMore" and the write commands share histograms
+ *       with the legacy opcodes named after them.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static mongoc_histogram_t *
+_mongoc_cluster_command_histogram (const char *name)
+{
+   if (!strcmp (name, "find")) {
+      return &__mongoc_histogram_op_query;
+   } else if (!strcmp (name, "getMore")) {
+      return &__mongoc_histogram_op_getmore;
+   } else if (!strcmp (name, "insert")) {
+      return &__mongoc_histogram_op_insert;
+   } else if (!strcmp (name, "update")) {
+      return &__mongoc_histogram_op_update;
+   } else if (!strcmp (name, "delete")) {
+      return &__mongoc_histogram_op_delete;
+   }
+
+   return &__mongoc_histogram_op_command;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_apm_started --
+ *
+ *       Call the command started callback for @rpc, in host byte order,
+ *       and mark @timing so the reply is monitored too. Legacy opcodes
+ *       are described by a minimal command document.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_apm_started (mongoc_cluster_t        *cluster,
+                             mongoc_cluster_timing_t *timing,
+                             const mongoc_rpc_t      *rpc,
+                             mongoc_server_stream_t  *server_stream)
+{
+   mongoc_apm_command_started_t event;
+   const char *ns = NULL;
+   const char *coll;
+   char db[MONGOC_NAMESPACE_MAX];
+   bson_t legacy = BSON_INITIALIZER;
+   bson_t command;
+
+   timing->is_command = true;
+
+   switch (rpc->header.opcode) {
+   case MONGOC_OPCODE_QUERY:
+      ns = rpc->query.collection;
+      if (!_mongoc_cluster_rpc_command (rpc, &command)) {
+         timing->is_command = false;
+         _mongoc_cluster_rpc_doc (rpc->query.query, &command);
+      }
+      break;
+   case MONGOC_OPCODE_GET_MORE:
+      ns = rpc->get_more.collection;
+      timing->is_command = false;
+      break;
+   case MONGOC_OPCODE_INSERT:
+      ns = rpc->insert.collection;
+      break;
+   case MONGOC_OPCODE_UPDATE:
+      ns = rpc->update.collection;
+      break;
+   case MONGOC_OPCODE_DELETE:
+      ns = rpc->delete_.collection;
+      break;
+   default:
+      BSON_ASSERT (false);
+      return;
+   }
+
+   coll = strchr (ns, '.');
+   coll = coll ? coll + 1 : ns;
+
+   if (rpc->header.opcode == MONGOC_OPCODE_GET_MORE) {
+      BSON_APPEND_INT64 (&legacy, "getMore", rpc->get_more.cursor_id);
+      BSON_APPEND_UTF8 (&legacy, "collection", coll);
+      BSON_APPEND_INT32 (&legacy, "batchSize", rpc->get_more.n_return);
+   } else if (rpc->header.opcode != MONGOC_OPCODE_QUERY) {
+      BSON_APPEND_UTF8 (&legacy, timing->command_name, coll);
+   }
+
+   _mongoc_get_db_name (ns, db);
+
+   timing->monitored = true;
+
+   if (cluster->client->apm_callbacks.started) {
+      event.command = (rpc->header.opcode == MONGOC_OPCODE_QUERY)
+                      ? &command : &legacy;
+      event.database_name = db;
+      event.command_name = timing->command_name;
+      event.request_id = timing->request_id;
+      event.host = &server_stream->sd->host;
+      event.server_id = server_stream->sd->id;
+      event.context = cluster->client->apm_context;
+
+      cluster->client->apm_callbacks.started (&event);
+   }
+
+   bson_destroy (&legacy);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_apm_succeeded --
+ * _mongoc_cluster_apm_failed --
+ *
+ *       Call the command succeeded or failed callback for the request
+ *       monitored with @timing.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_apm_succeeded (mongoc_cluster_t              *cluster,
+                               const mongoc_cluster_timing_t *timing,
+                               mongoc_server_stream_t        *server_stream,
+                               int64_t                        duration,
+                               const bson_t                  *reply,
+                               uint32_t                       reply_size)
+{
+   mongoc_apm_command_succeeded_t event;
+
+   if (!cluster->client->apm_callbacks.succeeded) {
+      return;
+   }
+
+   event.duration = duration;
+   event.reply = reply;
+   event.reply_size = reply_size;
+   event.command_name = timing->command_name;
+   event.request_id = timing->request_id;
+   event.host = server_stream ? &server_stream->sd->host : NULL;
+   event.server_id = timing->server_id;
+   event.context = cluster->client->apm_context;
+
+   cluster->client->apm_callbacks.succeeded (&event);
+}
+
+
+static void
+_mongoc_cluster_apm_failed (mongoc_cluster_t              *cluster,
+                            const mongoc_cluster_timing_t *timing,
+                            mongoc_server_stream_t        *server_stream,
+                            int64_t                        duration,
+                            const bson_error_t            *error)
+{
+   mongoc_apm_command_failed_t event;
+
+   if (!cluster->client->apm_callbacks.failed) {
+      return;
+   }
+
+   event.duration = duration;
+   event.command_name = timing->command_name;
+   event.error = error;
+   event.request_id = timing->request_id;
+   event.host = server_stream ? &server_stream->sd->host : NULL;
+   event.server_id = timing->server_id;
+   event.context = cluster->client->apm_context;
+
+   cluster->client->apm_callbacks.failed (&event);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_apm_reply --
+ *
+ *       Call the command succeeded or failed callback for the reply at
+ *       @data, depending on whether the server reported an error.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_apm_reply (mongoc_cluster_t              *cluster,
+                           const mongoc_cluster_timing_t *timing,
+                           mongoc_server_stream_t        *server_stream,
+                           int64_t                        duration,
+                           const uint8_t                 *data,
+                           size_t                         len)
+{
+   mongoc_rpc_t rpc;
+   bson_error_t error;
+   bson_t reply;
+   bool failed;
+
+   if (!_mongoc_rpc_scatter (&rpc, data, len)) {
+      bson_set_error (&error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Failed to decode reply from server.");
+      _mongoc_cluster_apm_failed (cluster, timing, server_stream, duration,
+                                  &error);
+      return;
+   }
+
+   _mongoc_rpc_swab_from_le (&rpc);
+
+   if (timing->is_command) {
+      failed = _mongoc_rpc_parse_command_error (&rpc, &error);
+   } else {
+      failed = _mongoc_rpc_parse_query_error (&rpc, &error);
+   }
+
+   if (failed) {
+      _mongoc_cluster_apm_failed (cluster, timing, server_stream, duration,
+                                  &error);
+      return;
+   }
+
+   if (!_mongoc_rpc_reply_get_first (&rpc.reply, &reply)) {
+      bson_init (&reply);
+   }
+
+   _mongoc_cluster_apm_succeeded (cluster, timing, server_stream, duration,
+                                  &reply, (uint32_t) len);
+   bson_destroy (&reply);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_timing_start --
+ *
+ *       Start timing the round trip of @request_id, sent as @rpc which
+ *       must still be in host byte order. If command monitoring is
+ *       enabled and @server_stream is not NULL, call the command started
+ *       callback too. A finished timing is reused if there is one,
+ *       otherwise @cluster->timings grows, so no outstanding request
+ *       loses its timing however many are in flight.
+ *
+ *       Nothing is timed if command monitoring is off and the histograms
+ *       aren't in shared memory, since nobody could read the result.
+ *
+ *       Unacknowledged writes expect no reply: they are reported as
+ *       succeeded right away.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_timing_start (mongoc_cluster_t       *cluster,
+                              int32_t                 request_id,
+                              const mongoc_rpc_t     *rpc,
+                              bool                    acknowledged,
+                              mongoc_server_stream_t *server_stream)
+{
+   mongoc_cluster_timing_t *timings;
+   mongoc_cluster_timing_t *timing;
+   mongoc_cluster_timing_t unacknowledged;
+   const char *name;
+   bson_t reply;
+   size_t i;
+
+   if (!acknowledged) {
+      if (BSON_UNLIKELY (cluster->client->apm_enabled) && server_stream) {
+         timing = &unacknowledged;
+         timing->request_id = request_id;
+         timing->server_id = server_stream->sd->id;
+         bson_strncpy (timing->command_name,
+                       _mongoc_cluster_rpc_command_name (rpc),
+                       sizeof timing->command_name);
+
+         _mongoc_cluster_apm_started (cluster, timing, rpc, server_stream);
+
+         bson_init (&reply);
+         BSON_APPEND_INT32 (&reply, "ok", 1);
+         _mongoc_cluster_apm_succeeded (cluster, timing, server_stream, 0,
+                                        &reply, 0);
+         bson_destroy (&reply);
+      }
+
+      return;
+   }
+
+   if (!_mongoc_counters_shared && !cluster->client->apm_enabled) {
+      return;
+   }
+
+   if (!(name = _mongoc_cluster_rpc_command_name (rpc))) {
+      return;
+   }
+
+   timing = NULL;
+   timings = (mongoc_cluster_timing_t *) cluster->timings.data;
+
+   for (i = 0; i < cluster->timings.len; i++) {
+      if (!timings[i].histogram) {
+         timing = &timings[i];
+         break;
+      }
+   }
+
+   if (!timing) {
+      memset (&unacknowledged, 0, sizeof unacknowledged);
+      _mongoc_array_append_val (&cluster->timings, unacknowledged);
+      timing = &_mongoc_array_index (&cluster->timings,
+                                     mongoc_cluster_timing_t,
+                                     cluster->timings.len - 1);
+   }
+
+   timing->request_id = request_id;
+   timing->histogram = _mongoc_cluster_command_histogram (name);
+   timing->monitored = false;
+   timing->server_id = server_stream ? server_stream->sd->id : 0;
+
+   if (BSON_UNLIKELY (cluster->client->apm_enabled) && server_stream) {
+      bson_strncpy (timing->command_name, name, sizeof timing->command_name);
+      _mongoc_cluster_apm_started (cluster, timing, rpc, server_stream);
+   }
+
+   timing->started = bson_get_monotonic_time ();
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_timing_end --
+ *
+ *       The reply to @response_to, of @len bytes at @data, has arrived:
+ *       record the round trip if it was being timed, and call the command
+ *       monitoring callbacks if it was monitored.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_timing_end (mongoc_cluster_t       *cluster,
+                            mongoc_server_stream_t *server_stream,
+                            int32_t                 response_to,
+                            const uint8_t          *data,
+                            size_t                  len)
+{
+   mongoc_cluster_timing_t *timing;
+   int64_t duration;
+   size_t i;
+
+   for (i = 0; i < cluster->timings.len; i++) {
+      timing = &_mongoc_array_index (&cluster->timings,
+                                     mongoc_cluster_timing_t, i);
+
+      if (timing->histogram && timing->request_id == response_to) {
+         duration = bson_get_monotonic_time () - timing->started;
+         _mongoc_histogram_record (timing->histogram, duration);
+         timing->histogram = NULL;
+
+         if (BSON_UNLIKELY (timing->monitored)) {
+            _mongoc_cluster_apm_reply (cluster, timing, server_stream,
+                                       duration, data, len);
+         }
+
+         return;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_timing_fail --
+ *
+ *       No reply will come for the @n_requests requests numbered from
+ *       @first_request_id that were sent to @server_id, or to any server
+ *       if @server_id is 0: stop timing them, and call the command failed
+ *       callback for those that were monitored.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_timing_fail (mongoc_cluster_t       *cluster,
+                             mongoc_server_stream_t *server_stream,
+                             uint32_t                server_id,
+                             int32_t                 first_request_id,
+                             uint32_t                n_requests,
+                             const bson_error_t     *error)
+{
+   mongoc_cluster_timing_t *timing;
+   size_t i;
+
+   for (i = 0; i < cluster->timings.len; i++) {
+      timing = &_mongoc_array_index (&cluster->timings,
+                                     mongoc_cluster_timing_t, i);
+
+      if (!timing->histogram ||
+          (server_id && timing->server_id != server_id) ||
+          (uint32_t) (timing->request_id - first_request_id) >= n_requests) {
+         continue;
+      }
+
+      timing->histogram = NULL;
+
+      if (BSON_UNLIKELY (timing->monitored)) {
+         _mongoc_cluster_apm_failed (
+            cluster, timing, server_stream,
+            bson_get_monotonic_time () - timing->started, error);
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_forget_reply --
+ *
+ *       Remove the entry at @i from @cluster->replies.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_forget_reply (mongoc_cluster_t *cluster,
+                              size_t            i)
+{
+   mongoc_cluster_reply_t *replies;
+
+   replies = (mongoc_cluster_reply_t *)cluster->replies.data;
+
+   bson_free (replies[i].data);
+   memmove (&replies[i], &replies[i + 1],
+            (cluster->replies.len - i - 1) * sizeof *replies);
+   cluster->replies.len--;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_stash_reply --
+ *
+ *       Keep a copy of a reply that was read from @stream while waiting
+ *       for a reply to some other request, so that it can be handed to
+ *       the caller waiting for it later. If @data is NULL, remember that
+ *       the caller of @response_to gave up instead, so its reply is
+ *       discarded when it arrives.
+ *
+ *       A caller that gives up without an error, for example by never
+ *       asking, would leave its reply here until @stream is dropped. So
+ *       no more than MONGOC_CLUSTER_MAX_STASHED_REPLIES are kept for a
+ *       stream, and the oldest is forgotten to make room.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Appends to @cluster->replies.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_stash_reply (mongoc_cluster_t *cluster,
+                             mongoc_stream_t  *stream,
+                             int32_t           response_to,
+                             const uint8_t    *data,
+                             size_t            len)
+{
+   mongoc_cluster_reply_t *replies;
+   mongoc_cluster_reply_t reply;
+   size_t oldest = 0;
+   size_t n = 0;
+   size_t i;
+
+   replies = (mongoc_cluster_reply_t *)cluster->replies.data;
+
+   for (i = 0; i < cluster->replies.len; i++) {
+      if (replies[i].stream == stream && !n++) {
+         oldest = i;
+      }
+   }
+
+   if (n >= MONGOC_CLUSTER_MAX_STASHED_REPLIES) {
+      MONGOC_WARNING ("Discarding unclaimed reply to request %d",
+                      replies[oldest].response_to);
+      _mongoc_cluster_forget_reply (cluster, oldest);
+   }
+
+   reply.stream = stream;
+   reply.response_to = response_to;
+   reply.data = NULL;
+   reply.len = 0;
+
+   if (data) {
+      TRACE ("Stashing out-of-order reply to request %d", response_to);
+
+      reply.data = (uint8_t *)bson_malloc (len);
+      reply.len = len;
+      memcpy (reply.data, data, len);
+   }
+
+   _mongoc_array_append_val (&cluster->replies, reply);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_take_reply --
+ *
+ *       If a reply to @request_id was already read from @stream, append
+ *       it to @buffer and forget it.
+ *
+ * Returns:
+ *       true if a stashed reply was found.
+ *
+ * Side effects:
+ *       @buffer is filled with the reply on success.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_take_reply (mongoc_cluster_t *cluster,
+                            mongoc_stream_t  *stream,
+                            int32_t           request_id,
+                            mongoc_buffer_t  *buffer)
+{
+   mongoc_cluster_reply_t *replies;
+   size_t i;
+
+   replies = (mongoc_cluster_reply_t *)cluster->replies.data;
+
+   for (i = 0; i < cluster->replies.len; i++) {
+      if (replies[i].stream == stream &&
+          replies[i].response_to == request_id &&
+          replies[i].data) {
+         _mongoc_buffer_append (buffer, replies[i].data, replies[i].len);
+         _mongoc_cluster_forget_reply (cluster, i);
+
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_reply_abandoned --
+ *
+ *       If the caller of @response_to gave up waiting for its reply on
+ *       @stream, forget that it did.
+ *
+ * Returns:
+ *       true if the reply to @response_to should be discarded.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_reply_abandoned (mongoc_cluster_t *cluster,
+                                 mongoc_stream_t  *stream,
+                                 int32_t           response_to)
+{
+   mongoc_cluster_reply_t *replies;
+   size_t i;
+
+   replies = (mongoc_cluster_reply_t *)cluster->replies.data;
+
+   for (i = 0; i < cluster->replies.len; i++) {
+      if (replies[i].stream == stream &&
+          replies[i].response_to == response_to &&
+          !replies[i].data) {
+         _mongoc_cluster_forget_reply (cluster, i);
+
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_drop_replies --
+ *
+ *       Forget all stashed replies read from @stream, or all stashed
+ *       replies if @stream is NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_drop_replies (mongoc_cluster_t *cluster,
+                              mongoc_stream_t  *stream)
+{
+   mongoc_cluster_reply_t *replies;
+   size_t i;
+   size_t kept = 0;
+
+   replies = (mongoc_cluster_reply_t *)cluster->replies.data;
+
+   for (i = 0; i < cluster->replies.len; i++) {
+      if (!stream || replies[i].stream == stream) {
+         bson_free (replies[i].data);
+      } else {
+         replies[kept++] = replies[i];
+      }
+   }
+
+   cluster->replies.len = kept;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_free_compressed --
+ *
+ *       Free the compressed messages built for the last
+ *       mongoc_cluster_sendv_to_server call.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cluster_free_compressed (mongoc_cluster_t *cluster)
+{
+   uint8_t **bufs;
+   size_t i;
+
+   bufs = (uint8_t **)cluster->compressed.data;
+
+   for (i = 0; i < cluster->compressed.len; i++) {
+      bson_free (bufs[i]);
+   }
+
+   cluster->compressed.len = 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_compress --
+ *
+ *       Compress the message gathered into @cluster->iov from index
+ *       @start on. The compressed message is freed by the next call to
+ *       _mongoc_cluster_free_compressed.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_cluster_compress (mongoc_cluster_t *cluster,
+                          size_t            start,
+                          int32_t           compressor_id,
+                          bson_error_t     *error)
+{
+   uint8_t *buf;
+
+   buf = _mongoc_rpc_compress (&cluster->iov, start, compressor_id,
+                               cluster->zlib_compression_level, error);
+
+   if (!buf) {
+      return false;
+   }
+
+   _mongoc_array_append_val (&cluster->compressed, buf);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_rpc_compressor --
+ *
+ *       The compressor to send @rpc with: the one negotiated with the
+ *       server, unless @rpc is a command that must not be compressed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int32_t
+_mongoc_cluster_rpc_compressor (const mongoc_rpc_t     *rpc,
+                                mongoc_server_stream_t *server_stream)
+{
+   const char *collection;
+   bson_iter_t iter;
+   bson_t doc;
+   int32_t len;
+   size_t n;
+
+   if (server_stream->sd->compressor_id == MONGOC_COMPRESSOR_NONE_ID) {
+      return MONGOC_COMPRESSOR_NONE_ID;
+   }
+
+   if (rpc->header.opcode == MONGOC_OPCODE_QUERY) {
+      collection = rpc->query.collection;
+      n = strlen (collection);
+
+      if (n > 5 && !strcmp (collection + n - 5, ".$cmd")) {
+         memcpy (&len, rpc->query.query, 4);
+         len = BSON_UINT32_FROM_LE (len);
+
+         if (bson_init_static (&doc, rpc->query.query, (size_t) len) &&
+             bson_iter_init (&iter, &doc) &&
+             bson_iter_next (&iter) &&
+             !_mongoc_compression_allowed (bson_iter_key (&iter))) {
+            return MONGOC_COMPRESSOR_NONE_ID;
+         }
+      }
+   }
+
+   return server_stream->sd->compressor_id;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cluster_recv_reply --
+ *
+ *       Read the reply to @request_id from @stream into @buffer. Several
+ *       requests may be outstanding on @stream at once; replies to other
+ *       requests read along the way are stashed until their callers ask
+ *       for them. @server_stream is the server stream for @stream, or NULL
+ *       if requests on @stream are not monitored.
+ *
+ *       On failure the caller is taken to have given up on @request_id:
+ *       if @stream is not dropped, its reply is discarded when it is read.
+ *
+ * Returns:
+ *       The length of the reply, or 0 on failure and @error is set.
+ *
+ * Side effects:
+ *       The reply is appended to @buffer, decompressed if the server
+ *       sent it as OP_COMPRESSED.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int32_t
+_mongoc_cluster_recv_reply (mongoc_cluster_t       *cluster,
+                            mongoc_stream_t        *stream,
+                            mongoc_server_stream_t *server_stream,
+                            int32_t                 request_id,
+                            int32_t                 max_msg_size,
+                            mongoc_buffer_t        *buffer,
+                            bson_error_t           *error)
+{
+   int32_t msg_len;
+   int32_t response_to;
+   off_t pos;
+
+   ENTRY;
+
+   pos = buffer->len;
+
+   if (_mongoc_cluster_take_reply (cluster, stream, request_id, buffer)) {
+      RETURN ((int32_t) (buffer->len - pos));
+   }
+
+   for (;;) {
+      if (!_mongoc_buffer_append_from_stream (buffer, stream, 4,
+                                              cluster->sockettimeoutms,
+                                              error)) {
+         GOTO (failure);
+      }
+
+      memcpy (&msg_len, &buffer->data[buffer->off + pos], 4);
+      msg_len = BSON_UINT32_FROM_LE (msg_len);
+      if ((msg_len < 16) || (msg_len > max_msg_size)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_PROTOCOL,
+                         MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                         "Corrupt or malicious reply received.");
+         GOTO (failure);
+      }
+
+      if (!_mongoc_buffer_append_from_stream (buffer, stream,
+                                              (size_t) msg_len - 4,
+                                              cluster->sockettimeoutms,
+                                              error)) {
+         GOTO (failure);
+      }
+
+      if (!_mongoc_rpc_decompress (buffer, (size_t) pos, max_msg_size,
+                                   &msg_len, error)) {
+         GOTO (failure);
+      }
+
+      memcpy (&response_to, &buffer->data[buffer->off + pos + 8], 4);
+      response_to = BSON_UINT32_FROM_LE (response_to);
+
+      _mongoc_cluster_timing_end (cluster, server_stream, response_to,
+                                  &buffer->data[buffer->off + pos],
+                                  (size_t) msg_len);
+
+      if (response_to == request_id) {
+         RETURN (msg_len);
+      }
+
+      if (!_mongoc_cluster_reply_abandoned (cluster, stream, response_to)) {
+         _mongoc_cluster_stash_reply (cluster, stream, response_to,
+                                      &buffer->data[buffer->off + pos],
+                                      (size_t) msg_len);
+      }
+
+      buffer->len = pos;
+   }
+
+failure:
+   /* if @stream is still used, the reply may arrive after all */
+   _mongoc_cluster_stash_reply (cluster, stream, request_id, NULL, 0);
+
+   RETURN (0);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -110,6 +1057,12 @@ _bson_error_message_printf (bson_error_t *error,
  *       the same to reuse storage. @buffer should be initialized before
  *       passing it in.
  *
+ *       The command is sent compressed with @compressor_id, unless it is
+ *       MONGOC_COMPRESSOR_NONE_ID or the command must not be compressed.
+ *
+ *       The command is monitored if @server_stream is not NULL. It is
+ *       NULL for handshakes and authentication, which are not.
+ *
  * Returns:
  *       true if successful; otherwise false and @error is set.
  *
@@ -120,15 +1073,19 @@ _bson_error_message_printf (bson_error_t *error,
  */
 
 bool
-mongoc_cluster_run_command_rpc (mongoc_cluster_t    *cluster,
-                                mongoc_stream_t     *stream,
-                                const char          *command_name,
-                                mongoc_rpc_t        *rpc,
-                                mongoc_rpc_t        *reply_rpc,
-                                mongoc_buffer_t     *buffer,
-                                bson_error_t        *error)
-{
-   mongoc_array_t ar;
+mongoc_cluster_run_command_rpc (mongoc_cluster_t       *cluster,
+                                mongoc_stream_t        *stream,
+                                mongoc_server_stream_t *server_stream,
+                                int32_t                 compressor_id,
+                                const char             *command_name,
+                                mongoc_rpc_t           *rpc,
+                                mongoc_rpc_t           *reply_rpc,
+                                mongoc_buffer_t        *buffer,
+                                bson_error_t           *error)
+{
+   mongoc_array_t *ar = &cluster->iov;
+   uint8_t *compressed = NULL;
+   int32_t request_id;
    int32_t msg_len;
    bool error_set = false;
    bool ret = false;
@@ -139,7 +1096,7 @@ mongoc_cluster_run_command_rpc (mongoc_cluster_t    *cluster,
    BSON_ASSERT(cluster);
    BSON_ASSERT(stream);
 
-   _mongoc_array_init (&ar, sizeof (mongoc_iovec_t));
+   _mongoc_array_clear (ar);
 
    if (cluster->client->in_exhaust) {
       bson_set_error(error,
@@ -150,40 +1107,45 @@ mongoc_cluster_run_command_rpc (mongoc_cluster_t    *cluster,
       GOTO (done);
    }
 
-   rpc->query.request_id = ++cluster->request_id;
-   _mongoc_rpc_gather (rpc, &ar);
+   request_id = ++cluster->request_id;
+   rpc->query.request_id = request_id;
+   _mongoc_rpc_gather (rpc, ar);
+   _mongoc_cluster_timing_start (cluster, request_id, rpc, true,
+                                 server_stream);
    _mongoc_rpc_swab_to_le (rpc);
 
-   if (!_mongoc_stream_writev_full (stream, (mongoc_iovec_t *)ar.data, ar.len,
+   if (compressor_id != MONGOC_COMPRESSOR_NONE_ID &&
+       _mongoc_compression_allowed (command_name)) {
+      if (!(compressed = _mongoc_rpc_compress (ar, 0, compressor_id,
+                                               cluster->zlib_compression_level,
+                                               error))) {
+         error_set = true;
+         GOTO (done);
+      }
+   }
+
+   if (!_mongoc_stream_writev_full (stream, (mongoc_iovec_t *)ar->data, ar->len,
                                    cluster->sockettimeoutms, error) ||
-       !_mongoc_buffer_append_from_stream (buffer, stream, 4,
-                                           cluster->sockettimeoutms, error)) {
-      /* add info about the command to writev_full's error message */
+       !(msg_len = _mongoc_cluster_recv_reply (cluster, stream,
+                                               server_stream, request_id,
+                                               MONGOC_DEFAULT_MAX_MSG_SIZE,
+                                               buffer, error))) {
+      /* add info about the command to the error message */
       _mongoc_get_db_name (rpc->query.collection, db);
       _bson_error_message_printf (
          error,
          "Failed to send \"%s\" command with database \"%s\": %s",
          command_name, db, error->message);
 
-      error_set = true;
-      GOTO (done);
-   }
-
-   BSON_ASSERT (buffer->len == 4);
+      _mongoc_cluster_timing_fail (cluster, server_stream, 0, request_id, 1,
+                                   error);
 
-   memcpy (&msg_len, buffer->data, 4);
-   msg_len = BSON_UINT32_FROM_LE(msg_len);
-   if ((msg_len < 16) || (msg_len > MONGOC_DEFAULT_MAX_MSG_SIZE)) {
-      GOTO (done);
-   }
-
-   if (!_mongoc_buffer_append_from_stream (buffer, stream, (size_t) msg_len - 4,
-                                           cluster->sockettimeoutms, error)) {
       error_set = true;
       GOTO (done);
    }
 
-   if (!_mongoc_rpc_scatter (reply_rpc, buffer->data, buffer->len)) {
+   if (!_mongoc_rpc_scatter (reply_rpc, buffer->data + buffer->off,
+                             (size_t) msg_len)) {
       GOTO (done);
    }
 
@@ -196,7 +1158,7 @@ mongoc_cluster_run_command_rpc (mongoc_cluster_t    *cluster,
    ret = true;
 
 done:
-   _mongoc_array_destroy (&ar);
+   bson_free (compressed);
 
    if (!ret && !error_set) {
       /* generic error */
@@ -212,10 +1174,12 @@ done:
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_cluster_run_command --
+ * _mongoc_cluster_run_command --
  *
- *       Internal function to run a command on a given stream.
- *       @error and @reply are optional out-pointers.
+ *       Run a command on a given stream, compressed with @compressor_id
+ *       if it isn't MONGOC_COMPRESSOR_NONE_ID. The command is monitored
+ *       if @server_stream is not NULL. @error and @reply are optional
+ *       out-pointers.
  *
  * Returns:
  *       true if successful; otherwise false and @error is set.
@@ -226,14 +1190,16 @@ done:
  *--------------------------------------------------------------------------
  */
 
-bool
-mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
-                            mongoc_stream_t     *stream,
-                            mongoc_query_flags_t flags,
-                            const char          *db_name,
-                            const bson_t        *command,
-                            bson_t              *reply,
-                            bson_error_t        *error)
+static bool
+_mongoc_cluster_run_command (mongoc_cluster_t       *cluster,
+                             mongoc_stream_t        *stream,
+                             mongoc_server_stream_t *server_stream,
+                             int32_t                 compressor_id,
+                             mongoc_query_flags_t    flags,
+                             const char             *db_name,
+                             const bson_t           *command,
+                             bson_t                 *reply,
+                             bson_error_t           *error)
 {
    char ns[MONGOC_NAMESPACE_MAX];
    mongoc_rpc_t rpc;
@@ -249,7 +1215,8 @@ mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
    _mongoc_rpc_prep_command (&rpc, ns, command, flags);
 
    /* we can reuse the query rpc for the reply */
-   if (!mongoc_cluster_run_command_rpc (cluster, stream,
+   if (!mongoc_cluster_run_command_rpc (cluster, stream, server_stream,
+                                        compressor_id,
                                         _mongoc_get_command_name (command),
                                         &rpc, &rpc, &buffer, error)) {
       GOTO (done);
@@ -273,11 +1240,16 @@ mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
    ret = true;
 
 done:
-   if (reply && reply_local_initialized) {
-      bson_copy_to (&reply_local, reply);
-      bson_destroy (&reply_local);
-   } else if (reply) {
+   if (reply) {
+      /* small replies fit in reply's inline storage, no malloc */
       bson_init (reply);
+      if (reply_local_initialized) {
+         bson_concat (reply, &reply_local);
+      }
+   }
+
+   if (reply_local_initialized) {
+      bson_destroy (&reply_local);
    }
 
    _mongoc_buffer_destroy (&buffer);
@@ -285,6 +1257,70 @@ done:
    RETURN (ret);
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_run_command --
+ *
+ *       Internal function to run a command on a given stream.
+ *       @error and @reply are optional out-pointers.
+ *
+ *       The command is never compressed, so this is what connection
+ *       handshakes and authentication use.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @reply is set and should ALWAYS be released with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_run_command (mongoc_cluster_t    *cluster,
+                            mongoc_stream_t     *stream,
+                            mongoc_query_flags_t flags,
+                            const char          *db_name,
+                            const bson_t        *command,
+                            bson_t              *reply,
+                            bson_error_t        *error)
+{
+   return _mongoc_cluster_run_command (cluster, stream, NULL,
+                                       MONGOC_COMPRESSOR_NONE_ID, flags,
+                                       db_name, command, reply, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_run_command_server_stream --
+ *
+ *       Like mongoc_cluster_run_command, but the command is compressed
+ *       if a compressor was negotiated with the server.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_run_command_server_stream (mongoc_cluster_t       *cluster,
+                                          mongoc_server_stream_t *server_stream,
+                                          mongoc_query_flags_t    flags,
+                                          const char             *db_name,
+                                          const bson_t           *command,
+                                          bson_t                 *reply,
+                                          bson_error_t           *error)
+{
+   return _mongoc_cluster_run_command (cluster, server_stream->stream,
+                                       server_stream,
+                                       server_stream->sd->compressor_id,
+                                       flags, db_name, command, reply,
+                                       error);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -319,6 +1355,7 @@ _mongoc_stream_run_ismaster (mongoc_cluster_t *cluster,
 
    bson_init (&command);
    bson_append_int32 (&command, "ismaster", 8, 1);
+   _mongoc_compression_append_ismaster (&command, cluster->uri);
 
    ret = mongoc_cluster_run_command (cluster, stream, MONGOC_QUERY_SLAVE_OK,
                                      "admin", &command, reply, error);
@@ -963,6 +2000,7 @@ _mongoc_cluster_auth_node_scram (mongoc_cluster_t      *cluster,
 
    _mongoc_scram_set_pass (&scram, mongoc_uri_get_password (cluster->uri));
    _mongoc_scram_set_user (&scram, mongoc_uri_get_username (cluster->uri));
+   _mongoc_scram_set_cache (&scram, cluster->client->topology->scram_cache);
 
    for (;;) {
       if (!_mongoc_scram_step (&scram, buf, buflen, buf, sizeof buf, &buflen, error)) {
@@ -1186,6 +2224,7 @@ mongoc_cluster_disconnect_node (mongoc_cluster_t *cluster, uint32_t server_id)
 
       /* might never actually have connected */
       if (scanner_node && scanner_node->stream) {
+         _mongoc_cluster_drop_replies (cluster, scanner_node->stream);
          mongoc_topology_scanner_node_disconnect (scanner_node, true);
          EXIT;
       }
@@ -1211,7 +2250,9 @@ _mongoc_cluster_node_dtor (void *data_,
                            void *ctx_)
 {
    mongoc_cluster_node_t *node = (mongoc_cluster_node_t *)data_;
+   mongoc_cluster_t *cluster = (mongoc_cluster_t *)ctx_;
 
+   _mongoc_cluster_drop_replies (cluster, node->stream);
    _mongoc_cluster_node_destroy (node);
 }
 
@@ -1242,35 +2283,29 @@ _mongoc_cluster_node_new (mongoc_stream_t *stream)
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_cluster_add_node --
- *
- *       Add a new node to this cluster for the given server description.
+ * _mongoc_cluster_connect_node --
  *
- *       NOTE: does NOT check if this server is already in the cluster.
+ *       Open a new connection to the server described by @sd, run
+ *       ismaster on it and authenticate it if needed.
  *
  * Returns:
- *       A stream connected to the server, or NULL on failure.
+ *       A node that is not yet part of @cluster, or NULL on failure.
  *
  * Side effects:
- *       Adds a cluster node, or sets error on failure.
+ *       Makes blocking I/O calls, sets @error on failure.
  *
  *--------------------------------------------------------------------------
  */
-static mongoc_stream_t *
-_mongoc_cluster_add_node (mongoc_cluster_t *cluster,
-                          mongoc_server_description_t *sd,
-                          bson_error_t *error /* OUT */)
+static mongoc_cluster_node_t *
+_mongoc_cluster_connect_node (mongoc_cluster_t *cluster,
+                              mongoc_server_description_t *sd,
+                              bson_error_t *error /* OUT */)
 {
    mongoc_cluster_node_t *cluster_node;
    mongoc_stream_t *stream;
 
    ENTRY;
 
-   BSON_ASSERT (cluster);
-   BSON_ASSERT (!cluster->client->topology->single_threaded);
-
-   TRACE ("Adding new server to cluster: %s", sd->connection_address);
-
    stream = _mongoc_client_create_stream(cluster->client, &sd->host, error);
    if (!stream) {
       MONGOC_WARNING ("Failed connection to %s (%s)", sd->connection_address, error->message);
@@ -1279,9 +2314,15 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
 
    /* take critical fields from a fresh ismaster */
    cluster_node = _mongoc_cluster_node_new (stream);
+   cluster_node->generation = ++cluster->generation;
    if (!_mongoc_cluster_run_ismaster (cluster, cluster_node)) {
       _mongoc_cluster_node_destroy (cluster_node);
       MONGOC_WARNING ("Failed connection to %s (ismaster failed)", sd->connection_address);
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_CONNECT,
+                      "Failed to run ismaster on %s",
+                      sd->connection_address);
       RETURN (NULL);
    }
 
@@ -1294,8 +2335,95 @@ _mongoc_cluster_add_node (mongoc_cluster_t *cluster,
       }
    }
 
+   RETURN (cluster_node);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_add_node --
+ *
+ *       Add a new node to this cluster for the given server description.
+ *
+ *       NOTE: does NOT check if this server is already in the cluster.
+ *
+ * Returns:
+ *       A stream connected to the server, or NULL on failure.
+ *
+ * Side effects:
+ *       Adds a cluster node, or sets error on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+static mongoc_stream_t *
+_mongoc_cluster_add_node (mongoc_cluster_t *cluster,
+                          mongoc_server_description_t *sd,
+                          bson_error_t *error /* OUT */)
+{
+   mongoc_cluster_node_t *cluster_node;
+
+   ENTRY;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (!cluster->client->topology->single_threaded);
+
+   TRACE ("Adding new server to cluster: %s", sd->connection_address);
+
+   cluster_node = _mongoc_cluster_connect_node (cluster, sd, error);
+   if (!cluster_node) {
+      RETURN (NULL);
+   }
+
    mongoc_set_add (cluster->nodes, sd->id, cluster_node);
 
+   RETURN (cluster_node->stream);
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_connect_server --
+ *
+ *       Open an authenticated connection to @server_id that is owned by
+ *       the caller rather than by @cluster. Used to run operations that
+ *       must not share the cluster's stream.
+ *
+ * Returns:
+ *       A new stream the caller must destroy, or NULL on failure.
+ *
+ * Side effects:
+ *       Makes blocking I/O calls, sets @error on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+mongoc_stream_t *
+mongoc_cluster_connect_server (mongoc_cluster_t *cluster,
+                               uint32_t          server_id,
+                               bson_error_t     *error)
+{
+   mongoc_server_description_t *sd;
+   mongoc_cluster_node_t *cluster_node;
+   mongoc_stream_t *stream;
+
+   ENTRY;
+
+   BSON_ASSERT (cluster);
+
+   if (!(sd = mongoc_topology_server_by_id (cluster->client->topology,
+                                            server_id, error))) {
+      RETURN (NULL);
+   }
+
+   cluster_node = _mongoc_cluster_connect_node (cluster, sd, error);
+   mongoc_server_description_destroy (sd);
+
+   if (!cluster_node) {
+      RETURN (NULL);
+   }
+
+   stream = cluster_node->stream;
+   bson_free (cluster_node);
+
    RETURN (stream);
 }
 
@@ -1485,7 +2613,8 @@ mongoc_cluster_fetch_stream_single (mongoc_cluster_t *cluster,
       scanner_node->has_auth = true;
    }
 
-   return mongoc_server_stream_new (topology->description.type, sd, stream);
+   return mongoc_server_stream_new (topology->description.type, sd, stream,
+                                    scanner_node->generation);
 }
 
 static mongoc_server_stream_t *
@@ -1514,7 +2643,8 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
       } else {
          /* TODO: thread safety! */
          return mongoc_server_stream_new (topology->description.type,
-                                          sd, cluster_node->stream);
+                                          sd, cluster_node->stream,
+                                          cluster_node->generation);
       }
    }
 
@@ -1527,8 +2657,9 @@ mongoc_cluster_fetch_stream_pooled (mongoc_cluster_t *cluster,
    stream = _mongoc_cluster_add_node (cluster, sd, error);
    if (stream) {
       /* TODO: thread safety! */
+      /* the node was just connected, it has the newest generation */
       return mongoc_server_stream_new (topology->description.type,
-                                       sd, stream);
+                                       sd, stream, cluster->generation);
    } else {
       return NULL;
    }
@@ -1576,10 +2707,16 @@ mongoc_cluster_init (mongoc_cluster_t   *cluster,
    cluster->socketcheckintervalms = mongoc_uri_get_option_as_int32(
       uri, "socketcheckintervalms", MONGOC_TOPOLOGY_SOCKET_CHECK_INTERVAL_MS);
 
+   cluster->zlib_compression_level = mongoc_uri_get_option_as_int32(
+      uri, "zlibcompressionlevel", -1);
+
    /* TODO for single-threaded case we don't need this */
-   cluster->nodes = mongoc_set_new(8, _mongoc_cluster_node_dtor, NULL);
+   cluster->nodes = mongoc_set_new(8, _mongoc_cluster_node_dtor, cluster);
 
    _mongoc_array_init (&cluster->iov, sizeof (mongoc_iovec_t));
+   _mongoc_array_init (&cluster->compressed, sizeof (uint8_t *));
+   _mongoc_array_init (&cluster->replies, sizeof (mongoc_cluster_reply_t));
+   _mongoc_array_init (&cluster->timings, sizeof (mongoc_cluster_timing_t));
 
    EXIT;
 }
@@ -1614,6 +2751,13 @@ mongoc_cluster_destroy (mongoc_cluster_t *cluster) /* INOUT */
 
    _mongoc_array_destroy(&cluster->iov);
 
+   _mongoc_cluster_free_compressed (cluster);
+   _mongoc_array_destroy (&cluster->compressed);
+
+   _mongoc_cluster_drop_replies (cluster, NULL);
+   _mongoc_array_destroy (&cluster->replies);
+   _mongoc_array_destroy (&cluster->timings);
+
    EXIT;
 }
 
@@ -2043,6 +3187,7 @@ _mongoc_cluster_check_interval (mongoc_cluster_t *cluster,
        now) {
       bson_init (&command);
       BSON_APPEND_INT32 (&command, "ismaster", 1);
+      _mongoc_compression_append_ismaster (&command, cluster->uri);
 
       before_ismaster = now;
 
@@ -2111,10 +3256,13 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
    const bson_t *b;
    mongoc_rpc_t gle;
    size_t iovcnt;
+   size_t start;
    size_t i;
    bool need_gle;
    char cmdname[140];
    int32_t max_msg_size;
+   int32_t compressor_id;
+   int32_t first_request_id;
 
    ENTRY;
 
@@ -2144,6 +3292,9 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
    }
 
    _mongoc_array_clear(&cluster->iov);
+   _mongoc_cluster_free_compressed (cluster);
+
+   first_request_id = (int32_t) (cluster->request_id + 1);
 
    /*
     * TODO: We can probably remove the need for sendv and just do send since
@@ -2156,6 +3307,8 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
       _mongoc_cluster_inc_egress_rpc (&rpcs[i]);
       rpcs[i].header.request_id = ++cluster->request_id;
       need_gle = _mongoc_rpc_needs_gle(&rpcs[i], write_concern);
+      compressor_id = _mongoc_cluster_rpc_compressor (&rpcs[i], server_stream);
+      start = cluster->iov.len;
       _mongoc_rpc_gather (&rpcs[i], &cluster->iov);
 
       max_msg_size = mongoc_server_stream_max_msg_size (server_stream);
@@ -2168,7 +3321,7 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
                         "max allowed message size. Was %u, allowed %u.",
                         rpcs[i].header.msg_len,
                         max_msg_size);
-         RETURN(false);
+         GOTO (fail);
       }
 
       if (need_gle) {
@@ -2200,11 +3353,38 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
          b = _mongoc_write_concern_get_gle((mongoc_write_concern_t *)write_concern);
          gle.query.query = bson_get_data(b);
          gle.query.fields = NULL;
-         _mongoc_rpc_gather(&gle, &cluster->iov);
-         _mongoc_rpc_swab_to_le(&gle);
+
+         /* the write's round trip ends with the getlasterror reply */
+         _mongoc_cluster_timing_start (cluster, gle.query.request_id,
+                                       &rpcs[i], true, server_stream);
+      } else {
+         /* writes without getlasterror are unacknowledged */
+         _mongoc_cluster_timing_start (
+            cluster, rpcs[i].header.request_id, &rpcs[i],
+            (rpcs[i].header.opcode != MONGOC_OPCODE_INSERT &&
+             rpcs[i].header.opcode != MONGOC_OPCODE_UPDATE &&
+             rpcs[i].header.opcode != MONGOC_OPCODE_DELETE),
+            server_stream);
       }
 
       _mongoc_rpc_swab_to_le(&rpcs[i]);
+
+      if (compressor_id != MONGOC_COMPRESSOR_NONE_ID &&
+          !_mongoc_cluster_compress (cluster, start, compressor_id, error)) {
+         GOTO (fail);
+      }
+
+      if (need_gle) {
+         start = cluster->iov.len;
+         _mongoc_rpc_gather(&gle, &cluster->iov);
+         _mongoc_rpc_swab_to_le(&gle);
+
+         if (compressor_id != MONGOC_COMPRESSOR_NONE_ID &&
+             !_mongoc_cluster_compress (cluster, start, compressor_id,
+                                        error)) {
+            GOTO (fail);
+         }
+      }
    }
 
    iov = (mongoc_iovec_t *)cluster->iov.data;
@@ -2214,7 +3394,7 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
 
    if (!_mongoc_stream_writev_full (server_stream->stream, iov, iovcnt,
                                     cluster->sockettimeoutms, error)) {
-      RETURN (false);
+      GOTO (fail);
    }
 
    if (cluster->client->topology->single_threaded) {
@@ -2228,6 +3408,15 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
    }
 
    RETURN (true);
+
+fail:
+   /* none of the requests numbered from first_request_id was sent */
+   _mongoc_cluster_timing_fail (
+      cluster, server_stream, server_id, first_request_id,
+      (uint32_t) (cluster->request_id + 1 - (uint32_t) first_request_id),
+      error);
+
+   RETURN (false);
 }
 
 
@@ -2244,6 +3433,9 @@ mongoc_cluster_sendv_to_server (mongoc_cluster_t              *cluster,
  *       Callers that can optimize a reuse of @buffer should do so. It
  *       can save many memory allocations.
  *
+ *       OP_COMPRESSED messages are decompressed in @buffer before they
+ *       are scattered, so @rpc always holds the original message.
+ *
  * Returns:
  *       True if successful.
  *
@@ -2286,6 +3478,8 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
       MONGOC_DEBUG("Could not read 4 bytes, stream probably closed or timed out");
       mongoc_counter_protocol_ingress_error_inc ();
       mongoc_cluster_disconnect_node(cluster, server_id);
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id, 0,
+                                   UINT32_MAX, error);
       RETURN (false);
    }
 
@@ -2302,6 +3496,8 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                       "Corrupt or malicious reply received.");
       mongoc_cluster_disconnect_node(cluster, server_id);
       mongoc_counter_protocol_ingress_error_inc ();
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id, 0,
+                                   UINT32_MAX, error);
       RETURN (false);
    }
 
@@ -2313,6 +3509,17 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                                            cluster->sockettimeoutms, error)) {
       mongoc_cluster_disconnect_node (cluster, server_id);
       mongoc_counter_protocol_ingress_error_inc ();
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id, 0,
+                                   UINT32_MAX, error);
+      RETURN (false);
+   }
+
+   if (!_mongoc_rpc_decompress (buffer, (size_t) pos, max_msg_size, &msg_len,
+                                error)) {
+      mongoc_cluster_disconnect_node (cluster, server_id);
+      mongoc_counter_protocol_ingress_error_inc ();
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id, 0,
+                                   UINT32_MAX, error);
       RETURN (false);
    }
 
@@ -2326,12 +3533,105 @@ mongoc_cluster_try_recv (mongoc_cluster_t       *cluster,
                       "Failed to decode reply from server.");
       mongoc_cluster_disconnect_node (cluster, server_id);
       mongoc_counter_protocol_ingress_error_inc ();
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id, 0,
+                                   UINT32_MAX, error);
       RETURN (false);
    }
 
    _mongoc_rpc_swab_from_le (rpc);
 
+   _mongoc_cluster_timing_end (cluster, server_stream,
+                               rpc->header.response_to,
+                               &buffer->data[buffer->off + pos],
+                               (size_t) msg_len);
    _mongoc_cluster_inc_ingress_rpc (rpc);
 
    RETURN(true);
 }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cluster_try_recv_reply --
+ *
+ *       Like mongoc_cluster_try_recv, but receives the reply to the
+ *       request numbered @request_id rather than whatever message is
+ *       next on the stream.
+ *
+ *       This allows several requests to be outstanding on one stream:
+ *       send them all with mongoc_cluster_sendv_to_server, remember
+ *       each request_id, and receive the replies in any order.
+ *       Replies to other requests read along the way are kept by
+ *       @cluster until they are asked for.
+ *
+ *       Streams are still not shared between clients, so this does not
+ *       reduce the number of connections a client pool opens: each
+ *       pooled client keeps its own connection to each server.
+ *
+ * Returns:
+ *       True if successful.
+ *
+ * Side effects:
+ *       @rpc is set on success, @error on failure.
+ *       @buffer will be filled with the input data.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_cluster_try_recv_reply (mongoc_cluster_t       *cluster,
+                               mongoc_rpc_t           *rpc,
+                               mongoc_buffer_t        *buffer,
+                               mongoc_server_stream_t *server_stream,
+                               int32_t                 request_id,
+                               bson_error_t           *error)
+{
+   uint32_t server_id;
+   int32_t msg_len;
+   off_t pos;
+
+   ENTRY;
+
+   BSON_ASSERT (cluster);
+   BSON_ASSERT (rpc);
+   BSON_ASSERT (buffer);
+   BSON_ASSERT (server_stream);
+
+   server_id = server_stream->sd->id;
+
+   TRACE ("Waiting for reply to request %d from server_id \"%u\"",
+          request_id, server_id);
+
+   pos = buffer->len;
+
+   msg_len = _mongoc_cluster_recv_reply (
+      cluster, server_stream->stream, server_stream, request_id,
+      mongoc_server_stream_max_msg_size (server_stream), buffer, error);
+
+   if (!msg_len) {
+      mongoc_counter_protocol_ingress_error_inc ();
+      mongoc_cluster_disconnect_node (cluster, server_id);
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id,
+                                   request_id, 1, error);
+      RETURN (false);
+   }
+
+   if (!_mongoc_rpc_scatter (rpc, &buffer->data[buffer->off + pos], msg_len)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Failed to decode reply from server.");
+      mongoc_cluster_disconnect_node (cluster, server_id);
+      mongoc_counter_protocol_ingress_error_inc ();
+      _mongoc_cluster_timing_fail (cluster, server_stream, server_id,
+                                   request_id, 1, error);
+      RETURN (false);
+   }
+
+   _mongoc_rpc_swab_from_le (rpc);
+
+   _mongoc_cluster_inc_ingress_rpc (rpc);
+
+   RETURN (true);
+}
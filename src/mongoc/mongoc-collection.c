@@ -33,6 +33,7 @@
 #include "mongoc-log.h"
 #include "mongoc-trace.h"
 #include "mongoc-read-concern-private.h"
+#include "mongoc-read-prefs-private.h"
 #include "mongoc-write-concern-private.h"
 
 
@@ -709,9 +710,9 @@ mongoc_collection_count_with_opts (mongoc_collection_t       *collection,  /* IN
        bson_concat(&cmd, opts);
    }
 
-   success = mongoc_cluster_run_command (cluster, server_stream->stream,
-                                         MONGOC_QUERY_SLAVE_OK, collection->db,
-                                         &cmd, &reply, error);
+   success = mongoc_cluster_run_command_server_stream (
+      cluster, server_stream, MONGOC_QUERY_SLAVE_OK, collection->db,
+      &cmd, &reply, error);
 
    if (success && bson_iter_init_find(&iter, &reply, "n")) {
       ret = bson_iter_as_int64(&iter);
@@ -2160,9 +2161,11 @@ mongoc_collection_find_and_modify_with_opts (mongoc_collection_t
       }
    }
 
-   ret = mongoc_cluster_run_command (cluster, server_stream->stream,
-                                     MONGOC_QUERY_NONE, collection->db,
-                                     &command, &reply_local, error);
+   ret = mongoc_cluster_run_command_server_stream (cluster, server_stream,
+                                                   MONGOC_QUERY_NONE,
+                                                   collection->db,
+                                                   &command, &reply_local,
+                                                   error);
 
    if (bson_iter_init_find (&iter, &reply_local, "writeConcernError") &&
          BSON_ITER_HOLDS_DOCUMENT (&iter)) {
@@ -2267,3 +2270,220 @@ mongoc_collection_find_and_modify (mongoc_collection_t *collection,
 
    return ret;
 }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_collection_find_async --
+ *
+ *       Start a "find" command on @collection without waiting for the
+ *       result. @cb is invoked from mongoc_async_run() on @async with
+ *       the command reply, whose "cursor.firstBatch" holds the
+ *       documents. @opts is appended to the command, e.g. "sort",
+ *       "projection", "limit" or "singleBatch".
+ *
+ *       The operation runs on a connection reserved for async use, so
+ *       @collection's client may keep running blocking operations.
+ *
+ * Returns:
+ *       true if the operation was started; otherwise false, @error is
+ *       set, and @cb will not be invoked.
+ *
+ * Side effects:
+ *       Server selection, and opening a connection when none is idle,
+ *       block.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_collection_find_async (mongoc_collection_t       *collection,
+                              mongoc_async_t            *async,
+                              const bson_t              *filter,
+                              const bson_t              *opts,
+                              const mongoc_read_prefs_t *read_prefs,
+                              mongoc_async_cmd_cb_t      cb,
+                              void                      *cb_data,
+                              int32_t                    timeout_msec,
+                              bson_error_t              *error)
+{
+   mongoc_apply_read_prefs_result_t result = READ_PREFS_RESULT_INIT;
+   mongoc_server_stream_t *server_stream;
+   bson_t command = BSON_INITIALIZER;
+   bool ret = false;
+
+   ENTRY;
+
+   BSON_ASSERT (collection);
+   BSON_ASSERT (async);
+   BSON_ASSERT (filter);
+   BSON_ASSERT (cb);
+
+   if (!read_prefs) {
+      read_prefs = collection->read_prefs;
+   }
+
+   server_stream = mongoc_cluster_stream_for_reads (&collection->client->cluster,
+                                                    read_prefs, error);
+   if (!server_stream) {
+      bson_destroy (&command);
+      RETURN (false);
+   }
+
+   if (server_stream->sd->max_wire_version < WIRE_VERSION_FIND_CMD) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
+                      "The selected server does not support the find command.");
+      GOTO (done);
+   }
+
+   BSON_APPEND_UTF8 (&command, "find", collection->collection);
+   BSON_APPEND_DOCUMENT (&command, "filter", filter);
+
+   if (collection->read_concern->level != NULL) {
+      BSON_APPEND_DOCUMENT (&command, "readConcern",
+                            _mongoc_read_concern_get_bson (collection->read_concern));
+   }
+
+   if (opts) {
+      bson_concat (&command, opts);
+   }
+
+   apply_read_preferences (read_prefs, server_stream, &command,
+                           MONGOC_QUERY_NONE, &result);
+
+   ret = _mongoc_client_async_command (collection->client, async,
+                                       server_stream->sd->id, collection->db,
+                                       result.query_with_read_prefs, cb,
+                                       cb_data, timeout_msec, error);
+
+done:
+   apply_read_prefs_result_cleanup (&result);
+   mongoc_server_stream_cleanup (server_stream);
+   bson_destroy (&command);
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_collection_insert_async --
+ *
+ *       Start an "insert" command for @document without waiting for the
+ *       result. @cb is invoked from mongoc_async_run() on @async with
+ *       the command reply. Write errors and write concern errors are
+ *       reported as MONGOC_ASYNC_CMD_ERROR.
+ *
+ *       An "_id" is generated if @document has none.
+ *
+ * Returns:
+ *       true if the operation was started; otherwise false, @error is
+ *       set, and @cb will not be invoked.
+ *
+ * Side effects:
+ *       Server selection, and opening a connection when none is idle,
+ *       block.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_collection_insert_async (mongoc_collection_t          *collection,
+                                mongoc_async_t               *async,
+                                mongoc_insert_flags_t         flags,
+                                const bson_t                 *document,
+                                const mongoc_write_concern_t *write_concern,
+                                mongoc_async_cmd_cb_t         cb,
+                                void                         *cb_data,
+                                int32_t                       timeout_msec,
+                                bson_error_t                 *error)
+{
+   mongoc_server_stream_t *server_stream;
+   bson_t command = BSON_INITIALIZER;
+   bson_t documents;
+   bson_t doc;
+   bson_oid_t oid;
+   bool ret = false;
+
+   ENTRY;
+
+   BSON_ASSERT (collection);
+   BSON_ASSERT (async);
+   BSON_ASSERT (document);
+   BSON_ASSERT (cb);
+
+   if (!write_concern) {
+      write_concern = collection->write_concern;
+   }
+
+   if (!(flags & MONGOC_INSERT_NO_VALIDATE)) {
+      int vflags = (BSON_VALIDATE_UTF8 | BSON_VALIDATE_UTF8_ALLOW_NULL
+                  | BSON_VALIDATE_DOLLAR_KEYS | BSON_VALIDATE_DOT_KEYS);
+
+      if (!bson_validate (document, (bson_validate_flags_t)vflags, NULL)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_BSON,
+                         MONGOC_ERROR_BSON_INVALID,
+                         "A document was corrupt or contained "
+                         "invalid characters . or $");
+         bson_destroy (&command);
+         RETURN (false);
+      }
+   }
+
+   if (!_mongoc_write_concern_is_valid (write_concern)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "The write concern is invalid.");
+      bson_destroy (&command);
+      RETURN (false);
+   }
+
+   server_stream = mongoc_cluster_stream_for_writes (&collection->client->cluster,
+                                                     error);
+   if (!server_stream) {
+      bson_destroy (&command);
+      RETURN (false);
+   }
+
+   if (server_stream->sd->max_wire_version < WIRE_VERSION_WRITE_CMD) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION,
+                      "The selected server does not support the insert command.");
+      GOTO (done);
+   }
+
+   BSON_APPEND_UTF8 (&command, "insert", collection->collection);
+   _BSON_APPEND_WRITE_CONCERN (&command,
+                               ((mongoc_write_concern_t *) write_concern));
+   BSON_APPEND_BOOL (&command, "ordered", true);
+
+   bson_append_array_begin (&command, "documents", 9, &documents);
+   bson_append_document_begin (&documents, "0", 1, &doc);
+
+   if (!bson_has_field (document, "_id")) {
+      bson_oid_init (&oid, NULL);
+      BSON_APPEND_OID (&doc, "_id", &oid);
+   }
+
+   bson_concat (&doc, document);
+   bson_append_document_end (&documents, &doc);
+   bson_append_array_end (&command, &documents);
+
+   ret = _mongoc_client_async_command (collection->client, async,
+                                       server_stream->sd->id, collection->db,
+                                       &command, cb, cb_data, timeout_msec,
+                                       error);
+
+done:
+   mongoc_server_stream_cleanup (server_stream);
+   bson_destroy (&command);
+
+   RETURN (ret);
+}
@@ -23,6 +23,7 @@
 
 #include <bson.h>
 
+#include "mongoc-async.h"
 #include "mongoc-bulk-operation.h"
 #include "mongoc-flags.h"
 #include "mongoc-cursor.h"
@@ -96,11 +97,29 @@ mongoc_cursor_t              *mongoc_collection_find                 (mongoc_col
                                                                       const bson_t                  *query,
                                                                       const bson_t                  *fields,
                                                                       const mongoc_read_prefs_t     *read_prefs) BSON_GNUC_WARN_UNUSED_RESULT;
+bool                          mongoc_collection_find_async           (mongoc_collection_t           *collection,
+                                                                      mongoc_async_t                *async,
+                                                                      const bson_t                  *filter,
+                                                                      const bson_t                  *opts,
+                                                                      const mongoc_read_prefs_t     *read_prefs,
+                                                                      mongoc_async_cmd_cb_t          cb,
+                                                                      void                          *cb_data,
+                                                                      int32_t                        timeout_msec,
+                                                                      bson_error_t                  *error);
 bool                          mongoc_collection_insert               (mongoc_collection_t           *collection,
                                                                       mongoc_insert_flags_t          flags,
                                                                       const bson_t                  *document,
                                                                       const mongoc_write_concern_t  *write_concern,
                                                                       bson_error_t                  *error);
+bool                          mongoc_collection_insert_async         (mongoc_collection_t           *collection,
+                                                                      mongoc_async_t                *async,
+                                                                      mongoc_insert_flags_t          flags,
+                                                                      const bson_t                  *document,
+                                                                      const mongoc_write_concern_t  *write_concern,
+                                                                      mongoc_async_cmd_cb_t          cb,
+                                                                      void                          *cb_data,
+                                                                      int32_t                        timeout_msec,
+                                                                      bson_error_t                  *error);
 bool                          mongoc_collection_insert_bulk          (mongoc_collection_t           *collection,
                                                                       mongoc_insert_flags_t          flags,
                                                                       const bson_t                 **documents,
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_COMPRESSION_PRIVATE_H
+#define MONGOC_COMPRESSION_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-uri.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* Compressor ids as sent in an OP_COMPRESSED message */
+#define MONGOC_COMPRESSOR_NONE_ID   -1
+#define MONGOC_COMPRESSOR_NOOP_ID    0
+#define MONGOC_COMPRESSOR_SNAPPY_ID  1
+#define MONGOC_COMPRESSOR_ZLIB_ID    2
+
+/* OP_COMPRESSED header: message header, original opcode, uncompressed
+ * size, and compressor id */
+#define MONGOC_COMPRESSED_HEADER_LEN 25
+
+
+typedef struct
+{
+   int32_t      id;
+   const char  *name;
+   size_t     (*max_compressed_length) (size_t         len);
+   bool       (*compress)              (int32_t        level,
+                                        const uint8_t *src,
+                                        size_t         src_len,
+                                        uint8_t       *dst,
+                                        size_t        *dst_len);
+   bool       (*uncompress)            (const uint8_t *src,
+                                        size_t         src_len,
+                                        uint8_t       *dst,
+                                        size_t        *dst_len);
+} mongoc_compressor_t;
+
+
+const mongoc_compressor_t *_mongoc_compressor_by_id       (int32_t             id);
+const mongoc_compressor_t *_mongoc_compressor_by_name     (const char         *name);
+int32_t                    _mongoc_compressor_choose      (const bson_t       *ismaster_response);
+void                       _mongoc_compression_append_ismaster
+                                                          (bson_t             *command,
+                                                           const mongoc_uri_t *uri);
+bool                       _mongoc_compression_allowed    (const char         *command_name);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_COMPRESSION_PRIVATE_H */
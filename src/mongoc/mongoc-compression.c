@@ -0,0 +1,311 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "mongoc-compression-private.h"
+#include "mongoc-config.h"
+#include "mongoc-log.h"
+#include "mongoc-snappy-private.h"
+#include "mongoc-util-private.h"
+
+#ifdef MONGOC_ENABLE_ZLIB
+# include <zlib.h>
+#endif
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "compression"
+
+
+static size_t
+_mongoc_noop_max_compressed_length (size_t len)
+{
+   return len;
+}
+
+
+static bool
+_mongoc_noop_compress (int32_t        level,
+                       const uint8_t *src,
+                       size_t         src_len,
+                       uint8_t       *dst,
+                       size_t        *dst_len)
+{
+   if (*dst_len < src_len) {
+      return false;
+   }
+
+   memcpy (dst, src, src_len);
+   *dst_len = src_len;
+
+   return true;
+}
+
+
+static bool
+_mongoc_noop_uncompress (const uint8_t *src,
+                         size_t         src_len,
+                         uint8_t       *dst,
+                         size_t        *dst_len)
+{
+   return _mongoc_noop_compress (0, src, src_len, dst, dst_len);
+}
+
+
+static bool
+_mongoc_snappy_compress_level (int32_t        level,
+                               const uint8_t *src,
+                               size_t         src_len,
+                               uint8_t       *dst,
+                               size_t        *dst_len)
+{
+   return _mongoc_snappy_compress (src, src_len, dst, dst_len);
+}
+
+
+#ifdef MONGOC_ENABLE_ZLIB
+static size_t
+_mongoc_zlib_max_compressed_length (size_t len)
+{
+   return (size_t) compressBound ((uLong) len);
+}
+
+
+static bool
+_mongoc_zlib_compress (int32_t        level,
+                       const uint8_t *src,
+                       size_t         src_len,
+                       uint8_t       *dst,
+                       size_t        *dst_len)
+{
+   uLongf len = (uLongf) *dst_len;
+
+   if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+      level = Z_DEFAULT_COMPRESSION;
+   }
+
+   if (compress2 (dst, &len, src, (uLong) src_len, level) != Z_OK) {
+      return false;
+   }
+
+   *dst_len = (size_t) len;
+
+   return true;
+}
+
+
+static bool
+_mongoc_zlib_uncompress (const uint8_t *src,
+                         size_t         src_len,
+                         uint8_t       *dst,
+                         size_t        *dst_len)
+{
+   uLongf len = (uLongf) *dst_len;
+
+   if (uncompress (dst, &len, src, (uLong) src_len) != Z_OK) {
+      return false;
+   }
+
+   *dst_len = (size_t) len;
+
+   return true;
+}
+#endif
+
+
+/* Compressors in order of preference. To add a codec, implement the three
+ * functions of mongoc_compressor_t and list it here. */
+static const mongoc_compressor_t gMongocCompressors[] = {
+   {
+      MONGOC_COMPRESSOR_SNAPPY_ID,
+      "snappy",
+      _mongoc_snappy_max_compressed_length,
+      _mongoc_snappy_compress_level,
+      _mongoc_snappy_uncompress,
+   },
+#ifdef MONGOC_ENABLE_ZLIB
+   {
+      MONGOC_COMPRESSOR_ZLIB_ID,
+      "zlib",
+      _mongoc_zlib_max_compressed_length,
+      _mongoc_zlib_compress,
+      _mongoc_zlib_uncompress,
+   },
+#endif
+   {
+      MONGOC_COMPRESSOR_NOOP_ID,
+      "noop",
+      _mongoc_noop_max_compressed_length,
+      _mongoc_noop_compress,
+      _mongoc_noop_uncompress,
+   },
+};
+
+
+const mongoc_compressor_t *
+_mongoc_compressor_by_id (int32_t id)
+{
+   size_t i;
+
+   for (i = 0; i < sizeof gMongocCompressors / sizeof gMongocCompressors[0];
+        i++) {
+      if (gMongocCompressors[i].id == id) {
+         return &gMongocCompressors[i];
+      }
+   }
+
+   return NULL;
+}
+
+
+const mongoc_compressor_t *
+_mongoc_compressor_by_name (const char *name)
+{
+   size_t i;
+
+   for (i = 0; i < sizeof gMongocCompressors / sizeof gMongocCompressors[0];
+        i++) {
+      if (!strcasecmp (gMongocCompressors[i].name, name)) {
+         return &gMongocCompressors[i];
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compressor_choose --
+ *
+ *       Choose the compressor for a connection from the "compression"
+ *       field of the server's ismaster reply, which lists the
+ *       compressors we offered that the server also supports.
+ *
+ * Returns:
+ *       The id of the first one we implement, or
+ *       MONGOC_COMPRESSOR_NONE_ID.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int32_t
+_mongoc_compressor_choose (const bson_t *ismaster_response)
+{
+   const mongoc_compressor_t *compressor;
+   bson_iter_t iter;
+   bson_iter_t child;
+
+   if (bson_iter_init_find (&iter, ismaster_response, "compression") &&
+       BSON_ITER_HOLDS_ARRAY (&iter) &&
+       bson_iter_recurse (&iter, &child)) {
+      while (bson_iter_next (&child)) {
+         if (BSON_ITER_HOLDS_UTF8 (&child) &&
+             (compressor = _mongoc_compressor_by_name (
+                 bson_iter_utf8 (&child, NULL)))) {
+            return compressor->id;
+         }
+      }
+   }
+
+   return MONGOC_COMPRESSOR_NONE_ID;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compression_append_ismaster --
+ *
+ *       Offer the compressors from the "compressors" URI option in an
+ *       ismaster command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_compression_append_ismaster (bson_t             *command,
+                                     const mongoc_uri_t *uri)
+{
+   const bson_t *compressors;
+   bson_iter_t iter;
+   bson_t array;
+   char buf[16];
+   const char *key;
+   uint32_t i = 0;
+
+   compressors = mongoc_uri_get_compressors (uri);
+
+   if (bson_empty (compressors)) {
+      return;
+   }
+
+   bson_append_array_begin (command, "compression", -1, &array);
+
+   if (bson_iter_init (&iter, compressors)) {
+      while (bson_iter_next (&iter)) {
+         bson_uint32_to_string (i++, &key, buf, sizeof buf);
+         bson_append_utf8 (&array, key, -1, bson_iter_key (&iter), -1);
+      }
+   }
+
+   bson_append_array_end (command, &array);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_compression_allowed --
+ *
+ *       Commands that carry credentials or set up a connection must
+ *       never be compressed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_compression_allowed (const char *command_name)
+{
+   static const char *disallowed[] = {
+      "ismaster",
+      "saslstart",
+      "saslcontinue",
+      "getnonce",
+      "authenticate",
+      "createuser",
+      "updateuser",
+      "copydbsaslstart",
+      "copydbgetnonce",
+      "copydb",
+   };
+   size_t i;
+
+   if (!command_name) {
+      return true;
+   }
+
+   for (i = 0; i < sizeof disallowed / sizeof disallowed[0]; i++) {
+      if (!strcasecmp (command_name, disallowed[i])) {
+         return false;
+      }
+   }
+
+   return true;
+}
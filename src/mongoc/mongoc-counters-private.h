@@ -165,6 +165,116 @@ mongoc_counter_##ident##_reset (void) \
 #undef COUNTER
 
 
+/*
+ * Latency histograms, recorded in microseconds into log-linear buckets:
+ * one per value below 16, then 8 per power of two, so the bounds of a
+ * bucket are within 12.5% of each other. Values of 2^32 usec or more
+ * are counted in the last bucket. Like counters, each CPU has its own
+ * copy of the buckets, which readers sum.
+ */
+#define MONGOC_HISTOGRAM_SUB_BUCKETS 8
+#define MONGOC_HISTOGRAM_N_BUCKETS   240
+
+
+typedef struct
+{
+   int64_t buckets [MONGOC_HISTOGRAM_N_BUCKETS];
+} mongoc_histogram_slots_t;
+
+
+typedef struct
+{
+   mongoc_histogram_slots_t *cpus;
+} mongoc_histogram_t;
+
+
+#define HISTOGRAM(ident, Category, Name, Description) \
+   extern mongoc_histogram_t __mongoc_histogram_##ident;
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
+/* true if the segment is shared memory that mongoc-stat can read. Otherwise
+ * nobody sees the histograms, and the cluster doesn't time round trips. */
+extern bool _mongoc_counters_shared;
+
+
+enum
+{
+#define HISTOGRAM(ident, Category, Name, Description) \
+   HISTOGRAM_##ident,
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+   LAST_HISTOGRAM
+};
+
+
+static BSON_INLINE uint32_t
+_mongoc_histogram_bucket (int64_t usec)
+{
+   uint32_t exp;
+
+   if (usec < 2 * MONGOC_HISTOGRAM_SUB_BUCKETS) {
+      return usec < 0 ? 0 : (uint32_t) usec;
+   } else if (usec >= (int64_t) 1 << 32) {
+      return MONGOC_HISTOGRAM_N_BUCKETS - 1;
+   }
+
+   /* the position of the highest bit set, at least 4 */
+#if defined(__GNUC__)
+   exp = 63 - __builtin_clzll ((unsigned long long) usec);
+#else
+   for (exp = 4; usec >> (exp + 1); exp++) { }
+#endif
+
+   return 2 * MONGOC_HISTOGRAM_SUB_BUCKETS +
+          (exp - 4) * MONGOC_HISTOGRAM_SUB_BUCKETS +
+          (uint32_t) ((usec >> (exp - 3)) & (MONGOC_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+/* the largest value counted in @bucket */
+static BSON_INLINE int64_t
+_mongoc_histogram_bucket_max (uint32_t bucket)
+{
+   uint32_t exp;
+   uint32_t sub;
+
+   if (bucket < 2 * MONGOC_HISTOGRAM_SUB_BUCKETS) {
+      return bucket;
+   } else if (bucket >= MONGOC_HISTOGRAM_N_BUCKETS - 1) {
+      return INT64_MAX;
+   }
+
+   exp = 4 + (bucket - 2 * MONGOC_HISTOGRAM_SUB_BUCKETS) /
+             MONGOC_HISTOGRAM_SUB_BUCKETS;
+   sub = (bucket - 2 * MONGOC_HISTOGRAM_SUB_BUCKETS) %
+         MONGOC_HISTOGRAM_SUB_BUCKETS;
+
+   return ((int64_t) (MONGOC_HISTOGRAM_SUB_BUCKETS + sub + 1) << (exp - 3)) - 1;
+}
+
+
+static BSON_INLINE void
+_mongoc_histogram_record (mongoc_histogram_t *histogram,
+                          int64_t             usec)
+{
+   _mongoc_counter_add (
+      histogram->cpus[_mongoc_sched_getcpu()].buckets[
+         _mongoc_histogram_bucket (usec)], 1);
+}
+
+
+#define HISTOGRAM(ident, Category, Name, Description) \
+static BSON_INLINE void \
+mongoc_histogram_##ident##_record (int64_t usec) \
+{ \
+   _mongoc_histogram_record (&__mongoc_histogram_##ident, usec); \
+}
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
 BSON_END_DECLS
 
 
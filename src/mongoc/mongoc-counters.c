@@ -50,6 +50,21 @@ typedef struct
 BSON_STATIC_ASSERT(sizeof(mongoc_counter_info_t) == 128);
 
 
+#pragma pack(1)
+typedef struct
+{
+   uint32_t offset;
+   uint32_t n_buckets;
+   char          category[24];
+   char          name[32];
+   char          description[64];
+} mongoc_histogram_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_histogram_info_t) == 128);
+
+
 #pragma pack(1)
 typedef struct
 {
@@ -58,7 +73,10 @@ typedef struct
    uint32_t n_counters;
    uint32_t infos_offset;
    uint32_t values_offset;
-   uint8_t  padding[44];
+   uint32_t n_histograms;
+   uint32_t histogram_infos_offset;
+   uint32_t histogram_values_offset;
+   uint8_t  padding[32];
 } mongoc_counters_t;
 #pragma pack()
 
@@ -66,6 +84,7 @@ typedef struct
 BSON_STATIC_ASSERT(sizeof(mongoc_counters_t) == 64);
 
 static void *gCounterFallback = NULL;
+bool _mongoc_counters_shared = false;
 
 
 #define COUNTER(ident, Category, Name, Description) \
@@ -74,6 +93,12 @@ static void *gCounterFallback = NULL;
 #undef COUNTER
 
 
+#define HISTOGRAM(ident, Category, Name, Description) \
+   mongoc_histogram_t __mongoc_histogram_##ident;
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
+
 /**
  * mongoc_counters_use_shm:
  *
@@ -110,7 +135,9 @@ mongoc_counters_calc_size (void)
    n_groups = (LAST_COUNTER / SLOTS_PER_CACHELINE) + 1;
    size = (sizeof(mongoc_counters_t) +
            (LAST_COUNTER * sizeof(mongoc_counter_info_t)) +
-           (n_cpu * n_groups * sizeof(mongoc_counter_slots_t)));
+           (n_cpu * n_groups * sizeof(mongoc_counter_slots_t)) +
+           (LAST_HISTOGRAM * sizeof(mongoc_histogram_info_t)) +
+           (LAST_HISTOGRAM * n_cpu * sizeof(mongoc_histogram_slots_t)));
 
 #ifdef BSON_OS_UNIX
    return BSON_MAX(getpagesize(), size);
@@ -190,6 +217,7 @@ mongoc_counters_alloc (size_t size)
 
    close (fd);
    memset (mem, 0, size);
+   _mongoc_counters_shared = true;
 
    return mem;
 
@@ -266,6 +294,59 @@ mongoc_counters_register (mongoc_counters_t *counters,
 }
 
 
+/**
+ * mongoc_counters_register_histogram:
+ * @counters: A mongoc_counters_t.
+ * @num: The histogram number.
+ * @category: The histogram category.
+ * @name: The histogram name.
+ * @description The histogram description.
+ *
+ * Registers a new histogram in the memory segment, after the counters.
+ * Each histogram has a mongoc_histogram_slots_t per CPU.
+ *
+ * Returns: The offset to the data for the histogram's buckets.
+ */
+static size_t
+mongoc_counters_register_histogram (mongoc_counters_t *counters,
+                                    uint32_t           num,
+                                    const char        *category,
+                                    const char        *name,
+                                    const char        *description)
+{
+   mongoc_histogram_info_t *infos;
+   char *segment;
+   int n_cpu;
+
+   BSON_ASSERT(counters);
+   BSON_ASSERT(category);
+   BSON_ASSERT(name);
+   BSON_ASSERT(description);
+
+   n_cpu = _mongoc_get_cpu_count();
+   segment = (char *)counters;
+
+   infos = (mongoc_histogram_info_t *)(segment +
+                                       counters->histogram_infos_offset);
+   infos = &infos[counters->n_histograms];
+   infos->n_buckets = MONGOC_HISTOGRAM_N_BUCKETS;
+   infos->offset = (uint32_t)(counters->histogram_values_offset +
+                              (num * n_cpu *
+                               sizeof(mongoc_histogram_slots_t)));
+
+   bson_strncpy (infos->category, category, sizeof infos->category);
+   bson_strncpy (infos->name, name, sizeof infos->name);
+   bson_strncpy (infos->description, description, sizeof infos->description);
+
+   /* as for counters, publish the histogram once it is initialized */
+   bson_memory_barrier ();
+
+   counters->n_histograms++;
+
+   return infos->offset;
+}
+
+
 /**
  * mongoc_counters_init:
  *
@@ -278,6 +359,7 @@ _mongoc_counters_init (void)
    mongoc_counter_info_t *info;
    mongoc_counters_t *counters;
    size_t infos_size;
+   size_t n_groups;
    size_t off;
    size_t size;
    char *segment;
@@ -294,12 +376,31 @@ _mongoc_counters_init (void)
 
    BSON_ASSERT ((counters->values_offset % 64) == 0);
 
+   n_groups = (LAST_COUNTER / SLOTS_PER_CACHELINE) + 1;
+   counters->n_histograms = 0;
+   counters->histogram_infos_offset = (uint32_t)(
+      counters->values_offset +
+      (counters->n_cpu * n_groups * sizeof(mongoc_counter_slots_t)));
+   counters->histogram_values_offset = (uint32_t)(
+      counters->histogram_infos_offset +
+      (LAST_HISTOGRAM * sizeof(mongoc_histogram_info_t)));
+
+   BSON_ASSERT ((counters->histogram_values_offset % 64) == 0);
+
 #define COUNTER(ident, Category, Name, Desc) \
    off = mongoc_counters_register(counters, COUNTER_##ident, Category, Name, Desc); \
    __mongoc_counter_##ident.cpus = (mongoc_counter_slots_t *)(segment + off);
 #include "mongoc-counters.defs"
 #undef COUNTER
 
+#define HISTOGRAM(ident, Category, Name, Desc) \
+   off = mongoc_counters_register_histogram(counters, HISTOGRAM_##ident, \
+                                            Category, Name, Desc); \
+   __mongoc_histogram_##ident.cpus = \
+      (mongoc_histogram_slots_t *)(segment + off);
+#include "mongoc-histograms.defs"
+#undef HISTOGRAM
+
    /*
     * NOTE:
     *
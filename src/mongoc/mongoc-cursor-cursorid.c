@@ -53,9 +53,14 @@ _mongoc_cursor_cursorid_destroy (mongoc_cursor_t *cursor)
 }
 
 
+static void
+_mongoc_cursor_prepare_getmore_command (mongoc_cursor_t *cursor,
+                                        bson_t          *command);
+
+
 static bool
-_mongoc_cursor_cursorid_refresh_from_command (mongoc_cursor_t *cursor,
-                                              const bson_t    *command)
+_mongoc_cursor_cursorid_read_reply (mongoc_cursor_t *cursor,
+                                    const char      *command_name)
 {
    mongoc_cursor_cursorid_t *cid;
    const bson_t *bson;
@@ -69,8 +74,7 @@ _mongoc_cursor_cursorid_refresh_from_command (mongoc_cursor_t *cursor,
 
    /* server replies to find / aggregate with {cursor: {id: N, firstBatch: []}},
     * to getMore command with {cursor: {id: N, nextBatch: []}}. */
-   if (_mongoc_cursor_run_command (cursor, command) &&
-       _mongoc_read_from_buffer (cursor, &bson) &&
+   if (_mongoc_read_from_buffer (cursor, &bson) &&
        bson_iter_init_find (&iter, bson, "cursor") &&
        BSON_ITER_HOLDS_DOCUMENT (&iter) &&
        bson_iter_recurse (&iter, &child)) {
@@ -92,6 +96,26 @@ _mongoc_cursor_cursorid_refresh_from_command (mongoc_cursor_t *cursor,
 
       RETURN (true);
    } else {
+      if (!cursor->error.domain) {
+         bson_set_error (&cursor->error,
+                         MONGOC_ERROR_PROTOCOL,
+                         MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                         "Invalid reply to %s command.",
+                         command_name);
+      }
+
+      RETURN (false);
+   }
+}
+
+
+static bool
+_mongoc_cursor_cursorid_refresh_from_command (mongoc_cursor_t *cursor,
+                                              const bson_t    *command)
+{
+   ENTRY;
+
+   if (!_mongoc_cursor_run_command (cursor, command)) {
       if (!cursor->error.domain) {
          bson_set_error (&cursor->error,
                          MONGOC_ERROR_PROTOCOL,
@@ -102,6 +126,36 @@ _mongoc_cursor_cursorid_refresh_from_command (mongoc_cursor_t *cursor,
 
       RETURN (false);
    }
+
+   RETURN (_mongoc_cursor_cursorid_read_reply (
+              cursor, _mongoc_get_command_name (command)));
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_cursorid_prefetch --
+ *
+ *       If prefetch is enabled, send the getMore command for the next
+ *       batch now; _mongoc_cursor_cursorid_get_more receives its reply.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cursor_cursorid_prefetch (mongoc_cursor_t        *cursor,
+                                  mongoc_server_stream_t *server_stream)
+{
+   bson_t command;
+
+   /* with OP_GET_MORE, _mongoc_cursor_op_getmore prefetches on its own */
+   if (_mongoc_cursor_should_prefetch (cursor) &&
+       _use_find_command (cursor, server_stream)) {
+      _mongoc_cursor_prepare_getmore_command (cursor, &command);
+      _mongoc_cursor_prefetch_command (cursor, server_stream, &command);
+      bson_destroy (&command);
+   }
 }
 
 
@@ -132,8 +186,22 @@ _mongoc_cursor_cursorid_read_from_batch (mongoc_cursor_t *cursor,
 bool
 _mongoc_cursor_cursorid_prime (mongoc_cursor_t *cursor)
 {
+   mongoc_server_stream_t *server_stream;
+
    cursor->sent = true;
-   return _mongoc_cursor_cursorid_refresh_from_command (cursor, &cursor->query);
+
+   if (!_mongoc_cursor_cursorid_refresh_from_command (cursor,
+                                                      &cursor->query)) {
+      return false;
+   }
+
+   if (_mongoc_cursor_should_prefetch (cursor) &&
+       (server_stream = _mongoc_cursor_fetch_stream (cursor))) {
+      _mongoc_cursor_cursorid_prefetch (cursor, server_stream);
+      mongoc_server_stream_cleanup (server_stream);
+   }
+
+   return true;
 }
 
 
@@ -193,9 +261,20 @@ _mongoc_cursor_cursorid_get_more (mongoc_cursor_t *cursor)
    }
 
    if (_use_find_command (cursor, server_stream)) {
-      _mongoc_cursor_prepare_getmore_command (cursor, &command);
-      ret = _mongoc_cursor_cursorid_refresh_from_command (cursor, &command);
-      bson_destroy (&command);
+      if (_mongoc_cursor_has_prefetched (cursor, server_stream)) {
+         ret = _mongoc_cursor_recv_prefetched_command (cursor,
+                                                       server_stream) &&
+               _mongoc_cursor_cursorid_read_reply (cursor, "getMore");
+      } else {
+         _mongoc_cursor_prepare_getmore_command (cursor, &command);
+         ret = _mongoc_cursor_cursorid_refresh_from_command (cursor,
+                                                             &command);
+         bson_destroy (&command);
+      }
+
+      if (ret) {
+         _mongoc_cursor_cursorid_prefetch (cursor, server_stream);
+      }
    } else {
       ret = _mongoc_cursor_op_getmore (cursor, server_stream);
       cid->in_reader = ret;
@@ -34,6 +34,32 @@ BSON_BEGIN_DECLS
 typedef struct _mongoc_cursor_interface_t mongoc_cursor_interface_t;
 
 
+/*
+ * Iterates the documents of an OP_REPLY in place, like a bson_reader_t
+ * over the reply, but without a heap allocation per batch.
+ */
+typedef struct
+{
+   const uint8_t *data;
+   size_t         len;
+   size_t         off;
+   bool           active;
+   bson_t         current;
+} mongoc_cursor_reader_t;
+
+
+/*
+ * The receive buffer holding a batch that the application retained with
+ * mongoc_cursor_retain_batch(). The cursor holds one reference until it
+ * moves on to the next batch.
+ */
+struct _mongoc_cursor_batch_t
+{
+   volatile int32_t ref_count;
+   mongoc_buffer_t  buffer;
+};
+
+
 struct _mongoc_cursor_interface_t
 {
    mongoc_cursor_t *(*clone)    (const mongoc_cursor_t  *cursor);
@@ -61,6 +87,8 @@ struct _mongoc_cursor_t
    unsigned                   end_of_event    : 1;
    unsigned                   has_fields      : 1;
    unsigned                   in_exhaust      : 1;
+   unsigned                   prefetch        : 1;
+   unsigned                   prefetching     : 1;
 
    bson_t                     query;
    bson_t                     fields;
@@ -81,9 +109,14 @@ struct _mongoc_cursor_t
 
    bson_error_t               error;
 
+   int32_t                    prefetch_request_id;
+   mongoc_stream_t           *prefetch_stream;
+   uint32_t                   prefetch_generation;
+
    mongoc_rpc_t               rpc;
    mongoc_buffer_t            buffer;
-   bson_reader_t             *reader;
+   mongoc_cursor_batch_t     *batch;
+   mongoc_cursor_reader_t     reader;
 
    const bson_t              *current;
 
@@ -107,6 +140,8 @@ mongoc_cursor_t         *_mongoc_cursor_clone         (const mongoc_cursor_t
 void                     _mongoc_cursor_destroy       (mongoc_cursor_t              *cursor);
 bool                     _mongoc_read_from_buffer     (mongoc_cursor_t              *cursor,
                                                        const bson_t                **bson);
+void                     _mongoc_cursor_reader_init   (mongoc_cursor_t              *cursor);
+void                     _mongoc_cursor_clear_buffer  (mongoc_cursor_t              *cursor);
 bool                     _use_find_command            (const mongoc_cursor_t        *cursor,
                                                        const mongoc_server_stream_t *server_stream);
 mongoc_server_stream_t * _mongoc_cursor_fetch_stream  (mongoc_cursor_t              *cursor);
@@ -117,6 +152,14 @@ bool                     _mongoc_cursor_op_getmore    (mongoc_cursor_t
                                                        mongoc_server_stream_t       *server_stream);
 bool                     _mongoc_cursor_run_command   (mongoc_cursor_t              *cursor,
                                                        const bson_t                 *command);
+bool                     _mongoc_cursor_should_prefetch (const mongoc_cursor_t      *cursor);
+bool                     _mongoc_cursor_has_prefetched (mongoc_cursor_t             *cursor,
+                                                       mongoc_server_stream_t       *server_stream);
+void                     _mongoc_cursor_prefetch_command (mongoc_cursor_t           *cursor,
+                                                       mongoc_server_stream_t       *server_stream,
+                                                       const bson_t                 *command);
+bool                     _mongoc_cursor_recv_prefetched_command (mongoc_cursor_t    *cursor,
+                                                       mongoc_server_stream_t       *server_stream);
 bool                     _mongoc_cursor_more          (mongoc_cursor_t              *cursor);
 bool                     _mongoc_cursor_next          (mongoc_cursor_t              *cursor,
                                                        const bson_t                **bson);
@@ -40,15 +40,24 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
 static const bson_t *
 _mongoc_cursor_find_command (mongoc_cursor_t *cursor);
 
+static void
+_mongoc_cursor_op_getmore_prefetch (mongoc_cursor_t        *cursor,
+                                    mongoc_server_stream_t *server_stream);
+
+static void
+_mongoc_cursor_drain_prefetch (mongoc_cursor_t *cursor);
 
+
+/* @pending is the number of documents received but not yet returned */
 static int32_t
-_mongoc_n_return (mongoc_cursor_t * cursor)
+_mongoc_n_return (mongoc_cursor_t *cursor,
+                  uint32_t         pending)
 {
    if (cursor->is_command) {
       /* commands always have n_return of 1 */
       return 1;
    } else if (cursor->limit) {
-      int32_t remaining = cursor->limit - cursor->count;
+      int32_t remaining = cursor->limit - cursor->count - pending;
       BSON_ASSERT (remaining > 0);
 
       if (cursor->batch_size) {
@@ -265,21 +274,24 @@ _mongoc_cursor_destroy (mongoc_cursor_t *cursor)
          mongoc_cluster_disconnect_node (&cursor->client->cluster,
                                          cursor->hint);
       }
-   } else if (cursor->rpc.reply.cursor_id) {
-      bson_strncpy (db, cursor->ns, cursor->dblen + 1);
+   } else {
+      if (cursor->prefetching) {
+         _mongoc_cursor_drain_prefetch (cursor);
+      }
 
-      _mongoc_client_kill_cursor(cursor->client,
-                                 cursor->hint,
-                                 cursor->rpc.reply.cursor_id,
-                                 db,
-                                 cursor->ns + cursor->dblen + 1);
-   }
+      if (cursor->rpc.reply.cursor_id) {
+         bson_strncpy (db, cursor->ns, cursor->dblen + 1);
 
-   if (cursor->reader) {
-      bson_reader_destroy(cursor->reader);
-      cursor->reader = NULL;
+         _mongoc_client_kill_cursor(cursor->client,
+                                    cursor->hint,
+                                    cursor->rpc.reply.cursor_id,
+                                    db,
+                                    cursor->ns + cursor->dblen + 1);
+      }
    }
 
+   mongoc_cursor_batch_release (cursor->batch);
+
    bson_destroy(&cursor->query);
    bson_destroy(&cursor->fields);
    _mongoc_buffer_destroy(&cursor->buffer);
@@ -404,7 +416,7 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
    if ((cursor->flags & MONGOC_QUERY_TAILABLE_CURSOR)) {
       rpc.query.n_return = 0;
    } else {
-      rpc.query.n_return = _mongoc_n_return(cursor);
+      rpc.query.n_return = _mongoc_n_return (cursor, 0);
    }
 
    if (cursor->has_fields) {
@@ -427,12 +439,13 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
 
    request_id = BSON_UINT32_FROM_LE (rpc.header.request_id);
 
-   _mongoc_buffer_clear(&cursor->buffer, false);
+   _mongoc_cursor_clear_buffer (cursor);
 
    if (!_mongoc_client_recv(cursor->client,
                             &cursor->rpc,
                             &cursor->buffer,
                             server_stream,
+                            (int32_t) request_id,
                             &cursor->error)) {
       GOTO (failure);
    }
@@ -467,13 +480,7 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
       }
    }
 
-   if (cursor->reader) {
-      bson_reader_destroy (cursor->reader);
-   }
-
-   cursor->reader = bson_reader_new_from_data(
-      cursor->rpc.reply.documents,
-      (size_t) cursor->rpc.reply.documents_len);
+   _mongoc_cursor_reader_init (cursor);
 
    if ((cursor->flags & MONGOC_QUERY_EXHAUST)) {
       cursor->in_exhaust = true;
@@ -484,6 +491,8 @@ _mongoc_cursor_op_query (mongoc_cursor_t        *cursor,
    cursor->end_of_event = false;
    cursor->sent = true;
 
+   _mongoc_cursor_op_getmore_prefetch (cursor, server_stream);
+
    _mongoc_read_from_buffer (cursor, &bson);
 
    apply_read_prefs_result_cleanup (&result);
@@ -521,7 +530,7 @@ _mongoc_cursor_run_command (mongoc_cursor_t *cursor,
       GOTO (done);
    }
 
-   _mongoc_buffer_clear (&cursor->buffer, false);
+   _mongoc_cursor_clear_buffer (cursor);
 
    bson_snprintf (cmd_ns, sizeof cmd_ns, "%.*s.$cmd", cursor->dblen,
                   cursor->ns);
@@ -535,6 +544,8 @@ _mongoc_cursor_run_command (mongoc_cursor_t *cursor,
                              read_prefs_result.flags);
 
    if (!mongoc_cluster_run_command_rpc (cluster, server_stream->stream,
+                                        server_stream,
+                                        server_stream->sd->compressor_id,
                                         _mongoc_get_command_name (&cursor->query),
                                         &rpc, &cursor->rpc, &cursor->buffer,
                                         &cursor->error)) {
@@ -554,13 +565,7 @@ _mongoc_cursor_run_command (mongoc_cursor_t *cursor,
       GOTO (done);
    }
 
-   if (cursor->reader) {
-      bson_reader_destroy (cursor->reader);
-   }
-
-   cursor->reader = bson_reader_new_from_data (
-      cursor->rpc.reply.documents,
-      (size_t)cursor->rpc.reply.documents_len);
+   _mongoc_cursor_reader_init (cursor);
 
    ret = true;
 
@@ -809,7 +814,7 @@ _mongoc_cursor_get_more (mongoc_cursor_t *cursor)
 
    mongoc_server_stream_cleanup (server_stream);
 
-   if (cursor->reader) {
+   if (cursor->reader.active) {
       _mongoc_read_from_buffer (cursor, &b);
    }
 
@@ -824,47 +829,120 @@ failure:
 }
 
 
+static bool
+_mongoc_cursor_op_getmore_send (mongoc_cursor_t        *cursor,
+                                mongoc_server_stream_t *server_stream,
+                                int32_t                 n_return,
+                                uint32_t               *request_id,
+                                bson_error_t           *error)
+{
+   mongoc_rpc_t rpc;
+
+   rpc.get_more.cursor_id = cursor->rpc.reply.cursor_id;
+   rpc.get_more.msg_len = 0;
+   rpc.get_more.request_id = 0;
+   rpc.get_more.response_to = 0;
+   rpc.get_more.opcode = MONGOC_OPCODE_GET_MORE;
+   rpc.get_more.zero = 0;
+   rpc.get_more.collection = cursor->ns;
+   rpc.get_more.n_return = n_return;
+
+   if (!mongoc_cluster_sendv_to_server (&cursor->client->cluster,
+                                        &rpc, 1, server_stream,
+                                        NULL, error)) {
+      return false;
+   }
+
+   *request_id = BSON_UINT32_FROM_LE (rpc.header.request_id);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_op_getmore_prefetch --
+ *
+ *       If prefetch is enabled, send the OP_GET_MORE for the next batch
+ *       as soon as the current one has been received, so the server
+ *       works on it while the application consumes this batch. The
+ *       reply is received by the next _mongoc_cursor_op_getmore.
+ *
+ *       A failure to send is not reported here; the next batch is then
+ *       requested as usual, and fails there if the connection is bad.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cursor_op_getmore_prefetch (mongoc_cursor_t        *cursor,
+                                    mongoc_server_stream_t *server_stream)
+{
+   uint32_t pending;
+   uint32_t request_id;
+   int32_t n_return;
+   bson_error_t error;
+
+   if (!_mongoc_cursor_should_prefetch (cursor)) {
+      return;
+   }
+
+   pending = (uint32_t) cursor->rpc.reply.n_returned;
+
+   if ((cursor->flags & MONGOC_QUERY_TAILABLE_CURSOR)) {
+      n_return = 0;
+   } else if (cursor->limit && cursor->count + pending >= cursor->limit) {
+      /* this batch completes the cursor */
+      return;
+   } else {
+      n_return = _mongoc_n_return (cursor, pending);
+   }
+
+   if (_mongoc_cursor_op_getmore_send (cursor, server_stream, n_return,
+                                       &request_id, &error)) {
+      cursor->prefetching = true;
+      cursor->prefetch_request_id = (int32_t) request_id;
+      cursor->prefetch_stream = server_stream->stream;
+      cursor->prefetch_generation = server_stream->generation;
+   }
+}
+
+
 bool
 _mongoc_cursor_op_getmore (mongoc_cursor_t        *cursor,
                            mongoc_server_stream_t *server_stream)
 {
-   mongoc_rpc_t rpc;
    uint32_t request_id;
+   int32_t n_return;
    bool ret = false;
 
    ENTRY;
 
    if (cursor->in_exhaust) {
       request_id = (uint32_t) cursor->rpc.header.request_id;
+   } else if (_mongoc_cursor_has_prefetched (cursor, server_stream)) {
+      request_id = (uint32_t) cursor->prefetch_request_id;
    } else {
-      rpc.get_more.cursor_id = cursor->rpc.reply.cursor_id;
-      rpc.get_more.msg_len = 0;
-      rpc.get_more.request_id = 0;
-      rpc.get_more.response_to = 0;
-      rpc.get_more.opcode = MONGOC_OPCODE_GET_MORE;
-      rpc.get_more.zero = 0;
-      rpc.get_more.collection = cursor->ns;
       if ((cursor->flags & MONGOC_QUERY_TAILABLE_CURSOR)) {
-         rpc.get_more.n_return = 0;
+         n_return = 0;
       } else {
-         rpc.get_more.n_return = _mongoc_n_return(cursor);
+         n_return = _mongoc_n_return (cursor, 0);
       }
 
-      if (!mongoc_cluster_sendv_to_server (&cursor->client->cluster,
-                                           &rpc, 1, server_stream,
-                                           NULL, &cursor->error)) {
+      if (!_mongoc_cursor_op_getmore_send (cursor, server_stream, n_return,
+                                           &request_id, &cursor->error)) {
          GOTO (done);
       }
-
-      request_id = BSON_UINT32_FROM_LE (rpc.header.request_id);
    }
 
-   _mongoc_buffer_clear (&cursor->buffer, false);
+   _mongoc_cursor_clear_buffer (cursor);
 
    if (!_mongoc_client_recv (cursor->client,
                              &cursor->rpc,
                              &cursor->buffer,
                              server_stream,
+                             (int32_t) request_id,
                              &cursor->error)) {
       GOTO (done);
    }
@@ -892,13 +970,8 @@ _mongoc_cursor_op_getmore (mongoc_cursor_t        *cursor,
       GOTO (done);
    }
 
-   if (cursor->reader) {
-      bson_reader_destroy (cursor->reader);
-   }
-
-   cursor->reader = bson_reader_new_from_data (
-      cursor->rpc.reply.documents,
-      (size_t)cursor->rpc.reply.documents_len);
+   _mongoc_cursor_reader_init (cursor);
+   _mongoc_cursor_op_getmore_prefetch (cursor, server_stream);
 
    ret = true;
 
@@ -907,6 +980,219 @@ done:
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_should_prefetch --
+ *
+ *       Whether to request the next batch now: prefetch is enabled, the
+ *       server has more results, and no request is outstanding already.
+ *       Exhaust cursors are streamed by the server regardless.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_cursor_should_prefetch (const mongoc_cursor_t *cursor)
+{
+   return cursor->prefetch &&
+          !cursor->prefetching &&
+          !cursor->in_exhaust &&
+          !CURSOR_FAILED (cursor) &&
+          cursor->rpc.reply.cursor_id != 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_has_prefetched --
+ *
+ *       Whether the next batch was already requested on @server_stream.
+ *       If the connection it was sent on has been closed since, the
+ *       request is forgotten and the caller must send it again.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_cursor_has_prefetched (mongoc_cursor_t        *cursor,
+                               mongoc_server_stream_t *server_stream)
+{
+   if (!cursor->prefetching) {
+      return false;
+   }
+
+   cursor->prefetching = false;
+
+   /* a reconnect may get a new stream at the old stream's address */
+   return server_stream->stream == cursor->prefetch_stream &&
+          server_stream->generation == cursor->prefetch_generation;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_prefetch_command --
+ *
+ *       Send @command, a getMore command, without waiting for the reply.
+ *       The reply is received by _mongoc_cursor_recv_prefetched_command.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_cursor_prefetch_command (mongoc_cursor_t        *cursor,
+                                 mongoc_server_stream_t *server_stream,
+                                 const bson_t           *command)
+{
+   char cmd_ns[MONGOC_NAMESPACE_MAX];
+   mongoc_apply_read_prefs_result_t read_prefs_result = READ_PREFS_RESULT_INIT;
+   mongoc_rpc_t rpc;
+   bson_error_t error;
+
+   ENTRY;
+
+   BSON_ASSERT (!cursor->prefetching);
+
+   bson_snprintf (cmd_ns, sizeof cmd_ns, "%.*s.$cmd", cursor->dblen,
+                  cursor->ns);
+
+   apply_read_preferences (cursor->read_prefs, server_stream,
+                           command, cursor->flags, &read_prefs_result);
+
+   _mongoc_rpc_prep_command (&rpc,
+                             cmd_ns,
+                             read_prefs_result.query_with_read_prefs,
+                             read_prefs_result.flags);
+
+   if (mongoc_cluster_sendv_to_server (&cursor->client->cluster,
+                                       &rpc, 1, server_stream,
+                                       NULL, &error)) {
+      cursor->prefetching = true;
+      cursor->prefetch_request_id = BSON_UINT32_FROM_LE (
+         rpc.header.request_id);
+      cursor->prefetch_stream = server_stream->stream;
+      cursor->prefetch_generation = server_stream->generation;
+   }
+
+   apply_read_prefs_result_cleanup (&read_prefs_result);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_recv_prefetched_command --
+ *
+ *       Receive the reply to the command sent by
+ *       _mongoc_cursor_prefetch_command, like _mongoc_cursor_run_command
+ *       does for a command it sends itself.
+ *
+ *       The caller has checked _mongoc_cursor_has_prefetched.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_cursor_recv_prefetched_command (mongoc_cursor_t        *cursor,
+                                        mongoc_server_stream_t *server_stream)
+{
+   bson_t bson;
+
+   ENTRY;
+
+   _mongoc_cursor_clear_buffer (cursor);
+
+   if (!_mongoc_client_recv (cursor->client,
+                             &cursor->rpc,
+                             &cursor->buffer,
+                             server_stream,
+                             cursor->prefetch_request_id,
+                             &cursor->error)) {
+      RETURN (false);
+   }
+
+   if (cursor->rpc.header.opcode != MONGOC_OPCODE_REPLY ||
+       !_mongoc_rpc_reply_get_first (&cursor->rpc.reply, &bson)) {
+      bson_set_error (&cursor->error,
+                      MONGOC_ERROR_BSON,
+                      MONGOC_ERROR_BSON_INVALID,
+                      "Failed to decode reply BSON document.");
+      RETURN (false);
+   }
+
+   if (_mongoc_rpc_parse_command_error (&cursor->rpc, &cursor->error)) {
+      RETURN (false);
+   }
+
+   _mongoc_cursor_reader_init (cursor);
+
+   RETURN (true);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_drain_prefetch --
+ *
+ *       Receive and discard the reply to an outstanding prefetch before
+ *       the cursor is destroyed, so it is not left stashed on the
+ *       cluster. The reply carries the cursor id to kill, if any.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_cursor_drain_prefetch (mongoc_cursor_t *cursor)
+{
+   mongoc_server_stream_t *server_stream;
+   bson_iter_t iter;
+   bson_iter_t child;
+   bson_error_t error;
+   int64_t cursor_id;
+   bson_t bson;
+
+   ENTRY;
+
+   cursor_id = cursor->rpc.reply.cursor_id;
+   server_stream = _mongoc_cursor_fetch_stream (cursor);
+
+   if (!server_stream || !_mongoc_cursor_has_prefetched (cursor, server_stream)) {
+      GOTO (done);
+   }
+
+   _mongoc_cursor_clear_buffer (cursor);
+
+   if (!_mongoc_client_recv (cursor->client, &cursor->rpc, &cursor->buffer,
+                             server_stream, cursor->prefetch_request_id,
+                             &error) ||
+       cursor->rpc.header.opcode != MONGOC_OPCODE_REPLY) {
+      cursor->rpc.reply.cursor_id = cursor_id;
+      GOTO (done);
+   }
+
+   if (_use_find_command (cursor, server_stream) &&
+       _mongoc_rpc_reply_get_first (&cursor->rpc.reply, &bson) &&
+       bson_iter_init_find (&iter, &bson, "cursor") &&
+       BSON_ITER_HOLDS_DOCUMENT (&iter) &&
+       bson_iter_recurse (&iter, &child) &&
+       bson_iter_find (&child, "id")) {
+      cursor->rpc.reply.cursor_id = bson_iter_as_int64 (&child);
+   }
+
+done:
+   cursor->prefetching = false;
+   mongoc_server_stream_cleanup (server_stream);
+
+   EXIT;
+}
+
+
 bool
 mongoc_cursor_error (mongoc_cursor_t *cursor,
                      bson_error_t    *error)
@@ -994,18 +1280,112 @@ mongoc_cursor_next (mongoc_cursor_t  *cursor,
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_clear_buffer --
+ *
+ *       Prepare @cursor->buffer to receive the next reply. If the
+ *       application retained the current batch, the cursor drops its
+ *       reference to it; if that was the last reference the batch's
+ *       memory becomes the cursor's buffer again.
+ *
+ * Side effects:
+ *       Documents previously returned from this cursor are invalid,
+ *       unless their batch was retained.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_cursor_clear_buffer (mongoc_cursor_t *cursor)
+{
+   mongoc_cursor_batch_t *batch = cursor->batch;
+
+   if (batch) {
+      if (bson_atomic_int_add (&batch->ref_count, -1) == 0) {
+         /* the application is done with it already, reuse its memory */
+         _mongoc_buffer_destroy (&cursor->buffer);
+         memcpy (&cursor->buffer, &batch->buffer, sizeof cursor->buffer);
+         bson_free (batch);
+      }
+
+      cursor->batch = NULL;
+   }
+
+   _mongoc_buffer_clear (&cursor->buffer, false);
+   cursor->reader.active = false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_cursor_reader_init --
+ *
+ *       Start iterating the documents of the reply in @cursor->rpc.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_cursor_reader_init (mongoc_cursor_t *cursor)
+{
+   cursor->reader.data = cursor->rpc.reply.documents;
+   cursor->reader.len = (size_t) cursor->rpc.reply.documents_len;
+   cursor->reader.off = 0;
+   cursor->reader.active = true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_read_from_buffer --
+ *
+ *       Read the next document of the current reply. @bson points into
+ *       the receive buffer, it is not copied.
+ *
+ * Returns:
+ *       true if there was a document. end_of_event is set once the
+ *       reply is exhausted.
+ *
+ *--------------------------------------------------------------------------
+ */
+
 bool
 _mongoc_read_from_buffer (mongoc_cursor_t *cursor,
                           const bson_t   **bson)
 {
-   bool eof = false;
+   mongoc_cursor_reader_t *reader = &cursor->reader;
+   int32_t len;
+
+   *bson = NULL;
 
-   BSON_ASSERT (cursor->reader);
+   if (!reader->active || reader->off == reader->len) {
+      cursor->end_of_event = 1;
+      return false;
+   }
+
+   cursor->end_of_event = 0;
+
+   if (reader->len - reader->off < 5) {
+      return false;
+   }
+
+   memcpy (&len, reader->data + reader->off, 4);
+   len = BSON_UINT32_FROM_LE (len);
+
+   if (len < 5 || (size_t) len > reader->len - reader->off ||
+       !bson_init_static (&reader->current, reader->data + reader->off,
+                          (uint32_t) len)) {
+      return false;
+   }
 
-   *bson = bson_reader_read (cursor->reader, &eof);
-   cursor->end_of_event = eof ? 1 : 0;
+   reader->off += (size_t) len;
+   *bson = &reader->current;
 
-   return *bson ? true : false;
+   return true;
 }
 
 
@@ -1044,7 +1424,7 @@ _mongoc_cursor_next (mongoc_cursor_t  *cursor,
     * Try to read the next document from the reader if it exists, we might
     * get NULL back and EOF, in which case we need to submit a getmore.
     */
-   if (cursor->reader) {
+   if (cursor->reader.active) {
       _mongoc_read_from_buffer (cursor, &b);
       if (b) {
          GOTO (complete);
@@ -1191,6 +1571,7 @@ _mongoc_cursor_clone (const mongoc_cursor_t *cursor)
    _clone->nslen = cursor->nslen;
    _clone->dblen = cursor->dblen;
    _clone->has_fields = cursor->has_fields;
+   _clone->prefetch = cursor->prefetch;
 
    if (cursor->read_prefs) {
       _clone->read_prefs = mongoc_read_prefs_copy (cursor->read_prefs);
@@ -1304,3 +1685,101 @@ mongoc_cursor_get_max_await_time_ms (const mongoc_cursor_t *cursor)
 
    return cursor->max_await_time_ms;
 }
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cursor_retain_batch --
+ *
+ *       Keep the documents of the current batch valid after the cursor
+ *       moves on. Documents returned by mongoc_cursor_next() point into
+ *       the buffer the reply was received into, and normally the next
+ *       batch is received into the same buffer. Once retained, the
+ *       cursor receives the next batch elsewhere and this batch's
+ *       documents stay valid, even after mongoc_cursor_destroy(), until
+ *       every reference is released.
+ *
+ *       This may be called once per document; each call returns the
+ *       same batch with another reference until the next batch arrives.
+ *
+ * Returns:
+ *       A batch to release with mongoc_cursor_batch_release().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_cursor_batch_t *
+mongoc_cursor_retain_batch (mongoc_cursor_t *cursor)
+{
+   mongoc_cursor_batch_t *batch;
+
+   BSON_ASSERT (cursor);
+
+   if (!cursor->batch) {
+      batch = (mongoc_cursor_batch_t *)bson_malloc0 (sizeof *batch);
+      batch->ref_count = 1;
+      memcpy (&batch->buffer, &cursor->buffer, sizeof batch->buffer);
+      _mongoc_buffer_init (&cursor->buffer, NULL, 0, NULL, NULL);
+      cursor->batch = batch;
+   }
+
+   bson_atomic_int_add (&cursor->batch->ref_count, 1);
+
+   return cursor->batch;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cursor_batch_release --
+ *
+ *       Release a reference from mongoc_cursor_retain_batch(). It is
+ *       safe to call this from any thread.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_cursor_batch_release (mongoc_cursor_batch_t *batch)
+{
+   if (batch && bson_atomic_int_add (&batch->ref_count, -1) == 0) {
+      _mongoc_buffer_destroy (&batch->buffer);
+      bson_free (batch);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_cursor_set_prefetch --
+ *
+ *       Enable or disable read-ahead. With prefetch enabled, the cursor
+ *       requests the next batch from the server as soon as it receives
+ *       the current one, instead of when the current one is exhausted,
+ *       hiding a round trip per batch. The request shares the cursor's
+ *       connection; its reply is received when the application reaches
+ *       the end of the current batch.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_cursor_set_prefetch (mongoc_cursor_t *cursor,
+                            bool             prefetch)
+{
+   BSON_ASSERT (cursor);
+
+   cursor->prefetch = prefetch ? 1 : 0;
+}
+
+
+bool
+mongoc_cursor_get_prefetch (const mongoc_cursor_t *cursor)
+{
+   BSON_ASSERT (cursor);
+
+   return !!cursor->prefetch;
+}
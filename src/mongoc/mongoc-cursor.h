@@ -29,7 +29,8 @@
 BSON_BEGIN_DECLS
 
 
-typedef struct _mongoc_cursor_t mongoc_cursor_t;
+typedef struct _mongoc_cursor_t       mongoc_cursor_t;
+typedef struct _mongoc_cursor_batch_t mongoc_cursor_batch_t;
 
 
 mongoc_cursor_t *mongoc_cursor_clone                 (const mongoc_cursor_t *cursor) BSON_GNUC_WARN_UNUSED_RESULT;
@@ -51,6 +52,12 @@ int64_t          mongoc_cursor_get_id                (const mongoc_cursor_t *cur
 void             mongoc_cursor_set_max_await_time_ms (mongoc_cursor_t       *cursor,
                                                       uint32_t               max_await_time_ms);
 uint32_t         mongoc_cursor_get_max_await_time_ms (const mongoc_cursor_t *cursor);
+void             mongoc_cursor_set_prefetch          (mongoc_cursor_t       *cursor,
+                                                      bool                   prefetch);
+bool             mongoc_cursor_get_prefetch          (const mongoc_cursor_t *cursor);
+mongoc_cursor_batch_t *
+                 mongoc_cursor_retain_batch          (mongoc_cursor_t       *cursor);
+void             mongoc_cursor_batch_release         (mongoc_cursor_batch_t *batch);
 
 
 BSON_END_DECLS
@@ -138,6 +138,7 @@ static MONGOC_ONCE_FUN( _mongoc_do_cleanup)
    WSACleanup ();
 #endif
 
+   mongoc_log_async_stop ();
    _mongoc_counters_cleanup ();
 
    MONGOC_ONCE_RETURN;
@@ -25,9 +25,11 @@
 #include <stdarg.h>
 #include <time.h>
 
+#include "mongoc-counters-private.h"
 #include "mongoc-log.h"
 #include "mongoc-log-private.h"
 #include "mongoc-thread-private.h"
+#include "mongoc-util-private.h"
 
 
 static mongoc_mutex_t       gLogMutex;
@@ -37,6 +39,57 @@ static bool               gLogTrace = true;
 #endif
 static void              *gLogData;
 
+
+/*
+ * Asynchronous logging.
+ *
+ * Messages are queued in a bounded ring and passed to the handler by a
+ * background thread, so threads that log never wait for the handler or
+ * for each other. A producer first reserves room by incrementing
+ * "count", dropping the message if "max_queued" are already waiting,
+ * then takes the next slot by incrementing "tail". Since at most
+ * "max_queued", and so at most "capacity", messages are reserved and
+ * not yet consumed, that slot has always been consumed already. The
+ * producer fills the slot and sets "ready"; the consumer takes slots in
+ * order, waiting for "ready" if a producer is still filling the next one.
+ */
+typedef struct
+{
+   volatile int32_t    ready;
+   mongoc_log_level_t  log_level;
+   char               *log_domain;
+   char               *message;
+} mongoc_log_slot_t;
+
+
+typedef struct
+{
+   mongoc_log_slot_t  *slots;
+   uint32_t            capacity;
+   uint32_t            max_queued;
+   volatile int32_t    count;
+   volatile int32_t    tail;
+   uint32_t            head;
+   bool                stopping;
+   mongoc_mutex_t      mutex;
+   mongoc_cond_t       cond;
+   mongoc_thread_t     thread;
+} mongoc_log_ring_t;
+
+
+/* how long the logging thread sleeps when there is nothing to log */
+#define MONGOC_LOG_ASYNC_IDLE_MSEC 10
+
+static mongoc_log_ring_t *gLogRing;
+static volatile int32_t   gLogAsync;
+static volatile int32_t   gLogProducers;
+
+
+static void _mongoc_log_enqueue (mongoc_log_ring_t  *ring,
+                                 mongoc_log_level_t  log_level,
+                                 const char         *log_domain,
+                                 char               *message);
+
 static MONGOC_ONCE_FUN( _mongoc_ensure_mutex_once)
 {
    mongoc_mutex_init(&gLogMutex);
@@ -95,6 +148,18 @@ mongoc_log (mongoc_log_level_t  log_level,
    message = bson_strdupv_printf(format, args);
    va_end(args);
 
+   /* stopping async logging waits until no thread is in here */
+   bson_atomic_int_add (&gLogProducers, 1);
+   bson_memory_barrier ();
+
+   if (gLogAsync) {
+      _mongoc_log_enqueue (gLogRing, log_level, log_domain, message);
+      bson_atomic_int_add (&gLogProducers, -1);
+      return;
+   }
+
+   bson_atomic_int_add (&gLogProducers, -1);
+
    mongoc_mutex_lock(&gLogMutex);
    gLogFunc(log_level, log_domain, message, gLogData);
    mongoc_mutex_unlock(&gLogMutex);
@@ -103,6 +168,177 @@ mongoc_log (mongoc_log_level_t  log_level,
 }
 
 
+/* queue @message for the logging thread, or drop it if @ring is full */
+
+static void
+_mongoc_log_enqueue (mongoc_log_ring_t  *ring,
+                     mongoc_log_level_t  log_level,
+                     const char         *log_domain,
+                     char               *message)
+{
+   mongoc_log_slot_t *slot;
+   uint32_t pos;
+
+   if ((uint32_t) bson_atomic_int_add (&ring->count, 1) > ring->max_queued) {
+      bson_atomic_int_add (&ring->count, -1);
+      mongoc_counter_log_dropped_inc ();
+      bson_free (message);
+      return;
+   }
+
+   pos = (uint32_t) bson_atomic_int_add (&ring->tail, 1) - 1;
+   slot = &ring->slots[pos & (ring->capacity - 1)];
+
+   slot->log_level = log_level;
+   slot->log_domain = bson_strdup (log_domain);
+   slot->message = message;
+
+   bson_memory_barrier ();
+   slot->ready = 1;
+
+   mongoc_counter_log_queued_inc ();
+}
+
+
+/* log queued messages until @ring is empty or the next slot isn't filled */
+
+static bool
+_mongoc_log_dequeue (mongoc_log_ring_t *ring)
+{
+   mongoc_log_slot_t *slot;
+   bool logged = false;
+
+   for (;;) {
+      slot = &ring->slots[ring->head & (ring->capacity - 1)];
+
+      if (!slot->ready) {
+         return logged;
+      }
+
+      bson_memory_barrier ();
+
+      mongoc_mutex_lock (&gLogMutex);
+      if (gLogFunc) {
+         gLogFunc (slot->log_level, slot->log_domain, slot->message,
+                   gLogData);
+      }
+      mongoc_mutex_unlock (&gLogMutex);
+
+      bson_free (slot->log_domain);
+      bson_free (slot->message);
+
+      slot->ready = 0;
+      bson_memory_barrier ();
+
+      ring->head++;
+      bson_atomic_int_add (&ring->count, -1);
+      logged = true;
+   }
+}
+
+
+static void *
+_mongoc_log_run_async (void *data)
+{
+   mongoc_log_ring_t *ring = (mongoc_log_ring_t *)data;
+   bool stopping;
+
+   for (;;) {
+      if (_mongoc_log_dequeue (ring)) {
+         continue;
+      }
+
+      mongoc_mutex_lock (&ring->mutex);
+      stopping = ring->stopping;
+      if (!stopping) {
+         mongoc_cond_timedwait (&ring->cond, &ring->mutex,
+                                MONGOC_LOG_ASYNC_IDLE_MSEC);
+      }
+      mongoc_mutex_unlock (&ring->mutex);
+
+      if (stopping) {
+         /* producers are gone, log what they left */
+         while (ring->count) {
+            _mongoc_log_dequeue (ring);
+         }
+
+         return NULL;
+      }
+   }
+}
+
+
+bool
+mongoc_log_async_start (uint32_t max_queued)
+{
+   static mongoc_once_t once = MONGOC_ONCE_INIT;
+   mongoc_log_ring_t *ring;
+   uint32_t capacity = 1;
+
+   BSON_ASSERT (max_queued > 0 && max_queued <= (1U << 30));
+
+   mongoc_once(&once, &_mongoc_ensure_mutex_once);
+
+   if (gLogRing) {
+      return false;
+   }
+
+   /* a power of two, so slot indexes stay in order when "tail" wraps */
+   while (capacity < max_queued) {
+      capacity <<= 1;
+   }
+
+   ring = (mongoc_log_ring_t *)bson_malloc0 (sizeof *ring);
+   ring->slots = (mongoc_log_slot_t *)bson_malloc0 (
+      capacity * sizeof *ring->slots);
+   ring->capacity = capacity;
+   ring->max_queued = max_queued;
+   mongoc_mutex_init (&ring->mutex);
+   mongoc_cond_init (&ring->cond);
+
+   gLogRing = ring;
+   mongoc_thread_create (&ring->thread, _mongoc_log_run_async, ring);
+
+   bson_memory_barrier ();
+   gLogAsync = 1;
+
+   return true;
+}
+
+
+void
+mongoc_log_async_stop (void)
+{
+   mongoc_log_ring_t *ring = gLogRing;
+
+   if (!ring) {
+      return;
+   }
+
+   gLogAsync = 0;
+   bson_memory_barrier ();
+
+   /* wait for threads that saw gLogAsync set to finish queuing */
+   while (gLogProducers) {
+      _mongoc_usleep (100);
+   }
+
+   mongoc_mutex_lock (&ring->mutex);
+   ring->stopping = true;
+   mongoc_cond_signal (&ring->cond);
+   mongoc_mutex_unlock (&ring->mutex);
+
+   mongoc_thread_join (ring->thread);
+
+   gLogRing = NULL;
+
+   mongoc_mutex_destroy (&ring->mutex);
+   mongoc_cond_destroy (&ring->cond);
+   bson_free (ring->slots);
+   bson_free (ring);
+}
+
+
 const char *
 mongoc_log_level_str (mongoc_log_level_t log_level)
 {
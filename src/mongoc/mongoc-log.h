@@ -92,6 +92,8 @@ void mongoc_log_set_handler (mongoc_log_func_t  log_func,
  * logging infrastructure. It is important that your configured log function
  * does not re-enter the logging system or deadlock will occur.
  *
+ * After mongoc_log_async_start(), the message is queued instead and this
+ * method returns without waiting for the log function.
  */
 void mongoc_log (mongoc_log_level_t  log_level,
                  const char         *log_domain,
@@ -100,6 +102,28 @@ void mongoc_log (mongoc_log_level_t  log_level,
    BSON_GNUC_PRINTF(3, 4);
 
 
+/**
+ * mongoc_log_async_start:
+ * @max_queued: The most messages to hold while the log function catches up.
+ *
+ * Calls the log function from a background thread, so that threads which
+ * log never wait for it. If @max_queued messages are already waiting, new
+ * messages are dropped and counted by the "Logging Dropped" counter.
+ *
+ * Returns: false if asynchronous logging was already started.
+ */
+bool mongoc_log_async_start (uint32_t max_queued);
+
+
+/**
+ * mongoc_log_async_stop:
+ *
+ * Waits for the background thread to log every queued message, then goes
+ * back to calling the log function from the thread that logs. This must
+ * not be called from the log function. mongoc_cleanup() calls it.
+ */
+void mongoc_log_async_stop (void);
+
 
 void mongoc_log_default_handler (mongoc_log_level_t  log_level,
                                  const char         *log_domain,
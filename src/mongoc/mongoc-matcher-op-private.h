@@ -22,6 +22,11 @@
 #endif
 
 #include <bson.h>
+#ifndef _WIN32
+# include <regex.h>
+#endif
+
+#include "mongoc-array-private.h"
 
 
 BSON_BEGIN_DECLS
@@ -34,6 +39,10 @@ typedef struct _mongoc_matcher_op_compare_t mongoc_matcher_op_compare_t;
 typedef struct _mongoc_matcher_op_exists_t  mongoc_matcher_op_exists_t;
 typedef struct _mongoc_matcher_op_type_t    mongoc_matcher_op_type_t;
 typedef struct _mongoc_matcher_op_not_t     mongoc_matcher_op_not_t;
+typedef struct _mongoc_matcher_op_regex_t   mongoc_matcher_op_regex_t;
+typedef struct _mongoc_matcher_op_elem_match_t mongoc_matcher_op_elem_match_t;
+typedef struct _mongoc_matcher_op_size_t    mongoc_matcher_op_size_t;
+typedef struct _mongoc_matcher_op_mod_t     mongoc_matcher_op_mod_t;
 
 
 typedef enum
@@ -52,9 +61,33 @@ typedef enum
    MONGOC_MATCHER_OPCODE_NOR,
    MONGOC_MATCHER_OPCODE_EXISTS,
    MONGOC_MATCHER_OPCODE_TYPE,
+   MONGOC_MATCHER_OPCODE_REGEX,
+   MONGOC_MATCHER_OPCODE_ELEM_MATCH,
+   MONGOC_MATCHER_OPCODE_ALL,
+   MONGOC_MATCHER_OPCODE_SIZE,
+   MONGOC_MATCHER_OPCODE_MOD,
 } mongoc_matcher_opcode_t;
 
 
+/*
+ * The values of an $in, $nin or $all array, hashed so that a field is
+ * looked up rather than compared with each value in turn. Values that
+ * can't be hashed consistently with equality, such as arrays, are kept
+ * aside and compared one by one.
+ */
+typedef struct
+{
+   uint32_t     n_values;  /* number of values, hashed or not */
+   uint32_t     n_buckets; /* power of two */
+   uint32_t    *buckets;   /* index + 1 into values, or 0 if empty */
+   uint32_t    *hashes;
+   bson_iter_t *values;
+   uint32_t     n_unhashed;
+   uint32_t    *unhashed;  /* indexes into values */
+   bool         never;     /* some value can never be equal to a field */
+} mongoc_matcher_value_set_t;
+
+
 struct _mongoc_matcher_op_base_t
 {
    mongoc_matcher_opcode_t opcode;
@@ -74,6 +107,7 @@ struct _mongoc_matcher_op_compare_t
    mongoc_matcher_op_base_t base;
    char *path;
    bson_iter_t iter;
+   mongoc_matcher_value_set_t *set; /* for $in, $nin and $all */
 };
 
 
@@ -101,6 +135,44 @@ struct _mongoc_matcher_op_not_t
 };
 
 
+struct _mongoc_matcher_op_regex_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   char *pattern;
+   char *options;
+#ifndef _WIN32
+   regex_t re;
+#endif
+};
+
+
+struct _mongoc_matcher_op_elem_match_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   mongoc_matcher_op_t *child;
+   bool is_value; /* child tests each element itself, not its fields */
+};
+
+
+struct _mongoc_matcher_op_size_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   int64_t size;
+};
+
+
+struct _mongoc_matcher_op_mod_t
+{
+   mongoc_matcher_op_base_t base;
+   char *path;
+   int64_t divisor;
+   int64_t remainder;
+};
+
+
 union _mongoc_matcher_op_t
 {
    mongoc_matcher_op_base_t base;
@@ -109,6 +181,10 @@ union _mongoc_matcher_op_t
    mongoc_matcher_op_exists_t exists;
    mongoc_matcher_op_type_t type;
    mongoc_matcher_op_not_t not_;
+   mongoc_matcher_op_regex_t regex;
+   mongoc_matcher_op_elem_match_t elem_match;
+   mongoc_matcher_op_size_t size;
+   mongoc_matcher_op_mod_t mod;
 };
 
 
@@ -124,8 +200,29 @@ mongoc_matcher_op_t *_mongoc_matcher_op_type_new    (const char              *pa
                                                      bson_type_t              type);
 mongoc_matcher_op_t *_mongoc_matcher_op_not_new     (const char              *path,
                                                      mongoc_matcher_op_t     *child);
+mongoc_matcher_op_t *_mongoc_matcher_op_regex_new   (const char              *path,
+                                                     const char              *pattern,
+                                                     const char              *options,
+                                                     bson_error_t            *error);
+mongoc_matcher_op_t *_mongoc_matcher_op_elem_match_new
+                                                    (const char              *path,
+                                                     mongoc_matcher_op_t     *child,
+                                                     bool                     is_value);
+mongoc_matcher_op_t *_mongoc_matcher_op_size_new    (const char              *path,
+                                                     int64_t                  size);
+mongoc_matcher_op_t *_mongoc_matcher_op_mod_new     (const char              *path,
+                                                     int64_t                  divisor,
+                                                     int64_t                  remainder);
 bool                 _mongoc_matcher_op_match       (mongoc_matcher_op_t     *op,
                                                      const bson_t            *bson);
+bool                 _mongoc_matcher_op_is_leaf     (const mongoc_matcher_op_t *op);
+const char          *_mongoc_matcher_op_leaf_path   (const mongoc_matcher_op_t *op);
+void                 _mongoc_matcher_op_conjuncts   (mongoc_matcher_op_t     *op,
+                                                     mongoc_array_t          *conjuncts);
+bool                 _mongoc_matcher_op_match_iter  (mongoc_matcher_op_t     *op,
+                                                     bson_iter_t             *iter);
+bool                 _mongoc_matcher_op_match_value (mongoc_matcher_op_t     *op,
+                                                     bson_iter_t             *iter);
 void                 _mongoc_matcher_op_destroy     (mongoc_matcher_op_t     *op);
 void                 _mongoc_matcher_op_to_bson     (mongoc_matcher_op_t     *op,
                                                      bson_t                  *bson);
@@ -15,10 +15,18 @@
  */
 
 
+#include <ctype.h>
+#include <string.h>
+
+#include "mongoc-error.h"
 #include "mongoc-log.h"
 #include "mongoc-matcher-op-private.h"
 #include "mongoc-util-private.h"
 
+
+static bool _mongoc_matcher_iter_eq_match (bson_iter_t *compare_iter,
+                                           bson_iter_t *iter);
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -129,6 +137,233 @@ _mongoc_matcher_op_logical_new (mongoc_matcher_opcode_t  opcode, /* IN */
 }
 
 
+/*
+ * Hash a value for the value set of an $in, $nin or $all. Values that
+ * _mongoc_matcher_iter_eq_match() finds equal must hash the same, so all
+ * numbers are hashed as doubles. @is_query tells whether @iter is a value
+ * from the query's array, which the equality test treats differently
+ * from a document's field: a query's bool or undefined never equals
+ * anything, while a field's bool equals the numbers 0 and 1 and its
+ * undefined equals null.
+ *
+ * Returns false if @iter can't be hashed. For the query's values, that
+ * is either because nothing can equal them, or because they are arrays
+ * and must be compared one by one.
+ */
+static bool
+_mongoc_matcher_value_hash (const bson_iter_t *iter,     /* IN */
+                            bool               is_query, /* IN */
+                            uint32_t          *hash)     /* OUT */
+{
+   const uint8_t *data;
+   uint32_t len;
+   uint32_t h;
+   uint32_t i;
+   uint8_t tag;
+   double d;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+      d = bson_iter_double (iter);
+      if (d != d) {
+         return false;
+      }
+      break;
+   case BSON_TYPE_INT32:
+      d = (double)bson_iter_int32 (iter);
+      break;
+   case BSON_TYPE_INT64:
+      d = (double)bson_iter_int64 (iter);
+      break;
+   case BSON_TYPE_BOOL:
+      if (is_query) {
+         return false;
+      }
+      d = bson_iter_bool (iter) ? 1.0 : 0.0;
+      break;
+   case BSON_TYPE_UTF8:
+      data = (const uint8_t *)bson_iter_utf8 (iter, &len);
+      tag = BSON_TYPE_UTF8;
+      goto bytes;
+   case BSON_TYPE_DOCUMENT:
+      bson_iter_document (iter, &len, &data);
+      tag = BSON_TYPE_DOCUMENT;
+      goto bytes;
+   case BSON_TYPE_UNDEFINED:
+      if (is_query) {
+         return false;
+      }
+      /* fall through */
+   case BSON_TYPE_NULL:
+      data = NULL;
+      len = 0;
+      tag = BSON_TYPE_NULL;
+      goto bytes;
+   default:
+      return false;
+   }
+
+   if (d == 0.0) {
+      d = 0.0; /* -0.0 == 0.0 */
+   }
+
+   data = (const uint8_t *)&d;
+   len = (uint32_t)sizeof d;
+   tag = BSON_TYPE_DOUBLE;
+
+bytes:
+   /* FNV-1a */
+   h = 2166136261u;
+   h = (h ^ tag) * 16777619u;
+   for (i = 0; i < len; i++) {
+      h = (h ^ data[i]) * 16777619u;
+   }
+
+   *hash = h;
+
+   return true;
+}
+
+
+/* Build the value set of an $in, $nin or $all from the array @iter. */
+static mongoc_matcher_value_set_t *
+_mongoc_matcher_value_set_new (const bson_iter_t *iter) /* IN */
+{
+   mongoc_matcher_value_set_t *set;
+   bson_iter_t child;
+   uint32_t n_alloc;
+   uint32_t hash;
+   uint32_t mask;
+   uint32_t i;
+   uint32_t j;
+
+   set = (mongoc_matcher_value_set_t *)bson_malloc0 (sizeof *set);
+
+   n_alloc = 0;
+   if (bson_iter_recurse (iter, &child)) {
+      while (bson_iter_next (&child)) {
+         n_alloc++;
+      }
+   }
+
+   set->n_buckets = 8;
+   while (set->n_buckets < n_alloc * 2) {
+      set->n_buckets <<= 1;
+   }
+
+   set->buckets = (uint32_t *)bson_malloc0 (set->n_buckets * sizeof (uint32_t));
+   set->hashes = (uint32_t *)bson_malloc0 ((n_alloc + 1) * sizeof (uint32_t));
+   set->values = (bson_iter_t *)bson_malloc0 ((n_alloc + 1) *
+                                              sizeof (bson_iter_t));
+   set->unhashed = (uint32_t *)bson_malloc0 ((n_alloc + 1) * sizeof (uint32_t));
+
+   mask = set->n_buckets - 1;
+
+   if (!bson_iter_recurse (iter, &child)) {
+      return set;
+   }
+
+   while (bson_iter_next (&child)) {
+      i = set->n_values;
+
+      if (_mongoc_matcher_value_hash (&child, true, &hash)) {
+         for (j = hash & mask; set->buckets[j]; j = (j + 1) & mask) { }
+         set->buckets[j] = i + 1;
+         set->hashes[i] = hash;
+      } else if (BSON_ITER_HOLDS_ARRAY (&child)) {
+         set->unhashed[set->n_unhashed++] = i;
+      } else {
+         set->never = true;
+         continue;
+      }
+
+      memcpy (&set->values[i], &child, sizeof child);
+      set->n_values++;
+   }
+
+   return set;
+}
+
+
+static void
+_mongoc_matcher_value_set_destroy (mongoc_matcher_value_set_t *set) /* IN */
+{
+   if (set) {
+      bson_free (set->buckets);
+      bson_free (set->hashes);
+      bson_free (set->values);
+      bson_free (set->unhashed);
+      bson_free (set);
+   }
+}
+
+
+/*
+ * Find the values in @set equal to the field @iter. If @marks is NULL,
+ * stop at the first one; otherwise set marks[i] for every values[i] that
+ * is equal, and count how many were not already marked in *n_marked.
+ *
+ * Returns true if any value was equal.
+ */
+static bool
+_mongoc_matcher_value_set_find (const mongoc_matcher_value_set_t *set,      /* IN */
+                                bson_iter_t                      *iter,     /* IN */
+                                bool                             *marks,    /* INOUT */
+                                uint32_t                         *n_marked) /* INOUT */
+{
+   uint32_t hash;
+   uint32_t mask;
+   uint32_t i;
+   uint32_t j;
+   bool found = false;
+
+   if (_mongoc_matcher_value_hash (iter, false, &hash)) {
+      mask = set->n_buckets - 1;
+
+      for (j = hash & mask; set->buckets[j]; j = (j + 1) & mask) {
+         i = set->buckets[j] - 1;
+
+         if (set->hashes[i] != hash ||
+             !_mongoc_matcher_iter_eq_match (&set->values[i], iter)) {
+            continue;
+         }
+
+         found = true;
+
+         if (!marks) {
+            return true;
+         }
+
+         if (!marks[i]) {
+            marks[i] = true;
+            (*n_marked)++;
+         }
+      }
+   } else if (BSON_ITER_HOLDS_ARRAY (iter)) {
+      for (j = 0; j < set->n_unhashed; j++) {
+         i = set->unhashed[j];
+
+         if (!_mongoc_matcher_iter_eq_match (&set->values[i], iter)) {
+            continue;
+         }
+
+         found = true;
+
+         if (!marks) {
+            return true;
+         }
+
+         if (!marks[i]) {
+            marks[i] = true;
+            (*n_marked)++;
+         }
+      }
+   }
+
+   return found;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -144,6 +379,10 @@ _mongoc_matcher_op_logical_new (mongoc_matcher_opcode_t  opcode, /* IN */
  *          {$ne: {...}
  *          {$in: [...]}
  *          {$nin: [...]}
+ *          {$all: [...]}
+ *
+ *       The values of $in, $nin and $all are hashed here, once, so
+ *       matching a field costs about the same however many there are.
  *
  * Returns:
  *       A newly allocated mongoc_matcher_op_t that should be freed with
@@ -170,6 +409,13 @@ _mongoc_matcher_op_compare_new (mongoc_matcher_opcode_t  opcode, /* IN */
    op->compare.path = bson_strdup (path);
    memcpy (&op->compare.iter, iter, sizeof *iter);
 
+   if ((opcode == MONGOC_MATCHER_OPCODE_IN ||
+        opcode == MONGOC_MATCHER_OPCODE_NIN ||
+        opcode == MONGOC_MATCHER_OPCODE_ALL) &&
+       BSON_ITER_HOLDS_ARRAY (iter)) {
+      op->compare.set = _mongoc_matcher_value_set_new (iter);
+   }
+
    return op;
 }
 
@@ -209,6 +455,384 @@ _mongoc_matcher_op_not_new (const char          *path,  /* IN */
 }
 
 
+#ifndef _WIN32
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_regex_translate --
+ *
+ *       Rewrite the PCRE @pattern as a POSIX extended regular expression
+ *       with the same meaning, appending it to @str.
+ *
+ *       POSIX has one flag, REG_NEWLINE, for both of PCRE's "m" and "s"
+ *       options, and it also stops [^...] from matching a line break.
+ *       We pass REG_NEWLINE for "m" only, so without "s" each . becomes
+ *       [^\n], and with "m" a negated bracket or a "s" . is widened to
+ *       also match a line break.
+ *
+ *       PCRE syntax that POSIX lacks, or parses differently, is rejected
+ *       rather than silently matched as something else: backslash
+ *       escapes of letters and digits (\d, \w, \s, \b, \1, ...), any
+ *       backslash in a bracket expression, (?...) groups, and lazy or
+ *       possessive quantifiers.
+ *
+ * Returns:
+ *       true if @pattern could be translated, otherwise false and @error
+ *       is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_regex_translate (const char    *pattern,   /* IN */
+                                 bool           multiline, /* IN */
+                                 bool           dotall,    /* IN */
+                                 bson_string_t *str,       /* OUT */
+                                 bson_error_t  *error)     /* OUT */
+{
+   const char *c = pattern;
+   const char *start;
+   const char *end;
+   bool negated;
+
+   while (*c) {
+      switch (*c) {
+      case '\\':
+         if (isalnum ((unsigned char)c[1])) {
+            bson_set_error (error,
+                            MONGOC_ERROR_MATCHER,
+                            MONGOC_ERROR_MATCHER_INVALID,
+                            "Invalid $regex \"%s\": \\%c is not supported",
+                            pattern, c[1]);
+            return false;
+         }
+         bson_string_append_c (str, *c++);
+         if (*c) {
+            bson_string_append_c (str, *c++);
+         }
+         continue;
+      case '(':
+         if (c[1] == '?') {
+            bson_set_error (error,
+                            MONGOC_ERROR_MATCHER,
+                            MONGOC_ERROR_MATCHER_INVALID,
+                            "Invalid $regex \"%s\": (? is not supported",
+                            pattern);
+            return false;
+         }
+         bson_string_append_c (str, *c++);
+         continue;
+      case '.':
+         if (!dotall) {
+            bson_string_append (str, "[^\n]");
+         } else if (multiline) {
+            bson_string_append (str, "(.|\n)");
+         } else {
+            bson_string_append_c (str, '.');
+         }
+         c++;
+         continue;
+      case '[':
+         /* find the closing ], which is literal first in the list, and
+          * skip over [:class:], [=equiv=] and [.coll.] */
+         start = c++;
+         negated = (*c == '^');
+         if (negated) {
+            c++;
+         }
+         if (*c == ']') {
+            c++;
+         }
+         while (*c && *c != ']') {
+            if (*c == '\\') {
+               bson_set_error (error,
+                               MONGOC_ERROR_MATCHER,
+                               MONGOC_ERROR_MATCHER_INVALID,
+                               "Invalid $regex \"%s\": \\ in a bracket "
+                               "expression is not supported",
+                               pattern);
+               return false;
+            }
+            if (*c == '[' && (c[1] == ':' || c[1] == '=' || c[1] == '.') &&
+                (end = strchr (c + 2, c[1])) && end[1] == ']') {
+               c = end + 2;
+            } else {
+               c++;
+            }
+         }
+         if (!*c) {
+            /* unterminated, let regcomp() report it */
+            bson_string_append (str, start);
+            return true;
+         }
+         c++;
+         if (negated && multiline) {
+            bson_string_append_c (str, '(');
+            bson_string_append_printf (str, "%.*s", (int)(c - start), start);
+            bson_string_append (str, "|\n)");
+         } else {
+            bson_string_append_printf (str, "%.*s", (int)(c - start), start);
+         }
+         continue;
+      case '{':
+         if (!(end = strchr (c, '}'))) {
+            bson_string_append (str, c);
+            return true;
+         }
+         bson_string_append_printf (str, "%.*s", (int)(end - c), c);
+         c = end;
+         /* fall through */
+      case '}':
+      case '*':
+      case '+':
+      case '?':
+         bson_string_append_c (str, *c++);
+         if (*c == '?' || *c == '+') {
+            bson_set_error (error,
+                            MONGOC_ERROR_MATCHER,
+                            MONGOC_ERROR_MATCHER_INVALID,
+                            "Invalid $regex \"%s\": lazy and possessive "
+                            "quantifiers are not supported",
+                            pattern);
+            return false;
+         }
+         continue;
+      default:
+         bson_string_append_c (str, *c++);
+         continue;
+      }
+   }
+
+   return true;
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_regex_new --
+ *
+ *       Create a new op for checking {$regex: "pattern", $options: "..."}
+ *       or a BSON regular expression. The pattern is compiled here, once,
+ *       as a POSIX extended regular expression.
+ *
+ *       The supported options are "i" for case insensitive matching,
+ *       "m" for ^ and $ to match at line breaks, and "s" for . to match
+ *       line breaks. See _mongoc_matcher_regex_translate() for how they
+ *       are mapped onto POSIX, and for the PCRE syntax that is rejected.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy(), or NULL if @pattern or @options is
+ *       invalid and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_regex_new (const char   *path,    /* IN */
+                              const char   *pattern, /* IN */
+                              const char   *options, /* IN */
+                              bson_error_t *error)   /* OUT */
+{
+#ifdef _WIN32
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "$regex is not supported on this platform.");
+   return NULL;
+#else
+   mongoc_matcher_op_t *op;
+   bson_string_t *str;
+   const char *c;
+   char msg[128];
+   int flags = REG_EXTENDED | REG_NOSUB;
+   bool multiline = false;
+   bool dotall = false;
+   int r;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (pattern);
+
+   if (!options) {
+      options = "";
+   }
+
+   for (c = options; *c; c++) {
+      switch (*c) {
+      case 'i':
+         flags |= REG_ICASE;
+         break;
+      case 'm':
+         flags |= REG_NEWLINE;
+         multiline = true;
+         break;
+      case 's':
+         dotall = true;
+         break;
+      default:
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "Invalid $options \"%s\"",
+                         options);
+         return NULL;
+      }
+   }
+
+   str = bson_string_new (NULL);
+
+   if (!_mongoc_matcher_regex_translate (pattern, multiline, dotall,
+                                         str, error)) {
+      bson_string_free (str, true);
+      return NULL;
+   }
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   r = regcomp (&op->regex.re, str->str, flags);
+   bson_string_free (str, true);
+
+   if (r) {
+      regerror (r, &op->regex.re, msg, sizeof msg);
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid $regex \"%s\": %s",
+                      pattern, msg);
+      bson_free (op);
+      return NULL;
+   }
+
+   op->regex.base.opcode = MONGOC_MATCHER_OPCODE_REGEX;
+   op->regex.path = bson_strdup (path);
+   op->regex.pattern = bson_strdup (pattern);
+   op->regex.options = bson_strdup (options);
+
+   return op;
+#endif
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_elem_match_new --
+ *
+ *       Create a new op for checking {$elemMatch: {...}}.
+ *
+ *       If @is_value, @child is made of operators such as $gt that are
+ *       applied to each element of the array itself. Otherwise @child
+ *       is a query applied to each element that is a document.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_elem_match_new (const char          *path,     /* IN */
+                                   mongoc_matcher_op_t *child,    /* IN */
+                                   bool                 is_value) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (child);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->elem_match.base.opcode = MONGOC_MATCHER_OPCODE_ELEM_MATCH;
+   op->elem_match.path = bson_strdup (path);
+   op->elem_match.child = child;
+   op->elem_match.is_value = is_value;
+
+   return op;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_size_new --
+ *
+ *       Create a new op for checking {$size: int}.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_size_new (const char *path, /* IN */
+                             int64_t     size) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (size >= 0);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->size.base.opcode = MONGOC_MATCHER_OPCODE_SIZE;
+   op->size.path = bson_strdup (path);
+   op->size.size = size;
+
+   return op;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_mod_new --
+ *
+ *       Create a new op for checking {$mod: [divisor, remainder]}.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t that should be freed with
+ *       _mongoc_matcher_op_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_op_mod_new (const char *path,      /* IN */
+                            int64_t     divisor,   /* IN */
+                            int64_t     remainder) /* IN */
+{
+   mongoc_matcher_op_t *op;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (divisor != 0);
+
+   op = (mongoc_matcher_op_t *)bson_malloc0 (sizeof *op);
+   op->mod.base.opcode = MONGOC_MATCHER_OPCODE_MOD;
+   op->mod.path = bson_strdup (path);
+   op->mod.divisor = divisor;
+   op->mod.remainder = remainder;
+
+   return op;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -238,6 +862,8 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
    case MONGOC_MATCHER_OPCODE_LTE:
    case MONGOC_MATCHER_OPCODE_NE:
    case MONGOC_MATCHER_OPCODE_NIN:
+   case MONGOC_MATCHER_OPCODE_ALL:
+      _mongoc_matcher_value_set_destroy (op->compare.set);
       bson_free (op->compare.path);
       break;
    case MONGOC_MATCHER_OPCODE_OR:
@@ -258,6 +884,24 @@ _mongoc_matcher_op_destroy (mongoc_matcher_op_t *op) /* IN */
    case MONGOC_MATCHER_OPCODE_TYPE:
       bson_free (op->type.path);
       break;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+#ifndef _WIN32
+      regfree (&op->regex.re);
+#endif
+      bson_free (op->regex.path);
+      bson_free (op->regex.pattern);
+      bson_free (op->regex.options);
+      break;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      _mongoc_matcher_op_destroy (op->elem_match.child);
+      bson_free (op->elem_match.path);
+      break;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      bson_free (op->size.path);
+      break;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      bson_free (op->mod.path);
+      break;
    default:
       break;
    }
@@ -334,7 +978,7 @@ _mongoc_matcher_op_type_match (mongoc_matcher_op_type_t *type, /* IN */
 
    if (bson_iter_init (&iter, bson) &&
        bson_iter_find_descendant (&iter, type->path, &desc)) {
-      return (bson_iter_type (&iter) == type->type);
+      return (bson_iter_type (&desc) == type->type);
    }
 
    return false;
@@ -714,23 +1358,75 @@ static bool
 _mongoc_matcher_op_in_match (mongoc_matcher_op_compare_t *compare, /* IN */
                              bson_iter_t                 *iter)    /* IN */
 {
-   mongoc_matcher_op_compare_t op;
-
-   op.base.opcode = MONGOC_MATCHER_OPCODE_EQ;
-   op.path = compare->path;
+   BSON_ASSERT (compare);
+   BSON_ASSERT (iter);
 
-   if (!BSON_ITER_HOLDS_ARRAY (&compare->iter) ||
-       !bson_iter_recurse (&compare->iter, &op.iter)) {
+   if (!compare->set) {
       return false;
    }
 
-   while (bson_iter_next (&op.iter)) {
-      if (_mongoc_matcher_op_eq_match (&op, iter)) {
-         return true;
-      }
-   }
-
-   return false;
+   return _mongoc_matcher_value_set_find (compare->set, iter, NULL, NULL);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_all_match --
+ *
+ *       Checks the spec {"path": {"$all": [value1, value2, ...]}}.
+ *
+ *       Each value must equal either the field itself or, if the field
+ *       is an array, one of its elements.
+ *
+ * Returns:
+ *       true if the spec matched, otherwise false.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_all_match (mongoc_matcher_op_compare_t *compare, /* IN */
+                              bson_iter_t                 *iter)    /* IN */
+{
+   const mongoc_matcher_value_set_t *set;
+   bson_iter_t child;
+   bool marks_buf[32];
+   bool *marks;
+   uint32_t n_marked = 0;
+
+   BSON_ASSERT (compare);
+   BSON_ASSERT (iter);
+
+   set = compare->set;
+
+   if (!set || set->never || !set->n_values) {
+      return false;
+   }
+
+   if (set->n_values <= sizeof marks_buf / sizeof marks_buf[0]) {
+      marks = marks_buf;
+      memset (marks, 0, set->n_values * sizeof *marks);
+   } else {
+      marks = (bool *)bson_malloc0 (set->n_values * sizeof *marks);
+   }
+
+   _mongoc_matcher_value_set_find (set, iter, marks, &n_marked);
+
+   if (BSON_ITER_HOLDS_ARRAY (iter) && bson_iter_recurse (iter, &child)) {
+      while (n_marked < set->n_values && bson_iter_next (&child)) {
+         _mongoc_matcher_value_set_find (set, &child, marks, &n_marked);
+      }
+   }
+
+   if (marks != marks_buf) {
+      bson_free (marks);
+   }
+
+   return (n_marked == set->n_values);
 }
 
 
@@ -946,6 +1642,38 @@ _mongoc_matcher_op_nin_match (mongoc_matcher_op_compare_t *compare, /* IN */
  *--------------------------------------------------------------------------
  */
 
+static bool
+_mongoc_matcher_op_compare_match_iter (mongoc_matcher_op_compare_t *compare, /* IN */
+                                       bson_iter_t                 *iter)    /* IN */
+{
+   switch ((int)compare->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+      return _mongoc_matcher_op_eq_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_GT:
+      return _mongoc_matcher_op_gt_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_GTE:
+      return _mongoc_matcher_op_gte_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_IN:
+      return _mongoc_matcher_op_in_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_LT:
+      return _mongoc_matcher_op_lt_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_LTE:
+      return _mongoc_matcher_op_lte_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_NE:
+      return _mongoc_matcher_op_ne_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_NIN:
+      return _mongoc_matcher_op_nin_match (compare, iter);
+   case MONGOC_MATCHER_OPCODE_ALL:
+      return _mongoc_matcher_op_all_match (compare, iter);
+   default:
+      BSON_ASSERT (false);
+      break;
+   }
+
+   return false;
+}
+
+
 static bool
 _mongoc_matcher_op_compare_match (mongoc_matcher_op_compare_t *compare, /* IN */
                                   const bson_t                *bson)    /* IN */
@@ -965,23 +1693,381 @@ _mongoc_matcher_op_compare_match (mongoc_matcher_op_compare_t *compare, /* IN */
       return false;
    }
 
-   switch ((int)compare->base.opcode) {
+   return _mongoc_matcher_op_compare_match_iter (compare, &iter);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_regex_match --
+ *
+ *       Perform a {"path": {"$regex": "pattern"}} match.
+ *
+ * Returns:
+ *       true if the field is a string matching the pattern, or a regular
+ *       expression with the same pattern and options.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_regex_match (mongoc_matcher_op_regex_t *regex, /* IN */
+                                bson_iter_t               *iter)  /* IN */
+{
+   const char *pattern;
+   const char *options;
+
+   BSON_ASSERT (regex);
+   BSON_ASSERT (iter);
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_UTF8:
+#ifdef _WIN32
+      return false;
+#else
+      return !regexec (&regex->re, bson_iter_utf8 (iter, NULL), 0, NULL, 0);
+#endif
+   case BSON_TYPE_REGEX:
+      pattern = bson_iter_regex (iter, &options);
+      return (0 == strcmp (pattern, regex->pattern) &&
+              0 == strcmp (options ? options : "", regex->options));
+   default:
+      return false;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_elem_match_match --
+ *
+ *       Perform a {"path": {"$elemMatch": {...}}} match.
+ *
+ * Returns:
+ *       true if the field is an array with at least one element that
+ *       matches the child op.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_elem_match_match (mongoc_matcher_op_elem_match_t *elem_match, /* IN */
+                                     bson_iter_t                    *iter)       /* IN */
+{
+   const uint8_t *data;
+   bson_iter_t child;
+   uint32_t len;
+   bson_t doc;
+
+   BSON_ASSERT (elem_match);
+   BSON_ASSERT (iter);
+
+   if (!BSON_ITER_HOLDS_ARRAY (iter) || !bson_iter_recurse (iter, &child)) {
+      return false;
+   }
+
+   while (bson_iter_next (&child)) {
+      if (elem_match->is_value) {
+         if (_mongoc_matcher_op_match_value (elem_match->child, &child)) {
+            return true;
+         }
+      } else if (BSON_ITER_HOLDS_DOCUMENT (&child)) {
+         bson_iter_document (&child, &len, &data);
+         if (bson_init_static (&doc, data, len) &&
+             _mongoc_matcher_op_match (elem_match->child, &doc)) {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_size_match --
+ *
+ *       Perform a {"path": {"$size": int}} match.
+ *
+ * Returns:
+ *       true if the field is an array with exactly that many elements.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_size_match (mongoc_matcher_op_size_t *size, /* IN */
+                               bson_iter_t              *iter) /* IN */
+{
+   bson_iter_t child;
+   int64_t n = 0;
+
+   BSON_ASSERT (size);
+   BSON_ASSERT (iter);
+
+   if (!BSON_ITER_HOLDS_ARRAY (iter) || !bson_iter_recurse (iter, &child)) {
+      return false;
+   }
+
+   while (n <= size->size && bson_iter_next (&child)) {
+      n++;
+   }
+
+   return (n == size->size);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_mod_match --
+ *
+ *       Perform a {"path": {"$mod": [divisor, remainder]}} match. A
+ *       double field is truncated to an integer first.
+ *
+ * Returns:
+ *       true if the field is a number with that remainder.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_matcher_op_mod_match (mongoc_matcher_op_mod_t *mod,  /* IN */
+                              bson_iter_t             *iter) /* IN */
+{
+   int64_t value;
+   double d;
+
+   BSON_ASSERT (mod);
+   BSON_ASSERT (iter);
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_INT32:
+      value = bson_iter_int32 (iter);
+      break;
+   case BSON_TYPE_INT64:
+      value = bson_iter_int64 (iter);
+      break;
+   case BSON_TYPE_DOUBLE:
+      d = bson_iter_double (iter);
+      /* the range of int64_t, excluding NaN and infinities */
+      if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) {
+         return false;
+      }
+      value = (int64_t)d;
+      break;
+   default:
+      return false;
+   }
+
+   /* INT64_MIN % -1 overflows */
+   if (mod->divisor == -1) {
+      return (mod->remainder == 0);
+   }
+
+   return (value % mod->divisor == mod->remainder);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_is_leaf --
+ *
+ *       Checks if @op tests a single field rather than combining other
+ *       operations. Leaf operations can be evaluated with
+ *       _mongoc_matcher_op_match_iter() once their path is resolved.
+ *
+ * Returns:
+ *       true if @op is a compare, $exists, $type, $regex, $elemMatch,
+ *       $size or $mod operation.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_op_is_leaf (const mongoc_matcher_op_t *op) /* IN */
+{
+   BSON_ASSERT (op);
+
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_IN:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+   case MONGOC_MATCHER_OPCODE_NE:
+   case MONGOC_MATCHER_OPCODE_NIN:
+   case MONGOC_MATCHER_OPCODE_EXISTS:
+   case MONGOC_MATCHER_OPCODE_TYPE:
+   case MONGOC_MATCHER_OPCODE_REGEX:
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+   case MONGOC_MATCHER_OPCODE_ALL:
+   case MONGOC_MATCHER_OPCODE_SIZE:
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return true;
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_AND:
+   case MONGOC_MATCHER_OPCODE_NOT:
+   case MONGOC_MATCHER_OPCODE_NOR:
+   default:
+      return false;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_leaf_path --
+ *
+ *       Get the dotted path of the field tested by the leaf @op.
+ *
+ * Returns:
+ *       A string owned by @op.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const char *
+_mongoc_matcher_op_leaf_path (const mongoc_matcher_op_t *op) /* IN */
+{
+   BSON_ASSERT (op);
+
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EXISTS:
+      return op->exists.path;
+   case MONGOC_MATCHER_OPCODE_TYPE:
+      return op->type.path;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      return op->regex.path;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      return op->elem_match.path;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      return op->size.path;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return op->mod.path;
+   default:
+      BSON_ASSERT (_mongoc_matcher_op_is_leaf (op));
+      return op->compare.path;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_conjuncts --
+ *
+ *       Collect the ops that must all match for @op to match, by
+ *       flattening nested $and. If @op is not an $and, that is just @op.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       mongoc_matcher_op_t pointers are appended to @conjuncts.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_op_conjuncts (mongoc_matcher_op_t *op,        /* IN */
+                              mongoc_array_t      *conjuncts) /* OUT */
+{
+   BSON_ASSERT (op);
+   BSON_ASSERT (conjuncts);
+
+   if (op->base.opcode == MONGOC_MATCHER_OPCODE_AND) {
+      _mongoc_matcher_op_conjuncts (op->logical.left, conjuncts);
+      if (op->logical.right) {
+         _mongoc_matcher_op_conjuncts (op->logical.right, conjuncts);
+      }
+   } else {
+      _mongoc_array_append_val (conjuncts, op);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_match_iter --
+ *
+ *       Evaluate the leaf @op against a field that has already been
+ *       located in the document. Pass NULL for @iter if the field is
+ *       not present.
+ *
+ *       This produces the same result as _mongoc_matcher_op_match() on
+ *       the document without searching for the field again.
+ *
+ * Returns:
+ *       Opcode specific.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_op_match_iter (mongoc_matcher_op_t *op,   /* IN */
+                               bson_iter_t         *iter) /* IN */
+{
+   BSON_ASSERT (op);
+
+   switch (op->base.opcode) {
    case MONGOC_MATCHER_OPCODE_EQ:
-      return _mongoc_matcher_op_eq_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_GT:
-      return _mongoc_matcher_op_gt_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_GTE:
-      return _mongoc_matcher_op_gte_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_IN:
-      return _mongoc_matcher_op_in_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_LT:
-      return _mongoc_matcher_op_lt_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_LTE:
-      return _mongoc_matcher_op_lte_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_NE:
-      return _mongoc_matcher_op_ne_match (compare, &iter);
    case MONGOC_MATCHER_OPCODE_NIN:
-      return _mongoc_matcher_op_nin_match (compare, &iter);
+   case MONGOC_MATCHER_OPCODE_ALL:
+      return iter && _mongoc_matcher_op_compare_match_iter (&op->compare,
+                                                             iter);
+   case MONGOC_MATCHER_OPCODE_EXISTS:
+      return ((iter != NULL) == op->exists.exists);
+   case MONGOC_MATCHER_OPCODE_TYPE:
+      return iter && (bson_iter_type (iter) == op->type.type);
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      return iter && _mongoc_matcher_op_regex_match (&op->regex, iter);
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      return iter && _mongoc_matcher_op_elem_match_match (&op->elem_match,
+                                                           iter);
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      return iter && _mongoc_matcher_op_size_match (&op->size, iter);
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return iter && _mongoc_matcher_op_mod_match (&op->mod, iter);
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_AND:
+   case MONGOC_MATCHER_OPCODE_NOT:
+   case MONGOC_MATCHER_OPCODE_NOR:
    default:
       BSON_ASSERT (false);
       break;
@@ -991,6 +2077,75 @@ _mongoc_matcher_op_compare_match (mongoc_matcher_op_compare_t *compare, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_op_match_value --
+ *
+ *       Evaluate @op against the value @iter itself rather than against
+ *       a field of a document, as {$elemMatch: {$gt: 1, $lt: 5}} does
+ *       for each element of an array.
+ *
+ * Returns:
+ *       Opcode specific.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_op_match_value (mongoc_matcher_op_t *op,   /* IN */
+                                bson_iter_t         *iter) /* IN */
+{
+   BSON_ASSERT (op);
+   BSON_ASSERT (iter);
+
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_AND:
+      return (_mongoc_matcher_op_match_value (op->logical.left, iter) &&
+              (!op->logical.right ||
+               _mongoc_matcher_op_match_value (op->logical.right, iter)));
+   case MONGOC_MATCHER_OPCODE_OR:
+      return (_mongoc_matcher_op_match_value (op->logical.left, iter) ||
+              (op->logical.right &&
+               _mongoc_matcher_op_match_value (op->logical.right, iter)));
+   case MONGOC_MATCHER_OPCODE_NOR:
+      return !(_mongoc_matcher_op_match_value (op->logical.left, iter) ||
+               (op->logical.right &&
+                _mongoc_matcher_op_match_value (op->logical.right, iter)));
+   case MONGOC_MATCHER_OPCODE_NOT:
+      return !_mongoc_matcher_op_match_value (op->not_.child, iter);
+   default:
+      return _mongoc_matcher_op_match_iter (op, iter);
+   }
+}
+
+
+/* Locate the field tested by the leaf @op in @bson and evaluate @op. */
+static bool
+_mongoc_matcher_op_field_match (mongoc_matcher_op_t *op,   /* IN */
+                                const bson_t        *bson) /* IN */
+{
+   const char *path;
+   bson_iter_t tmp;
+   bson_iter_t iter;
+   bool found;
+
+   path = _mongoc_matcher_op_leaf_path (op);
+
+   if (strchr (path, '.')) {
+      found = (bson_iter_init (&tmp, bson) &&
+               bson_iter_find_descendant (&tmp, path, &iter));
+   } else {
+      found = bson_iter_init_find (&iter, bson, path);
+   }
+
+   return _mongoc_matcher_op_match_iter (op, found ? &iter : NULL);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -1024,7 +2179,8 @@ _mongoc_matcher_op_logical_match (mongoc_matcher_op_logical_t *logical, /* IN */
               _mongoc_matcher_op_match (logical->right, bson));
    case MONGOC_MATCHER_OPCODE_NOR:
       return !(_mongoc_matcher_op_match (logical->left, bson) ||
-               _mongoc_matcher_op_match (logical->right, bson));
+               (logical->right &&
+                _mongoc_matcher_op_match (logical->right, bson)));
    default:
       BSON_ASSERT (false);
       break;
@@ -1066,11 +2222,17 @@ _mongoc_matcher_op_match (mongoc_matcher_op_t *op,   /* IN */
    case MONGOC_MATCHER_OPCODE_LTE:
    case MONGOC_MATCHER_OPCODE_NE:
    case MONGOC_MATCHER_OPCODE_NIN:
+   case MONGOC_MATCHER_OPCODE_ALL:
       return _mongoc_matcher_op_compare_match (&op->compare, bson);
    case MONGOC_MATCHER_OPCODE_OR:
    case MONGOC_MATCHER_OPCODE_AND:
    case MONGOC_MATCHER_OPCODE_NOR:
       return _mongoc_matcher_op_logical_match (&op->logical, bson);
+   case MONGOC_MATCHER_OPCODE_REGEX:
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+   case MONGOC_MATCHER_OPCODE_SIZE:
+   case MONGOC_MATCHER_OPCODE_MOD:
+      return _mongoc_matcher_op_field_match (op, bson);
    case MONGOC_MATCHER_OPCODE_NOT:
       return _mongoc_matcher_op_not_match (&op->not_, bson);
    case MONGOC_MATCHER_OPCODE_EXISTS:
@@ -1126,6 +2288,7 @@ _mongoc_matcher_op_to_bson (mongoc_matcher_op_t *op,   /* IN */
    case MONGOC_MATCHER_OPCODE_LTE:
    case MONGOC_MATCHER_OPCODE_NE:
    case MONGOC_MATCHER_OPCODE_NIN:
+   case MONGOC_MATCHER_OPCODE_ALL:
       switch ((int)op->base.opcode) {
       case MONGOC_MATCHER_OPCODE_GT:
          str = "$gt";
@@ -1148,6 +2311,9 @@ _mongoc_matcher_op_to_bson (mongoc_matcher_op_t *op,   /* IN */
       case MONGOC_MATCHER_OPCODE_NIN:
          str = "$nin";
          break;
+      case MONGOC_MATCHER_OPCODE_ALL:
+         str = "$all";
+         break;
       default:
          str = "???";
          break;
@@ -1194,6 +2360,32 @@ _mongoc_matcher_op_to_bson (mongoc_matcher_op_t *op,   /* IN */
    case MONGOC_MATCHER_OPCODE_TYPE:
       BSON_APPEND_INT32 (bson, "$type", (int)op->type.type);
       break;
+   case MONGOC_MATCHER_OPCODE_REGEX:
+      bson_append_document_begin (bson, op->regex.path, -1, &child);
+      BSON_APPEND_UTF8 (&child, "$regex", op->regex.pattern);
+      BSON_APPEND_UTF8 (&child, "$options", op->regex.options);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_ELEM_MATCH:
+      bson_append_document_begin (bson, op->elem_match.path, -1, &child);
+      bson_append_document_begin (&child, "$elemMatch", 10, &child2);
+      _mongoc_matcher_op_to_bson (op->elem_match.child, &child2);
+      bson_append_document_end (&child, &child2);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_SIZE:
+      bson_append_document_begin (bson, op->size.path, -1, &child);
+      BSON_APPEND_INT64 (&child, "$size", op->size.size);
+      bson_append_document_end (bson, &child);
+      break;
+   case MONGOC_MATCHER_OPCODE_MOD:
+      bson_append_document_begin (bson, op->mod.path, -1, &child);
+      bson_append_array_begin (&child, "$mod", 4, &child2);
+      BSON_APPEND_INT64 (&child2, "0", op->mod.divisor);
+      BSON_APPEND_INT64 (&child2, "1", op->mod.remainder);
+      bson_append_array_end (&child, &child2);
+      bson_append_document_end (bson, &child);
+      break;
    default:
       BSON_ASSERT (false);
       break;
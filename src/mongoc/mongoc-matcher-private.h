@@ -23,7 +23,10 @@
 
 #include <bson.h>
 
+#include "mongoc-array-private.h"
+#include "mongoc-matcher.h"
 #include "mongoc-matcher-op-private.h"
+#include "mongoc-matcher-program-private.h"
 
 
 BSON_BEGIN_DECLS
@@ -31,11 +34,82 @@ BSON_BEGIN_DECLS
 
 struct _mongoc_matcher_t
 {
-   bson_t               query;
-   mongoc_matcher_op_t *optree;
+   bson_t                    query;
+   mongoc_matcher_op_t      *optree;
+   mongoc_matcher_program_t  program;
 };
 
 
+typedef struct
+{
+   uint32_t                  id;
+   bson_t                   *query;
+   mongoc_matcher_op_t      *optree;
+   mongoc_matcher_program_t  program;  /* slots refer to the set's paths */
+} mongoc_matcher_set_entry_t;
+
+
+/*
+ * A value a field must have for a query to match. All numbers are keyed
+ * as doubles, since the matcher compares them by value across types.
+ */
+typedef struct
+{
+   uint32_t     slot;
+   bson_type_t  type;   /* BSON_TYPE_DOUBLE, BSON_TYPE_UTF8 or BSON_TYPE_NULL */
+   double       number;
+   const char  *str;
+   uint32_t     len;
+} mongoc_matcher_set_key_t;
+
+
+typedef struct
+{
+   mongoc_matcher_set_key_t key;
+   uint32_t                 hash;
+   uint32_t                 entry;
+   uint32_t                 next;   /* next in bucket, or MONGOC_MATCHER_PATH_NONE */
+} mongoc_matcher_set_eq_t;
+
+
+typedef struct
+{
+   double   lo;
+   double   hi;
+   double   max_hi;  /* largest hi in the subtree rooted here */
+   uint32_t entry;
+} mongoc_matcher_set_range_t;
+
+
+typedef struct
+{
+   uint32_t       slot;
+   bool           sorted;
+   mongoc_array_t ranges;  /* mongoc_matcher_set_range_t, by lo once sorted */
+} mongoc_matcher_set_ranges_t;
+
+
+struct _mongoc_matcher_set_t
+{
+   mongoc_matcher_paths_t  paths;       /* shared by every entry */
+   mongoc_array_t          entries;     /* mongoc_matcher_set_entry_t */
+   mongoc_array_t          eqs;         /* mongoc_matcher_set_eq_t */
+   uint32_t               *buckets;     /* heads of eqs chains */
+   uint32_t                n_buckets;
+   mongoc_array_t          eq_slots;    /* uint32_t, slots keyed in eqs */
+   mongoc_array_t          ranges;      /* mongoc_matcher_set_ranges_t */
+   mongoc_array_t          unindexed;   /* uint32_t, entries always checked */
+   mongoc_array_t          candidates;  /* uint32_t, scratch for match */
+   bson_iter_t            *values;      /* scratch for match, per slot */
+   bool                   *found;       /* scratch for match, per slot */
+   uint32_t                n_scratch;
+};
+
+
+mongoc_matcher_op_t *_mongoc_matcher_parse_query (const bson_t *query,
+                                                  bson_error_t *error);
+
+
 BSON_END_DECLS
 
 
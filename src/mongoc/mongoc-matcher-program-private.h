@@ -0,0 +1,146 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_MATCHER_PROGRAM_PRIVATE_H
+#define MONGOC_MATCHER_PROGRAM_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-array-private.h"
+#include "mongoc-matcher-op-private.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * A mongoc_matcher_program_t is an op tree flattened into a linear
+ * sequence of instructions operating on a single boolean register.
+ *
+ * $and and $or become conditional jumps past the remaining operands, so
+ * evaluation short-circuits without recursion.
+ *
+ * Every field path the program tests is stored in a trie of path
+ * segments and given a slot. Before running the instructions, the
+ * document is scanned once, left to right, descending only into
+ * subdocuments that lead to a path in the trie. That fills in the slot
+ * of every path, so a program with many predicates still reads the
+ * document only once.
+ *
+ * For matching many documents at once, numeric comparisons that the
+ * query's top-level $and requires are also kept as columns. A batch of
+ * documents is first filtered by those alone, reading only their paths
+ * into arrays of doubles and comparing whole arrays in tight loops, and
+ * the instructions run only for the documents that remain.
+ */
+
+
+#define MONGOC_MATCHER_PATH_NONE ((uint32_t)-1)
+
+
+typedef enum
+{
+   MONGOC_MATCHER_INSN_TEST,          /* r = op (field in slot) */
+   MONGOC_MATCHER_INSN_JUMP_IF_FALSE, /* if (!r) goto target */
+   MONGOC_MATCHER_INSN_JUMP_IF_TRUE,  /* if (r) goto target */
+   MONGOC_MATCHER_INSN_NOT,           /* r = !r */
+} mongoc_matcher_insn_code_t;
+
+
+typedef struct
+{
+   mongoc_matcher_insn_code_t  code;
+   uint32_t                    arg;  /* path slot, or jump target */
+   mongoc_matcher_op_t        *op;   /* leaf op for TEST, otherwise NULL */
+} mongoc_matcher_insn_t;
+
+
+typedef struct
+{
+   char     *key;          /* path segment, NULL for the root */
+   uint32_t  first_child;  /* index into nodes, or MONGOC_MATCHER_PATH_NONE */
+   uint32_t  next_sibling; /* index into nodes, or MONGOC_MATCHER_PATH_NONE */
+   uint32_t  n_children;
+   uint32_t  slot;         /* slot of the path ending here, if any */
+} mongoc_matcher_path_node_t;
+
+
+typedef struct
+{
+   mongoc_array_t nodes;   /* mongoc_matcher_path_node_t, root first */
+   uint32_t       n_slots;
+} mongoc_matcher_paths_t;
+
+
+/*
+ * A comparison of a path against numbers that are exact as doubles:
+ * $eq, $gt, $gte, $lt and $lte against one value, or $in against several.
+ */
+typedef struct
+{
+   mongoc_matcher_opcode_t  opcode;
+   uint32_t                 slot;      /* in the program's column_paths */
+   uint32_t                 n_values;
+   double                  *values;
+} mongoc_matcher_column_t;
+
+
+typedef struct
+{
+   mongoc_array_t         insns;        /* mongoc_matcher_insn_t */
+   mongoc_matcher_paths_t paths;
+   mongoc_array_t         columns;      /* mongoc_matcher_column_t */
+   mongoc_matcher_paths_t column_paths;
+   bool                   columns_only; /* columns decide the whole match */
+} mongoc_matcher_program_t;
+
+
+void     _mongoc_matcher_paths_init      (mongoc_matcher_paths_t         *paths);
+uint32_t _mongoc_matcher_paths_add       (mongoc_matcher_paths_t         *paths,
+                                          const char                     *path);
+void     _mongoc_matcher_paths_extract   (const mongoc_matcher_paths_t   *paths,
+                                          const bson_t                   *bson,
+                                          bson_iter_t                    *values,
+                                          bool                           *found);
+void     _mongoc_matcher_paths_destroy   (mongoc_matcher_paths_t         *paths);
+void     _mongoc_matcher_program_init    (mongoc_matcher_program_t       *program);
+void     _mongoc_matcher_program_compile (mongoc_matcher_program_t       *program,
+                                          mongoc_matcher_op_t            *op);
+void     _mongoc_matcher_program_compile_with_paths
+                                         (mongoc_matcher_program_t       *program,
+                                          mongoc_matcher_paths_t         *paths,
+                                          mongoc_matcher_op_t            *op);
+bool     _mongoc_matcher_program_exec    (const mongoc_matcher_program_t *program,
+                                          bson_iter_t                    *values,
+                                          const bool                     *found);
+bool     _mongoc_matcher_program_run     (const mongoc_matcher_program_t *program,
+                                          const bson_t                   *bson);
+size_t   _mongoc_matcher_program_run_many
+                                         (const mongoc_matcher_program_t *program,
+                                          const bson_t                  **bsons,
+                                          size_t                          n_bsons,
+                                          uint8_t                        *selection);
+void     _mongoc_matcher_program_destroy (mongoc_matcher_program_t       *program);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_MATCHER_PROGRAM_PRIVATE_H */
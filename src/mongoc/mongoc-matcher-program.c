@@ -0,0 +1,968 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "mongoc-matcher-program-private.h"
+
+
+/* slots and trie nodes kept on the stack before falling back to the heap */
+#define MONGOC_MATCHER_STACK_SLOTS 8
+#define MONGOC_MATCHER_STACK_NODES 32
+
+/* documents filtered together by _mongoc_matcher_program_run_many() */
+#define MONGOC_MATCHER_BATCH_SIZE 256
+
+/* int64 values beyond this may round when converted to double */
+#define MONGOC_MATCHER_MAX_EXACT_INT64 (INT64_C (1) << 53)
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_init --
+ *
+ *       Initialize an empty program.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_program_init (mongoc_matcher_program_t *program) /* OUT */
+{
+   BSON_ASSERT (program);
+
+   _mongoc_array_init (&program->insns, sizeof (mongoc_matcher_insn_t));
+   _mongoc_matcher_paths_init (&program->paths);
+   _mongoc_array_init (&program->columns, sizeof (mongoc_matcher_column_t));
+   _mongoc_matcher_paths_init (&program->column_paths);
+   program->columns_only = false;
+}
+
+
+static uint32_t
+_mongoc_matcher_program_emit (mongoc_matcher_program_t   *program, /* IN */
+                              mongoc_matcher_insn_code_t  code,    /* IN */
+                              uint32_t                    arg,     /* IN */
+                              mongoc_matcher_op_t        *op)      /* IN */
+{
+   mongoc_matcher_insn_t insn;
+
+   insn.code = code;
+   insn.arg = arg;
+   insn.op = op;
+
+   _mongoc_array_append_val (&program->insns, insn);
+
+   return (uint32_t)program->insns.len - 1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_paths_init --
+ *
+ *       Initialize an empty path trie.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_paths_init (mongoc_matcher_paths_t *paths) /* OUT */
+{
+   mongoc_matcher_path_node_t root = { 0 };
+
+   BSON_ASSERT (paths);
+
+   _mongoc_array_init (&paths->nodes, sizeof (mongoc_matcher_path_node_t));
+   paths->n_slots = 0;
+
+   root.key = NULL;
+   root.first_child = MONGOC_MATCHER_PATH_NONE;
+   root.next_sibling = MONGOC_MATCHER_PATH_NONE;
+   root.slot = MONGOC_MATCHER_PATH_NONE;
+   _mongoc_array_append_val (&paths->nodes, root);
+}
+
+
+#define NODE(_paths, _i) \
+   (&_mongoc_array_index (&(_paths)->nodes, mongoc_matcher_path_node_t, (_i)))
+
+
+/*
+ * Find the child of @parent whose key is the first @len bytes of @key,
+ * adding it if there is none.
+ */
+static uint32_t
+_mongoc_matcher_paths_child (mongoc_matcher_paths_t *paths,  /* IN */
+                             uint32_t                parent, /* IN */
+                             const char             *key,    /* IN */
+                             size_t                  len)    /* IN */
+{
+   mongoc_matcher_path_node_t node = { 0 };
+   uint32_t *link;
+   uint32_t i;
+
+   for (i = NODE (paths, parent)->first_child;
+        i != MONGOC_MATCHER_PATH_NONE;
+        i = NODE (paths, i)->next_sibling) {
+      if (strncmp (NODE (paths, i)->key, key, len) == 0 &&
+          NODE (paths, i)->key[len] == '\0') {
+         return i;
+      }
+   }
+
+   node.key = bson_strndup (key, len);
+   node.first_child = MONGOC_MATCHER_PATH_NONE;
+   node.next_sibling = MONGOC_MATCHER_PATH_NONE;
+   node.slot = MONGOC_MATCHER_PATH_NONE;
+   _mongoc_array_append_val (&paths->nodes, node);
+   i = (uint32_t)paths->nodes.len - 1;
+
+   /* keep siblings in insertion order, which is query order */
+   link = &NODE (paths, parent)->first_child;
+   while (*link != MONGOC_MATCHER_PATH_NONE) {
+      link = &NODE (paths, *link)->next_sibling;
+   }
+   *link = i;
+   NODE (paths, parent)->n_children++;
+
+   return i;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_paths_add --
+ *
+ *       Add the dotted @path to the trie, unless it is already there.
+ *
+ * Returns:
+ *       The slot that _mongoc_matcher_paths_extract() fills in for
+ *       @path.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+_mongoc_matcher_paths_add (mongoc_matcher_paths_t *paths, /* IN */
+                           const char             *path)  /* IN */
+{
+   const char *dot;
+   uint32_t node = 0;
+
+   BSON_ASSERT (paths);
+   BSON_ASSERT (path);
+
+   for (;;) {
+      dot = strchr (path, '.');
+      node = _mongoc_matcher_paths_child (
+         paths, node, path, dot ? (size_t)(dot - path) : strlen (path));
+
+      if (!dot) {
+         break;
+      }
+
+      path = dot + 1;
+   }
+
+   if (NODE (paths, node)->slot == MONGOC_MATCHER_PATH_NONE) {
+      NODE (paths, node)->slot = paths->n_slots++;
+   }
+
+   return NODE (paths, node)->slot;
+}
+
+
+/*
+ * Scan the container at @iter, recording fields that match the children
+ * of @parent and descending into those with children of their own.
+ *
+ * Like bson_iter_find_descendant(), only the first field with a given key
+ * is considered at each level. The scan stops as soon as every child has
+ * been seen.
+ */
+static void
+_mongoc_matcher_paths_scan (const mongoc_matcher_paths_t *paths,   /* IN */
+                            uint32_t                      parent,  /* IN */
+                            bson_iter_t                  *iter,    /* IN */
+                            bson_iter_t                  *values,  /* OUT */
+                            bool                         *found,   /* OUT */
+                            uint8_t                      *visited) /* INOUT */
+{
+   const mongoc_matcher_path_node_t *nodes;
+   const mongoc_matcher_path_node_t *node;
+   bson_iter_t child;
+   const char *key;
+   uint32_t remaining;
+   uint32_t i;
+
+   nodes = (const mongoc_matcher_path_node_t *)paths->nodes.data;
+   remaining = nodes[parent].n_children;
+
+   while (remaining && bson_iter_next (iter)) {
+      key = bson_iter_key (iter);
+
+      for (i = nodes[parent].first_child;
+           i != MONGOC_MATCHER_PATH_NONE;
+           i = nodes[i].next_sibling) {
+         node = &nodes[i];
+
+         if (node->key[0] != key[0] || visited[i] ||
+             strcmp (node->key, key) != 0) {
+            continue;
+         }
+
+         visited[i] = 1;
+         remaining--;
+
+         if (node->slot != MONGOC_MATCHER_PATH_NONE) {
+            memcpy (&values[node->slot], iter, sizeof *iter);
+            found[node->slot] = true;
+         }
+
+         if (node->first_child != MONGOC_MATCHER_PATH_NONE &&
+             (BSON_ITER_HOLDS_DOCUMENT (iter) ||
+              BSON_ITER_HOLDS_ARRAY (iter)) &&
+             bson_iter_recurse (iter, &child)) {
+            _mongoc_matcher_paths_scan (paths, i, &child, values, found,
+                                        visited);
+         }
+
+         break;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_paths_extract --
+ *
+ *       Locate every path in @paths within @bson in a single pass.
+ *
+ *       @values and @found must have room for paths->n_slots entries.
+ *       For each slot, found[slot] is set to whether the path exists
+ *       and, if so, values[slot] is positioned on the field, exactly as
+ *       bson_iter_find_descendant() would have left it.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_paths_extract (const mongoc_matcher_paths_t *paths,  /* IN */
+                               const bson_t                 *bson,   /* IN */
+                               bson_iter_t                  *values, /* OUT */
+                               bool                         *found)  /* OUT */
+{
+   uint8_t stack_visited[MONGOC_MATCHER_STACK_NODES];
+   uint8_t *visited = stack_visited;
+   bson_iter_t iter;
+
+   BSON_ASSERT (paths);
+   BSON_ASSERT (bson);
+
+   memset (found, 0, paths->n_slots * sizeof *found);
+
+   if (!paths->n_slots || !bson_iter_init (&iter, bson)) {
+      return;
+   }
+
+   if (paths->nodes.len > MONGOC_MATCHER_STACK_NODES) {
+      visited = (uint8_t *)bson_malloc (paths->nodes.len);
+   }
+
+   memset (visited, 0, paths->nodes.len);
+
+   _mongoc_matcher_paths_scan (paths, 0, &iter, values, found, visited);
+
+   if (visited != stack_visited) {
+      bson_free (visited);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_paths_destroy --
+ *
+ *       Release all resources associated with @paths.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_paths_destroy (mongoc_matcher_paths_t *paths) /* IN */
+{
+   size_t i;
+
+   BSON_ASSERT (paths);
+
+   for (i = 0; i < paths->nodes.len; i++) {
+      bson_free (NODE (paths, i)->key);
+   }
+
+   _mongoc_array_destroy (&paths->nodes);
+}
+
+
+static void
+_mongoc_matcher_program_compile_op (mongoc_matcher_program_t *program, /* IN */
+                                    mongoc_matcher_paths_t   *paths,   /* IN */
+                                    mongoc_matcher_op_t      *op)      /* IN */
+{
+   mongoc_matcher_insn_code_t jump_code;
+   uint32_t jump;
+
+   if (_mongoc_matcher_op_is_leaf (op)) {
+      _mongoc_matcher_program_emit (
+         program, MONGOC_MATCHER_INSN_TEST,
+         _mongoc_matcher_paths_add (paths, _mongoc_matcher_op_leaf_path (op)),
+         op);
+      return;
+   }
+
+   switch (op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_AND:
+   case MONGOC_MATCHER_OPCODE_OR:
+   case MONGOC_MATCHER_OPCODE_NOR:
+      /*
+       * left; JUMP_IF_FALSE end; right; end:  for $and
+       * left; JUMP_IF_TRUE end; right; end:   for $or and $nor
+       */
+      jump_code = (op->base.opcode == MONGOC_MATCHER_OPCODE_AND) ?
+                  MONGOC_MATCHER_INSN_JUMP_IF_FALSE :
+                  MONGOC_MATCHER_INSN_JUMP_IF_TRUE;
+
+      _mongoc_matcher_program_compile_op (program, paths, op->logical.left);
+
+      if (op->logical.right) {
+         jump = _mongoc_matcher_program_emit (program, jump_code, 0, NULL);
+         _mongoc_matcher_program_compile_op (program, paths,
+                                             op->logical.right);
+         _mongoc_array_index (&program->insns, mongoc_matcher_insn_t,
+                              jump).arg = (uint32_t)program->insns.len;
+      }
+
+      if (op->base.opcode == MONGOC_MATCHER_OPCODE_NOR) {
+         _mongoc_matcher_program_emit (program, MONGOC_MATCHER_INSN_NOT, 0,
+                                       NULL);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_NOT:
+      _mongoc_matcher_program_compile_op (program, paths, op->not_.child);
+      _mongoc_matcher_program_emit (program, MONGOC_MATCHER_INSN_NOT, 0, NULL);
+      break;
+   default:
+      BSON_ASSERT (false);
+      break;
+   }
+}
+
+
+/*
+ * A jump doesn't change the register, so a jump landing on a jump of
+ * the same kind is always taken again and one landing on the opposite
+ * kind never is. Follow those chains at compile time, so nested $and and
+ * $or exit in a single step.
+ */
+static void
+_mongoc_matcher_program_thread_jumps (mongoc_matcher_program_t *program) /* IN */
+{
+   mongoc_matcher_insn_t *insns;
+   mongoc_matcher_insn_t *target;
+   uint32_t n;
+   uint32_t i;
+
+   insns = (mongoc_matcher_insn_t *)program->insns.data;
+   n = (uint32_t)program->insns.len;
+
+   for (i = 0; i < n; i++) {
+      if (insns[i].code != MONGOC_MATCHER_INSN_JUMP_IF_FALSE &&
+          insns[i].code != MONGOC_MATCHER_INSN_JUMP_IF_TRUE) {
+         continue;
+      }
+
+      while (insns[i].arg < n) {
+         target = &insns[insns[i].arg];
+
+         if (target->code == insns[i].code) {
+            insns[i].arg = target->arg;
+         } else if (target->code == MONGOC_MATCHER_INSN_JUMP_IF_FALSE ||
+                    target->code == MONGOC_MATCHER_INSN_JUMP_IF_TRUE) {
+            insns[i].arg++;
+         } else {
+            break;
+         }
+      }
+   }
+}
+
+
+/*
+ * Convert a number to the double it compares as, if that is exact.
+ * Bools compare as 0 and 1, but only on the document side: the matcher
+ * never matches a bool in the query against a number.
+ */
+static bool
+_mongoc_matcher_exact_double (const bson_iter_t *iter,       /* IN */
+                              bool               allow_bool, /* IN */
+                              double            *value)      /* OUT */
+{
+   int64_t v;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+      *value = bson_iter_double (iter);
+      return true;
+   case BSON_TYPE_INT32:
+      *value = (double)bson_iter_int32 (iter);
+      return true;
+   case BSON_TYPE_INT64:
+      v = bson_iter_int64 (iter);
+      if (v > MONGOC_MATCHER_MAX_EXACT_INT64 ||
+          v < -MONGOC_MATCHER_MAX_EXACT_INT64) {
+         return false;
+      }
+      *value = (double)v;
+      return true;
+   case BSON_TYPE_BOOL:
+      if (!allow_bool) {
+         return false;
+      }
+      *value = bson_iter_bool (iter) ? 1.0 : 0.0;
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+/*
+ * Compile @op to a column if it compares its path against numbers that
+ * are exact as doubles.
+ */
+static bool
+_mongoc_matcher_program_compile_column (mongoc_matcher_program_t *program, /* IN */
+                                        mongoc_matcher_op_t      *op)      /* IN */
+{
+   mongoc_matcher_column_t column;
+   mongoc_array_t values;
+   bson_iter_t iter;
+   double value;
+
+   switch ((int)op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+      if (!_mongoc_matcher_exact_double (&op->compare.iter, false, &value)) {
+         return false;
+      }
+      column.n_values = 1;
+      column.values = (double *)bson_malloc (sizeof (double));
+      column.values[0] = value;
+      break;
+   case MONGOC_MATCHER_OPCODE_IN:
+      if (!BSON_ITER_HOLDS_ARRAY (&op->compare.iter) ||
+          !bson_iter_recurse (&op->compare.iter, &iter)) {
+         return false;
+      }
+
+      _mongoc_array_init (&values, sizeof (double));
+      while (bson_iter_next (&iter)) {
+         if (!_mongoc_matcher_exact_double (&iter, false, &value)) {
+            _mongoc_array_destroy (&values);
+            return false;
+         }
+         _mongoc_array_append_val (&values, value);
+      }
+
+      column.n_values = (uint32_t)values.len;
+      column.values = (double *)bson_malloc (
+         BSON_MAX (1, values.len) * sizeof (double));
+      memcpy (column.values, values.data, values.len * sizeof (double));
+      _mongoc_array_destroy (&values);
+      break;
+   default:
+      return false;
+   }
+
+   column.opcode = op->base.opcode;
+   column.slot = _mongoc_matcher_paths_add (&program->column_paths,
+                                            op->compare.path);
+   _mongoc_array_append_val (&program->columns, column);
+
+   return true;
+}
+
+
+static void
+_mongoc_matcher_program_compile_columns (mongoc_matcher_program_t *program, /* IN */
+                                         mongoc_matcher_op_t      *op)      /* IN */
+{
+   mongoc_matcher_op_t *conjunct;
+   mongoc_array_t conjuncts;
+   bool columns_only = true;
+   size_t i;
+
+   _mongoc_array_init (&conjuncts, sizeof (mongoc_matcher_op_t *));
+   _mongoc_matcher_op_conjuncts (op, &conjuncts);
+
+   for (i = 0; i < conjuncts.len; i++) {
+      conjunct = _mongoc_array_index (&conjuncts, mongoc_matcher_op_t *, i);
+      if (!_mongoc_matcher_program_compile_column (program, conjunct)) {
+         columns_only = false;
+      }
+   }
+
+   program->columns_only = columns_only && program->columns.len > 0;
+
+   _mongoc_array_destroy (&conjuncts);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_compile --
+ *
+ *       Compile the op tree @op into @program. @program references the
+ *       leaf ops of @op, so @op must outlive it.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @program is appended to.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_program_compile (mongoc_matcher_program_t *program, /* IN */
+                                 mongoc_matcher_op_t      *op)      /* IN */
+{
+   BSON_ASSERT (program);
+
+   _mongoc_matcher_program_compile_with_paths (program, &program->paths, op);
+   _mongoc_matcher_program_compile_columns (program, op);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_compile_with_paths --
+ *
+ *       Like _mongoc_matcher_program_compile(), but the paths @op tests
+ *       are added to @paths rather than to the program's own trie.
+ *
+ *       This lets several programs share one trie, so a document is
+ *       scanned once for all of them. Such a program must be run with
+ *       _mongoc_matcher_program_exec() on the values extracted by
+ *       @paths.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @program and @paths are appended to.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_program_compile_with_paths (mongoc_matcher_program_t *program, /* IN */
+                                            mongoc_matcher_paths_t   *paths,   /* IN */
+                                            mongoc_matcher_op_t      *op)      /* IN */
+{
+   BSON_ASSERT (program);
+   BSON_ASSERT (paths);
+   BSON_ASSERT (op);
+
+   _mongoc_matcher_program_compile_op (program, paths, op);
+   _mongoc_matcher_program_thread_jumps (program);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_exec --
+ *
+ *       Execute the instructions of @program against path values that
+ *       have already been extracted, as by
+ *       _mongoc_matcher_paths_extract().
+ *
+ * Returns:
+ *       true if the document the values came from matches.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_program_exec (const mongoc_matcher_program_t *program, /* IN */
+                              bson_iter_t                    *values,  /* IN */
+                              const bool                     *found)   /* IN */
+{
+   const mongoc_matcher_insn_t *insns;
+   const mongoc_matcher_insn_t *insn;
+   uint32_t n;
+   uint32_t pc = 0;
+   bool r = true;
+
+   BSON_ASSERT (program);
+
+   insns = (const mongoc_matcher_insn_t *)program->insns.data;
+   n = (uint32_t)program->insns.len;
+
+   while (pc < n) {
+      insn = &insns[pc];
+
+      switch (insn->code) {
+      case MONGOC_MATCHER_INSN_TEST:
+         /* leaf ops only read the field, so the extracted iter is reused */
+         r = _mongoc_matcher_op_match_iter (
+            insn->op, found[insn->arg] ? &values[insn->arg] : NULL);
+         pc++;
+         break;
+      case MONGOC_MATCHER_INSN_JUMP_IF_FALSE:
+         pc = r ? pc + 1 : insn->arg;
+         break;
+      case MONGOC_MATCHER_INSN_JUMP_IF_TRUE:
+         pc = r ? insn->arg : pc + 1;
+         break;
+      case MONGOC_MATCHER_INSN_NOT:
+         r = !r;
+         pc++;
+         break;
+      default:
+         BSON_ASSERT (false);
+         break;
+      }
+   }
+
+   return r;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_run --
+ *
+ *       Execute @program against @bson. The document is scanned once to
+ *       fill in every path slot, then the instructions are run.
+ *
+ * Returns:
+ *       true if @bson matches.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_matcher_program_run (const mongoc_matcher_program_t *program, /* IN */
+                             const bson_t                   *bson)    /* IN */
+{
+   bson_iter_t stack_values[MONGOC_MATCHER_STACK_SLOTS];
+   bool stack_found[MONGOC_MATCHER_STACK_SLOTS];
+   bson_iter_t *values = stack_values;
+   bool *found = stack_found;
+   uint32_t n_slots;
+   bool r;
+
+   BSON_ASSERT (program);
+   BSON_ASSERT (bson);
+
+   n_slots = program->paths.n_slots;
+   if (n_slots > MONGOC_MATCHER_STACK_SLOTS) {
+      values = (bson_iter_t *)bson_malloc (n_slots * sizeof *values);
+      found = (bool *)bson_malloc (n_slots * sizeof *found);
+   }
+
+   _mongoc_matcher_paths_extract (&program->paths, bson, values, found);
+   r = _mongoc_matcher_program_exec (program, values, found);
+
+   if (values != stack_values) {
+      bson_free (values);
+      bson_free (found);
+   }
+
+   return r;
+}
+
+
+/*
+ * Clear keep[i] for each value in @col that fails @column. These loops
+ * have no branches, so the compiler can vectorize them.
+ */
+static void
+_mongoc_matcher_column_filter (const mongoc_matcher_column_t *column, /* IN */
+                               const double                  *col,    /* IN */
+                               size_t                         n,      /* IN */
+                               uint8_t                       *keep,   /* INOUT */
+                               uint8_t                       *hits)   /* OUT */
+{
+   double value;
+   size_t i;
+   uint32_t j;
+
+   switch ((int)column->opcode) {
+   case MONGOC_MATCHER_OPCODE_EQ:
+      value = column->values[0];
+      for (i = 0; i < n; i++) {
+         keep[i] &= (uint8_t)(col[i] == value);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_GT:
+      value = column->values[0];
+      for (i = 0; i < n; i++) {
+         keep[i] &= (uint8_t)(col[i] > value);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_GTE:
+      value = column->values[0];
+      for (i = 0; i < n; i++) {
+         keep[i] &= (uint8_t)(col[i] >= value);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_LT:
+      value = column->values[0];
+      for (i = 0; i < n; i++) {
+         keep[i] &= (uint8_t)(col[i] < value);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_LTE:
+      value = column->values[0];
+      for (i = 0; i < n; i++) {
+         keep[i] &= (uint8_t)(col[i] <= value);
+      }
+      break;
+   case MONGOC_MATCHER_OPCODE_IN:
+      memset (hits, 0, n);
+      for (j = 0; j < column->n_values; j++) {
+         value = column->values[j];
+         for (i = 0; i < n; i++) {
+            hits[i] |= (uint8_t)(col[i] == value);
+         }
+      }
+      for (i = 0; i < n; i++) {
+         keep[i] &= hits[i];
+      }
+      break;
+   default:
+      BSON_ASSERT (false);
+      break;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_run_many --
+ *
+ *       Execute @program against each of the @n_bsons documents in
+ *       @bsons, setting bit i of @selection (bit i % 8 of byte i / 8)
+ *       if bsons[i] matches and clearing it otherwise.
+ *
+ *       Documents are processed in batches. The column paths of each
+ *       batch are read into arrays of doubles, with NaN for a missing
+ *       field since it fails every comparison just as a missing field
+ *       does. Each column then filters the whole batch. Only documents
+ *       that pass, or that hold a value the columns can't represent
+ *       exactly, are run through the instructions.
+ *
+ * Returns:
+ *       The number of matching documents.
+ *
+ * Side effects:
+ *       @selection is filled in.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_matcher_program_run_many (const mongoc_matcher_program_t *program,   /* IN */
+                                  const bson_t                  **bsons,     /* IN */
+                                  size_t                          n_bsons,   /* IN */
+                                  uint8_t                        *selection) /* OUT */
+{
+   const mongoc_matcher_column_t *columns;
+   uint8_t keep[MONGOC_MATCHER_BATCH_SIZE];
+   uint8_t exact[MONGOC_MATCHER_BATCH_SIZE];
+   uint8_t hits[MONGOC_MATCHER_BATCH_SIZE];
+   bson_iter_t *values = NULL;
+   bool *found = NULL;
+   double *cols = NULL;
+   double *col;
+   uint32_t n_slots;
+   uint32_t slot;
+   size_t n_matched = 0;
+   size_t start;
+   size_t n;
+   size_t i;
+   bool r;
+
+   BSON_ASSERT (program);
+   BSON_ASSERT (bsons || !n_bsons);
+   BSON_ASSERT (selection || !n_bsons);
+
+   if (!n_bsons) {
+      return 0;
+   }
+
+   memset (selection, 0, (n_bsons + 7) / 8);
+
+   columns = (const mongoc_matcher_column_t *)program->columns.data;
+   n_slots = program->column_paths.n_slots;
+
+   if (n_slots) {
+      values = (bson_iter_t *)bson_malloc (n_slots * sizeof *values);
+      found = (bool *)bson_malloc (n_slots * sizeof *found);
+      cols = (double *)bson_malloc (
+         n_slots * MONGOC_MATCHER_BATCH_SIZE * sizeof *cols);
+   }
+
+   for (start = 0; start < n_bsons; start += MONGOC_MATCHER_BATCH_SIZE) {
+      n = BSON_MIN (MONGOC_MATCHER_BATCH_SIZE, n_bsons - start);
+
+      memset (keep, 1, n);
+      memset (exact, 1, n);
+
+      for (i = 0; i < n && n_slots; i++) {
+         _mongoc_matcher_paths_extract (&program->column_paths,
+                                        bsons[start + i], values, found);
+
+         for (slot = 0; slot < n_slots; slot++) {
+            col = &cols[slot * MONGOC_MATCHER_BATCH_SIZE];
+
+            if (!found[slot]) {
+               col[i] = NAN;
+            } else if (!_mongoc_matcher_exact_double (&values[slot], true,
+                                                      &col[i])) {
+               col[i] = NAN;
+               exact[i] = 0;
+            }
+         }
+      }
+
+      for (i = 0; i < program->columns.len; i++) {
+         _mongoc_matcher_column_filter (
+            &columns[i], &cols[columns[i].slot * MONGOC_MATCHER_BATCH_SIZE],
+            n, keep, hits);
+      }
+
+      for (i = 0; i < n; i++) {
+         if (!exact[i]) {
+            r = _mongoc_matcher_program_run (program, bsons[start + i]);
+         } else if (keep[i]) {
+            r = program->columns_only ||
+                _mongoc_matcher_program_run (program, bsons[start + i]);
+         } else {
+            r = false;
+         }
+
+         if (r) {
+            selection[(start + i) / 8] |= (uint8_t)(1 << ((start + i) % 8));
+            n_matched++;
+         }
+      }
+   }
+
+   bson_free (values);
+   bson_free (found);
+   bson_free (cols);
+
+   return n_matched;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_program_destroy --
+ *
+ *       Release all resources associated with @program. The ops it
+ *       references are not freed.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_matcher_program_destroy (mongoc_matcher_program_t *program) /* IN */
+{
+   size_t i;
+
+   BSON_ASSERT (program);
+
+   for (i = 0; i < program->columns.len; i++) {
+      bson_free (_mongoc_array_index (&program->columns,
+                                      mongoc_matcher_column_t, i).values);
+   }
+
+   _mongoc_array_destroy (&program->columns);
+   _mongoc_matcher_paths_destroy (&program->column_paths);
+   _mongoc_matcher_paths_destroy (&program->paths);
+   _mongoc_array_destroy (&program->insns);
+}
@@ -0,0 +1,728 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mongoc-matcher.h"
+#include "mongoc-matcher-private.h"
+
+
+/*
+ * A mongoc_matcher_set_t indexes each of its queries by one of the
+ * predicates the query's top-level $and requires:
+ *
+ *   - {path: value} with a number, string or null value goes in a hash
+ *     table keyed by (path, value);
+ *   - numeric $gt, $gte, $lt and $lte on one path are merged into an
+ *     interval, kept in an interval tree per path;
+ *   - anything else is checked against every document.
+ *
+ * To match a document, its paths are extracted once into slots shared by
+ * all queries, the indexes produce candidate queries, and the compiled
+ * program of each candidate confirms the match. The indexes only need to
+ * be conservative: a query they suggest may still fail to match, but a
+ * query they skip never would have matched.
+ */
+
+
+#define MONGOC_MATCHER_SET_MIN_BUCKETS 64
+
+#define ENTRY(_set, _i) \
+   (&_mongoc_array_index (&(_set)->entries, mongoc_matcher_set_entry_t, (_i)))
+#define EQ(_set, _i) \
+   (&_mongoc_array_index (&(_set)->eqs, mongoc_matcher_set_eq_t, (_i)))
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_set_new --
+ *
+ *       Create a new, empty set of queries.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_set_t that should be freed with
+ *       mongoc_matcher_set_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_set_t *
+mongoc_matcher_set_new (void)
+{
+   mongoc_matcher_set_t *set;
+
+   set = (mongoc_matcher_set_t *)bson_malloc0 (sizeof *set);
+
+   _mongoc_matcher_paths_init (&set->paths);
+   _mongoc_array_init (&set->entries, sizeof (mongoc_matcher_set_entry_t));
+   _mongoc_array_init (&set->eqs, sizeof (mongoc_matcher_set_eq_t));
+   _mongoc_array_init (&set->eq_slots, sizeof (uint32_t));
+   _mongoc_array_init (&set->ranges, sizeof (mongoc_matcher_set_ranges_t));
+   _mongoc_array_init (&set->unindexed, sizeof (uint32_t));
+   _mongoc_array_init (&set->candidates, sizeof (uint32_t));
+
+   return set;
+}
+
+
+/*
+ * Read a number or bool the way the matcher compares it, as a double.
+ * Returns false for other types and for NaN, which compares false to
+ * everything.
+ */
+static bool
+_mongoc_matcher_set_number (const bson_iter_t *iter,  /* IN */
+                            double            *value) /* OUT */
+{
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+      *value = bson_iter_double (iter);
+      return !isnan (*value);
+   case BSON_TYPE_INT32:
+      *value = bson_iter_int32 (iter);
+      return true;
+   case BSON_TYPE_INT64:
+      *value = (double)bson_iter_int64 (iter);
+      return true;
+   case BSON_TYPE_BOOL:
+      *value = bson_iter_bool (iter) ? 1.0 : 0.0;
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+/*
+ * Build the hash key for the value at @iter, as it would be compared by
+ * an equality op. Returns false for values that aren't indexed.
+ */
+static bool
+_mongoc_matcher_set_key_init (mongoc_matcher_set_key_t *key,  /* OUT */
+                              uint32_t                  slot, /* IN */
+                              const bson_iter_t        *iter) /* IN */
+{
+   memset (key, 0, sizeof *key);
+   key->slot = slot;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_BOOL:
+      key->type = BSON_TYPE_DOUBLE;
+      if (!_mongoc_matcher_set_number (iter, &key->number)) {
+         return false;
+      }
+
+      /* -0.0 must hash like 0.0 */
+      if (key->number == 0.0) {
+         key->number = 0.0;
+      }
+      return true;
+   case BSON_TYPE_UTF8:
+      key->type = BSON_TYPE_UTF8;
+      key->str = bson_iter_utf8 (iter, &key->len);
+      return true;
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_UNDEFINED:
+      key->type = BSON_TYPE_NULL;
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+static uint32_t
+_mongoc_matcher_set_key_hash (const mongoc_matcher_set_key_t *key) /* IN */
+{
+   const uint8_t *bytes;
+   uint32_t hash = 2166136261u; /* FNV-1a */
+   size_t len;
+   size_t i;
+
+   hash = (hash ^ key->slot) * 16777619u;
+   hash = (hash ^ (uint32_t)key->type) * 16777619u;
+
+   if (key->type == BSON_TYPE_DOUBLE) {
+      bytes = (const uint8_t *)&key->number;
+      len = sizeof key->number;
+   } else if (key->type == BSON_TYPE_UTF8) {
+      bytes = (const uint8_t *)key->str;
+      len = key->len;
+   } else {
+      return hash;
+   }
+
+   for (i = 0; i < len; i++) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+   }
+
+   return hash;
+}
+
+
+static bool
+_mongoc_matcher_set_key_equal (const mongoc_matcher_set_key_t *a, /* IN */
+                               const mongoc_matcher_set_key_t *b) /* IN */
+{
+   if (a->slot != b->slot || a->type != b->type) {
+      return false;
+   }
+
+   switch ((int)a->type) {
+   case BSON_TYPE_DOUBLE:
+      return a->number == b->number;
+   case BSON_TYPE_UTF8:
+      return a->len == b->len && memcmp (a->str, b->str, a->len) == 0;
+   default:
+      return true;
+   }
+}
+
+
+static void
+_mongoc_matcher_set_rehash (mongoc_matcher_set_t *set,       /* IN */
+                            uint32_t              n_buckets) /* IN */
+{
+   mongoc_matcher_set_eq_t *eq;
+   uint32_t i;
+
+   bson_free (set->buckets);
+   set->buckets = (uint32_t *)bson_malloc (n_buckets * sizeof *set->buckets);
+   set->n_buckets = n_buckets;
+
+   for (i = 0; i < n_buckets; i++) {
+      set->buckets[i] = MONGOC_MATCHER_PATH_NONE;
+   }
+
+   for (i = 0; i < (uint32_t)set->eqs.len; i++) {
+      eq = EQ (set, i);
+      eq->next = set->buckets[eq->hash & (n_buckets - 1)];
+      set->buckets[eq->hash & (n_buckets - 1)] = i;
+   }
+}
+
+
+static void
+_mongoc_matcher_set_add_eq (mongoc_matcher_set_t           *set,   /* IN */
+                            uint32_t                        entry, /* IN */
+                            const mongoc_matcher_set_key_t *key)   /* IN */
+{
+   mongoc_matcher_set_eq_t eq;
+   uint32_t i;
+
+   for (i = 0; i < (uint32_t)set->eq_slots.len; i++) {
+      if (_mongoc_array_index (&set->eq_slots, uint32_t, i) == key->slot) {
+         break;
+      }
+   }
+
+   if (i == (uint32_t)set->eq_slots.len) {
+      _mongoc_array_append_val (&set->eq_slots, key->slot);
+   }
+
+   eq.key = *key;
+   eq.hash = _mongoc_matcher_set_key_hash (key);
+   eq.entry = entry;
+   eq.next = MONGOC_MATCHER_PATH_NONE;
+   _mongoc_array_append_val (&set->eqs, eq);
+
+   if (set->eqs.len > set->n_buckets) {
+      _mongoc_matcher_set_rehash (
+         set, BSON_MAX (MONGOC_MATCHER_SET_MIN_BUCKETS, set->n_buckets * 2));
+   } else {
+      i = (uint32_t)set->eqs.len - 1;
+      EQ (set, i)->next = set->buckets[eq.hash & (set->n_buckets - 1)];
+      set->buckets[eq.hash & (set->n_buckets - 1)] = i;
+   }
+}
+
+
+static void
+_mongoc_matcher_set_add_range (mongoc_matcher_set_t *set,   /* IN */
+                               uint32_t              entry, /* IN */
+                               uint32_t              slot,  /* IN */
+                               double                lo,    /* IN */
+                               double                hi)    /* IN */
+{
+   mongoc_matcher_set_ranges_t *ranges = NULL;
+   mongoc_matcher_set_ranges_t new_ranges;
+   mongoc_matcher_set_range_t range;
+   size_t i;
+
+   for (i = 0; i < set->ranges.len; i++) {
+      ranges = &_mongoc_array_index (&set->ranges,
+                                     mongoc_matcher_set_ranges_t, i);
+      if (ranges->slot == slot) {
+         break;
+      }
+   }
+
+   if (i == set->ranges.len) {
+      new_ranges.slot = slot;
+      new_ranges.sorted = true;
+      _mongoc_array_init (&new_ranges.ranges,
+                          sizeof (mongoc_matcher_set_range_t));
+      _mongoc_array_append_val (&set->ranges, new_ranges);
+      ranges = &_mongoc_array_index (&set->ranges,
+                                     mongoc_matcher_set_ranges_t, i);
+   }
+
+   range.lo = lo;
+   range.hi = hi;
+   range.max_hi = hi;
+   range.entry = entry;
+   _mongoc_array_append_val (&ranges->ranges, range);
+   ranges->sorted = false;
+}
+
+
+static bool
+_mongoc_matcher_set_is_bound (const mongoc_matcher_op_t *op) /* IN */
+{
+   double value;
+
+   switch ((int)op->base.opcode) {
+   case MONGOC_MATCHER_OPCODE_GT:
+   case MONGOC_MATCHER_OPCODE_GTE:
+   case MONGOC_MATCHER_OPCODE_LT:
+   case MONGOC_MATCHER_OPCODE_LTE:
+      break;
+   default:
+      return false;
+   }
+
+   return !BSON_ITER_HOLDS_BOOL (&op->compare.iter) &&
+          _mongoc_matcher_set_number (&op->compare.iter, &value);
+}
+
+
+/*
+ * Merge every numeric bound on @path among @conjuncts into [lo, hi].
+ *
+ * The merged interval is closed even for $gt and $lt, since converting
+ * int64 values to double may round them onto the bound. That only adds
+ * candidates, which the program then rejects.
+ */
+static void
+_mongoc_matcher_set_interval (mongoc_array_t *conjuncts, /* IN */
+                              const char     *path,      /* IN */
+                              double         *lo,        /* OUT */
+                              double         *hi)        /* OUT */
+{
+   mongoc_matcher_op_t *op;
+   double value;
+   size_t i;
+
+   *lo = -INFINITY;
+   *hi = INFINITY;
+
+   for (i = 0; i < conjuncts->len; i++) {
+      op = _mongoc_array_index (conjuncts, mongoc_matcher_op_t *, i);
+
+      if (!_mongoc_matcher_set_is_bound (op) ||
+          strcmp (op->compare.path, path) != 0) {
+         continue;
+      }
+
+      _mongoc_matcher_set_number (&op->compare.iter, &value);
+
+      if (op->base.opcode == MONGOC_MATCHER_OPCODE_GT ||
+          op->base.opcode == MONGOC_MATCHER_OPCODE_GTE) {
+         *lo = BSON_MAX (*lo, value);
+      } else {
+         *hi = BSON_MIN (*hi, value);
+      }
+   }
+}
+
+
+/*
+ * Index the entry at @entry by its most selective required predicate:
+ * an equality if there is one, otherwise the tightest numeric interval.
+ */
+static void
+_mongoc_matcher_set_index (mongoc_matcher_set_t *set,   /* IN */
+                           uint32_t              entry) /* IN */
+{
+   mongoc_matcher_set_key_t key;
+   mongoc_matcher_op_t *op;
+   mongoc_matcher_op_t *bound = NULL;
+   mongoc_array_t conjuncts;
+   double best_lo = 0;
+   double best_hi = 0;
+   double lo;
+   double hi;
+   size_t i;
+
+   _mongoc_array_init (&conjuncts, sizeof (mongoc_matcher_op_t *));
+   _mongoc_matcher_op_conjuncts (ENTRY (set, entry)->optree, &conjuncts);
+
+   for (i = 0; i < conjuncts.len; i++) {
+      op = _mongoc_array_index (&conjuncts, mongoc_matcher_op_t *, i);
+
+      if (op->base.opcode == MONGOC_MATCHER_OPCODE_EQ &&
+          bson_iter_type (&op->compare.iter) != BSON_TYPE_BOOL &&
+          _mongoc_matcher_set_key_init (
+             &key, _mongoc_matcher_paths_add (&set->paths, op->compare.path),
+             &op->compare.iter)) {
+         _mongoc_matcher_set_add_eq (set, entry, &key);
+         goto done;
+      }
+
+      if (_mongoc_matcher_set_is_bound (op)) {
+         _mongoc_matcher_set_interval (&conjuncts, op->compare.path, &lo, &hi);
+
+         /* prefer a path bounded on both sides */
+         if (!bound || ((isinf (best_lo) || isinf (best_hi)) &&
+                        !isinf (lo) && !isinf (hi))) {
+            bound = op;
+            best_lo = lo;
+            best_hi = hi;
+         }
+      }
+   }
+
+   if (bound) {
+      _mongoc_matcher_set_add_range (
+         set, entry,
+         _mongoc_matcher_paths_add (&set->paths, bound->compare.path),
+         best_lo, best_hi);
+   } else {
+      _mongoc_array_append_val (&set->unindexed, entry);
+   }
+
+done:
+   _mongoc_array_destroy (&conjuncts);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_set_add --
+ *
+ *       Add the query specification @query to @set. Documents it matches
+ *       will report @id from mongoc_matcher_set_match().
+ *
+ *       @query accepts the same operators as mongoc_matcher_new().
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_matcher_set_add (mongoc_matcher_set_t *set,   /* IN */
+                        uint32_t              id,    /* IN */
+                        const bson_t         *query, /* IN */
+                        bson_error_t         *error) /* OUT */
+{
+   mongoc_matcher_set_entry_t entry;
+
+   BSON_ASSERT (set);
+   BSON_ASSERT (query);
+
+   entry.id = id;
+   entry.query = bson_copy (query);
+
+   if (!(entry.optree = _mongoc_matcher_parse_query (entry.query, error))) {
+      bson_destroy (entry.query);
+      return false;
+   }
+
+   _mongoc_matcher_program_init (&entry.program);
+   _mongoc_matcher_program_compile_with_paths (&entry.program, &set->paths,
+                                               entry.optree);
+   _mongoc_array_append_val (&set->entries, entry);
+
+   _mongoc_matcher_set_index (set, (uint32_t)set->entries.len - 1);
+
+   return true;
+}
+
+
+static int
+_mongoc_matcher_set_range_cmp (const void *a, /* IN */
+                               const void *b) /* IN */
+{
+   const mongoc_matcher_set_range_t *ra = (const mongoc_matcher_set_range_t *)a;
+   const mongoc_matcher_set_range_t *rb = (const mongoc_matcher_set_range_t *)b;
+
+   if (ra->lo != rb->lo) {
+      return ra->lo < rb->lo ? -1 : 1;
+   }
+
+   return (ra->entry > rb->entry) - (ra->entry < rb->entry);
+}
+
+
+/*
+ * The ranges sorted by lo form an implicit balanced tree, rooted at the
+ * middle element of each subarray. Store in each root the largest hi of
+ * its subtree, so lookups can skip subtrees that end too soon.
+ */
+static double
+_mongoc_matcher_set_ranges_build (mongoc_matcher_set_range_t *ranges, /* IN */
+                                  size_t                      begin,  /* IN */
+                                  size_t                      end)    /* IN */
+{
+   mongoc_matcher_set_range_t *root;
+   double max_hi;
+   size_t mid;
+
+   if (begin >= end) {
+      return -INFINITY;
+   }
+
+   mid = begin + (end - begin) / 2;
+   root = &ranges[mid];
+
+   max_hi = root->hi;
+   max_hi = BSON_MAX (max_hi,
+                      _mongoc_matcher_set_ranges_build (ranges, begin, mid));
+   max_hi = BSON_MAX (max_hi,
+                      _mongoc_matcher_set_ranges_build (ranges, mid + 1, end));
+   root->max_hi = max_hi;
+
+   return max_hi;
+}
+
+
+static void
+_mongoc_matcher_set_ranges_find (const mongoc_matcher_set_range_t *ranges,     /* IN */
+                                 size_t                            begin,      /* IN */
+                                 size_t                            end,        /* IN */
+                                 double                            value,      /* IN */
+                                 mongoc_array_t                   *candidates) /* OUT */
+{
+   const mongoc_matcher_set_range_t *root;
+   size_t mid;
+
+   while (begin < end) {
+      mid = begin + (end - begin) / 2;
+      root = &ranges[mid];
+
+      if (root->max_hi < value) {
+         return;
+      }
+
+      _mongoc_matcher_set_ranges_find (ranges, begin, mid, value, candidates);
+
+      /* everything from here on starts after value */
+      if (root->lo > value) {
+         return;
+      }
+
+      if (root->hi >= value) {
+         _mongoc_array_append_val (candidates, root->entry);
+      }
+
+      begin = mid + 1;
+   }
+}
+
+
+static void
+_mongoc_matcher_set_candidates (mongoc_matcher_set_t *set) /* IN */
+{
+   mongoc_matcher_set_ranges_t *ranges;
+   mongoc_matcher_set_key_t key;
+   mongoc_matcher_set_eq_t *eq;
+   double value;
+   uint32_t slot;
+   uint32_t hash;
+   uint32_t i;
+   size_t j;
+
+   set->candidates.len = 0;
+
+   for (j = 0; j < set->eq_slots.len; j++) {
+      slot = _mongoc_array_index (&set->eq_slots, uint32_t, j);
+
+      if (!set->found[slot] ||
+          !_mongoc_matcher_set_key_init (&key, slot, &set->values[slot])) {
+         continue;
+      }
+
+      hash = _mongoc_matcher_set_key_hash (&key);
+
+      for (i = set->buckets[hash & (set->n_buckets - 1)];
+           i != MONGOC_MATCHER_PATH_NONE;
+           i = eq->next) {
+         eq = EQ (set, i);
+
+         if (eq->hash == hash && _mongoc_matcher_set_key_equal (&eq->key, &key)) {
+            _mongoc_array_append_val (&set->candidates, eq->entry);
+         }
+      }
+   }
+
+   for (j = 0; j < set->ranges.len; j++) {
+      ranges = &_mongoc_array_index (&set->ranges,
+                                     mongoc_matcher_set_ranges_t, j);
+
+      if (!set->found[ranges->slot] ||
+          !_mongoc_matcher_set_number (&set->values[ranges->slot], &value)) {
+         continue;
+      }
+
+      if (!ranges->sorted) {
+         qsort (ranges->ranges.data, ranges->ranges.len,
+                sizeof (mongoc_matcher_set_range_t),
+                _mongoc_matcher_set_range_cmp);
+         _mongoc_matcher_set_ranges_build (
+            (mongoc_matcher_set_range_t *)ranges->ranges.data, 0,
+            ranges->ranges.len);
+         ranges->sorted = true;
+      }
+
+      _mongoc_matcher_set_ranges_find (
+         (const mongoc_matcher_set_range_t *)ranges->ranges.data, 0,
+         ranges->ranges.len, value, &set->candidates);
+   }
+
+   _mongoc_array_append_vals (&set->candidates, set->unindexed.data,
+                              (uint32_t)set->unindexed.len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_set_match --
+ *
+ *       Find every query in @set that matches @document.
+ *
+ *       The ids of up to @max_ids matching queries are stored in @ids,
+ *       in no particular order. @ids may be NULL if @max_ids is 0.
+ *
+ *       @set caches per-document state and builds parts of its indexes
+ *       lazily, so it must not be used from more than one thread at a
+ *       time.
+ *
+ * Returns:
+ *       The number of matching queries, which may exceed @max_ids.
+ *
+ * Side effects:
+ *       @ids is filled in.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+mongoc_matcher_set_match (mongoc_matcher_set_t *set,      /* IN */
+                          const bson_t         *document, /* IN */
+                          uint32_t             *ids,      /* OUT */
+                          uint32_t              max_ids)  /* IN */
+{
+   mongoc_matcher_set_entry_t *entry;
+   uint32_t n_matched = 0;
+   size_t i;
+
+   BSON_ASSERT (set);
+   BSON_ASSERT (document);
+   BSON_ASSERT (ids || !max_ids);
+
+   if (!set->values || set->n_scratch < set->paths.n_slots) {
+      set->n_scratch = BSON_MAX (1, set->paths.n_slots);
+      set->values = (bson_iter_t *)bson_realloc (
+         set->values, set->n_scratch * sizeof *set->values);
+      set->found = (bool *)bson_realloc (
+         set->found, set->n_scratch * sizeof *set->found);
+   }
+
+   _mongoc_matcher_paths_extract (&set->paths, document, set->values,
+                                  set->found);
+   _mongoc_matcher_set_candidates (set);
+
+   for (i = 0; i < set->candidates.len; i++) {
+      entry = ENTRY (set, _mongoc_array_index (&set->candidates, uint32_t, i));
+
+      if (_mongoc_matcher_program_exec (&entry->program, set->values,
+                                        set->found)) {
+         if (n_matched < max_ids) {
+            ids[n_matched] = entry->id;
+         }
+         n_matched++;
+      }
+   }
+
+   return n_matched;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_set_destroy --
+ *
+ *       Release all resources associated with @set.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_matcher_set_destroy (mongoc_matcher_set_t *set) /* IN */
+{
+   mongoc_matcher_set_entry_t *entry;
+   size_t i;
+
+   BSON_ASSERT (set);
+
+   for (i = 0; i < set->entries.len; i++) {
+      entry = ENTRY (set, i);
+      _mongoc_matcher_program_destroy (&entry->program);
+      _mongoc_matcher_op_destroy (entry->optree);
+      bson_destroy (entry->query);
+   }
+
+   for (i = 0; i < set->ranges.len; i++) {
+      _mongoc_array_destroy (&_mongoc_array_index (
+         &set->ranges, mongoc_matcher_set_ranges_t, i).ranges);
+   }
+
+   _mongoc_array_destroy (&set->entries);
+   _mongoc_array_destroy (&set->eqs);
+   _mongoc_array_destroy (&set->eq_slots);
+   _mongoc_array_destroy (&set->ranges);
+   _mongoc_array_destroy (&set->unindexed);
+   _mongoc_array_destroy (&set->candidates);
+   _mongoc_matcher_paths_destroy (&set->paths);
+   bson_free (set->buckets);
+   bson_free (set->values);
+   bson_free (set->found);
+   bson_free (set);
+}
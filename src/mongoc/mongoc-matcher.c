@@ -30,12 +30,253 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,
                                bson_error_t            *error);
 
 
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_compare (bson_iter_t  *iter,
+                               const char   *path,
+                               bson_error_t *error);
+
+
+/*
+ * Read the whole number @iter holds. A double is truncated if @truncate,
+ * as the server does for $mod, and otherwise accepted only if it has no
+ * fractional part.
+ */
+static bool
+_mongoc_matcher_parse_integer (const bson_iter_t *iter,     /* IN */
+                               bool               truncate, /* IN */
+                               int64_t           *value)    /* OUT */
+{
+   double d;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_INT32:
+      *value = bson_iter_int32 (iter);
+      return true;
+   case BSON_TYPE_INT64:
+      *value = bson_iter_int64 (iter);
+      return true;
+   case BSON_TYPE_DOUBLE:
+      d = bson_iter_double (iter);
+      /* the range of int64_t, excluding NaN and infinities */
+      if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0) ||
+          (!truncate && d != (double)(int64_t)d)) {
+         return false;
+      }
+      *value = (int64_t)d;
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+/*
+ * Map the value of {$type: ...} to a bson_type_t. It is either the
+ * type's number, with -1 for MinKey and 127 for MaxKey, or its alias.
+ */
+static bool
+_mongoc_matcher_parse_type (const bson_iter_t *iter, /* IN */
+                            bson_type_t       *type) /* OUT */
+{
+   static const struct {
+      const char  *alias;
+      bson_type_t  type;
+   } aliases[] = {
+      { "double", BSON_TYPE_DOUBLE },
+      { "string", BSON_TYPE_UTF8 },
+      { "object", BSON_TYPE_DOCUMENT },
+      { "array", BSON_TYPE_ARRAY },
+      { "binData", BSON_TYPE_BINARY },
+      { "undefined", BSON_TYPE_UNDEFINED },
+      { "objectId", BSON_TYPE_OID },
+      { "bool", BSON_TYPE_BOOL },
+      { "date", BSON_TYPE_DATE_TIME },
+      { "null", BSON_TYPE_NULL },
+      { "regex", BSON_TYPE_REGEX },
+      { "dbPointer", BSON_TYPE_DBPOINTER },
+      { "javascript", BSON_TYPE_CODE },
+      { "symbol", BSON_TYPE_SYMBOL },
+      { "javascriptWithScope", BSON_TYPE_CODEWSCOPE },
+      { "int", BSON_TYPE_INT32 },
+      { "timestamp", BSON_TYPE_TIMESTAMP },
+      { "long", BSON_TYPE_INT64 },
+      { "minKey", BSON_TYPE_MINKEY },
+      { "maxKey", BSON_TYPE_MAXKEY },
+   };
+   const char *str;
+   int64_t value;
+   size_t i;
+
+   if (BSON_ITER_HOLDS_UTF8 (iter)) {
+      str = bson_iter_utf8 (iter, NULL);
+      for (i = 0; i < sizeof aliases / sizeof aliases[0]; i++) {
+         if (0 == strcmp (str, aliases[i].alias)) {
+            *type = aliases[i].type;
+            return true;
+         }
+      }
+      return false;
+   }
+
+   if (!_mongoc_matcher_parse_integer (iter, false, &value)) {
+      return false;
+   }
+
+   if (value == -1) {
+      *type = BSON_TYPE_MINKEY;
+   } else if (value == 127) {
+      *type = BSON_TYPE_MAXKEY;
+   } else if (value >= BSON_TYPE_DOUBLE && value <= BSON_TYPE_INT64) {
+      *type = (bson_type_t)value;
+   } else {
+      return false;
+   }
+
+   return true;
+}
+
+
+/*
+ * Parse {$regex: ...}, where @iter is the value of $regex and @parent
+ * is the document holding it, which may also hold $options.
+ */
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_regex (bson_iter_t       *iter,   /* IN */
+                             const bson_iter_t *parent, /* IN */
+                             const char        *path,   /* IN */
+                             bson_error_t      *error)  /* OUT */
+{
+   const char *pattern;
+   const char *options = NULL;
+   bson_iter_t child;
+
+   if (BSON_ITER_HOLDS_REGEX (iter)) {
+      pattern = bson_iter_regex (iter, &options);
+   } else if (BSON_ITER_HOLDS_UTF8 (iter)) {
+      pattern = bson_iter_utf8 (iter, NULL);
+   } else {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "$regex must be a string or regular expression.");
+      return NULL;
+   }
+
+   if (parent &&
+       bson_iter_recurse (parent, &child) &&
+       bson_iter_find (&child, "$options")) {
+      if (!BSON_ITER_HOLDS_UTF8 (&child)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "$options must be a string.");
+         return NULL;
+      }
+      options = bson_iter_utf8 (&child, NULL);
+   }
+
+   return _mongoc_matcher_op_regex_new (path, pattern, options, error);
+}
+
+
+/*
+ * Parse {$elemMatch: {...}}. If the first key of the document is an
+ * operator such as $gt, it applies to the elements themselves; otherwise
+ * the document is a query applied to elements that are documents.
+ */
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_elem_match (bson_iter_t  *iter,  /* IN */
+                                  const char   *path,  /* IN */
+                                  bson_error_t *error) /* OUT */
+{
+   mongoc_matcher_op_t *op_child;
+   bson_iter_t child;
+   const char *key;
+   bool is_value;
+
+   if (!BSON_ITER_HOLDS_DOCUMENT (iter) ||
+       !bson_iter_recurse (iter, &child) ||
+       !bson_iter_next (&child)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "$elemMatch must be a non-empty document.");
+      return NULL;
+   }
+
+   key = bson_iter_key (&child);
+   is_value = (key[0] == '$' &&
+               strcmp (key, "$and") != 0 &&
+               strcmp (key, "$or") != 0 &&
+               strcmp (key, "$nor") != 0);
+
+   if (is_value) {
+      op_child = _mongoc_matcher_parse_compare (iter, path, error);
+   } else {
+      bson_iter_recurse (iter, &child);
+      op_child = _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_AND,
+                                                &child, true, error);
+   }
+
+   if (!op_child) {
+      return NULL;
+   }
+
+   return _mongoc_matcher_op_elem_match_new (path, op_child, is_value);
+}
+
+
+/* Parse {$mod: [divisor, remainder]}. */
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_mod (bson_iter_t  *iter,  /* IN */
+                           const char   *path,  /* IN */
+                           bson_error_t *error) /* OUT */
+{
+   bson_iter_t child;
+   int64_t values[2];
+   int i;
+
+   if (!BSON_ITER_HOLDS_ARRAY (iter) || !bson_iter_recurse (iter, &child)) {
+      goto invalid;
+   }
+
+   for (i = 0; i < 2; i++) {
+      if (!bson_iter_next (&child) ||
+          !_mongoc_matcher_parse_integer (&child, true, &values[i])) {
+         goto invalid;
+      }
+   }
+
+   if (bson_iter_next (&child)) {
+      goto invalid;
+   }
+
+   if (values[0] == 0) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "$mod divisor cannot be 0.");
+      return NULL;
+   }
+
+   return _mongoc_matcher_op_mod_new (path, values[0], values[1]);
+
+invalid:
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "$mod must be an array of divisor and remainder.");
+   return NULL;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
- * _mongoc_matcher_parse_compare --
+ * _mongoc_matcher_parse_operator --
  *
- *       Parse a compare spec such as $gt or $in.
+ *       Parse the operator observed by @child, such as $gt or $in, from
+ *       the operator document @parent.
  *
  *       See the following link for more information.
  *
@@ -51,6 +292,113 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,
  *--------------------------------------------------------------------------
  */
 
+static mongoc_matcher_op_t *
+_mongoc_matcher_parse_operator (bson_iter_t       *child,  /* IN */
+                                const bson_iter_t *parent, /* IN */
+                                const char        *path,   /* IN */
+                                bson_error_t      *error)  /* OUT */
+{
+   const char * key;
+   mongoc_matcher_op_t * op_child;
+   bson_type_t type;
+   int64_t size;
+
+   key = bson_iter_key (child);
+
+   if (strcmp(key, "$not") == 0) {
+      if (!(op_child = _mongoc_matcher_parse_compare (child, path, error))) {
+         return NULL;
+      }
+      return _mongoc_matcher_op_not_new (path, op_child);
+   } else if (strcmp(key, "$gt") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GT, path,
+                                             child);
+   } else if (strcmp(key, "$gte") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GTE, path,
+                                             child);
+   } else if (strcmp(key, "$in") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_IN, path,
+                                             child);
+   } else if (strcmp(key, "$lt") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LT, path,
+                                             child);
+   } else if (strcmp(key, "$lte") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LTE, path,
+                                             child);
+   } else if (strcmp(key, "$ne") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NE, path,
+                                             child);
+   } else if (strcmp(key, "$nin") == 0) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NIN, path,
+                                             child);
+   } else if (strcmp(key, "$exists") == 0) {
+      return _mongoc_matcher_op_exists_new (path, bson_iter_bool (child));
+   } else if (strcmp(key, "$type") == 0) {
+      if (!_mongoc_matcher_parse_type (child, &type)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "Invalid value for $type.");
+         return NULL;
+      }
+      return _mongoc_matcher_op_type_new (path, type);
+   } else if (strcmp(key, "$regex") == 0) {
+      return _mongoc_matcher_parse_regex (child, parent, path, error);
+   } else if (strcmp(key, "$elemMatch") == 0) {
+      return _mongoc_matcher_parse_elem_match (child, path, error);
+   } else if (strcmp(key, "$all") == 0) {
+      if (!BSON_ITER_HOLDS_ARRAY (child)) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "$all must be an array.");
+         return NULL;
+      }
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_ALL, path,
+                                             child);
+   } else if (strcmp(key, "$size") == 0) {
+      if (!_mongoc_matcher_parse_integer (child, false, &size) || size < 0) {
+         bson_set_error (error,
+                         MONGOC_ERROR_MATCHER,
+                         MONGOC_ERROR_MATCHER_INVALID,
+                         "$size must be a non-negative integer.");
+         return NULL;
+      }
+      return _mongoc_matcher_op_size_new (path, size);
+   } else if (strcmp(key, "$mod") == 0) {
+      return _mongoc_matcher_parse_mod (child, path, error);
+   }
+
+   bson_set_error (error,
+                   MONGOC_ERROR_MATCHER,
+                   MONGOC_ERROR_MATCHER_INVALID,
+                   "Invalid operator \"%s\"",
+                   key);
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_compare --
+ *
+ *       Parse the value of a field in a query, such as "def" in
+ *       {"abc": "def"}, or an operator document such as {$gt: 1, $lt: 5}.
+ *       All the operators of a document must match, so several of them
+ *       are combined with $and.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t if successful; otherwise
+ *       NULL and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
 static mongoc_matcher_op_t *
 _mongoc_matcher_parse_compare (bson_iter_t  *iter,  /* IN */
                                const char   *path,  /* IN */
@@ -59,71 +407,77 @@ _mongoc_matcher_parse_compare (bson_iter_t  *iter,  /* IN */
    const char * key;
    mongoc_matcher_op_t * op = NULL, * op_child;
    bson_iter_t child;
+   bool has_regex;
 
    BSON_ASSERT (iter);
    BSON_ASSERT (path);
 
-   if (bson_iter_type (iter) == BSON_TYPE_DOCUMENT) {
-      if (!bson_iter_recurse (iter, &child) ||
-          !bson_iter_next (&child)) {
-         bson_set_error (error,
-                         MONGOC_ERROR_MATCHER,
-                         MONGOC_ERROR_MATCHER_INVALID,
-                         "Document contains no operations.");
-         return NULL;
+   if (bson_iter_type (iter) == BSON_TYPE_REGEX) {
+      return _mongoc_matcher_parse_regex (iter, NULL, path, error);
+   }
+
+   if (bson_iter_type (iter) != BSON_TYPE_DOCUMENT) {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
+                                             iter);
+   }
+
+   if (!bson_iter_recurse (iter, &child) ||
+       !bson_iter_next (&child)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Document contains no operations.");
+      return NULL;
+   }
+
+   key = bson_iter_key (&child);
+
+   if (key[0] != '$') {
+      return _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
+                                             iter);
+   }
+
+   has_regex = false;
+   do {
+      if (strcmp (bson_iter_key (&child), "$regex") == 0) {
+         has_regex = true;
       }
+   } while (bson_iter_next (&child));
 
-      key = bson_iter_key (&child);
+   bson_iter_recurse (iter, &child);
 
-      if (key[0] != '$') {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path,
-                                              iter);
-      } else if (strcmp(key, "$not") == 0) {
-         if (!(op_child = _mongoc_matcher_parse_compare (&child, path,
-                                                         error))) {
-            return NULL;
+   while (bson_iter_next (&child)) {
+      if (strcmp (bson_iter_key (&child), "$options") == 0) {
+         if (has_regex) {
+            /* consumed by $regex */
+            continue;
          }
-         op = _mongoc_matcher_op_not_new (path, op_child);
-      } else if (strcmp(key, "$gt") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GT, path,
-                                              &child);
-      } else if (strcmp(key, "$gte") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_GTE, path,
-                                              &child);
-      } else if (strcmp(key, "$in") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_IN, path,
-                                              &child);
-      } else if (strcmp(key, "$lt") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LT, path,
-                                              &child);
-      } else if (strcmp(key, "$lte") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_LTE, path,
-                                              &child);
-      } else if (strcmp(key, "$ne") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NE, path,
-                                              &child);
-      } else if (strcmp(key, "$nin") == 0) {
-         op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_NIN, path,
-                                              &child);
-      } else if (strcmp(key, "$exists") == 0) {
-         op = _mongoc_matcher_op_exists_new (path, bson_iter_bool (&child));
-      } else if (strcmp(key, "$type") == 0) {
-         op = _mongoc_matcher_op_type_new (path, bson_iter_type (&child));
-      } else {
          bson_set_error (error,
                          MONGOC_ERROR_MATCHER,
                          MONGOC_ERROR_MATCHER_INVALID,
-                         "Invalid operator \"%s\"",
-                         key);
-         return NULL;
+                         "$options requires $regex.");
+         goto failure;
       }
-   } else {
-      op = _mongoc_matcher_op_compare_new (MONGOC_MATCHER_OPCODE_EQ, path, iter);
+
+      if (!(op_child = _mongoc_matcher_parse_operator (&child, iter, path,
+                                                       error))) {
+         goto failure;
+      }
+
+      op = op ? _mongoc_matcher_op_logical_new (MONGOC_MATCHER_OPCODE_AND,
+                                                op, op_child) : op_child;
    }
 
    BSON_ASSERT (op);
 
    return op;
+
+failure:
+   if (op) {
+      _mongoc_matcher_op_destroy (op);
+   }
+
+   return NULL;
 }
 
 
@@ -148,6 +502,7 @@ static mongoc_matcher_op_t *
 _mongoc_matcher_parse (bson_iter_t  *iter,  /* IN */
                        bson_error_t *error) /* OUT */
 {
+   mongoc_matcher_op_t *op;
    bson_iter_t child;
    const char *key;
 
@@ -176,8 +531,13 @@ _mongoc_matcher_parse (bson_iter_t  *iter,  /* IN */
          return _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_AND,
                                                &child, false, error);
       } else if (strcmp(key, "$nor") == 0) {
-         return _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_NOR,
-                                               &child, false, error);
+         /* {$nor: [a, b, ...]} is the negation of {$or: [a, b, ...]} */
+         if (!(op = _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_OR,
+                                                   &child, false, error))) {
+            return NULL;
+         }
+         return _mongoc_matcher_op_logical_new (MONGOC_MATCHER_OPCODE_NOR,
+                                                op, NULL);
       }
    }
 
@@ -294,6 +654,47 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,  /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_matcher_parse_query --
+ *
+ *       Parse the query specification @query into an operation tree.
+ *
+ *       The compare ops in the tree point into @query, so it must
+ *       outlive the tree and must not move.
+ *
+ * Returns:
+ *       A newly allocated mongoc_matcher_op_t if successful; otherwise
+ *       NULL and @error is set.
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_matcher_op_t *
+_mongoc_matcher_parse_query (const bson_t *query, /* IN */
+                             bson_error_t *error) /* OUT */
+{
+   bson_iter_t iter;
+
+   BSON_ASSERT (query);
+
+   if (!bson_iter_init (&iter, query)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_MATCHER,
+                      MONGOC_ERROR_MATCHER_INVALID,
+                      "Invalid query document.");
+      return NULL;
+   }
+
+   return _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_AND, &iter,
+                                         true, error);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -302,8 +703,9 @@ _mongoc_matcher_parse_logical (mongoc_matcher_opcode_t  opcode,  /* IN */
  *       Create a new mongoc_matcher_t using the query specification
  *       provided in @query.
  *
- *       This will build an operation tree that can be applied to arbitrary
- *       bson documents using mongoc_matcher_match().
+ *       This will build an operation tree and compile it into a flat
+ *       program that can be applied to arbitrary bson documents using
+ *       mongoc_matcher_match().
  *
  * Returns:
  *       A newly allocated mongoc_matcher_t if successful; otherwise NULL
@@ -324,23 +726,19 @@ mongoc_matcher_new (const bson_t *query, /* IN */
 {
    mongoc_matcher_op_t *op;
    mongoc_matcher_t *matcher;
-   bson_iter_t iter;
 
    BSON_ASSERT (query);
 
    matcher = (mongoc_matcher_t *)bson_malloc0 (sizeof *matcher);
    bson_copy_to (query, &matcher->query);
 
-   if (!bson_iter_init (&iter, &matcher->query)) {
-      goto failure;
-   }
-
-   if (!(op = _mongoc_matcher_parse_logical (MONGOC_MATCHER_OPCODE_AND, &iter,
-                                             true, error))) {
+   if (!(op = _mongoc_matcher_parse_query (&matcher->query, error))) {
       goto failure;
    }
 
    matcher->optree = op;
+   _mongoc_matcher_program_init (&matcher->program);
+   _mongoc_matcher_program_compile (&matcher->program, op);
 
    return matcher;
 
@@ -376,7 +774,48 @@ mongoc_matcher_match (const mongoc_matcher_t *matcher,  /* IN */
    BSON_ASSERT (matcher->optree);
    BSON_ASSERT (document);
 
-   return _mongoc_matcher_op_match (matcher->optree, document);
+   return _mongoc_matcher_program_run (&matcher->program, document);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_matcher_match_many --
+ *
+ *       Checks which of the @n_documents documents in @documents match
+ *       the query specified when creating @matcher, such as a batch
+ *       read from a cursor.
+ *
+ *       Bit i % 8 of selection[i / 8] is set if documents[i] matches,
+ *       and cleared otherwise. @selection must have room for
+ *       (n_documents + 7) / 8 bytes.
+ *
+ *       The result for each document is the same as from
+ *       mongoc_matcher_match(), but numeric comparisons are applied to
+ *       the whole batch at once, which is much cheaper when they reject
+ *       most documents.
+ *
+ * Returns:
+ *       The number of documents that matched.
+ *
+ * Side effects:
+ *       @selection is filled in.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+mongoc_matcher_match_many (const mongoc_matcher_t  *matcher,     /* IN */
+                           const bson_t           **documents,   /* IN */
+                           size_t                   n_documents, /* IN */
+                           uint8_t                 *selection)   /* OUT */
+{
+   BSON_ASSERT (matcher);
+   BSON_ASSERT (matcher->optree);
+
+   return _mongoc_matcher_program_run_many (&matcher->program, documents,
+                                            n_documents, selection);
 }
 
 
@@ -401,6 +840,7 @@ mongoc_matcher_destroy (mongoc_matcher_t *matcher) /* IN */
 {
    BSON_ASSERT (matcher);
 
+   _mongoc_matcher_program_destroy (&matcher->program);
    _mongoc_matcher_op_destroy (matcher->optree);
    bson_destroy (&matcher->query);
    bson_free (matcher);
@@ -27,15 +27,32 @@
 BSON_BEGIN_DECLS
 
 
-typedef struct _mongoc_matcher_t mongoc_matcher_t;
+typedef struct _mongoc_matcher_t     mongoc_matcher_t;
+typedef struct _mongoc_matcher_set_t mongoc_matcher_set_t;
 
 
 mongoc_matcher_t *mongoc_matcher_new     (const bson_t           *query,
                                           bson_error_t           *error)      BSON_GNUC_DEPRECATED;
 bool              mongoc_matcher_match   (const mongoc_matcher_t *matcher,
                                           const bson_t           *document)   BSON_GNUC_DEPRECATED;
+size_t            mongoc_matcher_match_many
+                                         (const mongoc_matcher_t *matcher,
+                                          const bson_t          **documents,
+                                          size_t                  n_documents,
+                                          uint8_t                *selection)  BSON_GNUC_DEPRECATED;
 void              mongoc_matcher_destroy (mongoc_matcher_t       *matcher)    BSON_GNUC_DEPRECATED;
 
+mongoc_matcher_set_t *mongoc_matcher_set_new     (void)                               BSON_GNUC_DEPRECATED;
+bool                  mongoc_matcher_set_add     (mongoc_matcher_set_t *set,
+                                                  uint32_t              id,
+                                                  const bson_t         *query,
+                                                  bson_error_t         *error)    BSON_GNUC_DEPRECATED;
+uint32_t              mongoc_matcher_set_match   (mongoc_matcher_set_t *set,
+                                                  const bson_t         *document,
+                                                  uint32_t             *ids,
+                                                  uint32_t              max_ids)  BSON_GNUC_DEPRECATED;
+void                  mongoc_matcher_set_destroy (mongoc_matcher_set_t *set)      BSON_GNUC_DEPRECATED;
+
 
 BSON_END_DECLS
 
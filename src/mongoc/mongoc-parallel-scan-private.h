@@ -0,0 +1,63 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_PARALLEL_SCAN_PRIVATE_H
+#define MONGOC_PARALLEL_SCAN_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-client.h"
+#include "mongoc-collection.h"
+#include "mongoc-parallel-scan.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* how many _ids to sample for each partition boundary */
+#define MONGOC_PARALLEL_SCAN_SAMPLES_PER_PARTITION 20
+
+
+typedef struct
+{
+   mongoc_client_t     *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t     *cursor;
+} mongoc_parallel_scan_partition_t;
+
+
+struct _mongoc_parallel_scan_t
+{
+   mongoc_client_pool_t             *pool;
+   uint32_t                          n_partitions;
+   mongoc_parallel_scan_partition_t *partitions;
+};
+
+
+uint32_t _mongoc_parallel_scan_queries (const bson_t *sample,
+                                        uint32_t      n_partitions,
+                                        const bson_t *filter,
+                                        bson_t       *queries);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_PARALLEL_SCAN_PRIVATE_H */
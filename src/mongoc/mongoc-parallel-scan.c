@@ -0,0 +1,463 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mongoc-array-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-cluster-private.h"
+#include "mongoc-error.h"
+#include "mongoc-parallel-scan-private.h"
+#include "mongoc-server-stream-private.h"
+#include "mongoc-trace.h"
+
+
+#undef MONGOC_LOG_DOMAIN
+#define MONGOC_LOG_DOMAIN "parallel-scan"
+
+
+/*
+ * The server compares values of different types by type first, so a range
+ * query on _id only matches _ids of the bounds' type. Partitioning is only
+ * done for the common _id types, and the first partition also takes every
+ * _id of another type.
+ */
+static const char *
+_mongoc_parallel_scan_type_alias (bson_type_t type)
+{
+   switch (type) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      return "number";
+   case BSON_TYPE_UTF8:
+      return "string";
+   case BSON_TYPE_OID:
+      return "objectId";
+   case BSON_TYPE_DATE_TIME:
+      return "date";
+   default:
+      return NULL;
+   }
+}
+
+
+static void
+_mongoc_parallel_scan_init_query (bson_t       *query,
+                                  const bson_t *filter,
+                                  const bson_t *range)
+{
+   bson_t ar;
+
+   bson_init (query);
+
+   if (bson_empty0 (filter)) {
+      bson_concat (query, range);
+   } else {
+      bson_append_array_begin (query, "$and", 4, &ar);
+      bson_append_document (&ar, "0", 1, filter);
+      bson_append_document (&ar, "1", 1, range);
+      bson_append_array_end (query, &ar);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_parallel_scan_queries --
+ *
+ *       Split a collection into at most @n_partitions ranges of _id,
+ *       with boundaries picked evenly from @sample, an array of _ids in
+ *       ascending order. Each range is combined with @filter, if any,
+ *       into a query in @queries, which must have room for
+ *       @n_partitions documents.
+ *
+ *       If @sample is empty or holds _ids that can't be range-partitioned,
+ *       the result is a single query for the whole collection.
+ *
+ * Returns:
+ *       The number of queries initialized; the caller destroys them.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+_mongoc_parallel_scan_queries (const bson_t *sample,
+                               uint32_t      n_partitions,
+                               const bson_t *filter,
+                               bson_t       *queries)
+{
+   mongoc_array_t ids;
+   bson_iter_t *bounds;
+   bson_iter_t iter;
+   const char *alias = NULL;
+   const char *type_alias;
+   size_t idx;
+   size_t last_idx = 0;
+   uint32_t n_bounds = 0;
+   uint32_t i;
+   bson_t range;
+   bson_t ar;
+   bson_t item;
+   bson_t child;
+   bson_t not_type;
+
+   BSON_ASSERT (n_partitions > 0);
+   BSON_ASSERT (queries);
+
+   _mongoc_array_init (&ids, sizeof (bson_iter_t));
+
+   if (bson_iter_init (&iter, sample)) {
+      while (bson_iter_next (&iter)) {
+         type_alias = _mongoc_parallel_scan_type_alias (bson_iter_type (&iter));
+
+         if (!type_alias || (alias && strcmp (alias, type_alias))) {
+            ids.len = 0;
+            break;
+         }
+
+         alias = type_alias;
+         _mongoc_array_append_val (&ids, iter);
+      }
+   }
+
+   /* pick n_partitions - 1 boundaries, skipping repeats if the sample is
+    * smaller than the number of partitions */
+   bounds = (bson_iter_t *)bson_malloc (n_partitions * sizeof *bounds);
+
+   for (i = 1; i < n_partitions && ids.len; i++) {
+      idx = (size_t) i * ids.len / n_partitions;
+
+      if (n_bounds && idx == last_idx) {
+         continue;
+      }
+
+      bounds[n_bounds++] = _mongoc_array_index (&ids, bson_iter_t, idx);
+      last_idx = idx;
+   }
+
+   if (!n_bounds) {
+      bson_init (&range);
+      _mongoc_parallel_scan_init_query (&queries[0], filter, &range);
+      bson_destroy (&range);
+      GOTO (done);
+   }
+
+   for (i = 0; i <= n_bounds; i++) {
+      bson_init (&range);
+
+      if (i == 0) {
+         /* {$or: [{_id: {$lt: b0}}, {_id: {$not: {$type: alias}}}]} */
+         bson_append_array_begin (&range, "$or", 3, &ar);
+
+         bson_append_document_begin (&ar, "0", 1, &item);
+         bson_append_document_begin (&item, "_id", 3, &child);
+         bson_append_iter (&child, "$lt", 3, &bounds[0]);
+         bson_append_document_end (&item, &child);
+         bson_append_document_end (&ar, &item);
+
+         bson_append_document_begin (&ar, "1", 1, &item);
+         bson_append_document_begin (&item, "_id", 3, &child);
+         bson_append_document_begin (&child, "$not", 4, &not_type);
+         bson_append_utf8 (&not_type, "$type", 5, alias, -1);
+         bson_append_document_end (&child, &not_type);
+         bson_append_document_end (&item, &child);
+         bson_append_document_end (&ar, &item);
+
+         bson_append_array_end (&range, &ar);
+      } else {
+         bson_append_document_begin (&range, "_id", 3, &child);
+         bson_append_iter (&child, "$gte", 4, &bounds[i - 1]);
+
+         if (i < n_bounds) {
+            bson_append_iter (&child, "$lt", 3, &bounds[i]);
+         }
+
+         bson_append_document_end (&range, &child);
+      }
+
+      _mongoc_parallel_scan_init_query (&queries[i], filter, &range);
+      bson_destroy (&range);
+   }
+
+done:
+   bson_free (bounds);
+   _mongoc_array_destroy (&ids);
+
+   return n_bounds + 1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_parallel_scan_sample --
+ *
+ *       Fetch a random sample of _ids from the collection with $sample,
+ *       sorted, into @sample as an array. On servers older than 3.2 the
+ *       sample is left empty, so the scan is not partitioned.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_mongoc_parallel_scan_sample (mongoc_client_t           *client,
+                              const char                *db,
+                              const char                *collection,
+                              uint32_t                   n_partitions,
+                              const mongoc_read_prefs_t *read_prefs,
+                              bson_t                    *sample,
+                              bson_error_t              *error)
+{
+   mongoc_server_stream_t *server_stream;
+   mongoc_collection_t *coll;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_iter_t iter;
+   bson_t *pipeline;
+   const char *key;
+   char str[16];
+   uint32_t i = 0;
+   bool ret;
+
+   ENTRY;
+
+   server_stream = mongoc_cluster_stream_for_reads (&client->cluster,
+                                                    read_prefs, error);
+   if (!server_stream) {
+      RETURN (false);
+   }
+
+   if (server_stream->sd->max_wire_version < WIRE_VERSION_SAMPLE) {
+      mongoc_server_stream_cleanup (server_stream);
+      RETURN (true);
+   }
+
+   mongoc_server_stream_cleanup (server_stream);
+
+   pipeline = BCON_NEW ("pipeline", "[",
+                        "{", "$sample", "{",
+                           "size", BCON_INT64 ((int64_t) n_partitions *
+                              MONGOC_PARALLEL_SCAN_SAMPLES_PER_PARTITION),
+                        "}", "}",
+                        "{", "$project", "{", "_id", BCON_INT32 (1), "}", "}",
+                        "{", "$sort", "{", "_id", BCON_INT32 (1), "}", "}",
+                        "]");
+
+   coll = mongoc_client_get_collection (client, db, collection);
+   cursor = mongoc_collection_aggregate (coll, MONGOC_QUERY_NONE, pipeline,
+                                         NULL, read_prefs);
+
+   while (mongoc_cursor_next (cursor, &doc)) {
+      if (bson_iter_init_find (&iter, doc, "_id")) {
+         bson_uint32_to_string (i++, &key, str, sizeof str);
+         bson_append_iter (sample, key, -1, &iter);
+      }
+   }
+
+   ret = !mongoc_cursor_error (cursor, error);
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (coll);
+   bson_destroy (pipeline);
+
+   RETURN (ret);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_parallel_scan_new --
+ *
+ *       Split @collection into up to @n_partitions ranges of _id and open
+ *       a cursor over each, every one on its own client popped from
+ *       @pool, so that each cursor can be iterated by a different
+ *       thread.
+ *
+ *       Partition boundaries are taken from a $sample of the collection's
+ *       _ids, so partitions are of roughly equal size. Fewer partitions
+ *       are made if the collection is small, and a single one if the
+ *       server is older than MongoDB 3.2 or the _ids are of mixed types.
+ *
+ * Returns:
+ *       A new mongoc_parallel_scan_t that must be freed with
+ *       mongoc_parallel_scan_destroy(), or NULL and @error is set. It
+ *       fails if @pool cannot provide a client for every partition.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_parallel_scan_t *
+mongoc_parallel_scan_new (mongoc_client_pool_t      *pool,
+                          const char                *db,
+                          const char                *collection,
+                          const bson_t              *filter,
+                          const bson_t              *fields,
+                          uint32_t                   n_partitions,
+                          const mongoc_read_prefs_t *read_prefs,
+                          bson_error_t              *error)
+{
+   mongoc_parallel_scan_partition_t *partition;
+   mongoc_parallel_scan_t *scan = NULL;
+   mongoc_client_t *client;
+   bson_t sample = BSON_INITIALIZER;
+   bson_t *queries = NULL;
+   uint32_t n_queries = 0;
+   uint32_t i;
+
+   ENTRY;
+
+   BSON_ASSERT (pool);
+   BSON_ASSERT (db);
+   BSON_ASSERT (collection);
+
+   if (!n_partitions) {
+      bson_set_error (error,
+                      MONGOC_ERROR_COMMAND,
+                      MONGOC_ERROR_COMMAND_INVALID_ARG,
+                      "A parallel scan needs at least one partition.");
+      RETURN (NULL);
+   }
+
+   if (!(client = mongoc_client_pool_try_pop (pool))) {
+      bson_set_error (error,
+                      MONGOC_ERROR_CLIENT,
+                      MONGOC_ERROR_CLIENT_TOO_SMALL,
+                      "No client available in the pool for a parallel scan.");
+      RETURN (NULL);
+   }
+
+   if (n_partitions > 1 &&
+       !_mongoc_parallel_scan_sample (client, db, collection, n_partitions,
+                                      read_prefs, &sample, error)) {
+      mongoc_client_pool_push (pool, client);
+      GOTO (done);
+   }
+
+   queries = (bson_t *)bson_malloc (n_partitions * sizeof *queries);
+   n_queries = _mongoc_parallel_scan_queries (&sample, n_partitions, filter,
+                                              queries);
+
+   scan = (mongoc_parallel_scan_t *)bson_malloc0 (sizeof *scan);
+   scan->pool = pool;
+   scan->partitions = (mongoc_parallel_scan_partition_t *)bson_malloc0 (
+      n_queries * sizeof *scan->partitions);
+
+   for (i = 0; i < n_queries; i++) {
+      if (i > 0 && !(client = mongoc_client_pool_try_pop (pool))) {
+         bson_set_error (error,
+                         MONGOC_ERROR_CLIENT,
+                         MONGOC_ERROR_CLIENT_TOO_SMALL,
+                         "Only %u of the %u clients needed for a parallel "
+                         "scan are available in the pool.",
+                         i, n_queries);
+         mongoc_parallel_scan_destroy (scan);
+         scan = NULL;
+         GOTO (done);
+      }
+
+      partition = &scan->partitions[i];
+      partition->client = client;
+      partition->collection = mongoc_client_get_collection (client, db,
+                                                            collection);
+      partition->cursor = mongoc_collection_find (partition->collection,
+                                                  MONGOC_QUERY_NONE, 0, 0, 0,
+                                                  &queries[i], fields,
+                                                  read_prefs);
+      scan->n_partitions++;
+   }
+
+done:
+   for (i = 0; i < n_queries; i++) {
+      bson_destroy (&queries[i]);
+   }
+
+   bson_free (queries);
+   bson_destroy (&sample);
+
+   RETURN (scan);
+}
+
+
+uint32_t
+mongoc_parallel_scan_get_n_cursors (const mongoc_parallel_scan_t *scan)
+{
+   BSON_ASSERT (scan);
+
+   return scan->n_partitions;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_parallel_scan_get_cursor --
+ *
+ *       Get the cursor for partition @i. Each cursor has its own client,
+ *       so different cursors may be iterated from different threads,
+ *       but each cursor still only from one thread at a time.
+ *
+ * Returns:
+ *       A cursor owned by @scan.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_cursor_t *
+mongoc_parallel_scan_get_cursor (mongoc_parallel_scan_t *scan,
+                                 uint32_t                i)
+{
+   BSON_ASSERT (scan);
+   BSON_ASSERT (i < scan->n_partitions);
+
+   return scan->partitions[i].cursor;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_parallel_scan_destroy --
+ *
+ *       Destroy the cursors and return their clients to the pool. Call
+ *       this once every thread is done with its cursor.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+mongoc_parallel_scan_destroy (mongoc_parallel_scan_t *scan)
+{
+   mongoc_parallel_scan_partition_t *partition;
+   uint32_t i;
+
+   ENTRY;
+
+   if (scan) {
+      for (i = 0; i < scan->n_partitions; i++) {
+         partition = &scan->partitions[i];
+         mongoc_cursor_destroy (partition->cursor);
+         mongoc_collection_destroy (partition->collection);
+         mongoc_client_pool_push (scan->pool, partition->client);
+      }
+
+      bson_free (scan->partitions);
+      bson_free (scan);
+   }
+
+   EXIT;
+}
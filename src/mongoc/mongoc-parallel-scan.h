@@ -0,0 +1,54 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_PARALLEL_SCAN_H
+#define MONGOC_PARALLEL_SCAN_H
+
+#if !defined (MONGOC_INSIDE) && !defined (MONGOC_COMPILATION)
+# error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+#include "mongoc-client-pool.h"
+#include "mongoc-cursor.h"
+#include "mongoc-read-prefs.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef struct _mongoc_parallel_scan_t mongoc_parallel_scan_t;
+
+
+mongoc_parallel_scan_t *mongoc_parallel_scan_new            (mongoc_client_pool_t         *pool,
+                                                             const char                   *db,
+                                                             const char                   *collection,
+                                                             const bson_t                 *filter,
+                                                             const bson_t                 *fields,
+                                                             uint32_t                      n_partitions,
+                                                             const mongoc_read_prefs_t    *read_prefs,
+                                                             bson_error_t                 *error) BSON_GNUC_WARN_UNUSED_RESULT;
+uint32_t                mongoc_parallel_scan_get_n_cursors  (const mongoc_parallel_scan_t *scan);
+mongoc_cursor_t        *mongoc_parallel_scan_get_cursor     (mongoc_parallel_scan_t       *scan,
+                                                             uint32_t                      i);
+void                    mongoc_parallel_scan_destroy        (mongoc_parallel_scan_t       *scan);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_PARALLEL_SCAN_H */
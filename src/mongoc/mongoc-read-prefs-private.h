@@ -40,10 +40,13 @@ typedef struct _mongoc_apply_read_prefs_result_t {
    bson_t              *query_with_read_prefs;
    bool                 query_owned;
    mongoc_query_flags_t flags;
+   /* holds an owned query_with_read_prefs; small ones need no malloc */
+   bson_t               query_storage;
 } mongoc_apply_read_prefs_result_t;
 
 
-#define READ_PREFS_RESULT_INIT { NULL, false, MONGOC_QUERY_NONE }
+#define READ_PREFS_RESULT_INIT \
+   { NULL, false, MONGOC_QUERY_NONE, BSON_INITIALIZER }
 
 void
 apply_read_preferences (const mongoc_read_prefs_t *read_prefs,
@@ -206,7 +206,8 @@ _apply_read_preferences_mongos (const mongoc_read_prefs_t *read_prefs,
        *
        * This applies to commands, too.
        */
-      result->query_with_read_prefs = bson_new ();
+      bson_init (&result->query_storage);
+      result->query_with_read_prefs = &result->query_storage;
       result->query_owned = true;
 
       if (bson_has_field (query_bson, "$query")) {
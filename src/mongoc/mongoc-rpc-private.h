@@ -25,6 +25,7 @@
 #include <stddef.h>
 
 #include "mongoc-array-private.h"
+#include "mongoc-buffer-private.h"
 #include "mongoc-iovec.h"
 #include "mongoc-write-concern.h"
 #include "mongoc-flags.h"
@@ -36,6 +37,7 @@ BSON_BEGIN_DECLS
 #define RPC(_name, _code)                typedef struct { _code } mongoc_rpc_##_name##_t;
 #define ENUM_FIELD(_name)                uint32_t _name;
 #define INT32_FIELD(_name)               int32_t _name;
+#define UINT8_FIELD(_name)               uint8_t _name;
 #define INT64_FIELD(_name)               int64_t _name;
 #define INT64_ARRAY_FIELD(_len, _name)   int32_t _len; int64_t *_name;
 #define CSTRING_FIELD(_name)             const char *_name;
@@ -46,6 +48,7 @@ BSON_BEGIN_DECLS
 #define BSON_OPTIONAL(_check, _code)     _code
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-header.def"
@@ -59,6 +62,7 @@ BSON_BEGIN_DECLS
 
 typedef union
 {
+   mongoc_rpc_compressed_t   compressed;
    mongoc_rpc_delete_t       delete_;
    mongoc_rpc_get_more_t     get_more;
    mongoc_rpc_header_t       header;
@@ -79,6 +83,7 @@ BSON_STATIC_ASSERT (offsetof (mongoc_rpc_header_t, opcode) ==
 #undef RPC
 #undef ENUM_FIELD
 #undef INT32_FIELD
+#undef UINT8_FIELD
 #undef INT64_FIELD
 #undef INT64_ARRAY_FIELD
 #undef CSTRING_FIELD
@@ -99,6 +104,16 @@ void _mongoc_rpc_printf             (mongoc_rpc_t                 *rpc);
 bool _mongoc_rpc_scatter            (mongoc_rpc_t                 *rpc,
                                      const uint8_t                *buf,
                                      size_t                        buflen);
+uint8_t *_mongoc_rpc_compress       (mongoc_array_t               *iov,
+                                     size_t                        start,
+                                     int32_t                       compressor_id,
+                                     int32_t                       level,
+                                     bson_error_t                 *error);
+bool _mongoc_rpc_decompress         (mongoc_buffer_t              *buffer,
+                                     size_t                        pos,
+                                     int32_t                       max_msg_size,
+                                     int32_t                      *msg_len,
+                                     bson_error_t                 *error);
 bool _mongoc_rpc_reply_get_first    (mongoc_rpc_reply_t           *reply,
                                      bson_t                       *bson);
 void _mongoc_rpc_prep_command       (mongoc_rpc_t                 *rpc,
@@ -109,6 +124,9 @@ bool _mongoc_rpc_parse_command_error(mongoc_rpc_t                 *rpc,
                                      bson_error_t                 *error);
 bool _mongoc_rpc_parse_query_error  (mongoc_rpc_t                 *rpc,
                                      bson_error_t                 *error);
+void _mongoc_populate_error         (const bson_t                 *doc,
+                                     bool                          is_command,
+                                     bson_error_t                 *error);
 
 
 BSON_END_DECLS
@@ -18,6 +18,7 @@
 #include <bson.h>
 
 #include "mongoc.h"
+#include "mongoc-compression-private.h"
 #include "mongoc-rpc-private.h"
 #include "mongoc-trace.h"
 
@@ -40,6 +41,11 @@
    rpc->msg_len += (int32_t)iov.iov_len; \
    _mongoc_array_append_val(array, iov);
 #define ENUM_FIELD INT32_FIELD
+#define UINT8_FIELD(_name) \
+   iov.iov_base = (void *)&rpc->_name; \
+   iov.iov_len = 1; \
+   rpc->msg_len += (int32_t)iov.iov_len; \
+   _mongoc_array_append_val(array, iov);
 #define INT64_FIELD(_name) \
    iov.iov_base = (void *)&rpc->_name; \
    iov.iov_len = 8; \
@@ -104,6 +110,7 @@
 
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-insert.def"
@@ -117,6 +124,7 @@
 #undef RPC
 #undef ENUM_FIELD
 #undef INT32_FIELD
+#undef UINT8_FIELD
 #undef INT64_FIELD
 #undef INT64_ARRAY_FIELD
 #undef CSTRING_FIELD
@@ -139,6 +147,7 @@
 #define INT32_FIELD(_name) \
    rpc->_name = BSON_UINT32_FROM_LE(rpc->_name);
 #define ENUM_FIELD INT32_FIELD
+#define UINT8_FIELD(_name)
 #define INT64_FIELD(_name) \
    rpc->_name = BSON_UINT64_FROM_LE(rpc->_name);
 #define CSTRING_FIELD(_name)
@@ -158,6 +167,7 @@
    } while (0);
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-insert.def"
@@ -187,6 +197,7 @@
    } while (0);
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-insert.def"
@@ -200,6 +211,7 @@
 #undef RPC
 #undef ENUM_FIELD
 #undef INT32_FIELD
+#undef UINT8_FIELD
 #undef INT64_FIELD
 #undef INT64_ARRAY_FIELD
 #undef CSTRING_FIELD
@@ -223,6 +235,8 @@
    printf("  "#_name" : %d\n", rpc->_name);
 #define ENUM_FIELD(_name) \
    printf("  "#_name" : %u\n", rpc->_name);
+#define UINT8_FIELD(_name) \
+   printf("  "#_name" : %u\n", (unsigned) rpc->_name);
 #define INT64_FIELD(_name) \
    printf("  "#_name" : %" PRIi64 "\n", (int64_t)rpc->_name);
 #define CSTRING_FIELD(_name) \
@@ -290,6 +304,7 @@
    } while (0);
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-insert.def"
@@ -303,6 +318,7 @@
 #undef RPC
 #undef ENUM_FIELD
 #undef INT32_FIELD
+#undef UINT8_FIELD
 #undef INT64_FIELD
 #undef INT64_ARRAY_FIELD
 #undef CSTRING_FIELD
@@ -333,6 +349,13 @@
    buflen -= 4; \
    buf += 4;
 #define ENUM_FIELD INT32_FIELD
+#define UINT8_FIELD(_name) \
+   if (buflen < 1) { \
+      return false; \
+   } \
+   rpc->_name = *buf; \
+   buflen -= 1; \
+   buf += 1;
 #define INT64_FIELD(_name) \
    if (buflen < 8) { \
       return false; \
@@ -412,6 +435,7 @@
    buflen = 0;
 
 
+#include "op-compressed.def"
 #include "op-delete.def"
 #include "op-get-more.def"
 #include "op-header.def"
@@ -426,6 +450,7 @@
 #undef RPC
 #undef ENUM_FIELD
 #undef INT32_FIELD
+#undef UINT8_FIELD
 #undef INT64_FIELD
 #undef INT64_ARRAY_FIELD
 #undef CSTRING_FIELD
@@ -465,6 +490,9 @@ _mongoc_rpc_gather (mongoc_rpc_t   *rpc,
    case MONGOC_OPCODE_KILL_CURSORS:
       _mongoc_rpc_gather_kill_cursors(&rpc->kill_cursors, array);
       return;
+   case MONGOC_OPCODE_COMPRESSED:
+      _mongoc_rpc_gather_compressed(&rpc->compressed, array);
+      return;
    default:
       MONGOC_WARNING("Unknown rpc type: 0x%08x", rpc->header.opcode);
       break;
@@ -505,6 +533,9 @@ _mongoc_rpc_swab_to_le (mongoc_rpc_t *rpc)
    case MONGOC_OPCODE_KILL_CURSORS:
       _mongoc_rpc_swab_to_le_kill_cursors(&rpc->kill_cursors);
       break;
+   case MONGOC_OPCODE_COMPRESSED:
+      _mongoc_rpc_swab_to_le_compressed(&rpc->compressed);
+      break;
    default:
       MONGOC_WARNING("Unknown rpc type: 0x%08x", opcode);
       break;
@@ -546,6 +577,9 @@ _mongoc_rpc_swab_from_le (mongoc_rpc_t *rpc)
    case MONGOC_OPCODE_KILL_CURSORS:
       _mongoc_rpc_swab_from_le_kill_cursors(&rpc->kill_cursors);
       break;
+   case MONGOC_OPCODE_COMPRESSED:
+      _mongoc_rpc_swab_from_le_compressed(&rpc->compressed);
+      break;
    default:
       MONGOC_WARNING("Unknown rpc type: 0x%08x", rpc->header.opcode);
       break;
@@ -582,6 +616,9 @@ _mongoc_rpc_printf (mongoc_rpc_t *rpc)
    case MONGOC_OPCODE_KILL_CURSORS:
       _mongoc_rpc_printf_kill_cursors(&rpc->kill_cursors);
       break;
+   case MONGOC_OPCODE_COMPRESSED:
+      _mongoc_rpc_printf_compressed(&rpc->compressed);
+      break;
    default:
       MONGOC_WARNING("Unknown rpc type: 0x%08x", rpc->header.opcode);
       break;
@@ -625,6 +662,8 @@ _mongoc_rpc_scatter (mongoc_rpc_t  *rpc,
       return _mongoc_rpc_scatter_delete(&rpc->delete_, buf, buflen);
    case MONGOC_OPCODE_KILL_CURSORS:
       return _mongoc_rpc_scatter_kill_cursors(&rpc->kill_cursors, buf, buflen);
+   case MONGOC_OPCODE_COMPRESSED:
+      return _mongoc_rpc_scatter_compressed(&rpc->compressed, buf, buflen);
    default:
       MONGOC_WARNING("Unknown rpc type: 0x%08x", opcode);
       return false;
@@ -632,6 +671,216 @@ _mongoc_rpc_scatter (mongoc_rpc_t  *rpc,
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_rpc_compress --
+ *
+ *       Replace the message gathered into @iov from index @start on with
+ *       an OP_COMPRESSED message wrapping it. The message must already
+ *       be swabbed to little-endian.
+ *
+ * Returns:
+ *       A buffer holding the compressed message, which the caller must
+ *       free with bson_free() once @iov has been written, or NULL on
+ *       failure and @error is set.
+ *
+ * Side effects:
+ *       The iovecs from @start on are replaced by one pointing at the
+ *       returned buffer.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint8_t *
+_mongoc_rpc_compress (mongoc_array_t *iov,
+                      size_t          start,
+                      int32_t         compressor_id,
+                      int32_t         level,
+                      bson_error_t   *error)
+{
+   const mongoc_compressor_t *compressor;
+   mongoc_iovec_t *iovecs;
+   mongoc_iovec_t out_iov;
+   uint8_t *in = NULL;
+   uint8_t *out = NULL;
+   size_t in_len = 0;
+   size_t out_len;
+   size_t off = 0;
+   size_t i;
+   int32_t v;
+
+   ENTRY;
+
+   BSON_ASSERT (iov);
+   BSON_ASSERT (start < iov->len);
+
+   compressor = _mongoc_compressor_by_id (compressor_id);
+   BSON_ASSERT (compressor);
+
+   iovecs = (mongoc_iovec_t *)iov->data;
+
+   for (i = start; i < iov->len; i++) {
+      in_len += iovecs[i].iov_len;
+   }
+
+   BSON_ASSERT (in_len >= 16);
+
+   in = (uint8_t *)bson_malloc (in_len);
+
+   for (i = start; i < iov->len; i++) {
+      memcpy (in + off, iovecs[i].iov_base, iovecs[i].iov_len);
+      off += iovecs[i].iov_len;
+   }
+
+   out_len = compressor->max_compressed_length (in_len - 16);
+   out = (uint8_t *)bson_malloc (MONGOC_COMPRESSED_HEADER_LEN + out_len);
+
+   if (!compressor->compress (level, in + 16, in_len - 16,
+                              out + MONGOC_COMPRESSED_HEADER_LEN, &out_len) ||
+       MONGOC_COMPRESSED_HEADER_LEN + out_len > INT32_MAX) {
+      bson_set_error (error,
+                      MONGOC_ERROR_CLIENT,
+                      MONGOC_ERROR_CLIENT_TOO_BIG,
+                      "Failed to compress message with \"%s\".",
+                      compressor->name);
+      bson_free (in);
+      bson_free (out);
+      RETURN (NULL);
+   }
+
+   /* msgLen, then requestID and responseTo as they were */
+   v = BSON_UINT32_TO_LE ((int32_t) (MONGOC_COMPRESSED_HEADER_LEN + out_len));
+   memcpy (out, &v, 4);
+   memcpy (out + 4, in + 4, 8);
+   v = BSON_UINT32_TO_LE (MONGOC_OPCODE_COMPRESSED);
+   memcpy (out + 12, &v, 4);
+
+   /* originalOpcode, uncompressedSize, compressorId */
+   memcpy (out + 16, in + 12, 4);
+   v = BSON_UINT32_TO_LE ((int32_t) (in_len - 16));
+   memcpy (out + 20, &v, 4);
+   out[24] = (uint8_t) compressor_id;
+
+   bson_free (in);
+
+   iov->len = start;
+   out_iov.iov_base = (void *)out;
+   out_iov.iov_len = MONGOC_COMPRESSED_HEADER_LEN + out_len;
+   _mongoc_array_append_val (iov, out_iov);
+
+   RETURN (out);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_rpc_decompress --
+ *
+ *       If the @msg_len byte message at @pos in @buffer is an
+ *       OP_COMPRESSED message, replace it with the message it wraps.
+ *       The message must be the last thing in @buffer.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @msg_len is set to the length of the uncompressed message.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_rpc_decompress (mongoc_buffer_t *buffer,
+                        size_t           pos,
+                        int32_t          max_msg_size,
+                        int32_t         *msg_len,
+                        bson_error_t    *error)
+{
+   const mongoc_compressor_t *compressor;
+   mongoc_rpc_t rpc;
+   const uint8_t *data;
+   uint8_t *msg;
+   size_t len;
+   int32_t opcode;
+   int32_t v;
+
+   ENTRY;
+
+   BSON_ASSERT (buffer);
+   BSON_ASSERT (msg_len);
+   BSON_ASSERT (pos + *msg_len == buffer->len);
+
+   data = &buffer->data[buffer->off + pos];
+
+   memcpy (&opcode, data + 12, 4);
+   if (BSON_UINT32_FROM_LE (opcode) != MONGOC_OPCODE_COMPRESSED) {
+      RETURN (true);
+   }
+
+   if (!_mongoc_rpc_scatter (&rpc, data, (size_t) *msg_len)) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Failed to decode compressed reply from server.");
+      RETURN (false);
+   }
+
+   _mongoc_rpc_swab_from_le (&rpc);
+
+   if (rpc.compressed.uncompressed_size < 0 ||
+       rpc.compressed.uncompressed_size > max_msg_size - 16) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Corrupt or malicious reply received.");
+      RETURN (false);
+   }
+
+   if (!(compressor = _mongoc_compressor_by_id (
+            rpc.compressed.compressor_id))) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Unsupported compressor id %d in reply from server.",
+                      (int) rpc.compressed.compressor_id);
+      RETURN (false);
+   }
+
+   len = (size_t) rpc.compressed.uncompressed_size;
+   msg = (uint8_t *)bson_malloc (16 + len);
+
+   if (!compressor->uncompress (rpc.compressed.compressed_message,
+                                (size_t) rpc.compressed.compressed_message_len,
+                                msg + 16, &len) ||
+       len != (size_t) rpc.compressed.uncompressed_size) {
+      bson_set_error (error,
+                      MONGOC_ERROR_PROTOCOL,
+                      MONGOC_ERROR_PROTOCOL_INVALID_REPLY,
+                      "Failed to decompress reply with \"%s\".",
+                      compressor->name);
+      bson_free (msg);
+      RETURN (false);
+   }
+
+   v = BSON_UINT32_TO_LE ((int32_t) (16 + len));
+   memcpy (msg, &v, 4);
+   memcpy (msg + 4, data + 4, 8);
+   v = BSON_UINT32_TO_LE (rpc.compressed.original_opcode);
+   memcpy (msg + 12, &v, 4);
+
+   /* @data points into @buffer, so don't touch it after this */
+   buffer->len = pos;
+   _mongoc_buffer_append (buffer, msg, 16 + len);
+   bson_free (msg);
+
+   *msg_len = (int32_t) (16 + len);
+
+   RETURN (true);
+}
+
+
 bool
 _mongoc_rpc_reply_get_first (mongoc_rpc_reply_t *reply,
                              bson_t             *bson)
@@ -682,6 +931,7 @@ _mongoc_rpc_needs_gle (mongoc_rpc_t                 *rpc,
    case MONGOC_OPCODE_MSG:
    case MONGOC_OPCODE_GET_MORE:
    case MONGOC_OPCODE_KILL_CURSORS:
+   case MONGOC_OPCODE_COMPRESSED:
       return false;
    case MONGOC_OPCODE_INSERT:
    case MONGOC_OPCODE_UPDATE:
@@ -736,7 +986,7 @@ _mongoc_rpc_prep_command (mongoc_rpc_t        *rpc,
 }
 
 
-static void
+void
 _mongoc_populate_error (const bson_t *doc,
                         bool          is_command,
                         bson_error_t *error)
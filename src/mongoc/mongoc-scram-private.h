@@ -26,11 +26,45 @@
 
 #include <bson.h>
 
+#include "mongoc-thread-private.h"
+
 
 BSON_BEGIN_DECLS
 
 #define MONGOC_SCRAM_HASH_SIZE 20
 
+#define MONGOC_SCRAM_B64_ENCODED_SIZE(n) (2 * n)
+
+#define MONGOC_SCRAM_B64_HASH_SIZE \
+   MONGOC_SCRAM_B64_ENCODED_SIZE (MONGOC_SCRAM_HASH_SIZE)
+
+/*
+ * The keys derived from the last (password, salt, iteration count) a
+ * topology authenticated with. Hi() runs thousands of HMAC iterations, so
+ * connections after the first reuse its result instead of deriving the
+ * same keys again.
+ *
+ * A topology authenticates with the single credential in its URI, and
+ * every server of a replica set or sharded cluster shares the user's
+ * salt, so one entry is enough. It is replaced if the salt or iteration
+ * count changes, e.g. after the user's password is reset.
+ *
+ * The password is identified by the SHA-1 of its MONGODB-CR digest,
+ * which also covers the user name, rather than kept in the cache.
+ */
+typedef struct _mongoc_scram_cache_t
+{
+   mongoc_mutex_t mutex;
+   bool           valid;
+   uint8_t        password_digest[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t        salt[MONGOC_SCRAM_B64_HASH_SIZE];
+   uint32_t       salt_len;
+   uint32_t       iterations;
+   uint8_t        salted_password[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t        client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t        server_key[MONGOC_SCRAM_HASH_SIZE];
+} mongoc_scram_cache_t;
+
 typedef struct _mongoc_scram_t
 {
    bool         done;
@@ -38,6 +72,9 @@ typedef struct _mongoc_scram_t
    char        *user;
    char        *pass;
    uint8_t      salted_password[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t      client_key[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t      server_key[MONGOC_SCRAM_HASH_SIZE];
+   mongoc_scram_cache_t *cache;
    char         encoded_nonce[48];
    int32_t      encoded_nonce_len;
    uint8_t     *auth_message;
@@ -59,8 +96,18 @@ void
 _mongoc_scram_set_user (mongoc_scram_t *scram,
                         const char     *user);
 void
+_mongoc_scram_set_cache (mongoc_scram_t       *scram,
+                         mongoc_scram_cache_t *cache);
+
+void
 _mongoc_scram_destroy (mongoc_scram_t *scram);
 
+mongoc_scram_cache_t *
+_mongoc_scram_cache_new (void);
+
+void
+_mongoc_scram_cache_destroy (mongoc_scram_cache_t *cache);
+
 bool
 _mongoc_scram_step (mongoc_scram_t *scram,
                     const uint8_t  *inbuf,
@@ -27,6 +27,7 @@
 #include "mongoc-b64-private.h"
 
 #include "mongoc-memcmp-private.h"
+#include "mongoc-thread-private.h"
 
 #include <openssl/sha.h>
 #include <openssl/evp.h>
@@ -35,11 +36,6 @@
 #define MONGOC_SCRAM_SERVER_KEY "Server Key"
 #define MONGOC_SCRAM_CLIENT_KEY "Client Key"
 
-#define MONGOC_SCRAM_B64_ENCODED_SIZE(n) (2 * n)
-
-#define MONGOC_SCRAM_B64_HASH_SIZE \
-   MONGOC_SCRAM_B64_ENCODED_SIZE (MONGOC_SCRAM_HASH_SIZE)
-
 
 void
 _mongoc_scram_startup()
@@ -73,6 +69,16 @@ _mongoc_scram_set_user (mongoc_scram_t *scram,
 }
 
 
+void
+_mongoc_scram_set_cache (mongoc_scram_t       *scram,
+                         mongoc_scram_cache_t *cache)
+{
+   BSON_ASSERT (scram);
+
+   scram->cache = cache;
+}
+
+
 void
 _mongoc_scram_init (mongoc_scram_t *scram)
 {
@@ -94,6 +100,32 @@ _mongoc_scram_destroy (mongoc_scram_t *scram)
    }
 
    bson_free (scram->auth_message);
+
+   memset (scram->salted_password, 0, sizeof scram->salted_password);
+   memset (scram->client_key, 0, sizeof scram->client_key);
+   memset (scram->server_key, 0, sizeof scram->server_key);
+}
+
+
+mongoc_scram_cache_t *
+_mongoc_scram_cache_new (void)
+{
+   mongoc_scram_cache_t *cache;
+
+   cache = (mongoc_scram_cache_t *)bson_malloc0 (sizeof *cache);
+   mongoc_mutex_init (&cache->mutex);
+
+   return cache;
+}
+
+
+void
+_mongoc_scram_cache_destroy (mongoc_scram_cache_t *cache)
+{
+   if (cache) {
+      mongoc_mutex_destroy (&cache->mutex);
+      bson_zero_free (cache, sizeof *cache);
+   }
 }
 
 
@@ -332,14 +364,111 @@ cleanup:
 }
 
 
+/* Derive ClientKey and ServerKey from SaltedPassword */
+static void
+_mongoc_scram_generate_keys (mongoc_scram_t *scram)
+{
+   uint32_t hash_len = 0;
+
+   /* ClientKey := HMAC(saltedPassword, "Client Key") */
+   HMAC (EVP_sha1 (),
+         scram->salted_password,
+         MONGOC_SCRAM_HASH_SIZE,
+         (uint8_t *)MONGOC_SCRAM_CLIENT_KEY,
+         strlen (MONGOC_SCRAM_CLIENT_KEY),
+         scram->client_key,
+         &hash_len);
+
+   /* ServerKey := HMAC(SaltedPassword, "Server Key") */
+   HMAC (EVP_sha1 (),
+         scram->salted_password,
+         MONGOC_SCRAM_HASH_SIZE,
+         (uint8_t *)MONGOC_SCRAM_SERVER_KEY,
+         strlen (MONGOC_SCRAM_SERVER_KEY),
+         scram->server_key,
+         &hash_len);
+}
+
+
+static bool
+_mongoc_scram_cache_matches (mongoc_scram_cache_t *cache,
+                             const uint8_t        *password_digest,
+                             const uint8_t        *salt,
+                             uint32_t              salt_len,
+                             uint32_t              iterations)
+{
+   return cache->valid &&
+          cache->iterations == iterations &&
+          cache->salt_len == salt_len &&
+          mongoc_memcmp (cache->salt, salt, salt_len) == 0 &&
+          mongoc_memcmp (cache->password_digest, password_digest,
+                         MONGOC_SCRAM_HASH_SIZE) == 0;
+}
+
+
+/* Fill in scram's SaltedPassword, ClientKey and ServerKey, from the
+ * cache if a previous connection derived them already */
+static void
+_mongoc_scram_derive_keys (mongoc_scram_t *scram,
+                           const char     *hashed_password,
+                           const uint8_t  *salt,
+                           uint32_t        salt_len,
+                           uint32_t        iterations)
+{
+   mongoc_scram_cache_t *cache = scram->cache;
+   uint8_t password_digest[MONGOC_SCRAM_HASH_SIZE];
+
+   if (cache) {
+      _mongoc_scram_sha1 ((const unsigned char *)hashed_password,
+                          strlen (hashed_password), password_digest);
+
+      mongoc_mutex_lock (&cache->mutex);
+
+      if (_mongoc_scram_cache_matches (cache, password_digest, salt,
+                                       salt_len, iterations)) {
+         memcpy (scram->salted_password, cache->salted_password,
+                 MONGOC_SCRAM_HASH_SIZE);
+         memcpy (scram->client_key, cache->client_key,
+                 MONGOC_SCRAM_HASH_SIZE);
+         memcpy (scram->server_key, cache->server_key,
+                 MONGOC_SCRAM_HASH_SIZE);
+         mongoc_mutex_unlock (&cache->mutex);
+         return;
+      }
+
+      mongoc_mutex_unlock (&cache->mutex);
+   }
+
+   /* don't hold the lock for the slow part, if two connections race here
+    * they both compute the same keys */
+   _mongoc_scram_salt_password (scram, hashed_password,
+                                (uint32_t) strlen (hashed_password),
+                                salt, salt_len, iterations);
+   _mongoc_scram_generate_keys (scram);
+
+   if (cache) {
+      mongoc_mutex_lock (&cache->mutex);
+      memcpy (cache->password_digest, password_digest,
+              MONGOC_SCRAM_HASH_SIZE);
+      memcpy (cache->salt, salt, salt_len);
+      cache->salt_len = salt_len;
+      cache->iterations = iterations;
+      memcpy (cache->salted_password, scram->salted_password,
+              MONGOC_SCRAM_HASH_SIZE);
+      memcpy (cache->client_key, scram->client_key, MONGOC_SCRAM_HASH_SIZE);
+      memcpy (cache->server_key, scram->server_key, MONGOC_SCRAM_HASH_SIZE);
+      cache->valid = true;
+      mongoc_mutex_unlock (&cache->mutex);
+   }
+}
+
+
 static bool
 _mongoc_scram_generate_client_proof (mongoc_scram_t *scram,
                                      uint8_t        *outbuf,
                                      uint32_t        outbufmax,
                                      uint32_t       *outbuflen)
 {
-   /* ClientKey := HMAC(saltedPassword, "Client Key") */
-   uint8_t client_key[MONGOC_SCRAM_HASH_SIZE];
    uint8_t stored_key[MONGOC_SCRAM_HASH_SIZE];
    uint8_t client_signature[MONGOC_SCRAM_HASH_SIZE];
    unsigned char client_proof[MONGOC_SCRAM_HASH_SIZE];
@@ -347,16 +476,8 @@ _mongoc_scram_generate_client_proof (mongoc_scram_t *scram,
    int i;
    int r = 0;
 
-   HMAC (EVP_sha1 (),
-         scram->salted_password,
-         MONGOC_SCRAM_HASH_SIZE,
-         (uint8_t *)MONGOC_SCRAM_CLIENT_KEY,
-         strlen (MONGOC_SCRAM_CLIENT_KEY),
-         client_key,
-         &hash_len);
-
    /* StoredKey := H(client_key) */
-   _mongoc_scram_sha1 (client_key, MONGOC_SCRAM_HASH_SIZE, stored_key);
+   _mongoc_scram_sha1 (scram->client_key, MONGOC_SCRAM_HASH_SIZE, stored_key);
 
    /* ClientSignature := HMAC(StoredKey, AuthMessage) */
    HMAC (EVP_sha1 (),
@@ -370,7 +491,7 @@ _mongoc_scram_generate_client_proof (mongoc_scram_t *scram,
    /* ClientProof := ClientKey XOR ClientSignature */
 
    for (i = 0; i < MONGOC_SCRAM_HASH_SIZE; i++) {
-      client_proof[i] = client_key[i] ^ client_signature[i];
+      client_proof[i] = scram->client_key[i] ^ client_signature[i];
    }
 
    r = mongoc_b64_ntop (client_proof, sizeof (client_proof),
@@ -594,9 +715,8 @@ _mongoc_scram_step2 (mongoc_scram_t *scram,
       goto FAIL;
    }
 
-   _mongoc_scram_salt_password (scram, hashed_password, (uint32_t) strlen (
-                                   hashed_password), decoded_salt, decoded_salt_len,
-                                iterations);
+   _mongoc_scram_derive_keys (scram, hashed_password, decoded_salt,
+                              decoded_salt_len, iterations);
 
    _mongoc_scram_generate_client_proof (scram, outbuf, outbufmax, outbuflen);
 
@@ -639,24 +759,14 @@ _mongoc_scram_verify_server_signature (mongoc_scram_t *scram,
                                        uint8_t        *verification,
                                        uint32_t        len)
 {
-   /* ServerKey := HMAC(SaltedPassword, "Server Key") */
    uint32_t hash_len;
-   uint8_t server_key[MONGOC_SCRAM_HASH_SIZE];
    char encoded_server_signature[MONGOC_SCRAM_B64_HASH_SIZE];
    int32_t encoded_server_signature_len;
    uint8_t server_signature[MONGOC_SCRAM_HASH_SIZE];
 
-   HMAC (EVP_sha1 (),
-         scram->salted_password,
-         MONGOC_SCRAM_HASH_SIZE,
-         (uint8_t *)MONGOC_SCRAM_SERVER_KEY,
-         strlen (MONGOC_SCRAM_SERVER_KEY),
-         server_key,
-         &hash_len);
-
    /* ServerSignature := HMAC(ServerKey, AuthMessage) */
    HMAC (EVP_sha1 (),
-         server_key,
+         scram->server_key,
          MONGOC_SCRAM_HASH_SIZE,
          scram->auth_message,
          scram->auth_messagelen,
@@ -61,6 +61,7 @@ struct _mongoc_server_description_t
    int32_t                          max_msg_size;
    int32_t                          max_bson_obj_size;
    int32_t                          max_write_batch_size;
+   int32_t                          compressor_id;
 
    bson_t                           hosts;
    bson_t                           passives;
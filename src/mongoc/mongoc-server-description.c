@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "mongoc-compression-private.h"
 #include "mongoc-host-list.h"
 #include "mongoc-host-list-private.h"
 #include "mongoc-read-prefs.h"
@@ -57,6 +58,7 @@ mongoc_server_description_reset (mongoc_server_description_t *sd)
    sd->max_msg_size = MONGOC_DEFAULT_MAX_MSG_SIZE;
    sd->max_bson_obj_size = MONGOC_DEFAULT_BSON_OBJ_SIZE;
    sd->max_write_batch_size = MONGOC_DEFAULT_WRITE_BATCH_SIZE;
+   sd->compressor_id = MONGOC_COMPRESSOR_NONE_ID;
 
    /* always leave last ismaster in an init-ed state until we destroy sd */
    bson_destroy (&sd->last_is_master);
@@ -111,6 +113,7 @@ mongoc_server_description_init (mongoc_server_description_t *sd,
    sd->max_msg_size = MONGOC_DEFAULT_MAX_MSG_SIZE;
    sd->max_bson_obj_size = MONGOC_DEFAULT_BSON_OBJ_SIZE;
    sd->max_write_batch_size = MONGOC_DEFAULT_WRITE_BATCH_SIZE;
+   sd->compressor_id = MONGOC_COMPRESSOR_NONE_ID;
 
    bson_init_static (&sd->hosts, kMongocEmptyBson, sizeof (kMongocEmptyBson));
    bson_init_static (&sd->passives, kMongocEmptyBson, sizeof (kMongocEmptyBson));
@@ -379,6 +382,9 @@ mongoc_server_description_handle_ismaster (
       } else if (strcmp ("minWireVersion", bson_iter_key (&iter)) == 0) {
          if (! BSON_ITER_HOLDS_INT32 (&iter)) goto failure;
          sd->min_wire_version = bson_iter_int32 (&iter);
+      } else if (strcmp ("compression", bson_iter_key (&iter)) == 0) {
+         if (! BSON_ITER_HOLDS_ARRAY (&iter)) goto failure;
+         sd->compressor_id = _mongoc_compressor_choose (&sd->last_is_master);
       } else if (strcmp ("maxWireVersion", bson_iter_key (&iter)) == 0) {
          if (! BSON_ITER_HOLDS_INT32 (&iter)) goto failure;
          sd->max_wire_version = bson_iter_int32 (&iter);
@@ -480,6 +486,7 @@ mongoc_server_description_new_copy (const mongoc_server_description_t *descripti
    copy->id = description->id;
    memcpy (&copy->host, &description->host, sizeof (copy->host));
    copy->round_trip_time = -1;
+   copy->compressor_id = MONGOC_COMPRESSOR_NONE_ID;
 
    copy->connection_address = copy->host.host_and_port;
 
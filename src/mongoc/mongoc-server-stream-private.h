@@ -36,13 +36,15 @@ typedef struct _mongoc_server_stream_t
    mongoc_topology_description_type_t  topology_type;
    mongoc_server_description_t        *sd;            /* owned */
    mongoc_stream_t                    *stream;        /* borrowed */
+   uint32_t                            generation;    /* of the connection */
 } mongoc_server_stream_t;
 
 
 mongoc_server_stream_t *
 mongoc_server_stream_new (mongoc_topology_description_type_t topology_type,
                           mongoc_server_description_t *sd,
-                          mongoc_stream_t *stream);
+                          mongoc_stream_t *stream,
+                          uint32_t generation);
 
 int32_t
 mongoc_server_stream_max_bson_obj_size (mongoc_server_stream_t *server_stream);
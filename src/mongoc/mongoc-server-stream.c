@@ -26,7 +26,8 @@
 mongoc_server_stream_t *
 mongoc_server_stream_new (mongoc_topology_description_type_t topology_type,
                           mongoc_server_description_t *sd,
-                          mongoc_stream_t *stream)
+                          mongoc_stream_t *stream,
+                          uint32_t generation)
 {
    mongoc_server_stream_t *server_stream;
 
@@ -37,6 +38,7 @@ mongoc_server_stream_new (mongoc_topology_description_type_t topology_type,
    server_stream->topology_type = topology_type;
    server_stream->sd = sd;                       /* becomes owned */
    server_stream->stream = stream;               /* merely borrowed */
+   server_stream->generation = generation;
 
    return server_stream;
 }
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_SNAPPY_PRIVATE_H
+#define MONGOC_SNAPPY_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include <bson.h>
+
+
+BSON_BEGIN_DECLS
+
+
+size_t _mongoc_snappy_max_compressed_length (size_t         len);
+bool   _mongoc_snappy_compress              (const uint8_t *src,
+                                             size_t         src_len,
+                                             uint8_t       *dst,
+                                             size_t        *dst_len);
+bool   _mongoc_snappy_uncompress            (const uint8_t *src,
+                                             size_t         src_len,
+                                             uint8_t       *dst,
+                                             size_t        *dst_len);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_SNAPPY_PRIVATE_H */
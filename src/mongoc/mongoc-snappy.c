@@ -0,0 +1,397 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "mongoc-snappy-private.h"
+
+
+/*
+ * A codec for the raw Snappy format, built in so that compression can be
+ * negotiated with servers without linking libsnappy.
+ *
+ * The compressor is a greedy LZ77 over 64KB blocks, using a hash table
+ * of the last position each 4-byte sequence was seen, like the reference
+ * implementation. It favors speed over ratio.
+ */
+
+#define SNAPPY_BLOCK_SIZE   (1 << 16)
+#define SNAPPY_HASH_BITS    14
+#define SNAPPY_INPUT_MARGIN 15
+
+
+static BSON_INLINE uint32_t
+_mongoc_snappy_load32 (const uint8_t *p)
+{
+   uint32_t v;
+
+   memcpy (&v, p, 4);
+
+   return v;
+}
+
+
+static BSON_INLINE uint32_t
+_mongoc_snappy_hash (uint32_t v)
+{
+   return (v * 0x1e35a7bdU) >> (32 - SNAPPY_HASH_BITS);
+}
+
+
+static uint8_t *
+_mongoc_snappy_emit_literal (uint8_t       *op,
+                             const uint8_t *literal,
+                             size_t         len)
+{
+   uint8_t *tag;
+   size_t n = len - 1;
+   int count = 0;
+
+   if (n < 60) {
+      *op++ = (uint8_t) (n << 2);
+   } else {
+      /* the length follows the tag in 1 to 4 little-endian bytes */
+      tag = op++;
+
+      while (n > 0) {
+         *op++ = (uint8_t) (n & 0xff);
+         n >>= 8;
+         count++;
+      }
+
+      *tag = (uint8_t) ((59 + count) << 2);
+   }
+
+   memcpy (op, literal, len);
+
+   return op + len;
+}
+
+
+static uint8_t *
+_mongoc_snappy_emit_copy_upto_64 (uint8_t *op,
+                                  size_t   offset,
+                                  size_t   len)
+{
+   BSON_ASSERT (len >= 4 && len <= 64);
+   BSON_ASSERT (offset > 0 && offset < SNAPPY_BLOCK_SIZE);
+
+   if (len < 12 && offset < 2048) {
+      *op++ = (uint8_t) (1 | ((len - 4) << 2) | ((offset >> 8) << 5));
+      *op++ = (uint8_t) (offset & 0xff);
+   } else {
+      *op++ = (uint8_t) (2 | ((len - 1) << 2));
+      *op++ = (uint8_t) (offset & 0xff);
+      *op++ = (uint8_t) (offset >> 8);
+   }
+
+   return op;
+}
+
+
+static uint8_t *
+_mongoc_snappy_emit_copy (uint8_t *op,
+                          size_t   offset,
+                          size_t   len)
+{
+   /* emit 64-byte copies, but never leave a remainder shorter than 4 */
+   while (len >= 68) {
+      op = _mongoc_snappy_emit_copy_upto_64 (op, offset, 64);
+      len -= 64;
+   }
+
+   if (len > 64) {
+      op = _mongoc_snappy_emit_copy_upto_64 (op, offset, 60);
+      len -= 60;
+   }
+
+   return _mongoc_snappy_emit_copy_upto_64 (op, offset, len);
+}
+
+
+static uint8_t *
+_mongoc_snappy_compress_block (const uint8_t *base,
+                               size_t         len,
+                               uint8_t       *op,
+                               uint16_t      *table)
+{
+   const uint8_t *end = base + len;
+   const uint8_t *next_emit = base;
+   const uint8_t *limit;
+   const uint8_t *candidate;
+   const uint8_t *ip;
+   uint32_t skip = 32;
+   uint32_t h;
+   size_t matched;
+
+   if (len >= SNAPPY_INPUT_MARGIN) {
+      memset (table, 0, sizeof (uint16_t) << SNAPPY_HASH_BITS);
+      limit = end - SNAPPY_INPUT_MARGIN;
+
+      /* the first byte can't be the start of a copy */
+      ip = base + 1;
+
+      while (ip < limit) {
+         h = _mongoc_snappy_hash (_mongoc_snappy_load32 (ip));
+         candidate = base + table[h];
+         table[h] = (uint16_t) (ip - base);
+
+         if (_mongoc_snappy_load32 (candidate) != _mongoc_snappy_load32 (ip)) {
+            /* step faster through data that isn't compressing */
+            ip += skip++ >> 5;
+            continue;
+         }
+
+         if (ip > next_emit) {
+            op = _mongoc_snappy_emit_literal (op, next_emit,
+                                              (size_t) (ip - next_emit));
+         }
+
+         matched = 4;
+         while (ip + matched < end && candidate[matched] == ip[matched]) {
+            matched++;
+         }
+
+         op = _mongoc_snappy_emit_copy (op, (size_t) (ip - candidate),
+                                        matched);
+         ip += matched;
+         next_emit = ip;
+         skip = 32;
+
+         if (ip < limit) {
+            h = _mongoc_snappy_hash (_mongoc_snappy_load32 (ip - 1));
+            table[h] = (uint16_t) (ip - 1 - base);
+         }
+      }
+   }
+
+   if (next_emit < end) {
+      op = _mongoc_snappy_emit_literal (op, next_emit,
+                                        (size_t) (end - next_emit));
+   }
+
+   return op;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_snappy_max_compressed_length --
+ *
+ *       The largest output _mongoc_snappy_compress can produce for
+ *       @len bytes of input.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_mongoc_snappy_max_compressed_length (size_t len)
+{
+   return 32 + len + len / 6;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_snappy_compress --
+ *
+ *       Compress @src into @dst. @dst_len is the capacity of @dst on
+ *       input, which must be at least
+ *       _mongoc_snappy_max_compressed_length (@src_len).
+ *
+ * Returns:
+ *       true and sets @dst_len to the compressed length, or false if
+ *       @src is too large or @dst too small.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_snappy_compress (const uint8_t *src,
+                         size_t         src_len,
+                         uint8_t       *dst,
+                         size_t        *dst_len)
+{
+   uint16_t table[1 << SNAPPY_HASH_BITS];
+   const uint8_t *end = src + src_len;
+   uint8_t *op = dst;
+   uint32_t v;
+   size_t block_len;
+
+   if (src_len > UINT32_MAX ||
+       *dst_len < _mongoc_snappy_max_compressed_length (src_len)) {
+      return false;
+   }
+
+   /* preamble: the uncompressed length as a varint */
+   v = (uint32_t) src_len;
+   while (v >= 0x80) {
+      *op++ = (uint8_t) (v | 0x80);
+      v >>= 7;
+   }
+   *op++ = (uint8_t) v;
+
+   while (src < end) {
+      block_len = BSON_MIN ((size_t) (end - src), SNAPPY_BLOCK_SIZE);
+      op = _mongoc_snappy_compress_block (src, block_len, op, table);
+      src += block_len;
+   }
+
+   *dst_len = (size_t) (op - dst);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_snappy_uncompress --
+ *
+ *       Uncompress @src into @dst. @dst_len is the capacity of @dst on
+ *       input.
+ *
+ * Returns:
+ *       true and sets @dst_len to the uncompressed length, or false if
+ *       @src is corrupt or does not fit in @dst.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_mongoc_snappy_uncompress (const uint8_t *src,
+                           size_t         src_len,
+                           uint8_t       *dst,
+                           size_t        *dst_len)
+{
+   const uint8_t *ip = src;
+   const uint8_t *end = src + src_len;
+   uint8_t *op = dst;
+   uint8_t *op_end;
+   uint32_t expected = 0;
+   size_t nbytes;
+   size_t offset;
+   size_t len;
+   size_t i;
+   uint8_t tag;
+   int shift;
+
+   for (shift = 0; ; shift += 7) {
+      if (ip >= end || shift > 28) {
+         return false;
+      }
+
+      expected |= (uint32_t) (*ip & 0x7f) << shift;
+
+      if (!(*ip++ & 0x80)) {
+         break;
+      }
+   }
+
+   if (expected > *dst_len) {
+      return false;
+   }
+
+   op_end = dst + expected;
+
+   while (ip < end) {
+      tag = *ip++;
+
+      switch (tag & 3) {
+      case 0:
+         len = tag >> 2;
+
+         if (len >= 60) {
+            nbytes = len - 59;
+
+            if ((size_t) (end - ip) < nbytes) {
+               return false;
+            }
+
+            len = 0;
+            for (i = 0; i < nbytes; i++) {
+               len |= (size_t) ip[i] << (8 * i);
+            }
+
+            ip += nbytes;
+         }
+
+         len++;
+
+         if ((size_t) (end - ip) < len || (size_t) (op_end - op) < len) {
+            return false;
+         }
+
+         memcpy (op, ip, len);
+         op += len;
+         ip += len;
+         continue;
+      case 1:
+         if (ip >= end) {
+            return false;
+         }
+
+         len = 4 + ((tag >> 2) & 7);
+         offset = ((size_t) (tag >> 5) << 8) | *ip++;
+         break;
+      case 2:
+         if (end - ip < 2) {
+            return false;
+         }
+
+         len = 1 + (tag >> 2);
+         offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+         ip += 2;
+         break;
+      default:
+         if (end - ip < 4) {
+            return false;
+         }
+
+         len = 1 + (tag >> 2);
+         offset = (size_t) ip[0] | ((size_t) ip[1] << 8) |
+                  ((size_t) ip[2] << 16) | ((size_t) ip[3] << 24);
+         ip += 4;
+         break;
+      }
+
+      if (offset == 0 || offset > (size_t) (op - dst) ||
+          (size_t) (op_end - op) < len) {
+         return false;
+      }
+
+      if (offset >= len) {
+         memcpy (op, op - offset, len);
+         op += len;
+      } else {
+         /* the copy overlaps its own output, e.g. a run of one byte */
+         for (i = 0; i < len; i++, op++) {
+            *op = *(op - offset);
+         }
+      }
+   }
+
+   if (op != op_end) {
+      return false;
+   }
+
+   *dst_len = expected;
+
+   return true;
+}
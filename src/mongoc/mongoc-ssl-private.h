@@ -32,14 +32,30 @@
 BSON_BEGIN_DECLS
 
 
+typedef struct _mongoc_ssl_session_cache_t mongoc_ssl_session_cache_t;
+
+
 bool     _mongoc_ssl_check_cert      (SSL              *ssl,
                                       const char       *host,
                                       bool              weak_cert_validation);
 SSL_CTX *_mongoc_ssl_ctx_new         (mongoc_ssl_opt_t *opt);
+SSL_CTX *_mongoc_ssl_ctx_ref         (SSL_CTX          *ctx);
 char    *_mongoc_ssl_extract_subject (const char       *filename);
 void     _mongoc_ssl_init            (void);
 void     _mongoc_ssl_cleanup         (void);
 
+mongoc_ssl_session_cache_t *_mongoc_ssl_session_cache_new     (void);
+void                        _mongoc_ssl_session_cache_destroy (mongoc_ssl_session_cache_t *cache);
+void                        _mongoc_ssl_session_cache_clear   (mongoc_ssl_session_cache_t *cache);
+bool                        _mongoc_ssl_session_cache_offer   (mongoc_ssl_session_cache_t *cache,
+                                                               const char                 *host_and_port,
+                                                               SSL                        *ssl);
+void                        _mongoc_ssl_session_cache_put     (mongoc_ssl_session_cache_t *cache,
+                                                               const char                 *host_and_port,
+                                                               SSL_SESSION                *session);
+void                        _mongoc_ssl_session_cache_remove  (mongoc_ssl_session_cache_t *cache,
+                                                               const char                 *host_and_port);
+
 
 BSON_END_DECLS
 
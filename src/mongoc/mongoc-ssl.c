@@ -28,6 +28,8 @@
 
 #include <string.h>
 
+#include "mongoc-array-private.h"
+#include "mongoc-host-list.h"
 #include "mongoc-init.h"
 #include "mongoc-socket.h"
 #include "mongoc-ssl.h"
@@ -415,9 +417,11 @@ _mongoc_ssl_ctx_new (mongoc_ssl_opt_t *opt)
     * Note: this is for blocking sockets only. */
    SSL_CTX_set_mode (ctx, SSL_MODE_AUTO_RETRY);
 
-   /* TODO: does this cargo cult actually matter?
-    * Disable session caching (see SERVER-10261) */
-   SSL_CTX_set_session_cache_mode (ctx, SSL_SESS_CACHE_OFF);
+   /* Server-side session caching stays disabled (see SERVER-10261). Client
+    * sessions are kept in the topology's mongoc_ssl_session_cache_t rather
+    * than in this context, which only lives as long as a single stream. */
+   SSL_CTX_set_session_cache_mode (ctx, SSL_SESS_CACHE_CLIENT |
+                                        SSL_SESS_CACHE_NO_INTERNAL_STORE);
 
    /* Load in verification certs, private keys and revocation lists */
    if ((!opt->pem_file ||
@@ -435,6 +439,27 @@ _mongoc_ssl_ctx_new (mongoc_ssl_opt_t *opt)
 }
 
 
+/**
+ * _mongoc_ssl_ctx_ref:
+ *
+ * Take another reference to @ctx, released with SSL_CTX_free(). Lets a
+ * context built once be shared by every stream a topology opens.
+ */
+SSL_CTX *
+_mongoc_ssl_ctx_ref (SSL_CTX *ctx)
+{
+   BSON_ASSERT (ctx);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+   SSL_CTX_up_ref (ctx);
+#else
+   CRYPTO_add (&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+
+   return ctx;
+}
+
+
 char *
 _mongoc_ssl_extract_subject (const char *filename)
 {
@@ -484,6 +509,199 @@ _mongoc_ssl_extract_subject (const char *filename)
    return str;
 }
 
+
+/*
+ * Client sessions, keyed by "host:port", shared by every TLS stream that
+ * a topology opens. Offering a cached session lets the server resume it
+ * (by session id or session ticket) instead of performing a full
+ * handshake. A topology talks to a handful of servers, so a linear scan
+ * is all we need.
+ */
+typedef struct
+{
+   char         host_and_port [BSON_HOST_NAME_MAX + 7];
+   SSL_SESSION *session;
+} mongoc_ssl_session_cache_entry_t;
+
+
+struct _mongoc_ssl_session_cache_t
+{
+   mongoc_mutex_t mutex;
+   mongoc_array_t entries;
+};
+
+
+static mongoc_ssl_session_cache_entry_t *
+_mongoc_ssl_session_cache_find (mongoc_ssl_session_cache_t *cache,
+                                const char                 *host_and_port)
+{
+   mongoc_ssl_session_cache_entry_t *entry;
+   size_t i;
+
+   for (i = 0; i < cache->entries.len; i++) {
+      entry = &_mongoc_array_index (&cache->entries,
+                                    mongoc_ssl_session_cache_entry_t, i);
+
+      if (!strcmp (entry->host_and_port, host_and_port)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+mongoc_ssl_session_cache_t *
+_mongoc_ssl_session_cache_new (void)
+{
+   mongoc_ssl_session_cache_t *cache;
+
+   cache = (mongoc_ssl_session_cache_t *)bson_malloc0 (sizeof *cache);
+   mongoc_mutex_init (&cache->mutex);
+   _mongoc_array_init (&cache->entries,
+                       sizeof (mongoc_ssl_session_cache_entry_t));
+
+   return cache;
+}
+
+
+void
+_mongoc_ssl_session_cache_clear (mongoc_ssl_session_cache_t *cache)
+{
+   mongoc_ssl_session_cache_entry_t *entry;
+   size_t i;
+
+   BSON_ASSERT (cache);
+
+   mongoc_mutex_lock (&cache->mutex);
+
+   for (i = 0; i < cache->entries.len; i++) {
+      entry = &_mongoc_array_index (&cache->entries,
+                                    mongoc_ssl_session_cache_entry_t, i);
+      SSL_SESSION_free (entry->session);
+   }
+
+   _mongoc_array_clear (&cache->entries);
+
+   mongoc_mutex_unlock (&cache->mutex);
+}
+
+
+void
+_mongoc_ssl_session_cache_destroy (mongoc_ssl_session_cache_t *cache)
+{
+   if (cache) {
+      _mongoc_ssl_session_cache_clear (cache);
+      _mongoc_array_destroy (&cache->entries);
+      mongoc_mutex_destroy (&cache->mutex);
+      bson_free (cache);
+   }
+}
+
+
+/*
+ * Offer the session cached for @host_and_port, if any, on @ssl before it
+ * handshakes. SSL_set_session () takes its own reference, so the cached
+ * entry may be replaced or evicted while @ssl still uses the session.
+ */
+bool
+_mongoc_ssl_session_cache_offer (mongoc_ssl_session_cache_t *cache,
+                                 const char                 *host_and_port,
+                                 SSL                        *ssl)
+{
+   mongoc_ssl_session_cache_entry_t *entry;
+   bool ret = false;
+
+   BSON_ASSERT (cache);
+   BSON_ASSERT (host_and_port);
+   BSON_ASSERT (ssl);
+
+   mongoc_mutex_lock (&cache->mutex);
+
+   entry = _mongoc_ssl_session_cache_find (cache, host_and_port);
+
+   if (entry) {
+      ret = (SSL_set_session (ssl, entry->session) == 1);
+   }
+
+   mongoc_mutex_unlock (&cache->mutex);
+
+   return ret;
+}
+
+
+/*
+ * Store @session for @host_and_port, replacing any previous entry. The
+ * cache takes ownership of the reference to @session.
+ */
+void
+_mongoc_ssl_session_cache_put (mongoc_ssl_session_cache_t *cache,
+                               const char                 *host_and_port,
+                               SSL_SESSION                *session)
+{
+   mongoc_ssl_session_cache_entry_t *entry;
+   mongoc_ssl_session_cache_entry_t new_entry;
+
+   BSON_ASSERT (cache);
+   BSON_ASSERT (host_and_port);
+   BSON_ASSERT (session);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+   if (!SSL_SESSION_is_resumable (session)) {
+      SSL_SESSION_free (session);
+      return;
+   }
+#endif
+
+   mongoc_mutex_lock (&cache->mutex);
+
+   entry = _mongoc_ssl_session_cache_find (cache, host_and_port);
+
+   if (entry) {
+      SSL_SESSION_free (entry->session);
+      entry->session = session;
+   } else {
+      bson_strncpy (new_entry.host_and_port, host_and_port,
+                    sizeof new_entry.host_and_port);
+      new_entry.session = session;
+      _mongoc_array_append_val (&cache->entries, new_entry);
+   }
+
+   mongoc_mutex_unlock (&cache->mutex);
+}
+
+
+void
+_mongoc_ssl_session_cache_remove (mongoc_ssl_session_cache_t *cache,
+                                  const char                 *host_and_port)
+{
+   mongoc_ssl_session_cache_entry_t *entry;
+   mongoc_ssl_session_cache_entry_t *last;
+
+   BSON_ASSERT (cache);
+   BSON_ASSERT (host_and_port);
+
+   mongoc_mutex_lock (&cache->mutex);
+
+   entry = _mongoc_ssl_session_cache_find (cache, host_and_port);
+
+   if (entry) {
+      SSL_SESSION_free (entry->session);
+
+      /* move the last entry into the hole */
+      last = &_mongoc_array_index (&cache->entries,
+                                   mongoc_ssl_session_cache_entry_t,
+                                   cache->entries.len - 1);
+      if (entry != last) {
+         memcpy (entry, last, sizeof *entry);
+      }
+
+      cache->entries.len--;
+   }
+
+   mongoc_mutex_unlock (&cache->mutex);
+}
+
 #ifdef _WIN32
 
 static unsigned long
@@ -34,6 +34,9 @@ BSON_BEGIN_DECLS
 #define MONGOC_STREAM_GRIDFS   4
 #define MONGOC_STREAM_TLS      5
 
+mongoc_stream_t *
+mongoc_stream_get_root_stream (mongoc_stream_t *stream);
+
 bool
 mongoc_stream_wait (mongoc_stream_t *stream,
                     int64_t expire_at);
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MONGOC_STREAM_TLS_PRIVATE_H
+#define MONGOC_STREAM_TLS_PRIVATE_H
+
+#if !defined (MONGOC_I_AM_A_DRIVER) && !defined (MONGOC_COMPILATION)
+#error "Only <mongoc.h> can be included directly."
+#endif
+
+#include "mongoc-ssl-private.h"
+#include "mongoc-stream.h"
+
+
+BSON_BEGIN_DECLS
+
+
+mongoc_stream_t *_mongoc_stream_tls_new_with_ctx      (mongoc_stream_t            *base_stream,
+                                                       SSL_CTX                    *ssl_ctx,
+                                                       bool                        weak_cert_validation,
+                                                       int                         client);
+void             _mongoc_stream_tls_set_session_cache (mongoc_stream_t            *stream,
+                                                       mongoc_ssl_session_cache_t *cache,
+                                                       const char                 *host_and_port);
+
+
+BSON_END_DECLS
+
+
+#endif /* MONGOC_STREAM_TLS_PRIVATE_H */
@@ -33,6 +33,7 @@
 #include "mongoc-counters-private.h"
 #include "mongoc-errno-private.h"
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #include "mongoc-stream-private.h"
 #include "mongoc-ssl-private.h"
 #include "mongoc-trace.h"
@@ -42,7 +43,8 @@
 #undef MONGOC_LOG_DOMAIN
 #define MONGOC_LOG_DOMAIN "stream-tls"
 
-#define MONGOC_STREAM_TLS_BUFFER_SIZE 4096
+/* The largest plaintext payload of a single TLS record. */
+#define MONGOC_STREAM_TLS_RECORD_SIZE 16384
 
 
 /**
@@ -60,9 +62,15 @@ typedef struct
    mongoc_stream_t  parent;
    mongoc_stream_t *base_stream;
    BIO             *bio;
+   SSL             *ssl;
    SSL_CTX         *ctx;
+   char            *write_buf;
    int32_t          timeout_msec;
    bool             weak_cert_validation;
+   mongoc_ssl_session_cache_t *session_cache;
+   char            *host_and_port;
+   bool             session_offered;
+   bool             handshake_complete;
 } mongoc_stream_tls_t;
 
 
@@ -401,6 +409,8 @@ _mongoc_stream_tls_destroy (mongoc_stream_t *stream)
    SSL_CTX_free (tls->ctx);
    tls->ctx = NULL;
 
+   bson_free (tls->host_and_port);
+   bson_free (tls->write_buf);
    bson_free (stream);
 
    mongoc_counter_streams_active_dec();
@@ -562,26 +572,22 @@ _mongoc_stream_tls_writev (mongoc_stream_t *stream,
                            int32_t          timeout_msec)
 {
    mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *)stream;
-   char buf[MONGOC_STREAM_TLS_BUFFER_SIZE];
 
    ssize_t ret = 0;
    ssize_t child_ret;
    size_t i;
    size_t iov_pos = 0;
-
-   /* There's a bit of a dance to coalesce vectorized writes into
-    * MONGOC_STREAM_TLS_BUFFER_SIZE'd writes to avoid lots of small tls
-    * packets.
-    *
-    * The basic idea is that we want to combine writes in the buffer if they're
-    * smaller than the buffer, flushing as it gets full.  For larger writes, or
-    * the last write in the iovec array, we want to ignore the buffer and just
-    * write immediately.  We take care of doing buffer writes by re-invoking
-    * ourself with a single iovec_t, pointing at our stack buffer.
+   size_t remaining;
+
+   /* Every BIO_write() of n bytes becomes ceil(n / 16KB) TLS records, each
+    * with its own header, MAC and write to the socket. We want full
+    * records, so small iovecs are packed into a record-sized buffer that is
+    * written whenever it fills up. When the buffer is empty, whole records
+    * (and all of the last iovec) are written straight from the caller's
+    * memory instead; BIO_write() splits them into full records itself.
     */
-   char *buf_head = buf;
-   char *buf_tail = buf;
-   char *buf_end = buf + MONGOC_STREAM_TLS_BUFFER_SIZE;
+   char *buf;
+   size_t buf_len = 0;
    size_t bytes;
 
    char *to_write = NULL;
@@ -594,46 +600,56 @@ _mongoc_stream_tls_writev (mongoc_stream_t *stream,
 
    tls->timeout_msec = timeout_msec;
 
+   if (!tls->write_buf) {
+      tls->write_buf = (char *)bson_malloc (MONGOC_STREAM_TLS_RECORD_SIZE);
+   }
+
+   buf = tls->write_buf;
+
    for (i = 0; i < iovcnt; i++) {
       iov_pos = 0;
 
       while (iov_pos < iov[i].iov_len) {
-         if (buf_head != buf_tail ||
-             ((i + 1 < iovcnt) &&
-              ((buf_end - buf_tail) > (iov[i].iov_len - iov_pos)))) {
-            /* If we have either of:
-             *   - buffered bytes already
-             *   - another iovec to send after this one and we don't have more
-             *     bytes to send than the size of the buffer.
-             *
-             * copy into the buffer */
-
-            bytes = BSON_MIN (iov[i].iov_len - iov_pos, buf_end - buf_tail);
-
-            memcpy (buf_tail, (char *) iov[i].iov_base + iov_pos, bytes);
-            buf_tail += bytes;
-            iov_pos += bytes;
+         remaining = iov[i].iov_len - iov_pos;
 
-            if (buf_tail == buf_end) {
-               /* If we're full, request send */
+         if (buf_len == 0 &&
+             (remaining >= MONGOC_STREAM_TLS_RECORD_SIZE || i + 1 == iovcnt)) {
+            /* Nothing buffered: write whole records, or the rest of the
+             * last iovec, without copying them */
 
-               to_write = buf_head;
-               to_write_len = buf_tail - buf_head;
+            to_write = (char *)iov[i].iov_base + iov_pos;
 
-               buf_tail = buf_head = buf;
+            if (i + 1 == iovcnt) {
+               to_write_len = remaining;
+            } else {
+               to_write_len = remaining -
+                              (remaining % MONGOC_STREAM_TLS_RECORD_SIZE);
             }
+
+            iov_pos += to_write_len;
          } else {
-            /* Didn't buffer, so just write it through */
+            /* Top up the record buffer */
 
-            to_write = (char *)iov[i].iov_base + iov_pos;
-            to_write_len = iov[i].iov_len - iov_pos;
+            bytes = BSON_MIN (remaining,
+                              MONGOC_STREAM_TLS_RECORD_SIZE - buf_len);
 
-            iov_pos += to_write_len;
+            memcpy (buf + buf_len, (char *)iov[i].iov_base + iov_pos, bytes);
+            buf_len += bytes;
+            iov_pos += bytes;
+
+            if (buf_len == MONGOC_STREAM_TLS_RECORD_SIZE) {
+               /* If we're full, request send */
+
+               to_write = buf;
+               to_write_len = buf_len;
+
+               buf_len = 0;
+            }
          }
 
          if (to_write) {
-            /* We get here if we buffered some bytes and filled the buffer, or
-             * if we didn't buffer and have to send out of the iovec */
+            /* We get here if we filled a record, or if we write straight
+             * out of the iovec */
 
             child_ret = _mongoc_stream_tls_write (tls, to_write, to_write_len);
             if (child_ret != to_write_len) {
@@ -659,10 +675,10 @@ _mongoc_stream_tls_writev (mongoc_stream_t *stream,
       }
    }
 
-   if (buf_head != buf_tail) {
+   if (buf_len) {
       /* If we have any bytes buffered, send */
 
-      child_ret = _mongoc_stream_tls_write (tls, buf_head, buf_tail - buf_head);
+      child_ret = _mongoc_stream_tls_write (tls, buf, buf_len);
 
       if (child_ret < 0) {
          RETURN (child_ret);
@@ -764,7 +780,10 @@ _mongoc_stream_tls_readv (mongoc_stream_t *stream,
 
          ret += read_ret;
 
-         if ((size_t)ret >= min_bytes) {
+         /* Once we have min_bytes, keep going only while OpenSSL still
+          * holds decrypted bytes from the current record: handing them
+          * over now costs no I/O and saves our caller another readv. */
+         if ((size_t)ret >= min_bytes && !SSL_pending (tls->ssl)) {
             mongoc_counter_streams_ingress_add(ret);
             RETURN (ret);
          }
@@ -828,15 +847,40 @@ mongoc_stream_tls_do_handshake (mongoc_stream_t *stream,
                                 int32_t          timeout_msec)
 {
    mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *)stream;
+   SSL *ssl;
 
    BSON_ASSERT (tls);
 
    tls->timeout_msec = timeout_msec;
 
+   BIO_get_ssl (tls->bio, &ssl);
+
+   if (tls->session_cache && !tls->session_offered) {
+      _mongoc_ssl_session_cache_offer (tls->session_cache,
+                                       tls->host_and_port, ssl);
+      tls->session_offered = true;
+   }
+
    if (BIO_do_handshake (tls->bio) == 1) {
+      if (!tls->handshake_complete) {
+         tls->handshake_complete = true;
+
+         if (SSL_session_reused (ssl)) {
+            mongoc_counter_tls_handshakes_resumed_inc ();
+         } else {
+            mongoc_counter_tls_handshakes_full_inc ();
+         }
+      }
+
       return true;
    }
 
+   /* don't offer a session the server just refused to resume again */
+   if (tls->session_cache && !BIO_should_retry (tls->bio)) {
+      _mongoc_ssl_session_cache_remove (tls->session_cache,
+                                        tls->host_and_port);
+   }
+
    if (!timeout_msec) {
       return false;
    }
@@ -905,20 +949,74 @@ mongoc_stream_tls_should_write (mongoc_stream_t *stream)
  * mongoc_stream_tls_check_cert:
  *
  * check the cert returned by the other party
+ *
+ * If the stream has a session cache, a session is only cached once the
+ * peer has been verified.
  */
 bool
 mongoc_stream_tls_check_cert (mongoc_stream_t *stream,
                               const char      *host)
 {
    mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *)stream;
+   SSL_SESSION *session;
    SSL *ssl;
+   bool ret;
 
    BSON_ASSERT (tls);
    BSON_ASSERT (host);
 
    BIO_get_ssl (tls->bio, &ssl);
 
-   return _mongoc_ssl_check_cert (ssl, host, tls->weak_cert_validation);
+   ret = _mongoc_ssl_check_cert (ssl, host, tls->weak_cert_validation);
+
+   if (tls->session_cache) {
+      if (ret && (session = SSL_get1_session (ssl))) {
+         _mongoc_ssl_session_cache_put (tls->session_cache,
+                                        tls->host_and_port, session);
+      } else if (!ret) {
+         _mongoc_ssl_session_cache_remove (tls->session_cache,
+                                           tls->host_and_port);
+      }
+   }
+
+   return ret;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_stream_tls_set_session_cache --
+ *
+ *       Resume sessions from @cache when @stream handshakes with
+ *       @host_and_port, and store the session it negotiates there. Must
+ *       be called before mongoc_stream_tls_do_handshake().
+ *
+ *       @cache must outlive @stream's handshake.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_stream_tls_set_session_cache (mongoc_stream_t            *stream,
+                                      mongoc_ssl_session_cache_t *cache,
+                                      const char                 *host_and_port)
+{
+   mongoc_stream_tls_t *tls = (mongoc_stream_tls_t *)stream;
+
+   BSON_ASSERT (tls);
+   BSON_ASSERT (tls->parent.type == MONGOC_STREAM_TLS);
+   BSON_ASSERT (host_and_port);
+
+   bson_free (tls->host_and_port);
+   tls->host_and_port = bson_strdup (host_and_port);
+   tls->session_cache = cache;
 }
 
 
@@ -941,16 +1039,15 @@ _mongoc_stream_tls_check_closed (mongoc_stream_t *stream) /* IN */
 /*
  *--------------------------------------------------------------------------
  *
- * mongoc_stream_tls_new --
+ * _mongoc_stream_tls_new_with_ctx --
  *
- *       Creates a new mongoc_stream_tls_t to communicate with a remote
- *       server using a TLS stream.
+ *       Creates a new mongoc_stream_tls_t that uses an existing
+ *       SSL_CTX, so that the key, CA and CRL files it was built from
+ *       are not read again for every connection.
  *
- *       @base_stream should be a stream that will become owned by the
- *       resulting tls stream. It will be used for raw I/O.
- *
- *       @trust_store_dir should be a path to the SSL cert db to use for
- *       verifying trust of the remote server.
+ *       The stream takes its own reference to @ssl_ctx, the caller
+ *       keeps its reference. @base_stream becomes owned by the
+ *       resulting tls stream.
  *
  * Returns:
  *       NULL on failure, otherwise a mongoc_stream_t.
@@ -962,24 +1059,18 @@ _mongoc_stream_tls_check_closed (mongoc_stream_t *stream) /* IN */
  */
 
 mongoc_stream_t *
-mongoc_stream_tls_new (mongoc_stream_t  *base_stream,
-                       mongoc_ssl_opt_t *opt,
-                       int               client)
+_mongoc_stream_tls_new_with_ctx (mongoc_stream_t *base_stream,
+                                 SSL_CTX         *ssl_ctx,
+                                 bool             weak_cert_validation,
+                                 int              client)
 {
    mongoc_stream_tls_t *tls;
-   SSL_CTX *ssl_ctx = NULL;
 
    BIO *bio_ssl = NULL;
    BIO *bio_mongoc_shim = NULL;
 
    BSON_ASSERT(base_stream);
-   BSON_ASSERT(opt);
-
-   ssl_ctx = _mongoc_ssl_ctx_new (opt);
-
-   if (!ssl_ctx) {
-      return NULL;
-   }
+   BSON_ASSERT(ssl_ctx);
 
    bio_ssl = BIO_new_ssl (ssl_ctx, client);
    if (!bio_ssl) {
@@ -1007,9 +1098,10 @@ mongoc_stream_tls_new (mongoc_stream_t  *base_stream,
    tls->parent.setsockopt = _mongoc_stream_tls_setsockopt;
    tls->parent.get_base_stream = _mongoc_stream_tls_get_base_stream;
    tls->parent.check_closed = _mongoc_stream_tls_check_closed;
-   tls->weak_cert_validation = opt->weak_cert_validation;
+   tls->weak_cert_validation = weak_cert_validation;
    tls->bio = bio_ssl;
-   tls->ctx = ssl_ctx;
+   BIO_get_ssl (bio_ssl, &tls->ssl);
+   tls->ctx = _mongoc_ssl_ctx_ref (ssl_ctx);
    tls->timeout_msec = -1;
    bio_mongoc_shim->ptr = tls;
 
@@ -1018,4 +1110,55 @@ mongoc_stream_tls_new (mongoc_stream_t  *base_stream,
    return (mongoc_stream_t *)tls;
 }
 
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_stream_tls_new --
+ *
+ *       Creates a new mongoc_stream_tls_t to communicate with a remote
+ *       server using a TLS stream.
+ *
+ *       @base_stream should be a stream that will become owned by the
+ *       resulting tls stream. It will be used for raw I/O.
+ *
+ *       @trust_store_dir should be a path to the SSL cert db to use for
+ *       verifying trust of the remote server.
+ *
+ * Returns:
+ *       NULL on failure, otherwise a mongoc_stream_t.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+mongoc_stream_tls_new (mongoc_stream_t  *base_stream,
+                       mongoc_ssl_opt_t *opt,
+                       int               client)
+{
+   mongoc_stream_t *stream;
+   SSL_CTX *ssl_ctx = NULL;
+
+   BSON_ASSERT(base_stream);
+   BSON_ASSERT(opt);
+
+   ssl_ctx = _mongoc_ssl_ctx_new (opt);
+
+   if (!ssl_ctx) {
+      return NULL;
+   }
+
+   stream = _mongoc_stream_tls_new_with_ctx (base_stream, ssl_ctx,
+                                             opt->weak_cert_validation,
+                                             client);
+
+   /* the stream holds its own reference */
+   SSL_CTX_free (ssl_ctx);
+
+   return stream;
+}
+
 #endif
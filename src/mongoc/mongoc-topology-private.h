@@ -17,12 +17,16 @@
 #ifndef MONGOC_TOPOLOGY_PRIVATE_H
 #define MONGOC_TOPOLOGY_PRIVATE_H
 
+#include "mongoc-array-private.h"
 #include "mongoc-read-prefs-private.h"
 #include "mongoc-topology-scanner-private.h"
 #include "mongoc-server-description-private.h"
 #include "mongoc-topology-description-private.h"
 #include "mongoc-thread-private.h"
 #include "mongoc-uri.h"
+#ifdef MONGOC_ENABLE_SSL
+#include "mongoc-scram-private.h"
+#endif
 
 #define MONGOC_TOPOLOGY_MIN_HEARTBEAT_FREQUENCY_MS 500
 #define MONGOC_TOPOLOGY_SOCKET_CHECK_INTERVAL_MS 5000
@@ -61,6 +65,10 @@ typedef struct _mongoc_topology_t
    bool                          shutdown_requested;
    bool                          single_threaded;
    bool                          stale;
+
+#ifdef MONGOC_ENABLE_SSL
+   mongoc_scram_cache_t         *scram_cache;
+#endif
 } mongoc_topology_t;
 
 mongoc_topology_t *
@@ -99,4 +107,8 @@ int64_t
 mongoc_topology_server_timestamp (mongoc_topology_t *topology,
                                   uint32_t           id);
 
+void
+mongoc_topology_get_data_server_ids (mongoc_topology_t *topology,
+                                     mongoc_array_t    *ids);
+
 #endif
@@ -24,9 +24,14 @@
 #endif
 
 #include <bson.h>
+#include "mongoc-config.h"
 #include "mongoc-async-private.h"
 #include "mongoc-async-cmd-private.h"
 #include "mongoc-host-list.h"
+#include "mongoc-thread-private.h"
+#ifdef MONGOC_ENABLE_SSL
+#include "mongoc-ssl-private.h"
+#endif
 
 BSON_BEGIN_DECLS
 
@@ -43,6 +48,7 @@ typedef struct mongoc_topology_scanner_node
    uint32_t                        id;
    mongoc_async_cmd_t             *cmd;
    mongoc_stream_t                *stream;
+   uint32_t                        generation;  /* bumped on each connect */
    int64_t                         timestamp;
    int64_t                         last_used;
    int64_t                         last_failed;
@@ -74,7 +80,10 @@ typedef struct mongoc_topology_scanner
    void                           *initiator_context;
 
 #ifdef MONGOC_ENABLE_SSL
-   mongoc_ssl_opt_t *ssl_opts;
+   mongoc_ssl_opt_t           *ssl_opts;
+   mongoc_ssl_session_cache_t *session_cache;
+   mongoc_mutex_t              ssl_mutex;
+   SSL_CTX                    *ssl_ctx;
 #endif
 } mongoc_topology_scanner_t;
 
@@ -145,6 +154,16 @@ mongoc_topology_scanner_set_stream_initiator (mongoc_topology_scanner_t *ts,
 void
 mongoc_topology_scanner_set_ssl_opts (mongoc_topology_scanner_t *ts,
                                       mongoc_ssl_opt_t          *opts);
+
+bool
+mongoc_topology_scanner_reload_ssl_ctx (mongoc_topology_scanner_t *ts,
+                                        bson_error_t              *error);
+
+mongoc_stream_t *
+mongoc_topology_scanner_tls_stream_new (mongoc_topology_scanner_t *ts,
+                                        mongoc_stream_t           *base_stream,
+                                        mongoc_ssl_opt_t          *opts,
+                                        const mongoc_host_list_t  *host);
 #endif
 
 BSON_END_DECLS
@@ -16,6 +16,7 @@
 
 #include <bson.h>
 
+#include "mongoc-compression-private.h"
 #include "mongoc-error.h"
 #include "mongoc-trace.h"
 #include "mongoc-topology-scanner-private.h"
@@ -23,6 +24,7 @@
 
 #ifdef MONGOC_ENABLE_SSL
 #include "mongoc-stream-tls.h"
+#include "mongoc-stream-tls-private.h"
 #endif
 
 #include "mongoc-counters-private.h"
@@ -50,22 +52,153 @@ mongoc_topology_scanner_new (const mongoc_uri_t          *uri,
    ts->async = mongoc_async_new ();
    bson_init (&ts->ismaster_cmd);
    BSON_APPEND_INT32 (&ts->ismaster_cmd, "isMaster", 1);
+   _mongoc_compression_append_ismaster (&ts->ismaster_cmd, uri);
 
    ts->cb = cb;
    ts->cb_data = data;
    ts->uri = uri;
 
+#ifdef MONGOC_ENABLE_SSL
+   ts->session_cache = _mongoc_ssl_session_cache_new ();
+   mongoc_mutex_init (&ts->ssl_mutex);
+#endif
+
    return ts;
 }
 
 #ifdef MONGOC_ENABLE_SSL
+static void
+_mongoc_topology_scanner_swap_ssl_ctx (mongoc_topology_scanner_t *ts,
+                                       mongoc_ssl_opt_t          *opts,
+                                       SSL_CTX                   *ssl_ctx)
+{
+   SSL_CTX *old_ctx;
+
+   mongoc_mutex_lock (&ts->ssl_mutex);
+   old_ctx = ts->ssl_ctx;
+   ts->ssl_opts = opts;
+   ts->ssl_ctx = ssl_ctx;
+   mongoc_mutex_unlock (&ts->ssl_mutex);
+
+   /* streams that still use the old context hold their own references */
+   if (old_ctx) {
+      SSL_CTX_free (old_ctx);
+   }
+
+   /* sessions negotiated with the old options must not be resumed */
+   _mongoc_ssl_session_cache_clear (ts->session_cache);
+}
+
 void
 mongoc_topology_scanner_set_ssl_opts (mongoc_topology_scanner_t *ts,
                                       mongoc_ssl_opt_t          *opts)
 {
-   ts->ssl_opts = opts;
+   /* Read the key, CA and CRL files once for every stream this topology
+    * opens. If that fails, each stream tries again and reports the error
+    * when it connects, as before. */
+   _mongoc_topology_scanner_swap_ssl_ctx (ts, opts, _mongoc_ssl_ctx_new (opts));
    ts->setup = mongoc_async_cmd_tls_setup;
 }
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_reload_ssl_ctx --
+ *
+ *       Read the files named by the scanner's SSL options again and use
+ *       the new context for streams opened from now on. Existing
+ *       streams keep the context they were created with.
+ *
+ * Returns:
+ *       true if the new context was installed, otherwise false and
+ *       @error is set. The old context stays in use on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+mongoc_topology_scanner_reload_ssl_ctx (mongoc_topology_scanner_t *ts,
+                                        bson_error_t              *error)
+{
+   mongoc_ssl_opt_t *opts;
+   SSL_CTX *ssl_ctx;
+
+   mongoc_mutex_lock (&ts->ssl_mutex);
+   opts = ts->ssl_opts;
+   mongoc_mutex_unlock (&ts->ssl_mutex);
+
+   if (!opts) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_INVALID_STATE,
+                      "SSL options have not been set.");
+      return false;
+   }
+
+   ssl_ctx = _mongoc_ssl_ctx_new (opts);
+
+   if (!ssl_ctx) {
+      bson_set_error (error,
+                      MONGOC_ERROR_STREAM,
+                      MONGOC_ERROR_STREAM_SOCKET,
+                      "Failed to load TLS certificates.");
+      return false;
+   }
+
+   _mongoc_topology_scanner_swap_ssl_ctx (ts, opts, ssl_ctx);
+
+   return true;
+}
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_scanner_tls_stream_new --
+ *
+ *       Wrap @base_stream in a TLS stream to @host that resumes sessions
+ *       from the scanner's session cache. The stream shares the
+ *       scanner's SSL_CTX if @opts are the options it was built from,
+ *       otherwise it builds its own.
+ *
+ * Returns:
+ *       NULL on failure, otherwise a mongoc_stream_t that owns
+ *       @base_stream.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+mongoc_stream_t *
+mongoc_topology_scanner_tls_stream_new (mongoc_topology_scanner_t *ts,
+                                        mongoc_stream_t           *base_stream,
+                                        mongoc_ssl_opt_t          *opts,
+                                        const mongoc_host_list_t  *host)
+{
+   mongoc_stream_t *tls_stream;
+   SSL_CTX *ssl_ctx = NULL;
+
+   mongoc_mutex_lock (&ts->ssl_mutex);
+   if (ts->ssl_ctx &&
+       (opts == ts->ssl_opts ||
+        0 == memcmp (opts, ts->ssl_opts, sizeof *opts))) {
+      ssl_ctx = _mongoc_ssl_ctx_ref (ts->ssl_ctx);
+   }
+   mongoc_mutex_unlock (&ts->ssl_mutex);
+
+   if (ssl_ctx) {
+      tls_stream = _mongoc_stream_tls_new_with_ctx (
+         base_stream, ssl_ctx, opts->weak_cert_validation, 1);
+      SSL_CTX_free (ssl_ctx);
+   } else {
+      tls_stream = mongoc_stream_tls_new (base_stream, opts, 1);
+   }
+
+   if (tls_stream) {
+      _mongoc_stream_tls_set_session_cache (tls_stream, ts->session_cache,
+                                            host->host_and_port);
+   }
+
+   return tls_stream;
+}
 #endif
 
 void
@@ -90,6 +223,14 @@ mongoc_topology_scanner_destroy (mongoc_topology_scanner_t *ts)
    mongoc_async_destroy (ts->async);
    bson_destroy (&ts->ismaster_cmd);
 
+#ifdef MONGOC_ENABLE_SSL
+   _mongoc_ssl_session_cache_destroy (ts->session_cache);
+   if (ts->ssl_ctx) {
+      SSL_CTX_free (ts->ssl_ctx);
+   }
+   mongoc_mutex_destroy (&ts->ssl_mutex);
+#endif
+
    bson_free (ts);
 }
 
@@ -480,7 +621,8 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
 
 #ifdef MONGOC_ENABLE_SSL
       if (sock_stream && node->ts->ssl_opts) {
-         sock_stream = mongoc_stream_tls_new (sock_stream, node->ts->ssl_opts, 1);
+         sock_stream = mongoc_topology_scanner_tls_stream_new (
+            node->ts, sock_stream, node->ts->ssl_opts, &node->host);
       }
 #endif
    }
@@ -492,6 +634,7 @@ mongoc_topology_scanner_node_setup (mongoc_topology_scanner_node_t *node,
    }
 
    node->stream = sock_stream;
+   node->generation++;
    node->has_auth = false;
    node->timestamp = bson_get_monotonic_time ();
 
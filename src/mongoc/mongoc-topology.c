@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "mongoc-counters-private.h"
 #include "mongoc-error.h"
 #include "mongoc-topology-private.h"
 #include "mongoc-uri-private.h"
@@ -181,6 +182,9 @@ mongoc_topology_new (const mongoc_uri_t *uri,
    topology->scanner = mongoc_topology_scanner_new (topology->uri,
                                                     _mongoc_topology_scanner_cb,
                                                     topology);
+#ifdef MONGOC_ENABLE_SSL
+   topology->scram_cache = _mongoc_scram_cache_new ();
+#endif
    topology->single_threaded = single_threaded;
    if (single_threaded) {
       /* Server Selection Spec:
@@ -266,6 +270,9 @@ mongoc_topology_destroy (mongoc_topology_t *topology)
    mongoc_uri_destroy (topology->uri);
    mongoc_topology_description_destroy(&topology->description);
    mongoc_topology_scanner_destroy (topology->scanner);
+#ifdef MONGOC_ENABLE_SSL
+   _mongoc_scram_cache_destroy (topology->scram_cache);
+#endif
    mongoc_cond_destroy (&topology->cond_client);
    mongoc_cond_destroy (&topology->cond_server);
    mongoc_mutex_destroy (&topology->mutex);
@@ -382,6 +389,7 @@ mongoc_topology_select (mongoc_topology_t         *topology,
    int64_t sleep_usec;
    bool tried_once;
    bson_error_t scanner_error = { 0 };
+   int64_t started;
 
    /* These names come from the Server Selection Spec pseudocode */
    int64_t loop_start;  /* when we entered this function */
@@ -393,7 +401,7 @@ mongoc_topology_select (mongoc_topology_t         *topology,
    BSON_ASSERT (topology);
 
    try_once = topology->server_selection_try_once;
-   loop_start = loop_end = bson_get_monotonic_time ();
+   started = loop_start = loop_end = bson_get_monotonic_time ();
    expire_at = loop_start
                + ((int64_t) topology->server_selection_timeout_msec * 1000);
 
@@ -438,6 +446,8 @@ mongoc_topology_select (mongoc_topology_t         *topology,
                                                               local_threshold_ms);
 
          if (selected_server) {
+            mongoc_histogram_server_selection_record (
+               bson_get_monotonic_time () - started);
             return mongoc_server_description_new_copy(selected_server);
          }
 
@@ -525,12 +535,16 @@ mongoc_topology_select (mongoc_topology_t         *topology,
       } else {
          selected_server = mongoc_server_description_new_copy(selected_server);
          mongoc_mutex_unlock (&topology->mutex);
+         mongoc_histogram_server_selection_record (
+            bson_get_monotonic_time () - started);
          return selected_server;
       }
    }
 
 FAIL:
    topology->stale = true;
+   mongoc_histogram_server_selection_record (
+      bson_get_monotonic_time () - started);
 
    return NULL;
 }
@@ -724,6 +738,56 @@ mongoc_topology_server_timestamp (mongoc_topology_t *topology,
    return timestamp;
 }
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_topology_get_data_server_ids --
+ *
+ *      Append to @ids, an array of uint32_t, the ids of the servers that
+ *      have been discovered and can take operations: standalones,
+ *      mongoses, primaries and secondaries.
+ *
+ *      NOTE: this method uses @topology's mutex.
+ *
+ *--------------------------------------------------------------------------
+ */
+void
+mongoc_topology_get_data_server_ids (mongoc_topology_t *topology,
+                                     mongoc_array_t    *ids)
+{
+   mongoc_server_description_t *sd;
+   mongoc_set_t *servers;
+   size_t i;
+
+   mongoc_mutex_lock (&topology->mutex);
+
+   servers = topology->description.servers;
+
+   for (i = 0; i < servers->items_len; i++) {
+      sd = (mongoc_server_description_t *)mongoc_set_get_item (servers,
+                                                               (int) i);
+
+      switch (sd->type) {
+      case MONGOC_SERVER_STANDALONE:
+      case MONGOC_SERVER_MONGOS:
+      case MONGOC_SERVER_RS_PRIMARY:
+      case MONGOC_SERVER_RS_SECONDARY:
+         _mongoc_array_append_val (ids, sd->id);
+         break;
+      case MONGOC_SERVER_UNKNOWN:
+      case MONGOC_SERVER_POSSIBLE_PRIMARY:
+      case MONGOC_SERVER_RS_ARBITER:
+      case MONGOC_SERVER_RS_OTHER:
+      case MONGOC_SERVER_RS_GHOST:
+      case MONGOC_SERVER_DESCRIPTION_TYPES:
+      default:
+         break;
+      }
+   }
+
+   mongoc_mutex_unlock (&topology->mutex);
+}
+
 /*
  *--------------------------------------------------------------------------
  *
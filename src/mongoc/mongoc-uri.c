@@ -24,6 +24,7 @@
 /* strcasecmp on windows */
 #include "mongoc-util-private.h"
 
+#include "mongoc-compression-private.h"
 #include "mongoc-host-list.h"
 #include "mongoc-host-list-private.h"
 #include "mongoc-log.h"
@@ -42,6 +43,7 @@ struct _mongoc_uri_t
    char                   *database;
    bson_t                  options;
    bson_t                  credentials;
+   bson_t                  compressors;
    mongoc_read_prefs_t    *read_prefs;
    mongoc_read_concern_t  *read_concern;
    mongoc_write_concern_t *write_concern;
@@ -450,6 +452,31 @@ mongoc_uri_parse_auth_mechanism_properties (mongoc_uri_t *uri,
    return true;
 }
 
+static void
+mongoc_uri_parse_compressors (mongoc_uri_t *uri, /* IN */
+                              const char   *str) /* IN */
+{
+   const char *end_name;
+   char *name;
+
+   while (*str) {
+      if (!(name = scan_to_unichar (str, ',', "", &end_name))) {
+         name = bson_strdup (str);
+         str = "";
+      } else {
+         str = end_name + 1;
+      }
+
+      if (!_mongoc_compressor_by_name (name)) {
+         MONGOC_WARNING ("Unsupported compressor: \"%s\"", name);
+      } else if (!bson_has_field (&uri->compressors, name)) {
+         bson_append_utf8 (&uri->compressors, name, -1, "yes", 3);
+      }
+
+      bson_free (name);
+   }
+}
+
 static void
 mongoc_uri_parse_tags (mongoc_uri_t *uri, /* IN */
                        const char   *str) /* IN */
@@ -548,7 +575,8 @@ mongoc_uri_option_is_int32 (const char *key)
        !strcasecmp(key, "maxidletimems") ||
        !strcasecmp(key, "waitqueuemultiple") ||
        !strcasecmp(key, "waitqueuetimeoutms") ||
-       !strcasecmp(key, "wtimeoutms");
+       !strcasecmp(key, "wtimeoutms") ||
+       !strcasecmp(key, "zlibcompressionlevel");
 }
 
 bool
@@ -570,7 +598,8 @@ mongoc_uri_option_is_utf8 (const char *key)
    }
 
    if (!strcasecmp(key, "readpreferencetags") ||
-         !strcasecmp(key, "authmechanismproperties")) {
+         !strcasecmp(key, "authmechanismproperties") ||
+         !strcasecmp(key, "compressors")) {
       return false;
    }
 
@@ -625,6 +654,8 @@ mongoc_uri_parse_option (mongoc_uri_t *uri,
    } else if (!strcasecmp(key, "authmechanism") ||
               !strcasecmp(key, "authsource")) {
       bson_append_utf8(&uri->credentials, key, -1, value, -1);
+   } else if (!strcasecmp(key, "compressors")) {
+      mongoc_uri_parse_compressors(uri, value);
    } else if (!strcasecmp(key, "readconcernlevel")) {
       mongoc_read_concern_set_level (uri->read_concern, value);
    } else if (!strcasecmp(key, "authmechanismproperties")) {
@@ -926,6 +957,7 @@ mongoc_uri_new (const char *uri_string)
    uri = (mongoc_uri_t *)bson_malloc0(sizeof *uri);
    bson_init(&uri->options);
    bson_init(&uri->credentials);
+   bson_init(&uri->compressors);
 
    /* Initialize read_prefs since tag parsing may add to it */
    uri->read_prefs = mongoc_read_prefs_new(MONGOC_READ_PRIMARY);
@@ -1110,6 +1142,29 @@ mongoc_uri_get_options (const mongoc_uri_t *uri)
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * mongoc_uri_get_compressors --
+ *
+ *       Get the compressors from the "compressors" URI option, in order
+ *       of preference, as a document whose keys are compressor names.
+ *       Names the driver does not support are left out.
+ *
+ * Returns:
+ *       A bson_t owned by @uri.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const bson_t *
+mongoc_uri_get_compressors (const mongoc_uri_t *uri)
+{
+   BSON_ASSERT (uri);
+   return &uri->compressors;
+}
+
+
 void
 mongoc_uri_destroy (mongoc_uri_t *uri)
 {
@@ -1120,6 +1175,7 @@ mongoc_uri_destroy (mongoc_uri_t *uri)
       bson_free(uri->username);
       bson_destroy(&uri->options);
       bson_destroy(&uri->credentials);
+      bson_destroy(&uri->compressors);
       mongoc_read_prefs_destroy(uri->read_prefs);
       mongoc_read_concern_destroy(uri->read_concern);
       mongoc_write_concern_destroy(uri->write_concern);
@@ -1158,6 +1214,7 @@ mongoc_uri_copy (const mongoc_uri_t *uri)
 
    bson_copy_to (&uri->options, &copy->options);
    bson_copy_to (&uri->credentials, &copy->credentials);
+   bson_copy_to (&uri->compressors, &copy->compressors);
 
    return copy;
 }
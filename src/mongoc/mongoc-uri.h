@@ -48,6 +48,7 @@ mongoc_uri_t                 *mongoc_uri_new_for_host_port        (const char
                                                                          uint16_t      port)
    BSON_GNUC_WARN_UNUSED_RESULT;
 const mongoc_host_list_t     *mongoc_uri_get_hosts                (const mongoc_uri_t *uri);
+const bson_t                 *mongoc_uri_get_compressors          (const mongoc_uri_t *uri);
 const char                   *mongoc_uri_get_database             (const mongoc_uri_t *uri);
 const bson_t                 *mongoc_uri_get_options              (const mongoc_uri_t *uri);
 const char                   *mongoc_uri_get_password             (const mongoc_uri_t *uri);
@@ -91,6 +91,32 @@ typedef struct
 } mongoc_write_result_t;
 
 
+/* the number of unordered write command batches sent before the first
+ * reply is awaited */
+#define MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT 4
+
+
+typedef struct
+{
+   int                     type;
+   uint32_t                offset;
+   int32_t                 request_id;
+} mongoc_write_batch_t;
+
+
+/* a ring of write command batches sent on one stream, awaiting replies */
+typedef struct
+{
+   mongoc_client_t        *client;
+   mongoc_server_stream_t *server_stream;
+   mongoc_write_batch_t   *batches;
+   uint32_t                max_in_flight;
+   uint32_t                head;
+   uint32_t                n_in_flight;
+   bool                    failed;  /* the stream had an error, don't use it */
+} mongoc_write_pipeline_t;
+
+
 void _mongoc_write_command_destroy     (mongoc_write_command_t        *command);
 void _mongoc_write_command_init_insert (mongoc_write_command_t        *command,
                                         const bson_t                  *document,
@@ -125,6 +151,21 @@ void _mongoc_write_command_execute     (mongoc_write_command_t        *command,
                                         const mongoc_write_concern_t  *write_concern,
                                         uint32_t                       offset,
                                         mongoc_write_result_t         *result);
+void _mongoc_write_command_execute_pipelined
+                                       (mongoc_write_command_t        *command,
+                                        mongoc_write_pipeline_t       *pipeline,
+                                        const char                    *database,
+                                        const char                    *collection,
+                                        const mongoc_write_concern_t  *write_concern,
+                                        uint32_t                       offset,
+                                        mongoc_write_result_t         *result);
+void _mongoc_write_pipeline_init       (mongoc_write_pipeline_t       *pipeline,
+                                        mongoc_client_t               *client,
+                                        mongoc_server_stream_t        *server_stream,
+                                        uint32_t                       max_in_flight);
+void _mongoc_write_pipeline_drain      (mongoc_write_pipeline_t       *pipeline,
+                                        mongoc_write_result_t         *result);
+void _mongoc_write_pipeline_destroy    (mongoc_write_pipeline_t       *pipeline);
 void _mongoc_write_result_init         (mongoc_write_result_t         *result);
 void _mongoc_write_result_merge        (mongoc_write_result_t         *result,
                                         mongoc_write_command_t        *command,
@@ -17,6 +17,7 @@
 #include <bson.h>
 
 #include "mongoc-client-private.h"
+#include "mongoc-cluster-private.h"
 #include "mongoc-error.h"
 #include "mongoc-trace.h"
 #include "mongoc-write-command-private.h"
@@ -58,6 +59,12 @@ _mongoc_write_result_merge_arrays (uint32_t               offset,
                                    bson_t                *dest,
                                    bson_iter_t           *iter);
 
+static void
+_mongoc_write_result_merge_type (mongoc_write_result_t *result,
+                                 int                    type,
+                                 const bson_t          *reply,
+                                 uint32_t               offset);
+
 void
 _mongoc_write_command_insert_append (mongoc_write_command_t *command,
                                      const bson_t           *document)
@@ -773,6 +780,220 @@ static mongoc_write_op_t gLegacyWriteOps[3] = {
    _mongoc_write_command_update_legacy };
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_pipeline_init --
+ *
+ *       Prepare to send up to @max_in_flight write command batches on
+ *       @server_stream before waiting for their replies. The caller
+ *       keeps @server_stream alive until the pipeline is drained.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_pipeline_init (mongoc_write_pipeline_t *pipeline,
+                             mongoc_client_t         *client,
+                             mongoc_server_stream_t  *server_stream,
+                             uint32_t                 max_in_flight)
+{
+   BSON_ASSERT (pipeline);
+   BSON_ASSERT (client);
+   BSON_ASSERT (server_stream);
+   BSON_ASSERT (max_in_flight > 0);
+
+   pipeline->client = client;
+   pipeline->server_stream = server_stream;
+   pipeline->batches = (mongoc_write_batch_t *)bson_malloc (
+      max_in_flight * sizeof *pipeline->batches);
+   pipeline->max_in_flight = max_in_flight;
+   pipeline->head = 0;
+   pipeline->n_in_flight = 0;
+   pipeline->failed = false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_pipeline_recv --
+ *
+ *       Receive the reply to the oldest batch in flight and merge it
+ *       into @result, like _mongoc_write_command does for a batch it
+ *       runs itself.
+ *
+ *       Once sending or receiving has failed, the cluster has already
+ *       disconnected the node and freed its stream, so the replies to
+ *       the remaining batches are taken to be empty.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_write_pipeline_recv (mongoc_write_pipeline_t *pipeline,
+                             mongoc_write_result_t   *result)
+{
+   mongoc_write_batch_t *batch;
+   mongoc_buffer_t buffer;
+   mongoc_rpc_t rpc;
+   bson_t reply;
+
+   ENTRY;
+
+   BSON_ASSERT (pipeline->n_in_flight);
+
+   batch = &pipeline->batches[pipeline->head];
+   pipeline->head = (pipeline->head + 1) % pipeline->max_in_flight;
+   pipeline->n_in_flight--;
+
+   if (pipeline->failed) {
+      bson_init (&reply);
+      _mongoc_write_result_merge_type (result, batch->type, &reply,
+                                       batch->offset);
+      bson_destroy (&reply);
+      EXIT;
+   }
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+
+   if (!_mongoc_client_recv (pipeline->client, &rpc, &buffer,
+                             pipeline->server_stream, batch->request_id,
+                             &result->error)) {
+      pipeline->failed = true;
+      result->failed = true;
+      bson_init (&reply);
+   } else if (rpc.header.opcode != MONGOC_OPCODE_REPLY ||
+              !_mongoc_rpc_reply_get_first (&rpc.reply, &reply)) {
+      bson_set_error (&result->error,
+                      MONGOC_ERROR_BSON,
+                      MONGOC_ERROR_BSON_INVALID,
+                      "Failed to decode reply BSON document.");
+      result->failed = true;
+      bson_init (&reply);
+   } else if (_mongoc_rpc_parse_command_error (&rpc, &result->error)) {
+      result->failed = true;
+   }
+
+   _mongoc_write_result_merge_type (result, batch->type, &reply,
+                                    batch->offset);
+
+   bson_destroy (&reply);
+   _mongoc_buffer_destroy (&buffer);
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_pipeline_send --
+ *
+ *       Send @cmd, a batch of @command starting at @offset, without
+ *       waiting for its reply. If the pipeline is full, first receive
+ *       the reply to the oldest batch in flight.
+ *
+ *       Nothing is sent once the pipeline has failed; the batch is
+ *       merged into @result with an empty reply instead.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_mongoc_write_pipeline_send (mongoc_write_pipeline_t *pipeline,
+                             mongoc_write_command_t  *command,
+                             const char              *database,
+                             const bson_t            *cmd,
+                             uint32_t                 offset,
+                             mongoc_write_result_t   *result)
+{
+   char ns[MONGOC_NAMESPACE_MAX];
+   mongoc_write_batch_t *batch;
+   mongoc_rpc_t rpc;
+   bson_t reply;
+
+   ENTRY;
+
+   if (pipeline->n_in_flight == pipeline->max_in_flight) {
+      _mongoc_write_pipeline_recv (pipeline, result);
+   }
+
+   if (pipeline->failed) {
+      bson_init (&reply);
+      _mongoc_write_result_merge (result, command, &reply, offset);
+      bson_destroy (&reply);
+      EXIT;
+   }
+
+   bson_snprintf (ns, sizeof ns, "%s.$cmd", database);
+   _mongoc_rpc_prep_command (&rpc, ns, cmd, MONGOC_QUERY_NONE);
+
+   if (!mongoc_cluster_sendv_to_server (&pipeline->client->cluster, &rpc, 1,
+                                        pipeline->server_stream, NULL,
+                                        &result->error)) {
+      pipeline->failed = true;
+      result->failed = true;
+      bson_init (&reply);
+      _mongoc_write_result_merge (result, command, &reply, offset);
+      bson_destroy (&reply);
+      EXIT;
+   }
+
+   batch = &pipeline->batches[(pipeline->head + pipeline->n_in_flight) %
+                              pipeline->max_in_flight];
+   batch->type = command->type;
+   batch->offset = offset;
+   batch->request_id = BSON_UINT32_FROM_LE (rpc.header.request_id);
+   pipeline->n_in_flight++;
+
+   EXIT;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_pipeline_drain --
+ *
+ *       Receive the replies to all batches in flight, oldest first, and
+ *       merge them into @result.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_pipeline_drain (mongoc_write_pipeline_t *pipeline,
+                              mongoc_write_result_t   *result)
+{
+   ENTRY;
+
+   BSON_ASSERT (pipeline);
+
+   while (pipeline->n_in_flight) {
+      _mongoc_write_pipeline_recv (pipeline, result);
+   }
+
+   EXIT;
+}
+
+
+void
+_mongoc_write_pipeline_destroy (mongoc_write_pipeline_t *pipeline)
+{
+   BSON_ASSERT (pipeline);
+   BSON_ASSERT (!pipeline->n_in_flight);
+
+   bson_free (pipeline->batches);
+}
+
+
+/*
+ * Run @command as one or more write commands. If @pipeline is set, the
+ * command is unordered and its batches are sent on the pipeline's
+ * stream without waiting for each reply; they are merged into @result
+ * as they are received, at the latest by _mongoc_write_pipeline_drain.
+ */
 static void
 _mongoc_write_command(mongoc_write_command_t       *command,
                       mongoc_client_t              *client,
@@ -781,6 +1002,7 @@ _mongoc_write_command(mongoc_write_command_t       *command,
                       const char                   *collection,
                       const mongoc_write_concern_t *write_concern,
                       uint32_t                      offset,
+                      mongoc_write_pipeline_t      *pipeline,
                       mongoc_write_result_t        *result,
                       bson_error_t                 *error)
 {
@@ -904,10 +1126,16 @@ again:
       too_large_error (error, i, len, max_bson_obj_size, NULL);
       result->failed = true;
       ret = false;
+   } else if (pipeline) {
+      _mongoc_write_pipeline_send (pipeline, command, database, &cmd,
+                                   offset, result);
+      offset += i;
    } else {
-      ret = mongoc_cluster_run_command (&client->cluster, server_stream->stream,
-                                        MONGOC_QUERY_NONE, database, &cmd,
-                                        &reply, error);
+      ret = mongoc_cluster_run_command_server_stream (&client->cluster,
+                                                      server_stream,
+                                                      MONGOC_QUERY_NONE,
+                                                      database, &cmd,
+                                                      &reply, error);
 
       if (!ret) {
          result->failed = true;
@@ -928,15 +1156,17 @@ again:
 }
 
 
-void
-_mongoc_write_command_execute (mongoc_write_command_t       *command,       /* IN */
-                               mongoc_client_t              *client,        /* IN */
-                               mongoc_server_stream_t       *server_stream, /* IN */
-                               const char                   *database,      /* IN */
-                               const char                   *collection,    /* IN */
-                               const mongoc_write_concern_t *write_concern, /* IN */
-                               uint32_t                      offset,        /* IN */
-                               mongoc_write_result_t        *result)        /* OUT */
+static void
+_mongoc_write_command_execute_internal (
+   mongoc_write_command_t       *command,
+   mongoc_client_t              *client,
+   mongoc_server_stream_t       *server_stream,
+   const char                   *database,
+   const char                   *collection,
+   const mongoc_write_concern_t *write_concern,
+   uint32_t                      offset,
+   mongoc_write_pipeline_t      *pipeline,
+   mongoc_write_result_t        *result)
 {
    ENTRY;
 
@@ -968,7 +1198,7 @@ _mongoc_write_command_execute (mongoc_write_command_t       *command,       /* I
 
    if (server_stream->sd->max_wire_version >= WIRE_VERSION_WRITE_CMD) {
       _mongoc_write_command (command, client, server_stream, database,
-                             collection, write_concern, offset,
+                             collection, write_concern, offset, pipeline,
                              result, &result->error);
    } else {
       gLegacyWriteOps[command->type] (command, client, server_stream, database,
@@ -980,6 +1210,59 @@ _mongoc_write_command_execute (mongoc_write_command_t       *command,       /* I
 }
 
 
+void
+_mongoc_write_command_execute (mongoc_write_command_t       *command,       /* IN */
+                               mongoc_client_t              *client,        /* IN */
+                               mongoc_server_stream_t       *server_stream, /* IN */
+                               const char                   *database,      /* IN */
+                               const char                   *collection,    /* IN */
+                               const mongoc_write_concern_t *write_concern, /* IN */
+                               uint32_t                      offset,        /* IN */
+                               mongoc_write_result_t        *result)        /* OUT */
+{
+   _mongoc_write_command_execute_internal (command, client, server_stream,
+                                           database, collection,
+                                           write_concern, offset, NULL,
+                                           result);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _mongoc_write_command_execute_pipelined --
+ *
+ *       Like _mongoc_write_command_execute for an unordered @command, but
+ *       write command batches are sent on @pipeline without waiting for
+ *       replies. @result is complete once the pipeline is drained.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_mongoc_write_command_execute_pipelined (mongoc_write_command_t       *command,       /* IN */
+                                         mongoc_write_pipeline_t      *pipeline,      /* IN */
+                                         const char                   *database,      /* IN */
+                                         const char                   *collection,    /* IN */
+                                         const mongoc_write_concern_t *write_concern, /* IN */
+                                         uint32_t                      offset,        /* IN */
+                                         mongoc_write_result_t        *result)        /* OUT */
+{
+   BSON_ASSERT (pipeline);
+   BSON_ASSERT (!command->flags.ordered);
+
+   if (pipeline->failed) {
+      /* the stream is gone and the error is already in @result */
+      return;
+   }
+
+   _mongoc_write_command_execute_internal (command, pipeline->client,
+                                           pipeline->server_stream, database,
+                                           collection, write_concern, offset,
+                                           pipeline, result);
+}
+
+
 void
 _mongoc_write_command_destroy (mongoc_write_command_t *command)
 {
@@ -1278,6 +1561,20 @@ _mongoc_write_result_merge (mongoc_write_result_t  *result,  /* IN */
                             mongoc_write_command_t *command, /* IN */
                             const bson_t           *reply,   /* IN */
                             uint32_t                offset)
+{
+   _mongoc_write_result_merge_type (result, command->type, reply, offset);
+}
+
+
+/*
+ * Merge the reply to a write command of @type, one of
+ * MONGOC_WRITE_COMMAND_DELETE, INSERT, or UPDATE, into @result.
+ */
+static void
+_mongoc_write_result_merge_type (mongoc_write_result_t *result, /* IN */
+                                 int                    type,   /* IN */
+                                 const bson_t          *reply,  /* IN */
+                                 uint32_t               offset)
 {
    int32_t server_index = 0;
    const bson_value_t *value;
@@ -1304,7 +1601,7 @@ _mongoc_write_result_merge (mongoc_write_result_t  *result,  /* IN */
       result->failed = true;
    }
 
-   switch (command->type) {
+   switch (type) {
    case MONGOC_WRITE_COMMAND_INSERT:
       result->nInserted += affected;
       break;
@@ -22,6 +22,8 @@
 #include <bson.h>
 
 #define MONGOC_INSIDE
+#include "mongoc-apm.h"
+#include "mongoc-async.h"
 #include "mongoc-bulk-operation.h"
 #include "mongoc-client.h"
 #include "mongoc-client-pool.h"
@@ -40,6 +42,7 @@
 #include "mongoc-init.h"
 #include "mongoc-matcher.h"
 #include "mongoc-opcode.h"
+#include "mongoc-parallel-scan.h"
 #include "mongoc-log.h"
 #include "mongoc-socket.h"
 #include "mongoc-stream.h"
@@ -52,7 +52,10 @@ typedef struct
    uint32_t n_counters;
    uint32_t infos_offset;
    uint32_t values_offset;
-   uint8_t  padding[44];
+   uint32_t n_histograms;
+   uint32_t histogram_infos_offset;
+   uint32_t histogram_values_offset;
+   uint8_t  padding[32];
 } mongoc_counters_t;
 #pragma pack()
 
@@ -75,6 +78,31 @@ typedef struct
 } mongoc_counter_t;
 
 
+#pragma pack(1)
+typedef struct
+{
+   uint32_t offset;
+   uint32_t n_buckets;
+   char          category[24];
+   char          name[32];
+   char          description[64];
+} mongoc_histogram_info_t;
+#pragma pack()
+
+
+BSON_STATIC_ASSERT(sizeof(mongoc_histogram_info_t) == 128);
+
+
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_N_BUCKETS   240
+
+
+typedef struct
+{
+   int64_t buckets[HISTOGRAM_N_BUCKETS];
+} mongoc_histogram_slots_t;
+
+
 static mongoc_counters_t *
 mongoc_counters_new_from_pid (unsigned pid)
 {
@@ -194,10 +222,105 @@ mongoc_counters_print_info (mongoc_counters_t     *counters,
 }
 
 
+/* the largest value counted in @bucket, see mongoc-counters-private.h.
+ * the last bucket counts everything from 2^32 usec on. */
+static int64_t
+mongoc_histogram_bucket_max (uint32_t bucket)
+{
+   uint32_t exp;
+   uint32_t sub;
+
+   if (bucket < 2 * HISTOGRAM_SUB_BUCKETS) {
+      return bucket;
+   } else if (bucket >= HISTOGRAM_N_BUCKETS - 1) {
+      return (int64_t)1 << 32;
+   }
+
+   exp = 4 + (bucket - 2 * HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS;
+   sub = (bucket - 2 * HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+
+   return ((int64_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (exp - 3)) - 1;
+}
+
+
+/* the upper bound of the bucket holding the @permille'th value */
+static int64_t
+mongoc_histogram_percentile (const int64_t *buckets,
+                             int64_t        count,
+                             int            permille)
+{
+   int64_t rank;
+   int64_t seen = 0;
+   uint32_t i;
+
+   rank = (count * permille + 999) / 1000;
+
+   for (i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= rank && seen > 0) {
+         return mongoc_histogram_bucket_max (i);
+      }
+   }
+
+   return 0;
+}
+
+
+static void
+mongoc_histograms_print_info (mongoc_counters_t       *counters,
+                              mongoc_histogram_info_t *info,
+                              FILE                    *file)
+{
+   mongoc_histogram_slots_t *cpus;
+   int64_t buckets[HISTOGRAM_N_BUCKETS] = { 0 };
+   int64_t count = 0;
+   int64_t max = 0;
+   unsigned i;
+   uint32_t j;
+
+   BSON_ASSERT (info);
+   BSON_ASSERT (file);
+   BSON_ASSERT ((info->offset & 0x7) == 0);
+   BSON_ASSERT (info->n_buckets == HISTOGRAM_N_BUCKETS);
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+   cpus = (mongoc_histogram_slots_t *)(((char *)counters) + info->offset);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+   for (i = 0; i < counters->n_cpu; i++) {
+      for (j = 0; j < HISTOGRAM_N_BUCKETS; j++) {
+         buckets[j] += cpus[i].buckets[j];
+      }
+   }
+
+   for (j = 0; j < HISTOGRAM_N_BUCKETS; j++) {
+      if (buckets[j]) {
+         count += buckets[j];
+         max = mongoc_histogram_bucket_max (j);
+      }
+   }
+
+   fprintf(file, "%24s : %-24s : %-50s : count=%lld p50=%lld p99=%lld "
+           "p99.9=%lld max=%lld\n",
+           info->category, info->name, info->description,
+           (long long)count,
+           (long long)mongoc_histogram_percentile (buckets, count, 500),
+           (long long)mongoc_histogram_percentile (buckets, count, 990),
+           (long long)mongoc_histogram_percentile (buckets, count, 999),
+           (long long)max);
+}
+
+
 int
 main (int   argc,
       char *argv[])
 {
+   mongoc_histogram_info_t *histogram_infos;
    mongoc_counter_info_t *infos;
    mongoc_counters_t *counters;
    uint32_t n_counters = 0;
@@ -220,6 +343,13 @@ main (int   argc,
       mongoc_counters_print_info (counters, &infos[i], stdout);
    }
 
+   /* segments of older processes have no histograms, n_histograms is 0 */
+   histogram_infos = (mongoc_histogram_info_t *)
+      (((char *)counters) + counters->histogram_infos_offset);
+   for (i = 0; i < counters->n_histograms; i++) {
+      mongoc_histograms_print_info (counters, &histogram_infos[i], stdout);
+   }
+
    mongoc_counters_destroy (counters);
 
    return EXIT_SUCCESS;
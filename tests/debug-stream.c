@@ -107,7 +107,11 @@ _mongoc_stream_debug_writev (mongoc_stream_t *stream,
                              size_t           iovcnt,
                              int32_t          timeout_msec)
 {
-   return mongoc_stream_writev (((mongoc_stream_debug_t *) stream)->wrapped,
+   mongoc_stream_debug_t *debug_stream = (mongoc_stream_debug_t *) stream;
+
+   debug_stream->stats->n_writev++;
+
+   return mongoc_stream_writev (debug_stream->wrapped,
                                 iov,
                                 iovcnt,
                                 timeout_msec);
@@ -1645,23 +1645,24 @@ mock_server_reply_multi (request_t           *request,
    server = request->server;
    client = request->client;
 
-   docs_json = bson_string_new ("");
-   for (i = 0; i < n_docs; i++) {
-      doc_json = bson_as_json (&docs[i], NULL);
-      bson_string_append (docs_json, doc_json);
-      bson_free (doc_json);
-      if (i < n_docs - 1) {
-         bson_string_append (docs_json, ", ");
+   if (mock_server_get_verbose (request->server)) {
+      docs_json = bson_string_new ("");
+      for (i = 0; i < n_docs; i++) {
+         doc_json = bson_as_json (&docs[i], NULL);
+         bson_string_append (docs_json, doc_json);
+         bson_free (doc_json);
+         if (i < n_docs - 1) {
+            bson_string_append (docs_json, ", ");
+         }
       }
-   }
 
-   if (mock_server_get_verbose (request->server)) {
       printf ("%5.2f  %hu <- %hu \t%s\n",
               mock_server_get_uptime_sec (request->server),
               request->client_port,
               mock_server_get_port (request->server),
               docs_json->str);
       fflush (stdout);
+      bson_string_free (docs_json, true);
    }
 
    len = 0;
@@ -1711,7 +1712,6 @@ mock_server_reply_multi (request_t           *request,
 
    assert (n_written == expected);
 
-   bson_string_free (docs_json, true);
    _mongoc_array_destroy (&ar);
    bson_free (buf);
 }
@@ -15,6 +15,7 @@
  */
 
 
+#include <mongoc-compression-private.h>
 #include <mongoc-rpc-private.h>
 #include "mongoc.h"
 
@@ -50,10 +51,32 @@ request_new (const mongoc_buffer_t *buffer,
              uint16_t client_port)
 {
    request_t *request = (request_t *)bson_malloc0 (sizeof *request);
+   mongoc_buffer_t msg;
+   bson_error_t error;
+   int32_t opcode;
    uint8_t *data;
 
+   _mongoc_buffer_init (&msg, NULL, 0, NULL, NULL);
+   _mongoc_buffer_append (&msg, buffer->data + buffer->off, (size_t) msg_len);
+
+   /* decompress OP_COMPRESSED, remembering that the client compressed */
+   memcpy (&opcode, msg.data + 12, 4);
+   request->compressor_id = MONGOC_COMPRESSOR_NONE_ID;
+   if (BSON_UINT32_FROM_LE (opcode) == MONGOC_OPCODE_COMPRESSED &&
+       msg_len >= MONGOC_COMPRESSED_HEADER_LEN) {
+      request->compressor_id = msg.data[24];
+   }
+
+   if (!_mongoc_rpc_decompress (&msg, 0, INT32_MAX, &msg_len, &error)) {
+      MONGOC_WARNING ("%s():%d: %s", BSON_FUNC, __LINE__, error.message);
+      _mongoc_buffer_destroy (&msg);
+      bson_free (request);
+      return NULL;
+   }
+
    data = (uint8_t *)bson_malloc ((size_t)msg_len);
-   memcpy (data, buffer->data + buffer->off, (size_t) msg_len);
+   memcpy (data, msg.data + msg.off, (size_t) msg_len);
+   _mongoc_buffer_destroy (&msg);
    request->data = data;
    request->data_len = (size_t) msg_len;
 
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2015 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Counts the heap allocations the driver makes per operation, for small
+ * documents against a running server:
+ *
+ *    test-allocs [URI] [ITERATIONS]
+ *
+ * To measure a change, build this before and after it and run both
+ * against the same server with the same ITERATIONS.
+ */
+
+#include <mongoc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static volatile int64_t gAllocs;
+
+
+static void *
+counting_malloc (size_t num_bytes)
+{
+   bson_atomic_int64_add (&gAllocs, 1);
+   return malloc (num_bytes);
+}
+
+
+static void *
+counting_calloc (size_t n_members,
+                 size_t num_bytes)
+{
+   bson_atomic_int64_add (&gAllocs, 1);
+   return calloc (n_members, num_bytes);
+}
+
+
+static void *
+counting_realloc (void   *mem,
+                  size_t  num_bytes)
+{
+   if (num_bytes) {
+      bson_atomic_int64_add (&gAllocs, 1);
+   }
+
+   return realloc (mem, num_bytes);
+}
+
+
+static void
+report (const char *name,
+        int64_t     allocs,
+        unsigned    iterations)
+{
+   printf ("%-10s %8.2f allocations/op\n", name, (double) allocs / iterations);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+   bson_mem_vtable_t vtable = { counting_malloc, counting_calloc,
+                                counting_realloc, free };
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_error_t error;
+   unsigned iterations = 10000;
+   unsigned i;
+   int64_t start;
+   bson_t *ping;
+   bson_t reply;
+   bson_t *small;
+   bson_t *query;
+
+   mongoc_init ();
+
+   client = mongoc_client_new (argc > 1 ? argv[1] :
+                               "mongodb://127.0.0.1:27017");
+   if (!client) {
+      fprintf (stderr, "Failed to parse URI\n");
+      return 1;
+   }
+
+   if (argc > 2) {
+      iterations = (unsigned) BSON_MAX (atoi (argv[2]), 1);
+   }
+
+   collection = mongoc_client_get_collection (client, "test", "test_allocs");
+   ping = BCON_NEW ("ping", BCON_INT32 (1));
+   small = BCON_NEW ("_id", BCON_INT32 (1), "x", BCON_UTF8 ("small"));
+   query = BCON_NEW ("_id", BCON_INT32 (1));
+
+   /* connect, and give the collection its document */
+   mongoc_collection_drop (collection, NULL);
+   if (!mongoc_client_command_simple (client, "admin", ping, NULL, NULL,
+                                      &error) ||
+       !mongoc_collection_insert (collection, MONGOC_INSERT_NONE, small,
+                                  NULL, &error)) {
+      fprintf (stderr, "%s\n", error.message);
+      return 1;
+   }
+
+   bson_mem_set_vtable (&vtable);
+
+   start = gAllocs;
+   for (i = 0; i < iterations; i++) {
+      mongoc_client_command_simple (client, "admin", ping, NULL, &reply, NULL);
+      bson_destroy (&reply);
+   }
+   report ("command", gAllocs - start, iterations);
+
+   start = gAllocs;
+   for (i = 0; i < iterations; i++) {
+      cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 1, 0,
+                                       query, NULL, NULL);
+      while (mongoc_cursor_next (cursor, &doc)) { }
+      mongoc_cursor_destroy (cursor);
+   }
+   report ("find", gAllocs - start, iterations);
+
+   start = gAllocs;
+   for (i = 0; i < iterations; i++) {
+      mongoc_collection_update (collection, MONGOC_UPDATE_NONE, query, small,
+                                NULL, NULL);
+   }
+   report ("update", gAllocs - start, iterations);
+
+   bson_mem_restore_vtable ();
+
+   mongoc_collection_drop (collection, NULL);
+
+   bson_destroy (ping);
+   bson_destroy (small);
+   bson_destroy (query);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+
+   mongoc_cleanup ();
+
+   return 0;
+}
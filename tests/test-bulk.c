@@ -2829,6 +2829,345 @@ test_hint_pooled_command_primary (void)
    _test_bulk_hint (true, true, true);
 }
 
+static void
+test_unordered_pipelined (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   future_t *future;
+   request_t *requests[3];
+   bson_t reply;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ismaster': true,"
+                                      " 'maxWireVersion': 3,"
+                                      " 'maxWriteBatchSize': 2}");
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+
+   for (i = 0; i < 5; i++) {
+      mongoc_bulk_operation_insert (bulk, tmp_bson (i % 2 ? "{'x': 1}"
+                                                          : "{'x': 0}"));
+   }
+
+   future = future_bulk_operation_execute (bulk, &reply, &error);
+
+   /* all three batches are sent before any reply */
+   for (i = 0; i < 3; i++) {
+      requests[i] = mock_server_receives_command (
+         server, "test", MONGOC_QUERY_NONE,
+         "{'insert': 'test', 'ordered': false, 'documents': [{'x': 0}%s]}",
+         i < 2 ? ", {'x': 1}" : "");
+      assert (requests[i]);
+   }
+
+   /* replies are matched to batches whatever order they arrive in */
+   mock_server_replies_simple (requests[2], "{'ok': 1, 'n': 1}");
+   mock_server_replies_simple (
+      requests[1],
+      "{'ok': 1, 'n': 1,"
+      " 'writeErrors': [{'index': 1, 'code': 11000, 'errmsg': 'dupe'}]}");
+   mock_server_replies_simple (requests[0], "{'ok': 1, 'n': 2}");
+
+   assert (!future_get_uint32_t (future));
+   ASSERT_MATCH (&reply, "{'nInserted': 4,"
+                         " 'writeErrors': [{'index': 3, 'code': 11000}]}");
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_COMMAND);
+   ASSERT_CMPINT (error.code, ==, 11000);
+
+   for (i = 0; i < 3; i++) {
+      request_destroy (requests[i]);
+   }
+
+   future_destroy (future);
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_unordered_pipelined_hangup (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   future_t *future;
+   request_t *requests[MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT];
+   bson_t reply;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ismaster': true,"
+                                      " 'maxWireVersion': 3,"
+                                      " 'maxWriteBatchSize': 2}");
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+
+   /* one more batch than can be in flight */
+   for (i = 0; i < 2 * MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT + 1; i++) {
+      mongoc_bulk_operation_insert (bulk, tmp_bson ("{'x': 1}"));
+   }
+
+   future = future_bulk_operation_execute (bulk, &reply, &error);
+
+   for (i = 0; i < MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT; i++) {
+      requests[i] = mock_server_receives_command (
+         server, "test", MONGOC_QUERY_NONE,
+         "{'insert': 'test', 'ordered': false}");
+      assert (requests[i]);
+   }
+
+   /* the stream is freed, the last batch isn't sent and the replies to
+    * the others aren't read from it */
+   mock_server_hangs_up (requests[0]);
+
+   assert (!future_get_uint32_t (future));
+   ASSERT_MATCH (&reply, "{'nInserted': 0}");
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+   ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_STREAM_SOCKET);
+
+   for (i = 0; i < MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT; i++) {
+      request_destroy (requests[i]);
+   }
+
+   future_destroy (future);
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_streaming (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   future_t *future;
+   request_t *requests[3];
+   bson_t reply;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ismaster': true,"
+                                      " 'maxWireVersion': 3,"
+                                      " 'maxWriteBatchSize': 2}");
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+   mongoc_bulk_operation_set_streaming (bulk, true);
+   mongoc_bulk_operation_set_max_in_flight (bulk, 2);
+
+   /* a full batch is sent at once */
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 0}"));
+   ASSERT_CMPSIZE_T (bulk->commands.len, ==, (size_t) 1);
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 1}"));
+   ASSERT_CMPSIZE_T (bulk->commands.len, ==, (size_t) 0);
+
+   requests[0] = mock_server_receives_command (
+      server, "test", MONGOC_QUERY_NONE,
+      "{'insert': 'test', 'documents': [{'_id': 0}, {'_id': 1}]}");
+
+   /* a command is sent once an operation of another kind follows it */
+   mongoc_bulk_operation_remove (bulk, tmp_bson ("{'_id': 0}"));
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'_id': 2}"));
+   ASSERT_CMPSIZE_T (bulk->commands.len, ==, (size_t) 1);
+
+   requests[1] = mock_server_receives_command (
+      server, "test", MONGOC_QUERY_NONE,
+      "{'delete': 'test', 'deletes': [{'q': {'_id': 0}}]}");
+
+   /* two batches are in flight, the last waits for the first reply */
+   future = future_bulk_operation_execute (bulk, &reply, &error);
+   mock_server_replies_simple (requests[1], "{'ok': 1, 'n': 1}");
+   mock_server_replies_simple (requests[0], "{'ok': 1, 'n': 2}");
+
+   requests[2] = mock_server_receives_command (
+      server, "test", MONGOC_QUERY_NONE,
+      "{'insert': 'test', 'documents': [{'_id': 2}]}");
+   mock_server_replies_simple (requests[2], "{'ok': 1, 'n': 1}");
+
+   ASSERT_OR_PRINT (future_get_uint32_t (future), error);
+   ASSERT_MATCH (&reply, "{'nInserted': 3, 'nRemoved': 1, 'writeErrors': []}");
+
+   for (i = 0; i < 3; i++) {
+      request_destroy (requests[i]);
+   }
+
+   future_destroy (future);
+   bson_destroy (&reply);
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+_test_streaming_hangup (bool execute)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   request_t *requests[2];
+   bson_t reply;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ismaster': true,"
+                                      " 'maxWireVersion': 3,"
+                                      " 'maxWriteBatchSize': 1}");
+   mock_server_run (server);
+
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "test", "test");
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+   mongoc_bulk_operation_set_streaming (bulk, true);
+   mongoc_bulk_operation_set_max_in_flight (bulk, 2);
+
+   /* each batch holds one document, two are in flight */
+   for (i = 0; i < 2; i++) {
+      mongoc_bulk_operation_insert (bulk, tmp_bson ("{'x': 1}"));
+      requests[i] = mock_server_receives_command (
+         server, "test", MONGOC_QUERY_NONE, "{'insert': 'test'}");
+      assert (requests[i]);
+   }
+
+   mock_server_hangs_up (requests[0]);
+
+   /* the pipeline is full, awaiting the reply fails and later batches
+    * aren't sent on the freed stream */
+   for (i = 0; i < 3; i++) {
+      mongoc_bulk_operation_insert (bulk, tmp_bson ("{'x': 1}"));
+   }
+
+   if (execute) {
+      assert (!mongoc_bulk_operation_execute (bulk, &reply, &error));
+      ASSERT_MATCH (&reply, "{'nInserted': 0}");
+      ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+      ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_STREAM_SOCKET);
+      bson_destroy (&reply);
+   }
+
+   /* without execute(), destroy drains the pipeline */
+   mongoc_bulk_operation_destroy (bulk);
+
+   for (i = 0; i < 2; i++) {
+      request_destroy (requests[i]);
+   }
+
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_streaming_hangup_execute (void)
+{
+   _test_streaming_hangup (true);
+}
+
+
+static void
+test_streaming_hangup_destroy (void)
+{
+   _test_streaming_hangup (false);
+}
+
+
+static void
+test_streaming_set_late (void)
+{
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+
+   client = mongoc_client_new ("mongodb://localhost/");
+   collection = mongoc_client_get_collection (client, "test", "test");
+   bulk = mongoc_collection_create_bulk_operation (collection, false, NULL);
+   mongoc_bulk_operation_insert (bulk, tmp_bson ("{'x': 1}"));
+
+   /* ignored once an operation is added */
+   suppress_one_message ();
+   mongoc_bulk_operation_set_streaming (bulk, true);
+   assert (!bulk->streaming);
+
+   suppress_one_message ();
+   mongoc_bulk_operation_set_max_in_flight (bulk, 1);
+   ASSERT_CMPINT ((int) bulk->max_in_flight, ==,
+                  MONGOC_WRITE_PIPELINE_MAX_IN_FLIGHT);
+
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+}
+
+
+static void
+test_streaming_ordered_error (void)
+{
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   bson_t reply;
+   bson_error_t error;
+   bson_t *doc;
+   uint32_t r;
+   int i;
+
+   client = test_framework_client_new ();
+   collection = get_test_collection (client, "test_streaming_ordered_error");
+   bulk = mongoc_collection_create_bulk_operation (collection, true, NULL);
+   mongoc_bulk_operation_set_streaming (bulk, true);
+
+   /* more than one batch, with a duplicate key in the first */
+   for (i = 0; i < 2500; i++) {
+      doc = BCON_NEW ("_id", BCON_INT32 (i == 1 ? 0 : i));
+      mongoc_bulk_operation_insert (bulk, doc);
+      bson_destroy (doc);
+   }
+
+   r = mongoc_bulk_operation_execute (bulk, &reply, &error);
+   assert (!r);
+   ASSERT_MATCH (&reply, "{'nInserted': 1,"
+                         " 'writeErrors': [{'index': 1, 'code': 11000}]}");
+   ASSERT_CMPINT (error.code, ==, 11000);
+   ASSERT_CMPINT ((int) mongoc_collection_count (collection,
+                                                 MONGOC_QUERY_NONE, NULL,
+                                                 0, 0, NULL, NULL), ==, 1);
+
+   bson_destroy (&reply);
+   mongoc_collection_drop (collection, NULL);
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+}
+
+
 void
 test_bulk_install (TestSuite *suite)
 {
@@ -2943,4 +3282,18 @@ test_bulk_install (TestSuite *suite)
                   test_hint_pooled_command_secondary);
    TestSuite_Add (suite, "/BulkOperation/hint/pooled/command/primary",
                   test_hint_pooled_command_primary);
+   TestSuite_Add (suite, "/BulkOperation/unordered/pipelined",
+                  test_unordered_pipelined);
+   TestSuite_Add (suite, "/BulkOperation/unordered/pipelined/hangup",
+                  test_unordered_pipelined_hangup);
+   TestSuite_Add (suite, "/BulkOperation/streaming",
+                  test_streaming);
+   TestSuite_Add (suite, "/BulkOperation/streaming/hangup/execute",
+                  test_streaming_hangup_execute);
+   TestSuite_Add (suite, "/BulkOperation/streaming/hangup/destroy",
+                  test_streaming_hangup_destroy);
+   TestSuite_Add (suite, "/BulkOperation/streaming/set_late",
+                  test_streaming_set_late);
+   TestSuite_Add (suite, "/BulkOperation/streaming/ordered_error",
+                  test_streaming_ordered_error);
 }
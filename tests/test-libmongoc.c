@@ -31,6 +31,7 @@
 #include "test-libmongoc.h"
 
 
+extern void test_apm_install                     (TestSuite *suite);
 extern void test_array_install                   (TestSuite *suite);
 extern void test_async_install                   (TestSuite *suite);
 extern void test_buffer_install                  (TestSuite *suite);
@@ -40,6 +41,7 @@ extern void test_client_pool_install             (TestSuite *suite);
 extern void test_cluster_install                 (TestSuite *suite);
 extern void test_collection_install              (TestSuite *suite);
 extern void test_collection_find_install         (TestSuite *suite);
+extern void test_counters_install                (TestSuite *suite);
 extern void test_cursor_install                  (TestSuite *suite);
 extern void test_database_install                (TestSuite *suite);
 extern void test_exhaust_install                 (TestSuite *suite);
@@ -49,6 +51,7 @@ extern void test_gridfs_install                  (TestSuite *suite);
 extern void test_list_install                    (TestSuite *suite);
 extern void test_log_install                     (TestSuite *suite);
 extern void test_matcher_install                 (TestSuite *suite);
+extern void test_parallel_scan_install           (TestSuite *suite);
 extern void test_queue_install                   (TestSuite *suite);
 extern void test_read_prefs_install              (TestSuite *suite);
 extern void test_rpc_install                     (TestSuite *suite);
@@ -69,6 +72,7 @@ extern void test_version_install                 (TestSuite *suite);
 extern void test_write_command_install           (TestSuite *suite);
 extern void test_write_concern_install           (TestSuite *suite);
 #ifdef MONGOC_ENABLE_SSL
+extern void test_scram_install                   (TestSuite *suite);
 extern void test_x509_install                    (TestSuite *suite);
 extern void test_stream_tls_install              (TestSuite *suite);
 extern void test_stream_tls_error_install        (TestSuite *suite);
@@ -1232,6 +1236,7 @@ main (int   argc,
    TestSuite_Init (&suite, "", argc, argv);
    TestSuite_Add (&suite, "/TestSuite/version_cmp", test_version_cmp);
 
+   test_apm_install (&suite);
    test_array_install (&suite);
    test_async_install (&suite);
    test_buffer_install (&suite);
@@ -1242,6 +1247,7 @@ main (int   argc,
    test_cluster_install (&suite);
    test_collection_install (&suite);
    test_collection_find_install (&suite);
+   test_counters_install (&suite);
    test_cursor_install (&suite);
    test_database_install (&suite);
    test_exhaust_install (&suite);
@@ -1251,6 +1257,7 @@ main (int   argc,
    test_list_install (&suite);
    test_log_install (&suite);
    test_matcher_install (&suite);
+   test_parallel_scan_install (&suite);
    test_queue_install (&suite);
    test_read_prefs_install (&suite);
    test_rpc_install (&suite);
@@ -1270,6 +1277,7 @@ main (int   argc,
    test_version_install (&suite);
    test_write_concern_install (&suite);
 #ifdef MONGOC_ENABLE_SSL
+   test_scram_install (&suite);
    test_x509_install (&suite);
    test_stream_tls_install (&suite);
    test_stream_tls_error_install (&suite);
@@ -66,8 +66,11 @@ typedef struct _debug_stream_stats_t {
    mongoc_client_t *client;
    int n_destroyed;
    int n_failed;
+   int n_writev;
 } debug_stream_stats_t;
 
+mongoc_stream_t *debug_stream_new (mongoc_stream_t *stream,
+                                   debug_stream_stats_t *stats);
 void test_framework_set_debug_stream (mongoc_client_t *client,
                                       debug_stream_stats_t *stats);
 
@@ -0,0 +1,372 @@
+#include <mongoc.h>
+
+#include "mongoc-client-private.h"
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+#include "test-conveniences.h"
+#include "mock_server/future-functions.h"
+#include "mock_server/mock-server.h"
+
+
+typedef struct
+{
+   int          n_started;
+   int          n_succeeded;
+   int          n_failed;
+   char         command_name[32];
+   char         database_name[32];
+   bson_t       command;
+   bson_t       reply;
+   uint32_t     reply_size;
+   int32_t      started_request_id;
+   int32_t      request_id;
+   int64_t      duration;
+   uint16_t     port;
+   bson_error_t error;
+} apm_events_t;
+
+
+static void
+apm_events_init (apm_events_t *events)
+{
+   memset (events, 0, sizeof *events);
+   bson_init (&events->command);
+   bson_init (&events->reply);
+}
+
+
+static void
+apm_events_destroy (apm_events_t *events)
+{
+   bson_destroy (&events->command);
+   bson_destroy (&events->reply);
+}
+
+
+static void
+started_cb (const mongoc_apm_command_started_t *event)
+{
+   apm_events_t *events;
+
+   events = (apm_events_t *) mongoc_apm_command_started_get_context (event);
+   events->n_started++;
+   bson_strncpy (events->command_name,
+                 mongoc_apm_command_started_get_command_name (event),
+                 sizeof events->command_name);
+   bson_strncpy (events->database_name,
+                 mongoc_apm_command_started_get_database_name (event),
+                 sizeof events->database_name);
+   bson_destroy (&events->command);
+   bson_copy_to (mongoc_apm_command_started_get_command (event),
+                 &events->command);
+   events->started_request_id =
+      mongoc_apm_command_started_get_request_id (event);
+   ASSERT (mongoc_apm_command_started_get_server_id (event));
+}
+
+
+static void
+succeeded_cb (const mongoc_apm_command_succeeded_t *event)
+{
+   apm_events_t *events;
+
+   events = (apm_events_t *) mongoc_apm_command_succeeded_get_context (event);
+   events->n_succeeded++;
+   ASSERT_CMPSTR (events->command_name,
+                  mongoc_apm_command_succeeded_get_command_name (event));
+   bson_destroy (&events->reply);
+   bson_copy_to (mongoc_apm_command_succeeded_get_reply (event),
+                 &events->reply);
+   events->reply_size = mongoc_apm_command_succeeded_get_reply_size (event);
+   events->request_id = mongoc_apm_command_succeeded_get_request_id (event);
+   events->duration = mongoc_apm_command_succeeded_get_duration (event);
+   events->port = mongoc_apm_command_succeeded_get_host (event)->port;
+}
+
+
+static void
+failed_cb (const mongoc_apm_command_failed_t *event)
+{
+   apm_events_t *events;
+
+   events = (apm_events_t *) mongoc_apm_command_failed_get_context (event);
+   events->n_failed++;
+   ASSERT_CMPSTR (events->command_name,
+                  mongoc_apm_command_failed_get_command_name (event));
+   mongoc_apm_command_failed_get_error (event, &events->error);
+   events->request_id = mongoc_apm_command_failed_get_request_id (event);
+   events->duration = mongoc_apm_command_failed_get_duration (event);
+}
+
+
+static void
+set_callbacks (mongoc_client_t *client,
+               apm_events_t    *events)
+{
+   mongoc_apm_callbacks_t *callbacks;
+
+   callbacks = mongoc_apm_callbacks_new ();
+   mongoc_apm_set_command_started_cb (callbacks, started_cb);
+   mongoc_apm_set_command_succeeded_cb (callbacks, succeeded_cb);
+   mongoc_apm_set_command_failed_cb (callbacks, failed_cb);
+   mongoc_client_set_apm_callbacks (client, callbacks, events);
+   mongoc_apm_callbacks_destroy (callbacks);
+}
+
+
+static void
+test_apm_command (bool succeed)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   apm_events_t events;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   apm_events_init (&events);
+   set_callbacks (client, &events);
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+   request = mock_server_receives_command (server, "db",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+
+   if (succeed) {
+      mock_server_replies_simple (request, "{'ok': 1, 'x': 'y'}");
+      ASSERT_OR_PRINT (future_get_bool (future), error);
+   } else {
+      mock_server_replies_simple (request,
+                                  "{'ok': 0, 'code': 42, 'errmsg': 'bad'}");
+      ASSERT (!future_get_bool (future));
+   }
+
+   ASSERT_CMPINT (events.n_started, ==, 1);
+   ASSERT_CMPSTR (events.command_name, "ping");
+   ASSERT_CMPSTR (events.database_name, "db");
+   ASSERT_MATCH (&events.command, "{'ping': 1}");
+   ASSERT_CMPINT (events.request_id, ==, events.started_request_id);
+   ASSERT_CMPINT64 (events.duration, >=, (int64_t) 0);
+
+   if (succeed) {
+      ASSERT_CMPINT (events.n_succeeded, ==, 1);
+      ASSERT_CMPINT (events.n_failed, ==, 0);
+      ASSERT_MATCH (&events.reply, "{'ok': 1, 'x': 'y'}");
+      ASSERT_CMPINT (events.reply_size, ==, 36 + events.reply.len);
+      ASSERT_CMPINT (events.port, ==, mock_server_get_port (server));
+   } else {
+      ASSERT_CMPINT (events.n_succeeded, ==, 0);
+      ASSERT_CMPINT (events.n_failed, ==, 1);
+      ASSERT_CMPINT (events.error.code, ==, 42);
+      ASSERT_CMPSTR (events.error.message, "bad");
+   }
+
+   future_destroy (future);
+   request_destroy (request);
+   apm_events_destroy (&events);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_apm_command_succeeded (void)
+{
+   test_apm_command (true);
+}
+
+
+static void
+test_apm_command_failed (void)
+{
+   test_apm_command (false);
+}
+
+
+static void
+test_apm_legacy_query (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   apm_events_t events;
+   const bson_t *doc;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   apm_events_init (&events);
+   set_callbacks (client, &events);
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0, 0,
+                                    tmp_bson ("{'a': 1}"), NULL, NULL);
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_query (
+      server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 0, "{'a': 1}", NULL);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 0, 0, 1, "{'a': 1}");
+   ASSERT (future_get_bool (future));
+
+   ASSERT_CMPINT (events.n_started, ==, 1);
+   ASSERT_CMPSTR (events.command_name, "find");
+   ASSERT_CMPSTR (events.database_name, "db");
+   ASSERT_MATCH (&events.command, "{'a': 1}");
+   ASSERT_CMPINT (events.n_succeeded, ==, 1);
+   ASSERT_MATCH (&events.reply, "{'a': 1}");
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (collection);
+   apm_events_destroy (&events);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_apm_disabled (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   apm_events_t events;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   apm_events_init (&events);
+   set_callbacks (client, &events);
+   mongoc_client_set_apm_callbacks (client, NULL, NULL);
+
+   future = future_client_command_simple (client, "db",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+   request = mock_server_receives_command (server, "db",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+
+   ASSERT_CMPINT (events.n_started, ==, 0);
+   ASSERT_CMPINT (events.n_succeeded, ==, 0);
+
+   future_destroy (future);
+   request_destroy (request);
+   apm_events_destroy (&events);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+#define N_IN_FLIGHT 40
+
+/* every request gets its succeeded event, however many are in flight */
+static void
+test_apm_many_in_flight (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   apm_events_t events;
+   bson_t *queries[N_IN_FLIGHT];
+   mongoc_rpc_t rpcs[N_IN_FLIGHT];
+   int32_t request_ids[N_IN_FLIGHT];
+   request_t *request;
+   mongoc_rpc_t reply;
+   mongoc_buffer_t buffer;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   apm_events_init (&events);
+   set_callbacks (client, &events);
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   for (i = 0; i < N_IN_FLIGHT; i++) {
+      queries[i] = BCON_NEW ("i", BCON_INT32 (i));
+
+      rpcs[i].query.msg_len = 0;
+      rpcs[i].query.request_id = 0;
+      rpcs[i].query.response_to = 0;
+      rpcs[i].query.opcode = MONGOC_OPCODE_QUERY;
+      rpcs[i].query.flags = MONGOC_QUERY_NONE;
+      rpcs[i].query.collection = "db.collection";
+      rpcs[i].query.skip = 0;
+      rpcs[i].query.n_return = 1;
+      rpcs[i].query.query = bson_get_data (queries[i]);
+      rpcs[i].query.fields = NULL;
+
+      ASSERT_OR_PRINT (mongoc_cluster_sendv_to_server (&client->cluster,
+                                                       &rpcs[i], 1,
+                                                       server_stream,
+                                                       NULL, &error),
+                       error);
+
+      request_ids[i] = (int32_t) client->cluster.request_id;
+   }
+
+   ASSERT_CMPINT (events.n_started, ==, N_IN_FLIGHT);
+
+   for (i = 0; i < N_IN_FLIGHT; i++) {
+      request = mock_server_receives_query (server, "db.collection",
+                                            MONGOC_QUERY_NONE, 0, 1,
+                                            NULL, NULL);
+      ASSERT (request);
+      mock_server_replies_simple (request, "{'ok': 1}");
+      request_destroy (request);
+   }
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+
+   for (i = 0; i < N_IN_FLIGHT; i++) {
+      _mongoc_buffer_clear (&buffer, false);
+      ASSERT_OR_PRINT (mongoc_cluster_try_recv_reply (&client->cluster,
+                                                      &reply, &buffer,
+                                                      server_stream,
+                                                      request_ids[i],
+                                                      &error),
+                       error);
+      ASSERT_CMPINT (events.request_id, ==, request_ids[i]);
+   }
+
+   ASSERT_CMPINT (events.n_succeeded, ==, N_IN_FLIGHT);
+   ASSERT_CMPINT (events.n_failed, ==, 0);
+
+   for (i = 0; i < N_IN_FLIGHT; i++) {
+      bson_destroy (queries[i]);
+   }
+
+   _mongoc_buffer_destroy (&buffer);
+   mongoc_server_stream_cleanup (server_stream);
+   apm_events_destroy (&events);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+void
+test_apm_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/APM/command/succeeded",
+                  test_apm_command_succeeded);
+   TestSuite_Add (suite, "/APM/command/failed",
+                  test_apm_command_failed);
+   TestSuite_Add (suite, "/APM/legacy_query", test_apm_legacy_query);
+   TestSuite_Add (suite, "/APM/disabled", test_apm_disabled);
+   TestSuite_Add (suite, "/APM/many_in_flight", test_apm_many_in_flight);
+}
@@ -174,6 +174,108 @@ test_ismaster_ssl (void)
 #endif
 
 
+struct timeout_order {
+   int order[5];
+   int n;
+};
+
+
+struct timeout_result {
+   struct timeout_order *shared;
+   int                   id;
+};
+
+
+static void
+test_timeout_order_helper (mongoc_async_cmd_result_t result,
+                           const bson_t             *bson,
+                           int64_t                   rtt_msec,
+                           void                     *data,
+                           bson_error_t             *error)
+{
+   struct timeout_result *r = (struct timeout_result *)data;
+
+   ASSERT_CMPINT (result, ==, MONGOC_ASYNC_CMD_TIMEOUT);
+   r->shared->order[r->shared->n++] = r->id;
+}
+
+
+/* commands are queued out of expiration order against a listener that
+ * never replies; the timer heap must expire them soonest first */
+static void
+test_timeout_order (void)
+{
+   const int32_t timeouts[] = { 300, 100, 400, 200, 50 };
+   const int expected[] = { 4, 1, 3, 0, 2 };
+   enum { N = sizeof timeouts / sizeof timeouts[0] };
+   mongoc_socket_t *listen_sock;
+   mongoc_socket_t *conn_sock;
+   mongoc_stream_t *streams[N];
+   struct timeout_result results[N];
+   struct timeout_order shared = { { 0 } };
+   struct sockaddr_in server_addr = { 0 };
+   socklen_t addrlen = sizeof server_addr;
+   mongoc_async_t *async;
+   int r;
+   int i;
+   bson_t q = BSON_INITIALIZER;
+
+   assert (bson_append_int32 (&q, "isMaster", 8, 1));
+
+   listen_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   assert (listen_sock);
+
+   server_addr.sin_family = AF_INET;
+   server_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   server_addr.sin_port = htons (0);
+   r = mongoc_socket_bind (listen_sock,
+                           (struct sockaddr *)&server_addr,
+                           sizeof server_addr);
+   ASSERT_CMPINT (r, ==, 0);
+   r = mongoc_socket_getsockname (listen_sock,
+                                  (struct sockaddr *)&server_addr,
+                                  &addrlen);
+   ASSERT_CMPINT (r, ==, 0);
+   r = mongoc_socket_listen (listen_sock, 10);
+   ASSERT_CMPINT (r, ==, 0);
+
+   async = mongoc_async_new ();
+
+   for (i = 0; i < N; i++) {
+      conn_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+      assert (conn_sock);
+      mongoc_socket_connect (conn_sock, (struct sockaddr *)&server_addr,
+                             sizeof server_addr, 0);
+      streams[i] = mongoc_stream_socket_new (conn_sock);
+
+      results[i].shared = &shared;
+      results[i].id = i;
+
+      mongoc_async_cmd (async, streams[i], NULL, NULL, "admin", &q,
+                        &test_timeout_order_helper, (void *)&results[i],
+                        timeouts[i]);
+   }
+
+   while (mongoc_async_run (async, TIMEOUT)) {
+   }
+
+   ASSERT_CMPINT (shared.n, ==, N);
+
+   for (i = 0; i < N; i++) {
+      ASSERT_CMPINT (shared.order[i], ==, expected[i]);
+   }
+
+   mongoc_async_destroy (async);
+
+   for (i = 0; i < N; i++) {
+      mongoc_stream_destroy (streams[i]);
+   }
+
+   mongoc_socket_destroy (listen_sock);
+   bson_destroy (&q);
+}
+
+
 void
 test_async_install (TestSuite *suite)
 {
@@ -181,4 +283,5 @@ test_async_install (TestSuite *suite)
 #ifdef MONGOC_ENABLE_SSL
    TestSuite_Add (suite, "/Async/ismaster_ssl", test_ismaster_ssl);
 #endif
+   TestSuite_Add (suite, "/Async/timeout_order", test_timeout_order);
 }
@@ -1,10 +1,16 @@
 #include <mongoc.h>
 #include "mongoc-client-pool-private.h"
+#include "mongoc-client-private.h"
+#include "mongoc-topology-scanner-private.h"
 #include "mongoc-array-private.h"
+#include "mongoc-thread-private.h"
+#include "mongoc-uri-private.h"
+#include "mongoc-util-private.h"
 
 
 #include "TestSuite.h"
 #include "test-libmongoc.h"
+#include "mock_server/mock-server.h"
 
 
 static void
@@ -149,6 +155,293 @@ test_mongoc_client_pool_set_min_size (void)
    mongoc_client_pool_destroy (pool);
 }
 
+static void
+test_mongoc_client_pool_warm_up (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *clients[3];
+   mongoc_uri_t *uri;
+   int64_t start;
+   int i;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, "minPoolSize", 3);
+   pool = mongoc_client_pool_new (uri);
+
+   mongoc_client_pool_warm_up (pool);
+   mongoc_client_pool_warm_up (pool);
+
+   start = bson_get_monotonic_time ();
+   while (mongoc_client_pool_get_size (pool) < 3) {
+      ASSERT_CMPINT64 (bson_get_monotonic_time () - start, <,
+                       (int64_t) 10 * 1000 * 1000);
+      _mongoc_usleep (1000);
+   }
+
+   /* the clients were connected before anyone asked for them */
+   for (i = 0; i < 3; i++) {
+      clients[i] = mongoc_client_pool_pop (pool);
+      ASSERT_CMPSIZE_T (clients[i]->cluster.nodes->items_len, ==, (size_t) 1);
+   }
+
+   ASSERT_CMPSIZE_T (mongoc_client_pool_get_size (pool), ==, (size_t) 3);
+
+   for (i = 0; i < 3; i++) {
+      mongoc_client_pool_push (pool, clients[i]);
+   }
+
+   /* raising the minimum tops the pool up */
+   mongoc_client_pool_min_size (pool, 5);
+
+   start = bson_get_monotonic_time ();
+   while (mongoc_client_pool_get_size (pool) < 5) {
+      ASSERT_CMPINT64 (bson_get_monotonic_time () - start, <,
+                       (int64_t) 10 * 1000 * 1000);
+      _mongoc_usleep (1000);
+   }
+
+   mongoc_client_pool_destroy (pool);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
+
+/* answer the topology scanner's first ismaster, swallow the rest */
+static bool
+swallow_ismaster (request_t *request,
+                  void      *data)
+{
+   volatile int32_t *n_ismasters = (volatile int32_t *)data;
+
+   if (!request->is_command ||
+       strcasecmp (request->command_name, "ismaster") ||
+       bson_atomic_int_add (n_ismasters, 1) == 1) {
+      return false;
+   }
+
+   request_destroy (request);
+   return true;
+}
+
+
+/* destroying the pool doesn't wait socketTimeoutMS for a warm-up handshake */
+static void
+test_mongoc_client_pool_warm_up_destroy (void)
+{
+   mock_server_t *server;
+   mongoc_client_pool_t *pool;
+   mongoc_uri_t *uri;
+   volatile int32_t n_ismasters = 0;
+   int64_t start;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_autoresponds (server, swallow_ismaster,
+                             (void *)&n_ismasters, NULL);
+   mock_server_run (server);
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, "minPoolSize", 3);
+   mongoc_uri_set_option_as_int32 (uri, "connectTimeoutMS", 500);
+   mongoc_uri_set_option_as_int32 (uri, "socketTimeoutMS", 60 * 1000);
+   pool = mongoc_client_pool_new (uri);
+   mongoc_client_pool_warm_up (pool);
+
+   /* wait for a warm-up client's handshake */
+   start = bson_get_monotonic_time ();
+   while (bson_atomic_int_add (&n_ismasters, 0) < 2) {
+      ASSERT_CMPINT64 (bson_get_monotonic_time () - start, <,
+                       (int64_t) 10 * 1000 * 1000);
+      _mongoc_usleep (1000);
+   }
+
+   /* "Pool warm-up could not connect" */
+   suppress_one_message ();
+   start = bson_get_monotonic_time ();
+   mongoc_client_pool_destroy (pool);
+   ASSERT_CMPINT64 (bson_get_monotonic_time () - start, <,
+                    (int64_t) 5 * 1000 * 1000);
+
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
+
+typedef struct
+{
+   mongoc_client_pool_t *pool;
+   int                   n_checkouts;
+} contention_worker_t;
+
+
+static void *
+contention_worker (void *data)
+{
+   contention_worker_t *worker = (contention_worker_t *)data;
+   mongoc_client_t *client;
+   int i;
+
+   for (i = 0; i < worker->n_checkouts; i++) {
+      client = mongoc_client_pool_pop (worker->pool);
+      assert (client);
+      mongoc_client_pool_push (worker->pool, client);
+   }
+
+   return NULL;
+}
+
+
+/* many threads check clients in and out of a pool smaller than the number
+ * of threads. set MONGOC_TEST_BENCHMARK=on to print checkouts per second. */
+static void
+test_mongoc_client_pool_contention (void)
+{
+   enum { N_THREADS = 64, N_CHECKOUTS = 2000 };
+   mongoc_client_pool_t *pool;
+   mongoc_uri_t *uri;
+   mongoc_thread_t threads[N_THREADS];
+   contention_worker_t worker;
+   int64_t start;
+   int64_t usec;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://127.0.0.1?maxpoolsize=16&minpoolsize=16");
+   pool = mongoc_client_pool_new (uri);
+
+   worker.pool = pool;
+   worker.n_checkouts = N_CHECKOUTS;
+
+   start = bson_get_monotonic_time ();
+
+   for (i = 0; i < N_THREADS; i++) {
+      mongoc_thread_create (&threads[i], contention_worker, &worker);
+   }
+
+   for (i = 0; i < N_THREADS; i++) {
+      mongoc_thread_join (threads[i]);
+   }
+
+   usec = BSON_MAX (1, bson_get_monotonic_time () - start);
+
+   assert (mongoc_client_pool_get_size (pool) <= 16);
+
+   if (test_framework_getenv_bool ("MONGOC_TEST_BENCHMARK")) {
+      printf ("client pool: %d threads, %.0f checkouts/sec\n",
+              N_THREADS,
+              (double) N_THREADS * N_CHECKOUTS * 1000 * 1000 / usec);
+   }
+
+   mongoc_uri_destroy (uri);
+   mongoc_client_pool_destroy (pool);
+}
+
+
+typedef struct
+{
+   mongoc_client_pool_t *pool;
+   mongoc_client_t      *client;
+} push_worker_t;
+
+
+static void *
+push_worker (void *data)
+{
+   push_worker_t *worker = (push_worker_t *)data;
+
+   mongoc_client_pool_push (worker->pool, worker->client);
+
+   return NULL;
+}
+
+
+/* threads returning clients at once never trim the pool below
+ * min_pool_size */
+static void
+test_mongoc_client_pool_push_min_size (void)
+{
+   enum { MIN_SIZE = 4, MAX_SIZE = 8, N_ROUNDS = 100 };
+   mongoc_client_pool_t *pool;
+   mongoc_uri_t *uri;
+   mongoc_thread_t threads[MAX_SIZE];
+   push_worker_t workers[MAX_SIZE];
+   int round;
+   int i;
+
+   uri = mongoc_uri_new ("mongodb://127.0.0.1?maxpoolsize=8&minpoolsize=4");
+   pool = mongoc_client_pool_new (uri);
+
+   for (round = 0; round < N_ROUNDS; round++) {
+      for (i = 0; i < MAX_SIZE; i++) {
+         workers[i].pool = pool;
+         workers[i].client = mongoc_client_pool_pop (pool);
+         assert (workers[i].client);
+      }
+
+      for (i = 0; i < MAX_SIZE; i++) {
+         mongoc_thread_create (&threads[i], push_worker, &workers[i]);
+      }
+
+      for (i = 0; i < MAX_SIZE; i++) {
+         mongoc_thread_join (threads[i]);
+      }
+
+      ASSERT_CMPSIZE_T (mongoc_client_pool_get_size (pool), >=,
+                        (size_t) MIN_SIZE);
+   }
+
+   mongoc_uri_destroy (uri);
+   mongoc_client_pool_destroy (pool);
+}
+
+
+#ifdef MONGOC_ENABLE_SSL
+static void
+test_mongoc_client_pool_reload_ssl_certs (void)
+{
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   mongoc_topology_scanner_t *ts;
+   mongoc_ssl_opt_t opts = { 0 };
+   mongoc_uri_t *uri;
+   bson_error_t error;
+   SSL_CTX *ssl_ctx;
+
+   uri = mongoc_uri_new ("mongodb://localhost/?ssl=true");
+   pool = mongoc_client_pool_new (uri);
+
+   ASSERT (!mongoc_client_pool_reload_ssl_certs (pool, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+
+   /* the files are read once, when the options are set */
+   opts.ca_file = "tests/trust_dir/verify/mongo_root.pem";
+   mongoc_client_pool_set_ssl_opts (pool, &opts);
+
+   client = mongoc_client_pool_pop (pool);
+   ts = client->topology->scanner;
+   ssl_ctx = ts->ssl_ctx;
+   ASSERT (ssl_ctx);
+
+   ASSERT_OR_PRINT (mongoc_client_pool_reload_ssl_certs (pool, &error), error);
+   ASSERT (ts->ssl_ctx);
+   ASSERT (ts->ssl_ctx != ssl_ctx);
+   ssl_ctx = ts->ssl_ctx;
+
+   /* a failed reload keeps the previous certificates */
+   ts->ssl_opts->ca_file = "tests/trust_dir/does-not-exist.pem";
+   ASSERT (!mongoc_client_pool_reload_ssl_certs (pool, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_STREAM);
+   ASSERT (ts->ssl_ctx == ssl_ctx);
+
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+   mongoc_uri_destroy (uri);
+}
+#endif
+
+
 #ifndef MONGOC_ENABLE_SSL
 static void
 test_mongoc_client_pool_ssl_disabled (void)
@@ -171,6 +464,15 @@ test_client_pool_install (TestSuite *suite)
    TestSuite_Add (suite, "/ClientPool/min_size_dispose", test_mongoc_client_pool_min_size_dispose);
    TestSuite_Add (suite, "/ClientPool/set_max_size", test_mongoc_client_pool_set_max_size);
    TestSuite_Add (suite, "/ClientPool/set_min_size", test_mongoc_client_pool_set_min_size);
+   TestSuite_Add (suite, "/ClientPool/warm_up", test_mongoc_client_pool_warm_up);
+   TestSuite_Add (suite, "/ClientPool/warm_up/destroy",
+                  test_mongoc_client_pool_warm_up_destroy);
+   TestSuite_Add (suite, "/ClientPool/contention", test_mongoc_client_pool_contention);
+   TestSuite_Add (suite, "/ClientPool/push_min_size", test_mongoc_client_pool_push_min_size);
+
+#ifdef MONGOC_ENABLE_SSL
+   TestSuite_Add (suite, "/ClientPool/reload_ssl_certs", test_mongoc_client_pool_reload_ssl_certs);
+#endif
 
 #ifndef MONGOC_ENABLE_SSL
    TestSuite_Add (suite, "/ClientPool/ssl_disabled", test_mongoc_client_pool_ssl_disabled);
@@ -2,6 +2,7 @@
 #include <mongoc.h>
 
 #include "mongoc-client-private.h"
+#include "mongoc-compression-private.h"
 #include "mongoc-cursor-private.h"
 #include "mongoc-uri-private.h"
 #include "mongoc-util-private.h"
@@ -1006,6 +1007,80 @@ test_mongoc_client_mismatched_me (void)
 }
 
 
+static void
+_test_client_compression (const char *uri_compressors,
+                          const char *server_compressors,
+                          int32_t     expected_id)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+   char *uri_str;
+
+   server = mock_server_new ();
+   mock_server_auto_ismaster (server, "{'ok': 1.0,"
+                                      " 'ismaster': true,"
+                                      " 'minWireVersion': 0,"
+                                      " 'maxWireVersion': 3,"
+                                      " 'compression': %s}",
+                              server_compressors);
+   mock_server_run (server);
+
+   uri_str = bson_strdup_printf ("mongodb://%s/?compressors=%s",
+                                 mock_server_get_host_and_port (server),
+                                 uri_compressors);
+   client = mongoc_client_new (uri_str);
+
+   future = future_client_command_simple (client, "admin",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+
+   request = mock_server_receives_command (server, "admin",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   ASSERT (request);
+   ASSERT_CMPINT (request->compressor_id, ==, expected_id);
+
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_client_destroy (client);
+   bson_free (uri_str);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_mongoc_client_compression_snappy (void)
+{
+   _test_client_compression ("snappy", "['snappy']",
+                             MONGOC_COMPRESSOR_SNAPPY_ID);
+}
+
+
+#ifdef MONGOC_ENABLE_ZLIB
+static void
+test_mongoc_client_compression_zlib (void)
+{
+   /* the server's order of preference wins */
+   _test_client_compression ("snappy,zlib", "['zlib', 'snappy']",
+                             MONGOC_COMPRESSOR_ZLIB_ID);
+}
+#endif
+
+
+static void
+test_mongoc_client_compression_not_negotiated (void)
+{
+   _test_client_compression ("snappy", "['lz4']",
+                             MONGOC_COMPRESSOR_NONE_ID);
+}
+
+
 #ifdef MONGOC_ENABLE_SSL
 static void
 _test_mongoc_client_ssl_opts (bool pooled)
@@ -1141,6 +1216,11 @@ test_client_install (TestSuite *suite)
    TestSuite_Add (suite, "/Client/database_names", test_get_database_names);
    TestSuite_AddFull (suite, "/Client/connect/uds", test_mongoc_client_unix_domain_socket, NULL, NULL, test_framework_skip_if_windows);
    TestSuite_Add (suite, "/Client/mismatched_me", test_mongoc_client_mismatched_me);
+   TestSuite_Add (suite, "/Client/compression/snappy", test_mongoc_client_compression_snappy);
+#ifdef MONGOC_ENABLE_ZLIB
+   TestSuite_Add (suite, "/Client/compression/zlib", test_mongoc_client_compression_zlib);
+#endif
+   TestSuite_Add (suite, "/Client/compression/not_negotiated", test_mongoc_client_compression_not_negotiated);
 
 #ifdef TODO_CDRIVER_689
    TestSuite_Add (suite, "/Client/wire_version", test_wire_version);
@@ -1,6 +1,7 @@
 #include <mongoc.h>
 
 #include "mongoc-client-private.h"
+#include "mongoc-compression-private.h"
 #include "mongoc-uri-private.h"
 
 #include "mock_server/mock-server.h"
@@ -212,6 +213,323 @@ test_cluster_node_disconnect_pooled (void)
 }
 
 
+
+/* test that replies to pipelined requests are matched by response_to */
+static void
+test_cluster_recv_reply_out_of_order (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   bson_t *queries[2];
+   mongoc_rpc_t rpcs[2];
+   int32_t request_ids[2];
+   request_t *requests[2];
+   mongoc_rpc_t reply;
+   mongoc_buffer_t buffer;
+   bson_error_t error;
+   bson_t b;
+   int i;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   /* two queries in flight on one stream */
+   for (i = 0; i < 2; i++) {
+      queries[i] = BCON_NEW ("i", BCON_INT32 (i));
+
+      rpcs[i].query.msg_len = 0;
+      rpcs[i].query.request_id = 0;
+      rpcs[i].query.response_to = 0;
+      rpcs[i].query.opcode = MONGOC_OPCODE_QUERY;
+      rpcs[i].query.flags = MONGOC_QUERY_NONE;
+      rpcs[i].query.collection = "test.test";
+      rpcs[i].query.skip = 0;
+      rpcs[i].query.n_return = 1;
+      rpcs[i].query.query = bson_get_data (queries[i]);
+      rpcs[i].query.fields = NULL;
+
+      ASSERT_OR_PRINT (mongoc_cluster_sendv_to_server (&client->cluster,
+                                                       &rpcs[i], 1,
+                                                       server_stream,
+                                                       NULL, &error),
+                       error);
+
+      request_ids[i] = (int32_t) client->cluster.request_id;
+   }
+
+   requests[0] = mock_server_receives_query (server, "test.test",
+                                             MONGOC_QUERY_NONE, 0, 1,
+                                             "{'i': 0}", NULL);
+   requests[1] = mock_server_receives_query (server, "test.test",
+                                             MONGOC_QUERY_NONE, 0, 1,
+                                             "{'i': 1}", NULL);
+
+   /* the server replies in reverse order */
+   mock_server_replies_simple (requests[1], "{'reply': 1}");
+   mock_server_replies_simple (requests[0], "{'reply': 0}");
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+
+   for (i = 0; i < 2; i++) {
+      _mongoc_buffer_clear (&buffer, false);
+      ASSERT_OR_PRINT (mongoc_cluster_try_recv_reply (&client->cluster,
+                                                      &reply, &buffer,
+                                                      server_stream,
+                                                      request_ids[i],
+                                                      &error),
+                       error);
+
+      ASSERT_CMPINT (reply.header.response_to, ==, request_ids[i]);
+      assert (_mongoc_rpc_reply_get_first (&reply.reply, &b));
+      ASSERT_MATCH (&b, "{'reply': %d}", i);
+      bson_destroy (&b);
+
+      /* reply 1 was read while waiting for reply 0 and kept until asked */
+      ASSERT_CMPSIZE_T (client->cluster.replies.len, ==, (size_t) (1 - i));
+   }
+
+   for (i = 0; i < 2; i++) {
+      request_destroy (requests[i]);
+      bson_destroy (queries[i]);
+   }
+
+   _mongoc_buffer_destroy (&buffer);
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+_send_query (mongoc_client_t        *client,
+             mongoc_server_stream_t *server_stream,
+             int                     i,
+             int32_t                *request_id)
+{
+   bson_t *query;
+   mongoc_rpc_t rpc;
+   bson_error_t error;
+
+   query = BCON_NEW ("i", BCON_INT32 (i));
+
+   rpc.query.msg_len = 0;
+   rpc.query.request_id = 0;
+   rpc.query.response_to = 0;
+   rpc.query.opcode = MONGOC_OPCODE_QUERY;
+   rpc.query.flags = MONGOC_QUERY_NONE;
+   rpc.query.collection = "test.test";
+   rpc.query.skip = 0;
+   rpc.query.n_return = 1;
+   rpc.query.query = bson_get_data (query);
+   rpc.query.fields = NULL;
+
+   ASSERT_OR_PRINT (mongoc_cluster_sendv_to_server (&client->cluster,
+                                                    &rpc, 1, server_stream,
+                                                    NULL, &error),
+                    error);
+
+   *request_id = (int32_t) client->cluster.request_id;
+   bson_destroy (query);
+}
+
+
+/* a reply that arrives after its caller timed out is not kept */
+static void
+test_cluster_recv_reply_abandoned (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   request_t *ping;
+   request_t *request;
+   int32_t request_id;
+   uint32_t sockettimeoutms;
+   mongoc_rpc_t reply;
+   mongoc_buffer_t buffer;
+   bson_error_t error;
+   bson_t b;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   /* the command times out, but the connection is kept */
+   sockettimeoutms = client->cluster.sockettimeoutms;
+   client->cluster.sockettimeoutms = 100;
+   ASSERT (!mongoc_cluster_run_command (&client->cluster,
+                                        server_stream->stream,
+                                        MONGOC_QUERY_NONE, "admin",
+                                        tmp_bson ("{'ping': 1}"), NULL,
+                                        &error));
+   client->cluster.sockettimeoutms = sockettimeoutms;
+   ping = mock_server_receives_command (server, "admin", MONGOC_QUERY_NONE,
+                                        "{'ping': 1}");
+   ASSERT (ping);
+
+   _send_query (client, server_stream, 0, &request_id);
+   request = mock_server_receives_query (server, "test.test",
+                                         MONGOC_QUERY_NONE, 0, 1,
+                                         "{'i': 0}", NULL);
+
+   /* the late reply to the ping is read first, and thrown away */
+   mock_server_replies_simple (ping, "{'ok': 1}");
+   mock_server_replies_simple (request, "{'reply': 0}");
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+   ASSERT_OR_PRINT (mongoc_cluster_try_recv_reply (&client->cluster,
+                                                   &reply, &buffer,
+                                                   server_stream,
+                                                   request_id, &error),
+                    error);
+   assert (_mongoc_rpc_reply_get_first (&reply.reply, &b));
+   ASSERT_MATCH (&b, "{'reply': 0}");
+   bson_destroy (&b);
+   ASSERT_CMPSIZE_T (client->cluster.replies.len, ==, (size_t) 0);
+
+   _mongoc_buffer_destroy (&buffer);
+   request_destroy (request);
+   request_destroy (ping);
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* unclaimed replies are kept up to a limit per stream */
+static void
+test_cluster_recv_reply_cap (void)
+{
+   enum { N = MONGOC_CLUSTER_MAX_STASHED_REPLIES + 2 };
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   int32_t request_ids[N];
+   request_t *requests[N];
+   mongoc_cluster_reply_t *replies;
+   mongoc_rpc_t reply;
+   mongoc_buffer_t buffer;
+   bson_error_t error;
+   char query[32];
+   int i;
+
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   for (i = 0; i < N; i++) {
+      _send_query (client, server_stream, i, &request_ids[i]);
+      bson_snprintf (query, sizeof query, "{'i': %d}", i);
+      requests[i] = mock_server_receives_query (server, "test.test",
+                                                MONGOC_QUERY_NONE, 0, 1,
+                                                query, NULL);
+   }
+
+   for (i = 0; i < N; i++) {
+      mock_server_replies_simple (requests[i], "{'ok': 1}");
+   }
+
+   /* waiting for the last reply reads all the others first */
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+   suppress_one_message ();
+   ASSERT_OR_PRINT (mongoc_cluster_try_recv_reply (&client->cluster,
+                                                   &reply, &buffer,
+                                                   server_stream,
+                                                   request_ids[N - 1],
+                                                   &error),
+                    error);
+
+   /* the oldest was forgotten to make room */
+   ASSERT_CMPSIZE_T (client->cluster.replies.len, ==,
+                     (size_t) MONGOC_CLUSTER_MAX_STASHED_REPLIES);
+   replies = (mongoc_cluster_reply_t *)client->cluster.replies.data;
+   ASSERT_CMPINT (replies[0].response_to, ==, request_ids[1]);
+
+   _mongoc_buffer_destroy (&buffer);
+
+   for (i = 0; i < N; i++) {
+      request_destroy (requests[i]);
+   }
+
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* a copy of a description that has no ismaster yet must not compress */
+static void
+test_cluster_compression_copied_sd (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_server_stream_t *server_stream;
+   mongoc_server_description_t sd;
+   bson_t *query;
+   mongoc_rpc_t rpc;
+   request_t *request;
+   bson_error_t error;
+   char *uri_str;
+
+   /* the server doesn't support compression */
+   server = mock_server_with_autoismaster (0);
+   mock_server_run (server);
+   uri_str = bson_strdup_printf ("mongodb://%s/?compressors=snappy",
+                                 mock_server_get_host_and_port (server));
+   client = mongoc_client_new (uri_str);
+   server_stream = mongoc_cluster_stream_for_writes (&client->cluster, &error);
+   ASSERT_OR_PRINT (server_stream, error);
+
+   mongoc_server_description_init (&sd,
+                                   mock_server_get_host_and_port (server),
+                                   server_stream->sd->id);
+   mongoc_server_description_destroy (server_stream->sd);
+   server_stream->sd = mongoc_server_description_new_copy (&sd);
+   ASSERT_CMPINT (server_stream->sd->compressor_id, ==,
+                  MONGOC_COMPRESSOR_NONE_ID);
+
+   query = BCON_NEW ("i", BCON_INT32 (0));
+
+   rpc.query.msg_len = 0;
+   rpc.query.request_id = 0;
+   rpc.query.response_to = 0;
+   rpc.query.opcode = MONGOC_OPCODE_QUERY;
+   rpc.query.flags = MONGOC_QUERY_NONE;
+   rpc.query.collection = "test.test";
+   rpc.query.skip = 0;
+   rpc.query.n_return = 1;
+   rpc.query.query = bson_get_data (query);
+   rpc.query.fields = NULL;
+
+   ASSERT_OR_PRINT (mongoc_cluster_sendv_to_server (&client->cluster,
+                                                    &rpc, 1,
+                                                    server_stream,
+                                                    NULL, &error),
+                    error);
+
+   request = mock_server_receives_query (server, "test.test",
+                                         MONGOC_QUERY_NONE, 0, 1,
+                                         "{'i': 0}", NULL);
+   ASSERT (request);
+   ASSERT_CMPINT (request->compressor_id, ==, MONGOC_COMPRESSOR_NONE_ID);
+
+   request_destroy (request);
+   bson_destroy (query);
+   mongoc_server_description_cleanup (&sd);
+   mongoc_server_stream_cleanup (server_stream);
+   mongoc_client_destroy (client);
+   bson_free (uri_str);
+   mock_server_destroy (server);
+}
+
+
 void
 test_cluster_install (TestSuite *suite)
 {
@@ -219,4 +537,8 @@ test_cluster_install (TestSuite *suite)
    TestSuite_Add (suite, "/Cluster/test_get_max_msg_size", test_get_max_msg_size);
    TestSuite_Add (suite, "/Cluster/disconnect/single", test_cluster_node_disconnect_single);
    TestSuite_Add (suite, "/Cluster/disconnect/pooled", test_cluster_node_disconnect_pooled);
+   TestSuite_Add (suite, "/Cluster/recv_reply/out_of_order", test_cluster_recv_reply_out_of_order);
+   TestSuite_Add (suite, "/Cluster/recv_reply/abandoned", test_cluster_recv_reply_abandoned);
+   TestSuite_Add (suite, "/Cluster/recv_reply/cap", test_cluster_recv_reply_cap);
+   TestSuite_Add (suite, "/Cluster/compression/copied_sd", test_cluster_compression_copied_sd);
 }
@@ -3,6 +3,7 @@
 #include <mongoc-client-private.h>
 #include <mongoc-cursor-private.h>
 #include <mongoc-collection-private.h>
+#include <mongoc-uri-private.h>
 
 #include "TestSuite.h"
 
@@ -2927,6 +2928,273 @@ test_aggregate_read_concern (void)
 
 
 
+static bool
+async_crud_responder (request_t *request,
+                      void      *data)
+{
+   const bson_t *doc;
+   bson_iter_t iter;
+   bson_iter_t child;
+
+   if (!request->is_command) {
+      return false;
+   }
+
+   doc = request_get_doc (request, 0);
+
+   if (!strcmp (request->command_name, "find")) {
+      mock_server_replies_simple (request,
+                                  "{'ok': 1,"
+                                  " 'cursor': {"
+                                  "    'id': 0,"
+                                  "    'ns': 'db.collection',"
+                                  "    'firstBatch': [{'_id': 123}]"
+                                  "}}");
+   } else if (!strcmp (request->command_name, "insert")) {
+      /* the driver generates an _id */
+      ASSERT (bson_iter_init (&iter, doc) &&
+              bson_iter_find_descendant (&iter, "documents.0._id", &child));
+
+      if (bson_iter_init (&iter, doc) &&
+          bson_iter_find_descendant (&iter, "documents.0.dup", &child)) {
+         mock_server_replies_simple (request,
+                                     "{'ok': 1, 'n': 0,"
+                                     " 'writeErrors': [{'index': 0,"
+                                     "                  'code': 11000,"
+                                     "                  'errmsg': 'dup'}]}");
+      } else {
+         mock_server_replies_simple (request, "{'ok': 1, 'n': 1}");
+      }
+   } else {
+      return false;
+   }
+
+   request_destroy (request);
+   return true;
+}
+
+
+typedef struct
+{
+   int found;
+   int inserted;
+   int dups;
+   int other;
+} async_crud_counts_t;
+
+
+static void
+async_crud_find_cb (mongoc_async_cmd_result_t  result,
+                    const bson_t              *reply,
+                    int64_t                    rtt_msec,
+                    void                      *data,
+                    bson_error_t              *error)
+{
+   async_crud_counts_t *counts = (async_crud_counts_t *)data;
+
+   if (result == MONGOC_ASYNC_CMD_SUCCESS) {
+      ASSERT_MATCH (reply, "{'cursor': {'firstBatch': [{'_id': 123}]}}");
+      counts->found++;
+   } else {
+      counts->other++;
+   }
+}
+
+
+static void
+async_crud_insert_cb (mongoc_async_cmd_result_t  result,
+                      const bson_t              *reply,
+                      int64_t                    rtt_msec,
+                      void                      *data,
+                      bson_error_t              *error)
+{
+   async_crud_counts_t *counts = (async_crud_counts_t *)data;
+
+   if (result == MONGOC_ASYNC_CMD_SUCCESS) {
+      ASSERT_MATCH (reply, "{'n': 1}");
+      counts->inserted++;
+   } else if (result == MONGOC_ASYNC_CMD_ERROR &&
+              error->domain == MONGOC_ERROR_COMMAND &&
+              error->code == 11000) {
+      counts->dups++;
+   } else {
+      counts->other++;
+   }
+}
+
+
+/* more operations than maxPoolSize allows in flight, so some queue */
+static void
+test_find_insert_async (void)
+{
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_async_t *async;
+   mongoc_client_async_server_t *async_server;
+   async_crud_counts_t counts = { 0 };
+   bson_error_t error;
+   int i;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_FIND_CMD);
+   mock_server_autoresponds (server, async_crud_responder, NULL, NULL);
+   mock_server_run (server);
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, "maxPoolSize", 2);
+   client = mongoc_client_new_from_uri (uri);
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   async = mongoc_async_new ();
+
+   for (i = 0; i < 10; i++) {
+      ASSERT_OR_PRINT (mongoc_collection_find_async (
+                          collection, async, tmp_bson ("{}"), NULL, NULL,
+                          async_crud_find_cb, &counts, 10000, &error),
+                       error);
+   }
+
+   ASSERT_OR_PRINT (mongoc_collection_insert_async (
+                       collection, async, MONGOC_INSERT_NONE,
+                       tmp_bson ("{'x': 1}"), NULL,
+                       async_crud_insert_cb, &counts, 10000, &error),
+                    error);
+
+   ASSERT_OR_PRINT (mongoc_collection_insert_async (
+                       collection, async, MONGOC_INSERT_NONE,
+                       tmp_bson ("{'dup': true}"), NULL,
+                       async_crud_insert_cb, &counts, 10000, &error),
+                    error);
+
+   while (mongoc_async_run (async, 10000)) {
+   }
+
+   ASSERT_CMPINT (counts.found, ==, 10);
+   ASSERT_CMPINT (counts.inserted, ==, 1);
+   ASSERT_CMPINT (counts.dups, ==, 1);
+   ASSERT_CMPINT (counts.other, ==, 0);
+
+   /* connections were reused, never more than maxPoolSize */
+   async_server = (mongoc_client_async_server_t *)mongoc_set_get_item (
+      client->async->servers, 0);
+   ASSERT_CMPSIZE_T (async_server->nconns, <=, (size_t) 2);
+   ASSERT_CMPSIZE_T (async_server->idle.len, ==, async_server->nconns);
+   ASSERT_CMPSIZE_T (client->async->nops, ==, (size_t) 0);
+
+   mongoc_async_destroy (async);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
+
+/* destroying the executor cancels the client's operations, in flight and
+ * queued, and the client can then be driven by another executor */
+static void
+test_find_async_destroy_executor (void)
+{
+   mock_server_t *server;
+   mongoc_uri_t *uri;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_async_t *async;
+   mongoc_client_async_server_t *async_server;
+   async_crud_counts_t counts = { 0 };
+   request_t *request;
+   bson_error_t error;
+   int i;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_FIND_CMD);
+   mock_server_run (server);
+
+   uri = mongoc_uri_copy (mock_server_get_uri (server));
+   mongoc_uri_set_option_as_int32 (uri, "maxPoolSize", 1);
+   client = mongoc_client_new_from_uri (uri);
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   async = mongoc_async_new ();
+
+   /* one in flight, one waiting for the connection */
+   for (i = 0; i < 2; i++) {
+      ASSERT_OR_PRINT (mongoc_collection_find_async (
+                          collection, async, tmp_bson ("{}"), NULL, NULL,
+                          async_crud_find_cb, &counts, 10000, &error),
+                       error);
+   }
+
+   ASSERT (mongoc_async_run (async, 100));
+   request = mock_server_receives_command (server, "db", MONGOC_QUERY_SLAVE_OK,
+                                           "{'find': 'collection'}");
+   ASSERT (request);
+
+   mongoc_async_destroy (async);
+
+   ASSERT_CMPSIZE_T (client->async->nops, ==, (size_t) 0);
+   ASSERT (!client->async->async);
+   ASSERT (!client->async->ops);
+   async_server = (mongoc_client_async_server_t *)mongoc_set_get_item (
+      client->async->servers, 0);
+   ASSERT (!async_server->queue);
+   ASSERT_CMPSIZE_T (async_server->nconns, ==, (size_t) 0);
+   ASSERT_CMPINT (counts.found + counts.other, ==, 0);
+
+   /* the server never answers the cancelled command */
+   request_destroy (request);
+
+   mock_server_autoresponds (server, async_crud_responder, NULL, NULL);
+   async = mongoc_async_new ();
+
+   ASSERT_OR_PRINT (mongoc_collection_find_async (
+                       collection, async, tmp_bson ("{}"), NULL, NULL,
+                       async_crud_find_cb, &counts, 10000, &error),
+                    error);
+
+   while (mongoc_async_run (async, 10000)) {
+   }
+
+   ASSERT_CMPINT (counts.found, ==, 1);
+   ASSERT_CMPINT (counts.other, ==, 0);
+   ASSERT_CMPSIZE_T (client->async->nops, ==, (size_t) 0);
+
+   mongoc_async_destroy (async);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mongoc_uri_destroy (uri);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_find_async_bad_wire_version (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_async_t *async;
+   async_crud_counts_t counts = { 0 };
+   bson_error_t error;
+
+   server = mock_server_with_autoismaster (WIRE_VERSION_FIND_CMD - 1);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   async = mongoc_async_new ();
+
+   ASSERT (!mongoc_collection_find_async (collection, async, tmp_bson ("{}"),
+                                          NULL, NULL, async_crud_find_cb,
+                                          &counts, 10000, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_PROTOCOL);
+   ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_PROTOCOL_BAD_WIRE_VERSION);
+   ASSERT (!mongoc_async_run (async, 0));
+
+   mongoc_async_destroy (async);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+
 void
 test_collection_install (TestSuite *suite)
 {
@@ -2994,4 +3262,9 @@ test_collection_install (TestSuite *suite)
    TestSuite_Add (suite, "/Collection/batch_size", test_find_batch_size);
    TestSuite_AddFull (suite, "/Collection/command_fully_qualified", test_command_fq, NULL, NULL, test_framework_skip_if_mongos);
    TestSuite_Add (suite, "/Collection/get_index_info", test_get_index_info);
+   TestSuite_Add (suite, "/Collection/async/find_insert", test_find_insert_async);
+   TestSuite_Add (suite, "/Collection/async/destroy_executor",
+                  test_find_async_destroy_executor);
+   TestSuite_Add (suite, "/Collection/async/bad_wire_version",
+                  test_find_async_bad_wire_version);
 }
@@ -0,0 +1,170 @@
+#include <mongoc.h>
+
+#include "mongoc-client-private.h"
+#include "mongoc-counters-private.h"
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+#include "test-conveniences.h"
+#include "mock_server/future-functions.h"
+#include "mock_server/mock-server.h"
+
+
+static int64_t
+histogram_count (mongoc_histogram_t *histogram)
+{
+   int64_t count = 0;
+   unsigned i;
+   uint32_t j;
+
+   for (i = 0; i < _mongoc_get_cpu_count (); i++) {
+      for (j = 0; j < MONGOC_HISTOGRAM_N_BUCKETS; j++) {
+         count += histogram->cpus[i].buckets[j];
+      }
+   }
+
+   return count;
+}
+
+
+static void
+test_histogram_bucket (void)
+{
+   int64_t v;
+
+   ASSERT_CMPINT (_mongoc_histogram_bucket (-1), ==, 0);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (0), ==, 0);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (15), ==, 15);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (16), ==, 16);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (17), ==, 16);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (18), ==, 17);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (31), ==, 23);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (32), ==, 24);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (((int64_t) 1 << 32) - 1), ==,
+                  MONGOC_HISTOGRAM_N_BUCKETS - 2);
+   ASSERT_CMPINT (_mongoc_histogram_bucket ((int64_t) 1 << 32), ==,
+                  MONGOC_HISTOGRAM_N_BUCKETS - 1);
+   ASSERT_CMPINT (_mongoc_histogram_bucket (INT64_MAX), ==,
+                  MONGOC_HISTOGRAM_N_BUCKETS - 1);
+
+   /* every value is at most its bucket's max, and above the previous one's */
+   for (v = 0; v < 100000; v++) {
+      uint32_t bucket = _mongoc_histogram_bucket (v);
+
+      ASSERT_CMPINT64 (v, <=, _mongoc_histogram_bucket_max (bucket));
+      if (bucket > 0) {
+         ASSERT_CMPINT64 (v, >, _mongoc_histogram_bucket_max (bucket - 1));
+      }
+   }
+
+   for (v = 16; v < ((int64_t) 1 << 32); v = v * 3 / 2) {
+      uint32_t bucket = _mongoc_histogram_bucket (v);
+
+      ASSERT_CMPINT64 (v, <=, _mongoc_histogram_bucket_max (bucket));
+      ASSERT_CMPINT64 (v, >, _mongoc_histogram_bucket_max (bucket - 1));
+      /* the bounds of a bucket are within 12.5% */
+      ASSERT_CMPINT64 (_mongoc_histogram_bucket_max (bucket) - v, <=, v / 8);
+   }
+}
+
+
+static int
+histograms_shared (void)
+{
+   return _mongoc_counters_shared;
+}
+
+
+static void
+test_histogram_round_trip (void *ctx)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   int64_t n_commands;
+   int64_t n_selections;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+
+   n_commands = histogram_count (&__mongoc_histogram_op_command);
+   n_selections = histogram_count (&__mongoc_histogram_server_selection);
+
+   future = future_client_command_simple (client, "admin",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+   request = mock_server_receives_command (server, "admin",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+
+   ASSERT_CMPINT64 (histogram_count (&__mongoc_histogram_op_command), ==,
+                    n_commands + 1);
+   ASSERT_CMPINT64 (histogram_count (&__mongoc_histogram_server_selection),
+                    >, n_selections);
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* without a reader for the histograms or command monitoring, the cluster
+ * neither names nor times the request */
+static void
+test_histogram_not_shared (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   bool shared;
+   int64_t n_commands;
+   bson_error_t error;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+
+   shared = _mongoc_counters_shared;
+   _mongoc_counters_shared = false;
+   n_commands = histogram_count (&__mongoc_histogram_op_command);
+
+   future = future_client_command_simple (client, "admin",
+                                          tmp_bson ("{'ping': 1}"),
+                                          NULL, NULL, &error);
+   request = mock_server_receives_command (server, "admin",
+                                           MONGOC_QUERY_SLAVE_OK,
+                                           "{'ping': 1}");
+   mock_server_replies_simple (request, "{'ok': 1}");
+   ASSERT_OR_PRINT (future_get_bool (future), error);
+
+   ASSERT_CMPINT64 (histogram_count (&__mongoc_histogram_op_command), ==,
+                    n_commands);
+   ASSERT_CMPSIZE_T (client->cluster.timings.len, ==, (size_t) 0);
+
+   _mongoc_counters_shared = shared;
+
+   future_destroy (future);
+   request_destroy (request);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+void
+test_counters_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/Counters/histogram/bucket",
+                  test_histogram_bucket);
+   TestSuite_AddFull (suite, "/Counters/histogram/round_trip",
+                      test_histogram_round_trip, NULL, NULL,
+                      histograms_shared);
+   TestSuite_Add (suite, "/Counters/histogram/not_shared",
+                  test_histogram_not_shared);
+}
@@ -5,6 +5,7 @@
 #include "test-libmongoc.h"
 #include "mock_server/mock-rs.h"
 #include "mock_server/future-functions.h"
+#include "mongoc-client-private.h"
 #include "mongoc-cursor-private.h"
 #include "mongoc-collection-private.h"
 #include "test-conveniences.h"
@@ -543,6 +544,362 @@ test_client_kill_cursor_without_primary_wire_version_4 (void)
 }
 
 
+static void
+_test_cursor_retain_batch (bool find_cmd)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   mongoc_cursor_batch_t *batch;
+   mongoc_cursor_batch_t *batch2;
+   const bson_t *doc = NULL;
+   const uint8_t *first_data;
+   uint32_t first_len;
+   uint8_t *buffer_data;
+   future_t *future;
+   request_t *request;
+   bson_t first;
+
+   server = mock_server_with_autoismaster (find_cmd ? 4 : 3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0, 0,
+                                    tmp_bson ("{}"), NULL, NULL);
+
+   future = future_cursor_next (cursor, &doc);
+
+   if (find_cmd) {
+      request = mock_server_receives_command (
+         server, "db", MONGOC_QUERY_SLAVE_OK,
+         "{'find': 'collection', 'filter': {}}");
+   } else {
+      request = mock_server_receives_query (
+         server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 0, "{}", NULL);
+   }
+
+   mock_server_replies_to_find (request, MONGOC_QUERY_SLAVE_OK, 123, 2,
+                                "db.collection", "{'a': 1}, {'a': 2}",
+                                find_cmd);
+
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 1}");
+   future_destroy (future);
+   request_destroy (request);
+
+   /* documents are views into the receive buffer */
+   buffer_data = cursor->buffer.data;
+   ASSERT (bson_get_data (doc) > buffer_data);
+   ASSERT (bson_get_data (doc) < buffer_data + cursor->buffer.len);
+
+   batch = mongoc_cursor_retain_batch (cursor);
+   first_data = bson_get_data (doc);
+   first_len = doc->len;
+
+   ASSERT (mongoc_cursor_next (cursor, &doc));
+   ASSERT_MATCH (doc, "{'a': 2}");
+
+   /* retaining again before the next batch returns the same batch */
+   batch2 = mongoc_cursor_retain_batch (cursor);
+   ASSERT (batch2 == batch);
+   mongoc_cursor_batch_release (batch2);
+
+   future = future_cursor_next (cursor, &doc);
+
+   if (find_cmd) {
+      request = mock_server_receives_command (
+         server, "db", MONGOC_QUERY_SLAVE_OK,
+         "{'getMore': {'$numberLong': '123'}, 'collection': 'collection'}");
+      mock_server_replies_simple (request, "{'ok': 1,"
+                                           " 'cursor': {"
+                                           "    'id': 0,"
+                                           "    'ns': 'db.collection',"
+                                           "    'nextBatch': [{'a': 3}]}}");
+   } else {
+      request = mock_server_receives_getmore (server, "db.collection", 0,
+                                              123);
+      mock_server_replies (request, MONGOC_REPLY_NONE, 0, 2, 1, "{'a': 3}");
+   }
+
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 3}");
+   future_destroy (future);
+   request_destroy (request);
+
+   /* the retained batch outlives the next batch and the cursor */
+   ASSERT (cursor->buffer.data != buffer_data);
+   mongoc_cursor_destroy (cursor);
+
+   ASSERT (bson_init_static (&first, first_data, first_len));
+   ASSERT_MATCH (&first, "{'a': 1}");
+   mongoc_cursor_batch_release (batch);
+
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_cursor_retain_batch_op_query (void)
+{
+   _test_cursor_retain_batch (false);
+}
+
+
+static void
+test_cursor_retain_batch_find_cmd (void)
+{
+   _test_cursor_retain_batch (true);
+}
+
+
+static void
+test_cursor_reuses_buffer (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc = NULL;
+   uint8_t *buffer_data;
+   future_t *future;
+   request_t *request;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0, 0,
+                                    tmp_bson ("{}"), NULL, NULL);
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_query (
+      server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 0, "{}", NULL);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 123, 0, 1, "{'a': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   buffer_data = cursor->buffer.data;
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_getmore (server, "db.collection", 0, 123);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 0, 1, 1, "{'a': 2}");
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 2}");
+   future_destroy (future);
+   request_destroy (request);
+
+   /* the second batch was received into the same memory as the first */
+   ASSERT (cursor->buffer.data == buffer_data);
+   ASSERT (bson_get_data (doc) > buffer_data);
+   ASSERT (bson_get_data (doc) < buffer_data + cursor->buffer.len);
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+_test_cursor_prefetch (bool find_cmd)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc = NULL;
+   future_t *future;
+   request_t *request;
+   request_t *getmore;
+   bson_error_t error;
+
+   server = mock_server_with_autoismaster (find_cmd ? 4 : 3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 3, 0,
+                                    tmp_bson ("{}"), NULL, NULL);
+   ASSERT (!mongoc_cursor_get_prefetch (cursor));
+   mongoc_cursor_set_prefetch (cursor, true);
+   ASSERT (mongoc_cursor_get_prefetch (cursor));
+
+   future = future_cursor_next (cursor, &doc);
+
+   if (find_cmd) {
+      request = mock_server_receives_command (
+         server, "db", MONGOC_QUERY_SLAVE_OK,
+         "{'find': 'collection', 'filter': {},"
+         " 'limit': {'$numberLong': '3'}}");
+   } else {
+      request = mock_server_receives_query (
+         server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 3, "{}", NULL);
+   }
+
+   mock_server_replies_to_find (request, MONGOC_QUERY_SLAVE_OK, 123, 1,
+                                "db.collection", "{'a': 1}", find_cmd);
+
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 1}");
+   future_destroy (future);
+   request_destroy (request);
+
+   /* the next batch was requested before the application asked for it,
+    * with n_return reduced by the document already received */
+   if (find_cmd) {
+      getmore = mock_server_receives_command (
+         server, "db", MONGOC_QUERY_SLAVE_OK,
+         "{'getMore': {'$numberLong': '123'}, 'collection': 'collection'}");
+   } else {
+      getmore = mock_server_receives_getmore (server, "db.collection", 2, 123);
+   }
+
+   ASSERT (getmore);
+
+   future = future_cursor_next (cursor, &doc);
+
+   if (find_cmd) {
+      mock_server_replies_simple (getmore, "{'ok': 1,"
+                                           " 'cursor': {"
+                                           "    'id': 0,"
+                                           "    'ns': 'db.collection',"
+                                           "    'nextBatch': [{'a': 2}]}}");
+   } else {
+      mock_server_replies (getmore, MONGOC_REPLY_NONE, 0, 1, 1, "{'a': 2}");
+   }
+
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 2}");
+   future_destroy (future);
+   request_destroy (getmore);
+
+   /* server cursor is exhausted, nothing more is prefetched */
+   ASSERT (!mongoc_cursor_next (cursor, &doc));
+   ASSERT_OR_PRINT (!mongoc_cursor_error (cursor, &error), error);
+
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+static void
+test_cursor_prefetch_op_query (void)
+{
+   _test_cursor_prefetch (false);
+}
+
+
+static void
+test_cursor_prefetch_find_cmd (void)
+{
+   _test_cursor_prefetch (true);
+}
+
+
+/* destroying a cursor with a prefetch outstanding reads the reply first,
+ * then kills the cursor id it returned */
+static void
+test_cursor_prefetch_destroy (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc = NULL;
+   future_t *future;
+   request_t *request;
+   request_t *kill_cursors;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0, 0,
+                                    tmp_bson ("{}"), NULL, NULL);
+   mongoc_cursor_set_prefetch (cursor, true);
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_query (
+      server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 0, "{}", NULL);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 123, 0, 1, "{'a': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   request = mock_server_receives_getmore (server, "db.collection", 0, 123);
+
+   future = future_cursor_destroy (cursor);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 456, 1, 1, "{'a': 2}");
+   kill_cursors = mock_server_receives_kill_cursors (server, 456);
+   ASSERT (kill_cursors);
+   future_wait (future);
+
+   future_destroy (future);
+   request_destroy (kill_cursors);
+   request_destroy (request);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
+/* a prefetch sent on a connection that was closed since is sent again on
+ * the new connection, even if the new stream has the old one's address */
+static void
+test_cursor_prefetch_reconnect (void)
+{
+   mock_server_t *server;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc = NULL;
+   future_t *future;
+   request_t *request;
+   request_t *getmore;
+
+   server = mock_server_with_autoismaster (3);
+   mock_server_run (server);
+   client = mongoc_client_new_from_uri (mock_server_get_uri (server));
+   collection = mongoc_client_get_collection (client, "db", "collection");
+   cursor = mongoc_collection_find (collection, MONGOC_QUERY_NONE, 0, 0, 0,
+                                    tmp_bson ("{}"), NULL, NULL);
+   mongoc_cursor_set_prefetch (cursor, true);
+
+   future = future_cursor_next (cursor, &doc);
+   request = mock_server_receives_query (
+      server, "db.collection", MONGOC_QUERY_SLAVE_OK, 0, 0, "{}", NULL);
+   mock_server_replies (request, MONGOC_REPLY_NONE, 123, 0, 1, "{'a': 1}");
+   ASSERT (future_get_bool (future));
+   future_destroy (future);
+   request_destroy (request);
+
+   /* the prefetch is never answered, its connection is closed */
+   getmore = mock_server_receives_getmore (server, "db.collection", 0, 123);
+   ASSERT (getmore);
+   request_destroy (getmore);
+   mongoc_cluster_disconnect_node (&client->cluster, cursor->hint);
+
+   future = future_cursor_next (cursor, &doc);
+   getmore = mock_server_receives_getmore (server, "db.collection", 0, 123);
+   ASSERT (getmore);
+   mock_server_replies (getmore, MONGOC_REPLY_NONE, 0, 1, 1, "{'a': 2}");
+   ASSERT (future_get_bool (future));
+   ASSERT_MATCH (doc, "{'a': 2}");
+
+   future_destroy (future);
+   request_destroy (getmore);
+   mongoc_cursor_destroy (cursor);
+   mongoc_collection_destroy (collection);
+   mongoc_client_destroy (client);
+   mock_server_destroy (server);
+}
+
+
 void
 test_cursor_install (TestSuite *suite)
 {
@@ -550,6 +907,13 @@ test_cursor_install (TestSuite *suite)
    TestSuite_Add (suite, "/Cursor/clone", test_clone);
    TestSuite_Add (suite, "/Cursor/invalid_query", test_invalid_query);
    TestSuite_Add (suite, "/Cursor/kill/live", test_kill_cursor_live);
+   TestSuite_Add (suite, "/Cursor/retain_batch/op_query", test_cursor_retain_batch_op_query);
+   TestSuite_Add (suite, "/Cursor/retain_batch/find_cmd", test_cursor_retain_batch_find_cmd);
+   TestSuite_Add (suite, "/Cursor/reuses_buffer", test_cursor_reuses_buffer);
+   TestSuite_Add (suite, "/Cursor/prefetch/op_query", test_cursor_prefetch_op_query);
+   TestSuite_Add (suite, "/Cursor/prefetch/find_cmd", test_cursor_prefetch_find_cmd);
+   TestSuite_Add (suite, "/Cursor/prefetch/destroy", test_cursor_prefetch_destroy);
+   TestSuite_Add (suite, "/Cursor/prefetch/reconnect", test_cursor_prefetch_reconnect);
    TestSuite_Add (suite, "/Cursor/kill/single", test_kill_cursors_single);
    TestSuite_Add (suite, "/Cursor/kill/pooled", test_kill_cursors_pooled);
    TestSuite_Add (suite, "/Cursor/kill/single/cmd", test_kill_cursors_single_cmd);
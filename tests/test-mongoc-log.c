@@ -16,7 +16,9 @@
 
 #include <mongoc.h>
 
+#include "mongoc-counters-private.h"
 #include "mongoc-log-private.h"
+#include "mongoc-thread-private.h"
 #include "mongoc-trace.h"
 #include "TestSuite.h"
 
@@ -179,6 +181,125 @@ test_mongoc_log_trace_disabled (void *context)
    restore_state (&old_state);
 }
 
+
+struct async_log_data {
+   mongoc_mutex_t  mutex;
+   int             n_logged;
+   bool            in_order;
+};
+
+
+static void
+async_log_func (mongoc_log_level_t  log_level,
+                const char         *log_domain,
+                const char         *message,
+                void               *user_data)
+{
+   struct async_log_data *data = (struct async_log_data *)user_data;
+   char expected[16];
+
+   /* block until the test lets us proceed */
+   mongoc_mutex_lock (&data->mutex);
+   bson_snprintf (expected, sizeof expected, "%d", data->n_logged);
+   if (strcmp (message, expected) != 0) {
+      data->in_order = false;
+   }
+   data->n_logged++;
+   mongoc_mutex_unlock (&data->mutex);
+}
+
+
+static int64_t
+log_dropped_count (void)
+{
+   int64_t count = 0;
+   uint32_t i;
+
+   for (i = 0; i < _mongoc_get_cpu_count (); i++) {
+      count += __mongoc_counter_log_dropped.cpus[i].slots[
+         COUNTER_log_dropped % SLOTS_PER_CACHELINE];
+   }
+
+   return count;
+}
+
+
+static void
+test_mongoc_log_async (void)
+{
+   struct log_state old_state;
+   struct async_log_data data;
+   int i;
+
+   mongoc_mutex_init (&data.mutex);
+   data.n_logged = 0;
+   data.in_order = true;
+
+   save_state (&old_state);
+   mongoc_log_set_handler (async_log_func, &data);
+
+   ASSERT (mongoc_log_async_start (1000));
+   ASSERT (!mongoc_log_async_start (1000));
+
+   for (i = 0; i < 100; i++) {
+      MONGOC_WARNING ("%d", i);
+   }
+
+   /* waits for the queued messages */
+   mongoc_log_async_stop ();
+   ASSERT_CMPINT (data.n_logged, ==, 100);
+   ASSERT (data.in_order);
+
+   /* logs synchronously again */
+   MONGOC_WARNING ("%d", 100);
+   ASSERT_CMPINT (data.n_logged, ==, 101);
+
+   restore_state (&old_state);
+   mongoc_mutex_destroy (&data.mutex);
+}
+
+
+static void
+test_mongoc_log_async_dropped (void)
+{
+   struct log_state old_state;
+   struct async_log_data data;
+   int64_t dropped;
+   int i;
+
+   mongoc_mutex_init (&data.mutex);
+   data.n_logged = 0;
+   data.in_order = true;
+
+   save_state (&old_state);
+   mongoc_log_set_handler (async_log_func, &data);
+   mongoc_counter_log_dropped_reset ();
+
+   /* the ring is rounded up to 4 slots, but only 3 messages are queued */
+   ASSERT (mongoc_log_async_start (3));
+
+   /* the logging thread blocks on the first message it takes; logging
+    * doesn't wait for it */
+   mongoc_mutex_lock (&data.mutex);
+   for (i = 0; i < 10; i++) {
+      MONGOC_WARNING ("%d", i);
+   }
+
+   dropped = log_dropped_count ();
+   mongoc_mutex_unlock (&data.mutex);
+
+   mongoc_log_async_stop ();
+
+   /* a message's slot is freed once it's logged, so three were queued */
+   ASSERT_CMPINT64 (dropped, ==, (int64_t) 7);
+   ASSERT_CMPINT (data.n_logged, ==, 3);
+   ASSERT (data.in_order);
+
+   restore_state (&old_state);
+   mongoc_mutex_destroy (&data.mutex);
+}
+
+
 void
 test_log_install (TestSuite *suite)
 {
@@ -186,4 +307,6 @@ test_log_install (TestSuite *suite)
    TestSuite_AddFull (suite, "/Log/trace/enabled", test_mongoc_log_trace_enabled, NULL, NULL, should_run_trace_tests);
    TestSuite_AddFull (suite, "/Log/trace/disabled", test_mongoc_log_trace_disabled, NULL, NULL, should_not_run_trace_tests);
    TestSuite_Add (suite, "/Log/null", test_mongoc_log_null);
+   TestSuite_Add (suite, "/Log/async", test_mongoc_log_async);
+   TestSuite_Add (suite, "/Log/async/dropped", test_mongoc_log_async_dropped);
 }
@@ -5,6 +5,7 @@
 #include <mongoc-matcher-private.h>
 
 #include "TestSuite.h"
+#include "test-libmongoc.h"
 
 BEGIN_IGNORE_DEPRECATIONS;
 
@@ -197,6 +198,71 @@ typedef struct {
 } logic_op_test_t;
 
 
+static void
+_check_logic_op_tests (const logic_op_test_t *tests,
+                       size_t                 n_tests)
+{
+   bson_t *spec;
+   bson_error_t error;
+   mongoc_matcher_t *matcher;
+   bson_t *doc;
+   size_t i;
+   bool r;
+
+   for (i = 0; i < n_tests; i++) {
+      spec = bson_new_from_json ((uint8_t * )tests[i].spec, -1, &error);
+      BSON_ASSERT (spec);
+      matcher = mongoc_matcher_new (spec, &error);
+      if (!matcher) {
+         fprintf (stderr, "couldn't parse query:\n\n%s\n\n%s\n",
+                  tests[i].spec, error.message);
+         abort ();
+      }
+
+      doc = bson_new_from_json ((uint8_t * )tests[i].doc, -1, &error);
+      BSON_ASSERT (doc);
+
+      r = mongoc_matcher_match (matcher, doc);
+      BSON_ASSERT (r == _mongoc_matcher_op_match (matcher->optree, doc));
+
+      if (tests[i].match != r) {
+         fprintf (stderr,
+                  "query:\n\n%s\n\nshould %shave matched:\n\n%s\n",
+                  tests[i].spec, tests[i].match ? "" : "not ",
+                  tests[i].doc);
+         abort ();
+      }
+
+      mongoc_matcher_destroy (matcher);
+      bson_destroy (doc);
+      bson_destroy (spec);
+   }
+}
+
+
+static void
+_check_invalid_specs (const char **invalid,
+                      size_t       n_invalid)
+{
+   bson_t *spec;
+   bson_error_t error;
+   size_t i;
+
+   for (i = 0; i < n_invalid; i++) {
+      spec = bson_new_from_json ((uint8_t * )invalid[i], -1, &error);
+      BSON_ASSERT (spec);
+      if (mongoc_matcher_new (spec, &error)) {
+         fprintf (stderr, "query should have been invalid:\n\n%s\n",
+                  invalid[i]);
+         abort ();
+      }
+      BSON_ASSERT (error.domain == MONGOC_ERROR_MATCHER);
+      BSON_ASSERT (error.code == MONGOC_ERROR_MATCHER_INVALID);
+      bson_destroy (spec);
+   }
+}
+
+
 static void
 test_mongoc_matcher_logic_ops (void)
 {
@@ -238,6 +304,37 @@ test_mongoc_matcher_logic_ops (void)
                "{\"a\": 1}",
                false
          },
+         {"{\"$nor\": [{\"a\": 1}]}", "{\"a\": 1}", false},
+         {"{\"$nor\": [{\"a\": 1}]}", "{\"a\": 2}", true},
+         {"{\"$nor\": [{\"a\": 1}, {\"b\": 2}]}", "{\"b\": 2}", false},
+         {"{\"$nor\": [{\"a\": 1}, {\"b\": 2}, {\"c\": 3}]}", "{\"c\": 3}", false},
+         {"{\"$nor\": [{\"a\": 1}, {\"b\": 2}, {\"c\": 3}]}", "{\"c\": 4}", true},
+         {
+               "{\"$or\": [{\"$and\": [{\"a\": 1}, {\"b\": 1}]},"
+               "            {\"$and\": [{\"a\": 2}, {\"b\": 2}]}]}",
+               "{\"a\": 2, \"b\": 2}",
+               true
+         },
+         {
+               "{\"$or\": [{\"$and\": [{\"a\": 1}, {\"b\": 1}]},"
+               "            {\"$and\": [{\"a\": 2}, {\"b\": 2}]}]}",
+               "{\"a\": 1, \"b\": 2}",
+               false
+         },
+         {
+               "{\"$and\": [{\"$or\": [{\"a\": 1}, {\"a\": 2}]},"
+               "             {\"$nor\": [{\"b\": 1}, {\"b\": 2}]}]}",
+               "{\"a\": 2, \"b\": 3}",
+               true
+         },
+         {
+               "{\"$and\": [{\"$or\": [{\"a\": 1}, {\"a\": 2}]},"
+               "             {\"$nor\": [{\"b\": 1}, {\"b\": 2}]}]}",
+               "{\"a\": 2, \"b\": 1}",
+               false
+         },
+         {"{\"a.b\": 1, \"a.c\": 2}", "{\"a\": {\"c\": 2, \"b\": 1}}", true},
+         {"{\"a.b\": 1, \"a.c\": 2}", "{\"a\": {\"b\": 1}}", false},
    };
 
    int n_tests = sizeof tests / sizeof (logic_op_test_t);
@@ -271,6 +368,10 @@ test_mongoc_matcher_logic_ops (void)
       }
 
       r = mongoc_matcher_match (matcher, doc);
+
+      /* the compiled program agrees with the op tree it came from */
+      BSON_ASSERT (r == _mongoc_matcher_op_match (matcher->optree, doc));
+
       if (test.match != r) {
          fprintf (stderr,
                   "query:\n\n%s\n\nshould %shave matched:\n\n%s\n",
@@ -534,6 +635,677 @@ test_mongoc_matcher_in_basic (void)
    mongoc_matcher_destroy (matcher);
 }
 
+
+static void
+test_mongoc_matcher_in_hashed (void)
+{
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   bson_t spec;
+   bson_t doc;
+   bson_t child;
+   bson_t values;
+   char key[16];
+   int i;
+
+   bson_init (&spec);
+   bson_init (&doc);
+
+   /* $in of the even numbers below 400, as int32, int64 and double */
+   bson_append_document_begin (&spec, "a", -1, &child);
+   bson_append_array_begin (&child, "$in", -1, &values);
+   for (i = 0; i < 200; i++) {
+      bson_snprintf (key, sizeof key, "%d", i);
+      switch (i % 3) {
+      case 0:
+         bson_append_int32 (&values, key, -1, i * 2);
+         break;
+      case 1:
+         bson_append_int64 (&values, key, -1, i * 2);
+         break;
+      default:
+         bson_append_double (&values, key, -1, i * 2);
+         break;
+      }
+   }
+   bson_append_array_end (&child, &values);
+   bson_append_document_end (&spec, &child);
+
+   matcher = mongoc_matcher_new (&spec, &error);
+   BSON_ASSERT (matcher);
+
+   for (i = -2; i < 402; i++) {
+      bson_destroy (&doc);
+      bson_init (&doc);
+      bson_append_int32 (&doc, "a", -1, i);
+      BSON_ASSERT (mongoc_matcher_match (matcher, &doc) ==
+                   (i >= 0 && i < 400 && i % 2 == 0));
+
+      bson_destroy (&doc);
+      bson_init (&doc);
+      bson_append_double (&doc, "a", -1, i + 0.5);
+      BSON_ASSERT (!mongoc_matcher_match (matcher, &doc));
+   }
+
+   bson_destroy (&doc);
+   bson_destroy (&spec);
+   mongoc_matcher_destroy (matcher);
+}
+
+
+static void
+test_mongoc_matcher_operators (void)
+{
+   logic_op_test_t tests[] = {
+         /* several operators on one field must all match */
+         {"{\"a\": {\"$gte\": 3, \"$lt\": 8}}", "{\"a\": 5}", true},
+         {"{\"a\": {\"$gte\": 3, \"$lt\": 8}}", "{\"a\": 8}", false},
+         {"{\"a\": {\"$gte\": 3, \"$lt\": 8}}", "{\"a\": 2}", false},
+         {"{\"a\": {\"$in\": [1, 2], \"$ne\": 2}}", "{\"a\": 1}", true},
+         {"{\"a\": {\"$in\": [1, 2], \"$ne\": 2}}", "{\"a\": 2}", false},
+         {"{\"a\": {\"$not\": {\"$gt\": 1, \"$lt\": 5}}}", "{\"a\": 3}", false},
+         {"{\"a\": {\"$not\": {\"$gt\": 1, \"$lt\": 5}}}", "{\"a\": 7}", true},
+
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": 1.0}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": \"x\"}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": null}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": {\"b\": 1}}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": [1, 2]}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": true}", true},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": \"y\"}", false},
+         {"{\"a\": {\"$in\": [1, \"x\", null, {\"b\": 1}, [1, 2]]}}",
+          "{\"a\": [2, 1]}", false},
+         {"{\"a\": {\"$nin\": [1, 2]}}", "{\"a\": 3}", true},
+         {"{\"a\": {\"$nin\": [1, 2]}}", "{\"a\": 2}", false},
+
+         {"{\"a\": {\"$elemMatch\": {\"$gt\": 1, \"$lt\": 5}}}",
+          "{\"a\": [0, 3, 6]}", true},
+         {"{\"a\": {\"$elemMatch\": {\"$gt\": 1, \"$lt\": 5}}}",
+          "{\"a\": [0, 6]}", false},
+         {"{\"a\": {\"$elemMatch\": {\"$gt\": 1, \"$lt\": 5}}}",
+          "{\"a\": 3}", false},
+         {"{\"a\": {\"$elemMatch\": {\"b\": 1, \"c\": {\"$gt\": 2}}}}",
+          "{\"a\": [{\"b\": 1, \"c\": 1}, {\"b\": 2, \"c\": 3}]}", false},
+         {"{\"a\": {\"$elemMatch\": {\"b\": 1, \"c\": {\"$gt\": 2}}}}",
+          "{\"a\": [5, {\"b\": 1, \"c\": 3}]}", true},
+         {"{\"a\": {\"$elemMatch\": {\"$or\": [{\"b\": 1}, {\"c\": 1}]}}}",
+          "{\"a\": [{\"c\": 1}]}", true},
+
+         {"{\"a\": {\"$all\": [1, 2]}}", "{\"a\": [2, 3, 1]}", true},
+         {"{\"a\": {\"$all\": [1, 2]}}", "{\"a\": [1, 3]}", false},
+         {"{\"a\": {\"$all\": [1, 2]}}", "{\"a\": 1}", false},
+         {"{\"a\": {\"$all\": [1, 1.0]}}", "{\"a\": 1}", true},
+         {"{\"a\": {\"$all\": [\"x\", [1, 2]]}}",
+          "{\"a\": [\"x\", [1, 2]]}", true},
+         {"{\"a\": {\"$all\": [\"x\", [1, 2]]}}",
+          "{\"a\": [\"x\", [2, 1]]}", false},
+         {"{\"a\": {\"$all\": []}}", "{\"a\": []}", false},
+         {"{\"a\": {\"$all\": [1, true]}}", "{\"a\": [1, true]}", false},
+
+         {"{\"a\": {\"$size\": 2}}", "{\"a\": [1, 2]}", true},
+         {"{\"a\": {\"$size\": 2}}", "{\"a\": [1]}", false},
+         {"{\"a\": {\"$size\": 2}}", "{\"a\": [1, 2, 3]}", false},
+         {"{\"a\": {\"$size\": 2}}", "{\"a\": \"ab\"}", false},
+         {"{\"a\": {\"$size\": 0}}", "{\"a\": []}", true},
+
+         {"{\"a\": {\"$mod\": [4, 1]}}", "{\"a\": 5}", true},
+         {"{\"a\": {\"$mod\": [4, 1]}}", "{\"a\": 6}", false},
+         {"{\"a\": {\"$mod\": [4, 1]}}", "{\"a\": 5.7}", true},
+         {"{\"a\": {\"$mod\": [4, 1]}}", "{\"a\": \"5\"}", false},
+         {"{\"a\": {\"$mod\": [4, 1]}}", "{\"a\": -3}", false},
+         {"{\"a\": {\"$mod\": [4, -3]}}", "{\"a\": -3}", true},
+         {"{\"a\": {\"$mod\": [-1, 0]}}", "{\"a\": 7}", true},
+
+         {"{\"a\": {\"$type\": 2}}", "{\"a\": \"x\"}", true},
+         {"{\"a\": {\"$type\": 2}}", "{\"a\": 1}", false},
+         {"{\"a\": {\"$type\": \"string\"}}", "{\"a\": \"x\"}", true},
+         {"{\"a\": {\"$type\": 4}}", "{\"a\": []}", true},
+         {"{\"a\": {\"$type\": 10}}", "{\"a\": null}", true},
+   };
+
+   const char *invalid[] = {
+         "{\"a\": {\"$gt\": 1, \"$bogus\": 2}}",
+         "{\"a\": {\"$size\": -1}}",
+         "{\"a\": {\"$size\": 1.5}}",
+         "{\"a\": {\"$mod\": [0, 1]}}",
+         "{\"a\": {\"$mod\": [1]}}",
+         "{\"a\": {\"$mod\": [1, 2, 3]}}",
+         "{\"a\": {\"$all\": 1}}",
+         "{\"a\": {\"$type\": 99}}",
+         "{\"a\": {\"$type\": \"bogus\"}}",
+         "{\"a\": {\"$elemMatch\": {}}}",
+         "{\"a\": {\"$elemMatch\": 1}}",
+   };
+
+   bson_t *spec;
+   bson_error_t error;
+   bson_t child;
+
+   _check_logic_op_tests (tests, sizeof tests / sizeof tests[0]);
+   _check_invalid_specs (invalid, sizeof invalid / sizeof invalid[0]);
+
+   /* $options without $regex */
+   spec = bson_new ();
+   bson_append_document_begin (spec, "a", -1, &child);
+   bson_append_utf8 (&child, "$options", -1, "i", -1);
+   bson_append_document_end (spec, &child);
+   BSON_ASSERT (!mongoc_matcher_new (spec, &error));
+   BSON_ASSERT (error.domain == MONGOC_ERROR_MATCHER);
+   bson_destroy (spec);
+}
+
+
+#ifndef _WIN32
+static void
+test_mongoc_matcher_regex (void)
+{
+   logic_op_test_t tests[] = {
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"\"}}",
+          "{\"a\": \"abc\"}", true},
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"\"}}",
+          "{\"a\": \"xabc\"}", false},
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"\"}}",
+          "{\"a\": \"ABC\"}", false},
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"i\"}}",
+          "{\"a\": \"ABC\"}", true},
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"\"}}",
+          "{\"a\": 1}", false},
+         {"{\"a\": {\"$regex\": \"^ab\", \"$options\": \"\"}}",
+          "{\"b\": \"abc\"}", false},
+         {"{\"a\": {\"$not\": {\"$regex\": \"^ab\", \"$options\": \"\"}}}",
+          "{\"a\": \"abc\"}", false},
+         {"{\"a\": {\"$not\": {\"$regex\": \"^ab\", \"$options\": \"\"}}}",
+          "{\"a\": \"xyz\"}", true},
+
+         /* without "s", . does not match a line break */
+         {"{\"a\": {\"$regex\": \"a.c\", \"$options\": \"\"}}",
+          "{\"a\": \"abc\"}", true},
+         {"{\"a\": {\"$regex\": \"a.c\", \"$options\": \"\"}}",
+          "{\"a\": \"a\\nc\"}", false},
+         {"{\"a\": {\"$regex\": \"a.c\", \"$options\": \"m\"}}",
+          "{\"a\": \"a\\nc\"}", false},
+         {"{\"a\": {\"$regex\": \"a.c\", \"$options\": \"s\"}}",
+          "{\"a\": \"a\\nc\"}", true},
+         {"{\"a\": {\"$regex\": \"a.c\", \"$options\": \"ms\"}}",
+          "{\"a\": \"a\\nc\"}", true},
+
+         /* "m" makes ^ and $ match at line breaks, whatever "s" is */
+         {"{\"a\": {\"$regex\": \"^b\", \"$options\": \"\"}}",
+          "{\"a\": \"a\\nb\"}", false},
+         {"{\"a\": {\"$regex\": \"^b\", \"$options\": \"s\"}}",
+          "{\"a\": \"a\\nb\"}", false},
+         {"{\"a\": {\"$regex\": \"^b\", \"$options\": \"m\"}}",
+          "{\"a\": \"a\\nb\"}", true},
+         {"{\"a\": {\"$regex\": \"a$\", \"$options\": \"ms\"}}",
+          "{\"a\": \"a\\nb\"}", true},
+
+         /* a negated bracket matches a line break with or without "m" */
+         {"{\"a\": {\"$regex\": \"a[^x]c\", \"$options\": \"\"}}",
+          "{\"a\": \"a\\nc\"}", true},
+         {"{\"a\": {\"$regex\": \"a[^x]c\", \"$options\": \"m\"}}",
+          "{\"a\": \"a\\nc\"}", true},
+         {"{\"a\": {\"$regex\": \"a[^x]c\", \"$options\": \"m\"}}",
+          "{\"a\": \"axc\"}", false},
+
+         /* brackets, escapes and intervals are copied as they are */
+         {"{\"a\": {\"$regex\": \"^[[:digit:]]+$\", \"$options\": \"\"}}",
+          "{\"a\": \"123\"}", true},
+         {"{\"a\": {\"$regex\": \"^[[:digit:]]+$\", \"$options\": \"\"}}",
+          "{\"a\": \"12a\"}", false},
+         {"{\"a\": {\"$regex\": \"a[].]\", \"$options\": \"\"}}",
+          "{\"a\": \"a]\"}", true},
+         {"{\"a\": {\"$regex\": \"a[].]\", \"$options\": \"\"}}",
+          "{\"a\": \"ab\"}", false},
+         {"{\"a\": {\"$regex\": \"a\\\\.c\", \"$options\": \"\"}}",
+          "{\"a\": \"a.c\"}", true},
+         {"{\"a\": {\"$regex\": \"a\\\\.c\", \"$options\": \"\"}}",
+          "{\"a\": \"abc\"}", false},
+         {"{\"a\": {\"$regex\": \"^a{2}$\", \"$options\": \"\"}}",
+          "{\"a\": \"aa\"}", true},
+         {"{\"a\": {\"$regex\": \"^a{2}$\", \"$options\": \"\"}}",
+          "{\"a\": \"aaa\"}", false},
+   };
+
+   /* bad patterns and options, and PCRE syntax that POSIX lacks or would
+    * parse as something else */
+   const char *invalid[] = {
+         "{\"a\": {\"$regex\": \"(\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x\", \"$options\": \"q\"}}",
+         "{\"a\": {\"$regex\": \"\\\\d\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\w\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\s\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\D\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\W\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\S\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"\\\\bx\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"[\\\\d]\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"(?i)x\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"(?:x)\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x*?\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x+?\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x??\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x{2}?\", \"$options\": \"\"}}",
+         "{\"a\": {\"$regex\": \"x*+\", \"$options\": \"\"}}",
+   };
+
+   bson_t *spec;
+   bson_error_t error;
+   mongoc_matcher_t *matcher;
+   bson_t *doc;
+   bson_t child;
+
+   _check_logic_op_tests (tests, sizeof tests / sizeof tests[0]);
+   _check_invalid_specs (invalid, sizeof invalid / sizeof invalid[0]);
+
+   /* a BSON regular expression, and $regex without $options */
+   spec = bson_new ();
+   bson_append_regex (spec, "a", -1, "^AB", "i");
+   bson_append_document_begin (spec, "b", -1, &child);
+   bson_append_utf8 (&child, "$regex", -1, "c$", -1);
+   bson_append_document_end (spec, &child);
+   matcher = mongoc_matcher_new (spec, &error);
+   BSON_ASSERT (matcher);
+
+   doc = bson_new ();
+   bson_append_utf8 (doc, "a", -1, "abc", -1);
+   bson_append_utf8 (doc, "b", -1, "abc", -1);
+   BSON_ASSERT (mongoc_matcher_match (matcher, doc));
+   bson_destroy (doc);
+
+   doc = bson_new ();
+   bson_append_utf8 (doc, "a", -1, "abc", -1);
+   bson_append_utf8 (doc, "b", -1, "cab", -1);
+   BSON_ASSERT (!mongoc_matcher_match (matcher, doc));
+   bson_destroy (doc);
+
+   /* a regular expression in the document equals an identical one */
+   doc = bson_new ();
+   bson_append_regex (doc, "a", -1, "^AB", "i");
+   bson_append_utf8 (doc, "b", -1, "c", -1);
+   BSON_ASSERT (mongoc_matcher_match (matcher, doc));
+   bson_destroy (doc);
+
+   mongoc_matcher_destroy (matcher);
+   bson_destroy (spec);
+}
+#endif
+
+
+static void
+test_mongoc_matcher_paths_extract (void)
+{
+   mongoc_matcher_paths_t paths;
+   const char *path_strs[] = {
+      "a", "a.b", "a.c.d", "e", "f.0", "missing", "a.missing", "g.h"
+   };
+   uint32_t slots[sizeof path_strs / sizeof path_strs[0]];
+   bson_iter_t values[sizeof path_strs / sizeof path_strs[0]];
+   bool found[sizeof path_strs / sizeof path_strs[0]];
+   bson_iter_t iter;
+   bson_iter_t desc;
+   bson_error_t error;
+   bson_t *doc;
+   size_t i;
+
+   _mongoc_matcher_paths_init (&paths);
+
+   for (i = 0; i < sizeof path_strs / sizeof path_strs[0]; i++) {
+      slots[i] = _mongoc_matcher_paths_add (&paths, path_strs[i]);
+   }
+
+   /* adding a path twice gives the same slot */
+   ASSERT_CMPUINT (_mongoc_matcher_paths_add (&paths, "a.c.d"), ==, slots[2]);
+   ASSERT_CMPUINT (paths.n_slots, ==,
+                   (uint32_t) (sizeof path_strs / sizeof path_strs[0]));
+
+   /* only the first "g" is considered, as with bson_iter_find_descendant */
+   doc = bson_new_from_json ((const uint8_t *)
+                             "{\"e\": 1, \"a\": {\"x\": 0,"
+                             " \"c\": {\"d\": \"s\"}, \"b\": 2},"
+                             " \"f\": [3, 4], \"g\": 5, \"g\": {\"h\": 6}}",
+                             -1, &error);
+   ASSERT_OR_PRINT (doc, error);
+
+   _mongoc_matcher_paths_extract (&paths, doc, values, found);
+
+   for (i = 0; i < sizeof path_strs / sizeof path_strs[0]; i++) {
+      bool expected = bson_iter_init (&iter, doc) &&
+                      bson_iter_find_descendant (&iter, path_strs[i], &desc);
+
+      ASSERT (found[slots[i]] == expected);
+      if (expected) {
+         ASSERT_CMPINT (bson_iter_type (&values[slots[i]]), ==,
+                        bson_iter_type (&desc));
+         ASSERT_CMPSTR (bson_iter_key (&values[slots[i]]),
+                        bson_iter_key (&desc));
+      }
+   }
+
+   ASSERT (!found[slots[5]]);
+   ASSERT (!found[slots[7]]);
+   ASSERT_CMPINT (bson_iter_int32 (&values[slots[4]]), ==, 3);
+
+   bson_destroy (doc);
+   _mongoc_matcher_paths_destroy (&paths);
+}
+
+
+static void
+test_mongoc_matcher_match_many (void)
+{
+   const char *queries[] = {
+      "{\"a\": {\"$gt\": 10, \"$lte\": 40}}",
+      "{\"a\": {\"$in\": [1, 2.5, 3, 5000000000]}, \"b\": {\"$lt\": 0.5}}",
+      "{\"a\": 7, \"s\": \"x\"}",
+      "{\"a\": {\"$gte\": 9007199254740993}}",
+      "{\"a\": {\"$lt\": 20}, \"$or\": [{\"b\": 0}, {\"b\": 1}]}",
+      "{\"c.d\": {\"$gte\": 1}, \"a\": {\"$in\": []}}",
+      "{\"s\": \"x\"}",
+      "{\"c.d\": {\"$lt\": 3}}",
+   };
+   const size_t n_queries = sizeof queries / sizeof queries[0];
+   const size_t n_docs = 700;
+   mongoc_matcher_t *matcher;
+   const bson_t **docs;
+   uint8_t *selection;
+   size_t n_expected;
+   size_t n_matched;
+   bson_error_t error;
+   bson_t *spec;
+   char json[256];
+   size_t i;
+   size_t j;
+   bool r;
+
+   /* cover every type of value the columns have to fall back on */
+   docs = (const bson_t **)bson_malloc (n_docs * sizeof *docs);
+   for (i = 0; i < n_docs; i++) {
+      switch (i % 7) {
+      case 0:
+         bson_snprintf (json, sizeof json,
+                        "{\"a\": %d, \"b\": %d, \"c\": {\"d\": %d}}",
+                        (int) (i % 50), (int) (i % 3), (int) (i % 5));
+         break;
+      case 1:
+         bson_snprintf (json, sizeof json, "{\"a\": %d.5, \"b\": 0.25}",
+                        (int) (i % 45));
+         break;
+      case 2:
+         bson_snprintf (json, sizeof json, "{\"a\": 7, \"s\": \"x\", \"b\": 1}");
+         break;
+      case 3:
+         bson_snprintf (json, sizeof json, "{\"a\": \"%d\", \"c\": {\"d\": 0}}",
+                        (int) i);
+         break;
+      case 4:
+         bson_snprintf (json, sizeof json,
+                        "{\"a\": %s, \"b\": true}",
+                        i % 2 ? "9007199254740993" : "5000000000");
+         break;
+      case 5:
+         bson_snprintf (json, sizeof json, "{\"a\": true, \"b\": false}");
+         break;
+      default:
+         bson_snprintf (json, sizeof json, "{\"c\": %d}", (int) i);
+         break;
+      }
+
+      docs[i] = bson_new_from_json ((const uint8_t *)json, -1, &error);
+      ASSERT_OR_PRINT (docs[i], error);
+   }
+
+   selection = (uint8_t *)bson_malloc ((n_docs + 7) / 8);
+
+   for (i = 0; i < n_queries; i++) {
+      spec = bson_new_from_json ((const uint8_t *)queries[i], -1, &error);
+      ASSERT_OR_PRINT (spec, error);
+      matcher = mongoc_matcher_new (spec, &error);
+      ASSERT_OR_PRINT (matcher, error);
+
+      n_matched = mongoc_matcher_match_many (matcher, docs, n_docs, selection);
+
+      n_expected = 0;
+      for (j = 0; j < n_docs; j++) {
+         r = mongoc_matcher_match (matcher, docs[j]);
+         n_expected += r;
+
+         if (r != !!(selection[j / 8] & (1 << (j % 8)))) {
+            fprintf (stderr, "query:\n\n%s\n\nshould %shave matched "
+                     "document %d in the batch\n", queries[i],
+                     r ? "" : "not ", (int) j);
+            abort ();
+         }
+      }
+
+      ASSERT_CMPINT ((int) n_matched, ==, (int) n_expected);
+
+      /* an empty batch is fine */
+      ASSERT_CMPINT ((int) mongoc_matcher_match_many (matcher, NULL, 0, NULL),
+                     ==, 0);
+
+      mongoc_matcher_destroy (matcher);
+      bson_destroy (spec);
+   }
+
+   for (i = 0; i < n_docs; i++) {
+      bson_destroy ((bson_t *)docs[i]);
+   }
+
+   bson_free (docs);
+   bson_free (selection);
+}
+
+
+static int
+cmp_uint32 (const void *a,
+            const void *b)
+{
+   uint32_t ua = *(const uint32_t *)a;
+   uint32_t ub = *(const uint32_t *)b;
+
+   return (ua > ub) - (ua < ub);
+}
+
+
+static void
+test_mongoc_matcher_set (void)
+{
+   const char *queries[] = {
+      "{\"kind\": \"insert\"}",
+      "{\"kind\": \"update\", \"user.age\": {\"$gte\": 18}}",
+      "{\"n\": 1}",
+      "{\"n\": 1.0}",
+      "{\"n\": 5000000000}",
+      "{\"n\": {\"$gt\": 2, \"$lte\": 10}}",
+      "{\"n\": {\"$gte\": 10}}",
+      "{\"n\": {\"$lt\": -1.5}}",
+      "{\"n\": {\"$gt\": 4999999999}}",
+      "{\"$and\": [{\"n\": {\"$gt\": 0}}, {\"n\": {\"$lt\": 3}}]}",
+      "{\"$or\": [{\"kind\": \"delete\"}, {\"n\": 0}]}",
+      "{\"x\": null}",
+      "{\"user.name\": \"a\", \"n\": {\"$gt\": 0}}",
+      "{\"user.age\": {\"$lt\": 30}, \"kind\": {\"$ne\": \"insert\"}}",
+      "{\"tags\": {\"$exists\": true}}",
+      "{\"$nor\": [{\"kind\": \"insert\"}, {\"kind\": \"update\"}]}",
+      "{\"n\": -0.0}",
+      "{\"n\": true}",
+   };
+   const char *docs[] = {
+      "{\"kind\": \"insert\", \"n\": 1, \"user\": {\"name\": \"a\", \"age\": 20}}",
+      "{\"kind\": \"update\", \"n\": 1.0, \"user\": {\"age\": 17}}",
+      "{\"kind\": \"update\", \"n\": 10, \"user\": {\"age\": 40}}",
+      "{\"kind\": \"delete\", \"n\": 0, \"x\": null}",
+      "{\"n\": 5000000000, \"tags\": []}",
+      "{\"n\": -2, \"user\": {\"name\": \"a\"}}",
+      "{\"n\": 2.5, \"kind\": 1}",
+      "{\"n\": true, \"x\": 1}",
+      "{\"n\": \"1\", \"kind\": \"insert\", \"kind\": \"delete\"}",
+      "{}",
+   };
+   const size_t n_queries = sizeof queries / sizeof queries[0];
+   const size_t n_docs = sizeof docs / sizeof docs[0];
+   mongoc_matcher_t *matchers[sizeof queries / sizeof queries[0]];
+   uint32_t expected[sizeof queries / sizeof queries[0]];
+   uint32_t ids[sizeof queries / sizeof queries[0]];
+   mongoc_matcher_set_t *set;
+   uint32_t n_expected;
+   uint32_t n;
+   bson_error_t error;
+   bson_t *spec;
+   bson_t *doc;
+   size_t i;
+   size_t j;
+
+   set = mongoc_matcher_set_new ();
+
+   for (i = 0; i < n_queries; i++) {
+      spec = bson_new_from_json ((const uint8_t *)queries[i], -1, &error);
+      ASSERT_OR_PRINT (spec, error);
+
+      matchers[i] = mongoc_matcher_new (spec, &error);
+      ASSERT_OR_PRINT (matchers[i], error);
+      ASSERT_OR_PRINT (mongoc_matcher_set_add (set, (uint32_t)i, spec,
+                                               &error), error);
+
+      bson_destroy (spec);
+   }
+
+   for (i = 0; i < n_docs; i++) {
+      doc = bson_new_from_json ((const uint8_t *)docs[i], -1, &error);
+      ASSERT_OR_PRINT (doc, error);
+
+      n_expected = 0;
+      for (j = 0; j < n_queries; j++) {
+         if (mongoc_matcher_match (matchers[j], doc)) {
+            expected[n_expected++] = (uint32_t)j;
+         }
+      }
+
+      n = mongoc_matcher_set_match (set, doc, ids, (uint32_t)n_queries);
+      qsort (ids, n, sizeof ids[0], cmp_uint32);
+
+      if (n != n_expected || memcmp (ids, expected, n * sizeof ids[0])) {
+         fprintf (stderr, "matcher set disagrees with matchers on:\n\n%s\n",
+                  docs[i]);
+         abort ();
+      }
+
+      /* too small an array still counts every match */
+      if (n_expected > 1) {
+         ASSERT_CMPUINT (mongoc_matcher_set_match (set, doc, ids, 1), ==,
+                         n_expected);
+         ASSERT_CMPUINT (mongoc_matcher_set_match (set, doc, NULL, 0), ==,
+                         n_expected);
+      }
+
+      bson_destroy (doc);
+   }
+
+   /* a bad query leaves the set unchanged */
+   spec = bson_new_from_json ((const uint8_t *)"{\"n\": {\"$bogus\": 1}}", -1,
+                              &error);
+   ASSERT_OR_PRINT (spec, error);
+   ASSERT (!mongoc_matcher_set_add (set, 100, spec, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_MATCHER);
+   bson_destroy (spec);
+
+   for (i = 0; i < n_queries; i++) {
+      mongoc_matcher_destroy (matchers[i]);
+   }
+
+   mongoc_matcher_set_destroy (set);
+}
+
+
+/*
+ * Compare the compiled program against walking the op tree directly.
+ * Set MONGOC_TEST_MATCHER_BENCH to print the timings.
+ */
+static void
+test_mongoc_matcher_bench_program (void)
+{
+   mongoc_matcher_t *matcher;
+   bson_error_t error;
+   bson_t *spec;
+   bson_t *docs;
+   int64_t start;
+   int64_t tree_usec;
+   int64_t program_usec;
+   int n_docs = 1000;
+   int n_passes = 20;
+   int tree_matches = 0;
+   int program_matches = 0;
+   int i;
+   int j;
+
+   spec = BCON_NEW ("user.name", BCON_UTF8 ("benchmark"),
+                    "user.age", "{", "$gte", BCON_INT32 (18), "}",
+                    "$or", "[",
+                       "{", "kind", BCON_UTF8 ("insert"), "}",
+                       "{", "kind", BCON_UTF8 ("update"), "}",
+                    "]",
+                    "score", "{", "$lt", BCON_DOUBLE (50.0), "}",
+                    "flags", "{", "$exists", BCON_BOOL (true), "}");
+
+   matcher = mongoc_matcher_new (spec, &error);
+   ASSERT_OR_PRINT (matcher, error);
+
+   docs = (bson_t *)bson_malloc ((size_t)n_docs * sizeof (bson_t));
+   for (i = 0; i < n_docs; i++) {
+      bson_init (&docs[i]);
+      BCON_APPEND (&docs[i],
+                   "_id", BCON_INT32 (i),
+                   "kind", BCON_UTF8 (i % 3 ? "insert" : "delete"),
+                   "ts", BCON_INT64 (i * 1000),
+                   "user", "{",
+                      "name", BCON_UTF8 ("benchmark"),
+                      "age", BCON_INT32 (i % 40),
+                   "}",
+                   "score", BCON_DOUBLE ((double) (i % 100)),
+                   "flags", BCON_INT32 (0));
+   }
+
+   start = bson_get_monotonic_time ();
+   for (j = 0; j < n_passes; j++) {
+      for (i = 0; i < n_docs; i++) {
+         tree_matches += _mongoc_matcher_op_match (matcher->optree, &docs[i]);
+      }
+   }
+   tree_usec = bson_get_monotonic_time () - start;
+
+   start = bson_get_monotonic_time ();
+   for (j = 0; j < n_passes; j++) {
+      for (i = 0; i < n_docs; i++) {
+         program_matches += mongoc_matcher_match (matcher, &docs[i]);
+      }
+   }
+   program_usec = bson_get_monotonic_time () - start;
+
+   ASSERT_CMPINT (tree_matches, ==, program_matches);
+   ASSERT (program_matches > 0);
+
+   if (test_framework_getenv_bool ("MONGOC_TEST_MATCHER_BENCH")) {
+      fprintf (stderr, "matcher: tree %" PRId64 "us, program %" PRId64 "us "
+               "for %d documents\n", tree_usec, program_usec,
+               n_docs * n_passes);
+   }
+
+   for (i = 0; i < n_docs; i++) {
+      bson_destroy (&docs[i]);
+   }
+
+   bson_free (docs);
+   bson_destroy (spec);
+   mongoc_matcher_destroy (matcher);
+}
+
 END_IGNORE_DEPRECATIONS;
 
 void
@@ -549,4 +1321,16 @@ test_matcher_install (TestSuite *suite)
    TestSuite_Add (suite, "/Matcher/eq/int64", test_mongoc_matcher_eq_int64);
    TestSuite_Add (suite, "/Matcher/eq/doc", test_mongoc_matcher_eq_doc);
    TestSuite_Add (suite, "/Matcher/in/basic", test_mongoc_matcher_in_basic);
+   TestSuite_Add (suite, "/Matcher/in/hashed", test_mongoc_matcher_in_hashed);
+   TestSuite_Add (suite, "/Matcher/operators", test_mongoc_matcher_operators);
+#ifndef _WIN32
+   TestSuite_Add (suite, "/Matcher/regex", test_mongoc_matcher_regex);
+#endif
+   TestSuite_Add (suite, "/Matcher/paths/extract",
+                  test_mongoc_matcher_paths_extract);
+   TestSuite_Add (suite, "/Matcher/match_many",
+                  test_mongoc_matcher_match_many);
+   TestSuite_Add (suite, "/Matcher/set", test_mongoc_matcher_set);
+   TestSuite_Add (suite, "/Matcher/bench/program",
+                  test_mongoc_matcher_bench_program);
 }
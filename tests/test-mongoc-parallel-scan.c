@@ -0,0 +1,225 @@
+#include <mongoc.h>
+
+#include <assert.h>
+
+#include "mongoc-client-private.h"
+#include "mongoc-parallel-scan-private.h"
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+#include "test-conveniences.h"
+
+
+static void
+destroy_queries (bson_t   *queries,
+                 uint32_t  n)
+{
+   uint32_t i;
+
+   for (i = 0; i < n; i++) {
+      bson_destroy (&queries[i]);
+   }
+}
+
+
+static void
+test_parallel_scan_queries (void)
+{
+   bson_t queries[3];
+   uint32_t n;
+
+   n = _mongoc_parallel_scan_queries (
+      tmp_bson ("{'0': 0, '1': 1, '2': 2, '3': 3, '4': 4, "
+                " '5': 5, '6': 6, '7': 7, '8': 8}"),
+      3, NULL, queries);
+
+   ASSERT_CMPINT (n, ==, 3);
+   ASSERT_MATCH (&queries[0], "{'$or': [{'_id': {'$lt': 3}},"
+                              "         {'_id': {'$not': {'$type': 'number'}}}]}");
+   ASSERT_MATCH (&queries[1], "{'_id': {'$gte': 3, '$lt': 6}}");
+   ASSERT_MATCH (&queries[2], "{'_id': {'$gte': 6}}");
+   ASSERT_CMPINT (bson_count_keys (&queries[2]), ==, 1);
+
+   destroy_queries (queries, n);
+}
+
+
+static void
+test_parallel_scan_queries_filter (void)
+{
+   bson_t queries[2];
+   uint32_t n;
+
+   n = _mongoc_parallel_scan_queries (
+      tmp_bson ("{'0': {'$oid': '000000000000000000000000'},"
+                " '1': {'$oid': '000000000000000000000001'}}"),
+      2, tmp_bson ("{'x': 1}"), queries);
+
+   ASSERT_CMPINT (n, ==, 2);
+   ASSERT_MATCH (&queries[0],
+                 "{'$and': [{'x': 1},"
+                 "          {'$or': [{'_id': {'$lt': {'$oid': '000000000000000000000001'}}},"
+                 "                   {'_id': {'$not': {'$type': 'objectId'}}}]}]}");
+   ASSERT_MATCH (&queries[1],
+                 "{'$and': [{'x': 1},"
+                 "          {'_id': {'$gte': {'$oid': '000000000000000000000001'}}}]}");
+
+   destroy_queries (queries, n);
+}
+
+
+static void
+test_parallel_scan_queries_small_sample (void)
+{
+   bson_t queries[5];
+   uint32_t n;
+
+   /* boundaries repeat when there are more partitions than samples */
+   n = _mongoc_parallel_scan_queries (tmp_bson ("{'0': 'a', '1': 'b'}"),
+                                      5, NULL, queries);
+
+   ASSERT_CMPINT (n, ==, 3);
+   ASSERT_MATCH (&queries[0], "{'$or': [{'_id': {'$lt': 'a'}},"
+                              "         {'_id': {'$not': {'$type': 'string'}}}]}");
+   ASSERT_MATCH (&queries[1], "{'_id': {'$gte': 'a', '$lt': 'b'}}");
+   ASSERT_MATCH (&queries[2], "{'_id': {'$gte': 'b'}}");
+
+   destroy_queries (queries, n);
+}
+
+
+static void
+test_parallel_scan_queries_unpartitioned (void)
+{
+   bson_t queries[4];
+   uint32_t n;
+
+   /* mixed types */
+   n = _mongoc_parallel_scan_queries (tmp_bson ("{'0': 1, '1': 'a'}"),
+                                      4, NULL, queries);
+   ASSERT_CMPINT (n, ==, 1);
+   assert (bson_empty (&queries[0]));
+   destroy_queries (queries, n);
+
+   /* unsupported type */
+   n = _mongoc_parallel_scan_queries (tmp_bson ("{'0': {'a': 1}}"),
+                                      4, NULL, queries);
+   ASSERT_CMPINT (n, ==, 1);
+   assert (bson_empty (&queries[0]));
+   destroy_queries (queries, n);
+
+   /* empty sample */
+   n = _mongoc_parallel_scan_queries (tmp_bson ("{}"), 4,
+                                      tmp_bson ("{'x': 1}"), queries);
+   ASSERT_CMPINT (n, ==, 1);
+   ASSERT_MATCH (&queries[0], "{'$and': [{'x': 1}, {}]}");
+   destroy_queries (queries, n);
+}
+
+
+static void
+test_parallel_scan_invalid (void)
+{
+   mongoc_client_pool_t *pool;
+   mongoc_parallel_scan_t *scan;
+   bson_error_t error;
+
+   pool = test_framework_client_pool_new ();
+   scan = mongoc_parallel_scan_new (pool, "test", "test", NULL, NULL, 0,
+                                    NULL, &error);
+   assert (!scan);
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_COMMAND);
+   ASSERT_CMPINT (error.code, ==, MONGOC_ERROR_COMMAND_INVALID_ARG);
+
+   mongoc_client_pool_destroy (pool);
+}
+
+
+static void
+test_parallel_scan (void)
+{
+   mongoc_client_pool_t *pool;
+   mongoc_client_t *client;
+   mongoc_collection_t *collection;
+   mongoc_bulk_operation_t *bulk;
+   bson_t *b;
+   mongoc_parallel_scan_t *scan;
+   mongoc_cursor_t *cursor;
+   const bson_t *doc;
+   bson_error_t error;
+   bson_iter_t iter;
+   bool seen[200] = { false };
+   char *collection_name;
+   uint32_t n_cursors;
+   uint32_t i;
+   int32_t id;
+   int n_seen = 0;
+   bool r;
+
+   pool = test_framework_client_pool_new ();
+   client = mongoc_client_pool_pop (pool);
+   collection_name = gen_collection_name ("parallel_scan");
+   collection = mongoc_client_get_collection (client, "test", collection_name);
+
+   bulk = mongoc_collection_create_bulk_operation (collection, true, NULL);
+   for (id = 0; id < 200; id++) {
+      b = BCON_NEW ("_id", BCON_INT32 (id), "x", BCON_INT32 (id % 2));
+      mongoc_bulk_operation_insert (bulk, b);
+      bson_destroy (b);
+   }
+
+   r = (bool) mongoc_bulk_operation_execute (bulk, NULL, &error);
+   ASSERT_OR_PRINT (r, error);
+
+   scan = mongoc_parallel_scan_new (pool, "test", collection_name,
+                                    tmp_bson ("{'x': 0}"), NULL, 4,
+                                    NULL, &error);
+   ASSERT_OR_PRINT (scan, error);
+
+   n_cursors = mongoc_parallel_scan_get_n_cursors (scan);
+   assert (n_cursors >= 1 && n_cursors <= 4);
+   if (test_framework_max_wire_version_at_least (WIRE_VERSION_SAMPLE)) {
+      assert (n_cursors > 1);
+   }
+
+   for (i = 0; i < n_cursors; i++) {
+      cursor = mongoc_parallel_scan_get_cursor (scan, i);
+      while (mongoc_cursor_next (cursor, &doc)) {
+         assert (bson_iter_init_find (&iter, doc, "_id"));
+         id = bson_iter_int32 (&iter);
+         assert (id % 2 == 0);
+         assert (!seen[id]);
+         seen[id] = true;
+         n_seen++;
+      }
+
+      ASSERT_OR_PRINT (!mongoc_cursor_error (cursor, &error), error);
+   }
+
+   ASSERT_CMPINT (n_seen, ==, 100);
+
+   mongoc_parallel_scan_destroy (scan);
+   ASSERT_OR_PRINT (mongoc_collection_drop (collection, &error), error);
+
+   mongoc_bulk_operation_destroy (bulk);
+   mongoc_collection_destroy (collection);
+   bson_free (collection_name);
+   mongoc_client_pool_push (pool, client);
+   mongoc_client_pool_destroy (pool);
+}
+
+
+void
+test_parallel_scan_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/ParallelScan/queries",
+                  test_parallel_scan_queries);
+   TestSuite_Add (suite, "/ParallelScan/queries/filter",
+                  test_parallel_scan_queries_filter);
+   TestSuite_Add (suite, "/ParallelScan/queries/small_sample",
+                  test_parallel_scan_queries_small_sample);
+   TestSuite_Add (suite, "/ParallelScan/queries/unpartitioned",
+                  test_parallel_scan_queries_unpartitioned);
+   TestSuite_Add (suite, "/ParallelScan/invalid", test_parallel_scan_invalid);
+   TestSuite_Add (suite, "/ParallelScan/scan", test_parallel_scan);
+}
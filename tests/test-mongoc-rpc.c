@@ -1,6 +1,8 @@
 #include <fcntl.h>
 #include <mongoc.h>
 #include <mongoc-array-private.h>
+#include <mongoc-buffer-private.h>
+#include <mongoc-compression-private.h>
 #include <mongoc-rpc-private.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -631,6 +633,144 @@ test_mongoc_rpc_update_scatter (void)
 }
 
 
+static void
+_test_mongoc_rpc_compressed_roundtrip (int32_t compressor_id)
+{
+   mongoc_buffer_t buffer;
+   mongoc_array_t ar;
+   mongoc_iovec_t *iov;
+   mongoc_rpc_t rpc;
+   bson_error_t error;
+   uint8_t *original;
+   uint8_t *compressed;
+   size_t original_len = 0;
+   size_t i;
+   int32_t msg_len;
+   int32_t opcode;
+   bson_t b;
+   bool r;
+
+   bson_init (&b);
+   for (i = 0; i < 100; i++) {
+      BSON_APPEND_UTF8 (&b, "key", "a fairly repetitive string value");
+   }
+
+   memset (&rpc, 0xFFFFFFFF, sizeof rpc);
+   rpc.query.msg_len = 0;
+   rpc.query.request_id = 1234;
+   rpc.query.response_to = -1;
+   rpc.query.opcode = MONGOC_OPCODE_QUERY;
+   rpc.query.flags = MONGOC_QUERY_SLAVE_OK;
+   rpc.query.collection = "test.$cmd";
+   rpc.query.skip = 0;
+   rpc.query.n_return = -1;
+   rpc.query.query = bson_get_data (&b);
+   rpc.query.fields = NULL;
+
+   _mongoc_array_init (&ar, sizeof (mongoc_iovec_t));
+   _mongoc_rpc_gather (&rpc, &ar);
+   _mongoc_rpc_swab_to_le (&rpc);
+
+   /* keep a flat copy of the uncompressed message */
+   iov = (mongoc_iovec_t *)ar.data;
+   for (i = 0; i < ar.len; i++) {
+      original_len += iov[i].iov_len;
+   }
+
+   original = (uint8_t *)bson_malloc (original_len);
+   original_len = 0;
+   for (i = 0; i < ar.len; i++) {
+      memcpy (original + original_len, iov[i].iov_base, iov[i].iov_len);
+      original_len += iov[i].iov_len;
+   }
+
+   compressed = _mongoc_rpc_compress (&ar, 0, compressor_id, -1, &error);
+   ASSERT_OR_PRINT (compressed, error);
+   ASSERT_CMPINT ((int) ar.len, ==, 1);
+
+   iov = (mongoc_iovec_t *)ar.data;
+   memcpy (&opcode, compressed + 12, 4);
+   ASSERT_CMPINT (BSON_UINT32_FROM_LE (opcode), ==, MONGOC_OPCODE_COMPRESSED);
+   ASSERT_CMPINT (compressed[24], ==, compressor_id);
+   ASSERT (memcmp (compressed + 4, original + 4, 8) == 0);
+
+   if (compressor_id != MONGOC_COMPRESSOR_NOOP_ID) {
+      ASSERT_CMPSIZE_T (iov[0].iov_len, <, original_len);
+   }
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+   _mongoc_buffer_append (&buffer, (uint8_t *)iov[0].iov_base,
+                          iov[0].iov_len);
+   msg_len = (int32_t) iov[0].iov_len;
+
+   r = _mongoc_rpc_decompress (&buffer, 0, INT32_MAX, &msg_len, &error);
+   ASSERT_OR_PRINT (r, error);
+   ASSERT_CMPINT (msg_len, ==, (int32_t) original_len);
+   ASSERT_CMPSIZE_T (buffer.len, ==, original_len);
+   ASSERT (memcmp (buffer.data + buffer.off, original, original_len) == 0);
+
+   _mongoc_buffer_destroy (&buffer);
+   bson_free (compressed);
+   bson_free (original);
+   _mongoc_array_destroy (&ar);
+   bson_destroy (&b);
+}
+
+
+static void
+test_mongoc_rpc_compressed_noop (void)
+{
+   _test_mongoc_rpc_compressed_roundtrip (MONGOC_COMPRESSOR_NOOP_ID);
+}
+
+
+static void
+test_mongoc_rpc_compressed_snappy (void)
+{
+   _test_mongoc_rpc_compressed_roundtrip (MONGOC_COMPRESSOR_SNAPPY_ID);
+}
+
+
+#ifdef MONGOC_ENABLE_ZLIB
+static void
+test_mongoc_rpc_compressed_zlib (void)
+{
+   _test_mongoc_rpc_compressed_roundtrip (MONGOC_COMPRESSOR_ZLIB_ID);
+}
+#endif
+
+
+static void
+test_mongoc_rpc_compressed_corrupt (void)
+{
+   mongoc_buffer_t buffer;
+   bson_error_t error;
+   uint8_t data[MONGOC_COMPRESSED_HEADER_LEN + 4];
+   int32_t msg_len = (int32_t) sizeof data;
+   int32_t v;
+
+   memset (data, 0, sizeof data);
+   v = BSON_UINT32_TO_LE (msg_len);
+   memcpy (data, &v, 4);
+   v = BSON_UINT32_TO_LE (MONGOC_OPCODE_COMPRESSED);
+   memcpy (data + 12, &v, 4);
+   v = BSON_UINT32_TO_LE (MONGOC_OPCODE_REPLY);
+   memcpy (data + 16, &v, 4);
+   v = BSON_UINT32_TO_LE (1000);
+   memcpy (data + 20, &v, 4);
+   data[24] = MONGOC_COMPRESSOR_SNAPPY_ID;
+   memset (data + MONGOC_COMPRESSED_HEADER_LEN, 0xFF, 4);
+
+   _mongoc_buffer_init (&buffer, NULL, 0, NULL, NULL);
+   _mongoc_buffer_append (&buffer, data, sizeof data);
+
+   ASSERT (!_mongoc_rpc_decompress (&buffer, 0, INT32_MAX, &msg_len, &error));
+   ASSERT_CMPINT (error.domain, ==, MONGOC_ERROR_PROTOCOL);
+
+   _mongoc_buffer_destroy (&buffer);
+}
+
+
 void
 test_rpc_install (TestSuite *suite)
 {
@@ -651,4 +791,10 @@ test_rpc_install (TestSuite *suite)
    TestSuite_Add (suite, "/Rpc/reply/scatter2", test_mongoc_rpc_reply_scatter2);
    TestSuite_Add (suite, "/Rpc/update/gather", test_mongoc_rpc_update_gather);
    TestSuite_Add (suite, "/Rpc/update/scatter", test_mongoc_rpc_update_scatter);
+   TestSuite_Add (suite, "/Rpc/compressed/noop", test_mongoc_rpc_compressed_noop);
+   TestSuite_Add (suite, "/Rpc/compressed/snappy", test_mongoc_rpc_compressed_snappy);
+#ifdef MONGOC_ENABLE_ZLIB
+   TestSuite_Add (suite, "/Rpc/compressed/zlib", test_mongoc_rpc_compressed_zlib);
+#endif
+   TestSuite_Add (suite, "/Rpc/compressed/corrupt", test_mongoc_rpc_compressed_corrupt);
 }
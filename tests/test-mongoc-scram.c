@@ -0,0 +1,193 @@
+#include <mongoc.h>
+
+#include "mongoc-scram-private.h"
+
+#include "TestSuite.h"
+#include "test-libmongoc.h"
+
+
+/* base64 of "saltsaltsaltsalt" and "ABCDEFGHIJKLMNOP" */
+#define SALT_A "c2FsdHNhbHRzYWx0c2FsdA=="
+#define SALT_B "QUJDREVGR0hJSktMTU5PUA=="
+
+
+/* run the client's first two SCRAM steps, answering its client-first
+ * message with a server-first message carrying @salt and @iterations */
+static void
+scram_derive (mongoc_scram_t       *scram,
+              mongoc_scram_cache_t *cache,
+              const char           *user,
+              const char           *pass,
+              const char           *salt,
+              int                   iterations)
+{
+   uint8_t buf[4096];
+   uint32_t buflen = 0;
+   char *server_first;
+   bson_error_t error;
+
+   _mongoc_scram_init (scram);
+   _mongoc_scram_set_user (scram, user);
+   _mongoc_scram_set_pass (scram, pass);
+   _mongoc_scram_set_cache (scram, cache);
+
+   ASSERT_OR_PRINT (_mongoc_scram_step (scram, buf, 0, buf, sizeof buf,
+                                        &buflen, &error),
+                    error);
+
+   server_first = bson_strdup_printf ("r=%.*sservernonce,s=%s,i=%d",
+                                      scram->encoded_nonce_len,
+                                      scram->encoded_nonce,
+                                      salt,
+                                      iterations);
+
+   ASSERT_OR_PRINT (_mongoc_scram_step (scram, (uint8_t *)server_first,
+                                        (uint32_t)strlen (server_first),
+                                        buf, sizeof buf, &buflen, &error),
+                    error);
+
+   bson_free (server_first);
+}
+
+
+/* overwrite the cached ClientKey, so a connection that uses the cache
+ * instead of deriving its keys can be told apart */
+static void
+mark_cache (mongoc_scram_cache_t *cache)
+{
+   memset (cache->client_key, 'x', MONGOC_SCRAM_HASH_SIZE);
+}
+
+
+static bool
+used_cache (const mongoc_scram_t *scram)
+{
+   uint8_t marked[MONGOC_SCRAM_HASH_SIZE];
+
+   memset (marked, 'x', MONGOC_SCRAM_HASH_SIZE);
+
+   return !memcmp (scram->client_key, marked, MONGOC_SCRAM_HASH_SIZE);
+}
+
+
+static void
+test_scram_cache_hit (void)
+{
+   mongoc_scram_cache_t *cache;
+   mongoc_scram_t scram;
+
+   cache = _mongoc_scram_cache_new ();
+   ASSERT (!cache->valid);
+
+   scram_derive (&scram, cache, "user", "pass", SALT_A, 4096);
+   ASSERT (cache->valid);
+   ASSERT_CMPINT (cache->iterations, ==, 4096);
+   ASSERT_CMPINT (cache->salt_len, ==, 16);
+   ASSERT (!memcmp (cache->salt, "saltsaltsaltsalt", 16));
+   ASSERT (!memcmp (cache->client_key, scram.client_key,
+                    MONGOC_SCRAM_HASH_SIZE));
+   _mongoc_scram_destroy (&scram);
+
+   /* same password, salt and iterations on a second connection */
+   mark_cache (cache);
+   scram_derive (&scram, cache, "user", "pass", SALT_A, 4096);
+   ASSERT (used_cache (&scram));
+   _mongoc_scram_destroy (&scram);
+
+   _mongoc_scram_cache_destroy (cache);
+}
+
+
+static void
+test_scram_cache_miss (void)
+{
+   mongoc_scram_cache_t *cache;
+   mongoc_scram_t scram;
+
+   cache = _mongoc_scram_cache_new ();
+   scram_derive (&scram, cache, "user", "pass", SALT_A, 4096);
+   _mongoc_scram_destroy (&scram);
+
+   /* the salt changes, e.g. the password was reset */
+   mark_cache (cache);
+   scram_derive (&scram, cache, "user", "pass", SALT_B, 4096);
+   ASSERT (!used_cache (&scram));
+   ASSERT (!memcmp (cache->salt, "ABCDEFGHIJKLMNOP", 16));
+   ASSERT (!memcmp (cache->client_key, scram.client_key,
+                    MONGOC_SCRAM_HASH_SIZE));
+   _mongoc_scram_destroy (&scram);
+
+   /* the iteration count changes */
+   mark_cache (cache);
+   scram_derive (&scram, cache, "user", "pass", SALT_B, 10000);
+   ASSERT (!used_cache (&scram));
+   ASSERT_CMPINT (cache->iterations, ==, 10000);
+   ASSERT (!memcmp (cache->client_key, scram.client_key,
+                    MONGOC_SCRAM_HASH_SIZE));
+   _mongoc_scram_destroy (&scram);
+
+   _mongoc_scram_cache_destroy (cache);
+}
+
+
+static void
+_test_scram_cache_replaced (const char *user,
+                            const char *pass)
+{
+   mongoc_scram_cache_t *cache;
+   mongoc_scram_t scram;
+   uint8_t password_digest[MONGOC_SCRAM_HASH_SIZE];
+   uint8_t client_key[MONGOC_SCRAM_HASH_SIZE];
+
+   cache = _mongoc_scram_cache_new ();
+   scram_derive (&scram, cache, "user", "pass", SALT_A, 4096);
+   memcpy (password_digest, cache->password_digest, MONGOC_SCRAM_HASH_SIZE);
+   memcpy (client_key, scram.client_key, MONGOC_SCRAM_HASH_SIZE);
+   _mongoc_scram_destroy (&scram);
+
+   /* same salt and iterations, different credential */
+   mark_cache (cache);
+   scram_derive (&scram, cache, user, pass, SALT_A, 4096);
+   ASSERT (!used_cache (&scram));
+   ASSERT (memcmp (scram.client_key, client_key, MONGOC_SCRAM_HASH_SIZE));
+   ASSERT (memcmp (cache->password_digest, password_digest,
+                   MONGOC_SCRAM_HASH_SIZE));
+   ASSERT (!memcmp (cache->client_key, scram.client_key,
+                    MONGOC_SCRAM_HASH_SIZE));
+   _mongoc_scram_destroy (&scram);
+
+   /* the first credential's keys were replaced, not kept alongside */
+   mark_cache (cache);
+   scram_derive (&scram, cache, "user", "pass", SALT_A, 4096);
+   ASSERT (!used_cache (&scram));
+   ASSERT (!memcmp (scram.client_key, client_key, MONGOC_SCRAM_HASH_SIZE));
+   _mongoc_scram_destroy (&scram);
+
+   _mongoc_scram_cache_destroy (cache);
+}
+
+
+static void
+test_scram_cache_other_user (void)
+{
+   _test_scram_cache_replaced ("other", "pass");
+}
+
+
+static void
+test_scram_cache_other_password (void)
+{
+   _test_scram_cache_replaced ("user", "other");
+}
+
+
+void
+test_scram_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/Scram/cache/hit", test_scram_cache_hit);
+   TestSuite_Add (suite, "/Scram/cache/miss", test_scram_cache_miss);
+   TestSuite_Add (suite, "/Scram/cache/other_user",
+                  test_scram_cache_other_user);
+   TestSuite_Add (suite, "/Scram/cache/other_password",
+                  test_scram_cache_other_password);
+}
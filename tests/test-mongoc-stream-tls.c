@@ -1,8 +1,11 @@
 #include <openssl/err.h>
 #include <mongoc.h>
 
+#include "mongoc-ssl-private.h"
+
 #include "ssl-test.h"
 #include "TestSuite.h"
+#include "test-libmongoc.h"
 
 #define HOST "mongodb.com"
 
@@ -17,6 +20,16 @@
 #define PEMFILE_REV TRUST_DIR "/keys/rev.mongodb.com.pem"
 #define PASSWORD "testpass"
 
+#define TIMEOUT 10000 /* milliseconds */
+
+/* more than one TLS record, sent as many iovecs that are each far smaller */
+#define RECORDS_IOVEC_LEN 4
+#define RECORDS_N_IOVECS 5000
+#define RECORDS_LEN (RECORDS_IOVEC_LEN * RECORDS_N_IOVECS)
+
+/* fits in one record */
+#define RECORDS_REPLY_LEN 1000
+
 static void
 test_mongoc_tls_no_certs (void)
 {
@@ -237,6 +250,312 @@ test_mongoc_tls_trust_dir (void)
 #endif
 
 
+static SSL_SESSION *
+make_session (const char *id)
+{
+   SSL_SESSION *session;
+
+   session = SSL_SESSION_new ();
+   ASSERT (session);
+
+   /* give the session an id so OpenSSL considers it resumable */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+   ASSERT (SSL_SESSION_set1_id (session, (const unsigned char *)id,
+                                (unsigned int)strlen (id)));
+#else
+   memcpy (session->session_id, id, strlen (id));
+   session->session_id_length = (unsigned int)strlen (id);
+#endif
+
+   return session;
+}
+
+
+static void
+test_mongoc_tls_session_cache (void)
+{
+   mongoc_ssl_opt_t copt = { 0 };
+   mongoc_ssl_session_cache_t *cache;
+   SSL_SESSION *a;
+   SSL_SESSION *b;
+   SSL_CTX *ctx;
+   SSL *ssl;
+
+   copt.ca_file = CAFILE;
+
+   ctx = _mongoc_ssl_ctx_new (&copt);
+   ASSERT (ctx);
+
+   cache = _mongoc_ssl_session_cache_new ();
+
+   ssl = SSL_new (ctx);
+   ASSERT (!_mongoc_ssl_session_cache_offer (cache, "a:1", ssl));
+   ASSERT (!SSL_get_session (ssl));
+   SSL_free (ssl);
+
+   a = make_session ("a");
+   b = make_session ("b");
+
+   /* the cache owns one reference, keep another to compare with */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+   SSL_SESSION_up_ref (a);
+#else
+   CRYPTO_add (&a->references, 1, CRYPTO_LOCK_SSL_SESSION);
+#endif
+   _mongoc_ssl_session_cache_put (cache, "a:1", a);
+   _mongoc_ssl_session_cache_put (cache, "b:1", b);
+
+   ssl = SSL_new (ctx);
+   ASSERT (_mongoc_ssl_session_cache_offer (cache, "a:1", ssl));
+   ASSERT (SSL_get_session (ssl) == a);
+
+   /* the stream keeps using its session after the entry is evicted */
+   _mongoc_ssl_session_cache_remove (cache, "a:1");
+   ASSERT (SSL_get_session (ssl) == a);
+   SSL_free (ssl);
+
+   ssl = SSL_new (ctx);
+   ASSERT (!_mongoc_ssl_session_cache_offer (cache, "a:1", ssl));
+   ASSERT (_mongoc_ssl_session_cache_offer (cache, "b:1", ssl));
+   ASSERT (SSL_get_session (ssl) == b);
+   SSL_free (ssl);
+
+   /* a newer session for the same server replaces the old one */
+   _mongoc_ssl_session_cache_put (cache, "b:1", a);
+
+   ssl = SSL_new (ctx);
+   ASSERT (_mongoc_ssl_session_cache_offer (cache, "b:1", ssl));
+   ASSERT (SSL_get_session (ssl) == a);
+   SSL_free (ssl);
+
+   _mongoc_ssl_session_cache_clear (cache);
+
+   ssl = SSL_new (ctx);
+   ASSERT (!_mongoc_ssl_session_cache_offer (cache, "b:1", ssl));
+   SSL_free (ssl);
+
+   _mongoc_ssl_session_cache_destroy (cache);
+   SSL_CTX_free (ctx);
+}
+
+
+/** run as a child thread by _test_mongoc_tls_records
+ *
+ * It:
+ *    1. spins up
+ *    2. binds and listens to a random port
+ *    3. notifies the client of its port through a condvar
+ *    4. accepts a request
+ *    5. reads RECORDS_LEN bytes and checks them
+ *    6. writes RECORDS_REPLY_LEN bytes in one writev, so one record
+ *    7. shuts down
+ */
+static void *
+tls_records_server (void *ptr)
+{
+   ssl_test_data_t *data = (ssl_test_data_t *)ptr;
+   mongoc_stream_t *sock_stream;
+   mongoc_stream_t *ssl_stream;
+   mongoc_socket_t *listen_sock;
+   mongoc_socket_t *conn_sock;
+   socklen_t sock_len;
+   char buf[RECORDS_LEN];
+   ssize_t r;
+   mongoc_iovec_t iov;
+   struct sockaddr_in server_addr = { 0 };
+   int i;
+
+   listen_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   assert (listen_sock);
+
+   server_addr.sin_family = AF_INET;
+   server_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+   server_addr.sin_port = htons (0);
+
+   r = mongoc_socket_bind (listen_sock,
+                           (struct sockaddr *)&server_addr,
+                           sizeof server_addr);
+   assert (r == 0);
+
+   sock_len = sizeof (server_addr);
+   r = mongoc_socket_getsockname (listen_sock, (struct sockaddr *)&server_addr,
+                                  &sock_len);
+   assert (r == 0);
+
+   r = mongoc_socket_listen (listen_sock, 10);
+   assert (r == 0);
+
+   mongoc_mutex_lock (&data->cond_mutex);
+   data->server_port = ntohs (server_addr.sin_port);
+   mongoc_cond_signal (&data->cond);
+   mongoc_mutex_unlock (&data->cond_mutex);
+
+   conn_sock = mongoc_socket_accept (listen_sock, -1);
+   assert (conn_sock);
+
+   sock_stream = mongoc_stream_socket_new (conn_sock);
+   assert (sock_stream);
+
+   ssl_stream = mongoc_stream_tls_new (sock_stream, data->server, 0);
+   assert (ssl_stream);
+
+   r = mongoc_stream_tls_do_handshake (ssl_stream, TIMEOUT);
+   assert (r);
+
+   iov.iov_base = buf;
+   iov.iov_len = RECORDS_LEN;
+   r = mongoc_stream_readv (ssl_stream, &iov, 1, RECORDS_LEN, TIMEOUT);
+   assert (r == RECORDS_LEN);
+
+   for (i = 0; i < RECORDS_LEN; i++) {
+      assert (buf[i] == (char) (i / RECORDS_IOVEC_LEN));
+   }
+
+   memset (buf, 'r', RECORDS_REPLY_LEN);
+   iov.iov_len = RECORDS_REPLY_LEN;
+   r = mongoc_stream_writev (ssl_stream, &iov, 1, TIMEOUT);
+   assert (r == RECORDS_REPLY_LEN);
+
+   data->server_result->result = SSL_TEST_SUCCESS;
+
+   mongoc_stream_destroy (ssl_stream);
+   mongoc_socket_destroy (listen_sock);
+
+   return NULL;
+}
+
+
+/** run as a child thread by _test_mongoc_tls_records
+ *
+ * It:
+ *    1. waits on a condvar until the server is up
+ *    2. connects to the server's port, counting writes to the socket
+ *    3. writes RECORDS_LEN bytes as RECORDS_N_IOVECS iovecs
+ *    4. confirms they were packed into full records
+ *    5. reads the reply into two iovecs with a min_bytes of 1
+ *    6. confirms all of it came back from one readv
+ *    7. shuts down
+ */
+static void *
+tls_records_client (void *ptr)
+{
+   ssl_test_data_t *data = (ssl_test_data_t *)ptr;
+   debug_stream_stats_t stats = { 0 };
+   mongoc_stream_t *sock_stream;
+   mongoc_stream_t *ssl_stream;
+   mongoc_socket_t *conn_sock;
+   char bytes[RECORDS_N_IOVECS][RECORDS_IOVEC_LEN];
+   mongoc_iovec_t wiov[RECORDS_N_IOVECS];
+   char head[10];
+   char tail[RECORDS_REPLY_LEN];
+   mongoc_iovec_t riov[2];
+   struct sockaddr_in server_addr = { 0 };
+   int n_writev;
+   ssize_t r;
+   int i;
+
+   conn_sock = mongoc_socket_new (AF_INET, SOCK_STREAM, 0);
+   assert (conn_sock);
+
+   mongoc_mutex_lock (&data->cond_mutex);
+   while (!data->server_port) {
+      mongoc_cond_wait (&data->cond, &data->cond_mutex);
+   }
+   mongoc_mutex_unlock (&data->cond_mutex);
+
+   server_addr.sin_family = AF_INET;
+   server_addr.sin_port = htons (data->server_port);
+   server_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+   r = mongoc_socket_connect (conn_sock, (struct sockaddr *)&server_addr,
+                              sizeof (server_addr), -1);
+   assert (r == 0);
+
+   sock_stream = debug_stream_new (mongoc_stream_socket_new (conn_sock),
+                                   &stats);
+   assert (sock_stream);
+
+   ssl_stream = mongoc_stream_tls_new (sock_stream, data->client, 1);
+   assert (ssl_stream);
+
+   r = mongoc_stream_tls_do_handshake (ssl_stream, TIMEOUT);
+   assert (r);
+
+   for (i = 0; i < RECORDS_N_IOVECS; i++) {
+      memset (bytes[i], (char) i, RECORDS_IOVEC_LEN);
+      wiov[i].iov_base = bytes[i];
+      wiov[i].iov_len = RECORDS_IOVEC_LEN;
+   }
+
+   n_writev = stats.n_writev;
+   r = mongoc_stream_writev (ssl_stream, wiov, RECORDS_N_IOVECS, TIMEOUT);
+   assert (r == RECORDS_LEN);
+
+   /* one socket write per record: a full 16KB one and the remainder, not
+    * one per iovec */
+   assert (stats.n_writev - n_writev <= 2);
+
+   /* the first BIO_read decrypts the whole record, SSL_pending then holds
+    * the rest, which must come back now even though min_bytes is met */
+   riov[0].iov_base = head;
+   riov[0].iov_len = sizeof head;
+   riov[1].iov_base = tail;
+   riov[1].iov_len = sizeof tail;
+
+   r = mongoc_stream_readv (ssl_stream, riov, 2, 1, TIMEOUT);
+   assert (r == RECORDS_REPLY_LEN);
+   assert (head[0] == 'r' && tail[RECORDS_REPLY_LEN - sizeof head - 1] == 'r');
+
+   mongoc_stream_destroy (ssl_stream);
+   data->client_result->result = SSL_TEST_SUCCESS;
+
+   return NULL;
+}
+
+
+static void
+test_mongoc_tls_records (void)
+{
+   mongoc_ssl_opt_t sopt = { 0 };
+   mongoc_ssl_opt_t copt = { 0 };
+   ssl_test_result_t sr;
+   ssl_test_result_t cr;
+   ssl_test_data_t data = { 0 };
+   mongoc_thread_t threads[2];
+   int i, r;
+
+   sopt.pem_file = PEMFILE_NOPASS;
+   sopt.weak_cert_validation = 1;
+   copt.weak_cert_validation = 1;
+
+   data.server = &sopt;
+   data.client = &copt;
+   data.server_result = &sr;
+   data.client_result = &cr;
+   data.host = "localhost";
+
+   mongoc_mutex_init (&data.cond_mutex);
+   mongoc_cond_init (&data.cond);
+
+   r = mongoc_thread_create (threads, &tls_records_server, &data);
+   assert (r == 0);
+
+   r = mongoc_thread_create (threads + 1, &tls_records_client, &data);
+   assert (r == 0);
+
+   for (i = 0; i < 2; i++) {
+      r = mongoc_thread_join (threads[i]);
+      assert (r == 0);
+   }
+
+   mongoc_mutex_destroy (&data.cond_mutex);
+   mongoc_cond_destroy (&data.cond);
+
+   ASSERT (cr.result == SSL_TEST_SUCCESS);
+   ASSERT (sr.result == SSL_TEST_SUCCESS);
+}
+
+
 void
 test_stream_tls_install (TestSuite *suite)
 {
@@ -249,6 +568,8 @@ test_stream_tls_install (TestSuite *suite)
    TestSuite_Add (suite, "/TLS/no_certs", test_mongoc_tls_no_certs);
    TestSuite_Add (suite, "/TLS/no_verify", test_mongoc_tls_no_verify);
    TestSuite_Add (suite, "/TLS/password", test_mongoc_tls_password);
+   TestSuite_Add (suite, "/TLS/records", test_mongoc_tls_records);
+   TestSuite_Add (suite, "/TLS/session_cache", test_mongoc_tls_session_cache);
 #ifndef _WIN32
    TestSuite_Add (suite, "/TLS/trust_dir", test_mongoc_tls_trust_dir);
 #endif
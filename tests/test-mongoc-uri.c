@@ -754,6 +754,41 @@ test_mongoc_uri_read_concern (void)
 }
 
 
+static void
+test_mongoc_uri_compressors (void)
+{
+   const bson_t *compressors;
+   mongoc_uri_t *uri;
+#ifdef MONGOC_ENABLE_ZLIB
+   bson_iter_t iter;
+#endif
+
+   uri = mongoc_uri_new ("mongodb://localhost/");
+   compressors = mongoc_uri_get_compressors (uri);
+   ASSERT (bson_empty (compressors));
+   mongoc_uri_destroy (uri);
+
+   uri = mongoc_uri_new ("mongodb://localhost/?compressors=snappy,bogus,snappy");
+   compressors = mongoc_uri_get_compressors (uri);
+   ASSERT (bson_has_field (compressors, "snappy"));
+   ASSERT (!bson_has_field (compressors, "bogus"));
+   ASSERT_CMPINT (bson_count_keys (compressors), ==, 1);
+   mongoc_uri_destroy (uri);
+
+#ifdef MONGOC_ENABLE_ZLIB
+   uri = mongoc_uri_new ("mongodb://localhost/?compressors=zlib,snappy"
+                         "&zlibCompressionLevel=9");
+   compressors = mongoc_uri_get_compressors (uri);
+   ASSERT (bson_has_field (compressors, "zlib"));
+   ASSERT (bson_has_field (compressors, "snappy"));
+   ASSERT (bson_iter_init_find_case (&iter, mongoc_uri_get_options (uri),
+                                     "zlibcompressionlevel"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 9);
+   mongoc_uri_destroy (uri);
+#endif
+}
+
+
 
 void
 test_uri_install (TestSuite *suite)
@@ -766,4 +801,5 @@ test_uri_install (TestSuite *suite)
    TestSuite_Add (suite, "/Uri/write_concern", test_mongoc_uri_write_concern);
    TestSuite_Add (suite, "/HostList/from_string", test_mongoc_host_list_from_string);
    TestSuite_Add (suite, "/Uri/functions", test_mongoc_uri_functions);
+   TestSuite_Add (suite, "/Uri/compressors", test_mongoc_uri_compressors);
 }